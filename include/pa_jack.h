@@ -50,12 +50,36 @@
 extern "C" {
 #endif
 
+/** JACK-specific stream information, passed as hostApiSpecificStreamInfo of the input or output
+ * parameters, or both.
+ */
+typedef struct PaJackStreamInfo
+{
+    unsigned long size;
+    PaHostApiTypeId hostApiType;
+    unsigned long version;
+
+    /** Nonzero to open the stream on a JACK client of its own instead of the client shared by all
+     * streams of the process. Its ports then show up under a client of their own in the JACK graph, and
+     * since jackd2 runs independent clients in parallel, the stream's callback may run on another core
+     * than those of the other streams. The client is named like the shared one, see
+     * PaJack_SetClientName, with a suffix added by the JACK server to keep it unique. Set for either
+     * direction it applies to the whole stream.
+     */
+    int ownClient;
+}
+PaJackStreamInfo;
+
+/** Initialize host API specific structure, call this before setting relevant attributes. */
+void PaJack_InitializeStreamInfo( PaJackStreamInfo *info );
+
 /** Set the JACK client name.
  *
  * During Pa_Initialize, When PA JACK connects as a client of the JACK server, it requests a certain
  * name, which is for instance prepended to port names. By default this name is "PortAudio". The
  * JACK server may append a suffix to the client name, in order to avoid clashes among clients that
- * try to connect with the same name (e.g., different PA JACK clients).
+ * try to connect with the same name (e.g., different PA JACK clients). Streams opened with
+ * PaJackStreamInfo::ownClient use the same name for their clients.
  *
  * This function must be called before Pa_Initialize, otherwise it won't have any effect. Note that
  * the string is not copied, but instead referenced directly, so it must not be freed for as long as
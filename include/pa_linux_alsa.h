@@ -42,6 +42,15 @@
 /** @file
  *  @ingroup public_header
  *  @brief ALSA-specific PortAudio API extension header file.
+ *
+ *  Pa_Initialize() builds the ALSA device list by opening every device, which can take a while. Two
+ *  environment variables make this faster:
+ *  - PA_ALSA_DEVICE_CACHE: if set to "1", the capabilities of devices that were probed are kept in
+ *    portaudio/alsa-devices in the user's cache directory ($XDG_CACHE_HOME, or $HOME/.cache), and
+ *    later initializations take them from there as long as the device is unchanged. Any other value
+ *    except "0" or an empty string names the cache file. The cache is not used if the variable is unset.
+ *  - PA_ALSA_LAZY_PROBE: if set to a non-zero number, hardware devices are only probed when their
+ *    information is first asked for, by Pa_GetDeviceInfo() or when opening a stream.
  */
 
 #include "portaudio.h"
@@ -50,6 +59,20 @@
 extern "C" {
 #endif
 
+/** A further ALSA device making up an aggregate device, see PaAlsaStreamInfo::aggregateDevices. */
+typedef struct PaAlsaAggregateDevice
+{
+    const char *deviceString;   /**< The ALSA name of the device, such as "hw:2" */
+    int channelCount;           /**< The number of channels to use from the device */
+}
+PaAlsaAggregateDevice;
+
+/** ALSA-specific stream information.
+ *
+ * In version 1 the structure only names an ALSA device by deviceString, and must be used with
+ * paUseHostApiSpecificDeviceSpecification. Version 2 adds cpuAffinity, and may also be passed with
+ * a PortAudio device index, in which case deviceString must be NULL. Version 3 adds aggregateDevices.
+ */
 typedef struct PaAlsaStreamInfo
 {
     unsigned long size;
@@ -57,12 +80,41 @@ typedef struct PaAlsaStreamInfo
     unsigned long version;
 
     const char *deviceString;
+
+    /** The CPUs the stream's callback thread may run on, as a list in the format used by taskset -c,
+     * for example "2-3,6". NULL to use the default set with PaAlsa_SetDefaultCpuAffinity, an empty
+     * string for no restriction. Since version 2.
+     */
+    const char *cpuAffinity;
+
+    /** Further devices whose channels follow those of the stream's device, in order, for callback streams.
+     * The channelCount of the stream parameters counts the channels of all devices. The stream's device is
+     * the clock master: the clocks of the other devices are tracked against it from their hardware timestamps,
+     * and their frames are resampled to it, so that all channels stay aligned without the devices sharing a
+     * clock. The channels of a captured aggregate are delayed by up to two periods of the other devices, which
+     * is included in the stream's input latency. NULL if aggregateDeviceCount is 0. Since version 3.
+     * @see PaAlsa_GetStreamAggregateRatio
+     */
+    const PaAlsaAggregateDevice *aggregateDevices;
+    unsigned long aggregateDeviceCount;
 }
 PaAlsaStreamInfo;
 
-/** Initialize host API specific structure, call this before setting relevant attributes. */
+/** Initialize host API specific structure, call this before setting relevant attributes.
+ *
+ * Only the version 1 fields are written, since applications built against older headers pass a
+ * structure that ends after deviceString. Use PaAlsa_InitializeStreamInfoVersion for later versions.
+ */
 void PaAlsa_InitializeStreamInfo( PaAlsaStreamInfo *info );
 
+/** Initialize the fields of a given version of the host API specific structure, setting size and
+ * version to match.
+ *
+ * @param version 1, 2 or 3, the structure must be at least as large as that version of it.
+ * @return paIncompatibleHostApiSpecificStreamInfo if the version is unknown.
+ */
+PaError PaAlsa_InitializeStreamInfoVersion( PaAlsaStreamInfo *info, unsigned long version );
+
 /** Instruct whether to enable real-time priority when starting the audio thread.
  *
  * If this is turned on by the stream is started, the audio callback thread will be created
@@ -70,9 +122,93 @@ void PaAlsa_InitializeStreamInfo( PaAlsaStreamInfo *info );
  **/
 void PaAlsa_EnableRealtimeScheduling( PaStream *s, int enable );
 
-#if 0
+/** Set the CPUs the callback threads of streams run on, unless their PaAlsaStreamInfo specifies
+ * cpuAffinity.
+ *
+ * The initial default is read from the PA_CPU_AFFINITY environment variable. Pinning audio threads to
+ * isolated cores keeps them from being migrated, which is a common cause of cache-cold callbacks. Takes
+ * effect for streams started after the call.
+ * @param cpuList A CPU list such as "2-3,6", NULL or an empty string to remove the restriction.
+ * @return paIncompatibleHostApiSpecificStreamInfo if cpuList is malformed, paDeviceUnavailable if thread
+ * affinity isn't supported on this system.
+ */
+PaError PaAlsa_SetDefaultCpuAffinity( const char *cpuList );
+
+/** Get the CPUs this stream's callback thread runs on, as a CPU list.
+ *
+ * This is the affinity the thread actually got, which may differ from the requested one if the
+ * requested CPUs are not available to the process. The list is empty if the stream hasn't been
+ * started, is a blocking stream or if the affinity can't be determined.
+ * @param cpuList Receives the list, truncated to size bytes including the terminating nul.
+ */
+PaError PaAlsa_GetStreamCpuAffinity( PaStream *s, char *cpuList, unsigned long size );
+
+/** Instruct whether to run the audio callback thread under the SCHED_DEADLINE policy.
+ *
+ * If this is turned on by the time the stream is started, the callback thread starts under the FIFO
+ * policy as with PaAlsa_EnableRealtimeScheduling. Once the cost of processing a period has been
+ * measured, the thread switches to SCHED_DEADLINE with a period and deadline equal to the ALSA period
+ * and a runtime budget derived from the measured cost, which includes polling and transferring frames
+ * to and from ALSA besides the callback, with headroom and a fixed margin on top. Unlike fixed FIFO priorities, this lets the
+ * kernel's admission control decide how many streams fit on a system. If the kernel refuses, for
+ * instance because the bandwidth is exhausted, privileges are lacking or the thread is pinned with
+ * cpuAffinity, the thread stays under the FIFO policy.
+ * @see PaAlsa_GetStreamSchedulingPolicy
+ **/
+void PaAlsa_EnableDeadlineScheduling( PaStream *s, int enable );
+
+/** Get the scheduling policy of a running callback stream's audio thread.
+ *
+ * @param policy Receives SCHED_OTHER, SCHED_FIFO or SCHED_DEADLINE (6).
+ * @return paStreamIsStopped if the stream isn't an active callback stream.
+ */
+PaError PaAlsa_GetStreamSchedulingPolicy( PaStream *s, int *policy );
+
+/** Instruct whether to put the audio callback thread under the watchdog.
+ *
+ * If this is turned on by the time the stream is started, a supervisor thread shared by all watched
+ * streams checks the CPU time of the callback thread every two periods. A real-time callback thread which
+ * uses nearly all of a CPU while not making progress or while running into xruns is demoted to normal
+ * scheduling within a few periods, and gets its priority back once it makes progress again with a lower CPU use.
+ * @see PaAlsa_GetStreamWatchdogStatistics
+ **/
 void PaAlsa_EnableWatchdog( PaStream *s, int enable );
-#endif
+
+/** Counters of the watchdog's decisions about a stream's callback thread. */
+typedef struct PaAlsaWatchdogStatistics
+{
+    unsigned long throttleCount;    /**< times the thread was demoted to normal scheduling */
+    unsigned long stallCount;       /**< times the thread stopped making progress while not using the CPU */
+    int throttled;                  /**< is the thread currently demoted? */
+    double cpuFraction;             /**< fraction of a CPU used over the last check interval */
+    double maximumCpuFraction;
+}
+PaAlsaWatchdogStatistics;
+
+/** Get the watchdog counters of the stream's callback thread since it was last started. */
+PaError PaAlsa_GetStreamWatchdogStatistics( PaStream *s, PaAlsaWatchdogStatistics *statistics );
+
+/** Instruct whether to run the stream's callback on a shared engine thread rather than on a thread of its own.
+ *
+ * If this is turned on by the time a callback stream is started, the stream is attached to the least loaded
+ * of a set of engine threads, one per CPU available to audio threads (see PaAlsa_SetDefaultCpuAffinity),
+ * each pinned to its CPU and running under the FIFO policy. An engine thread polls the devices of all its
+ * streams at once and runs the callbacks of those that are ready in order of their deadlines, so that the
+ * number of real-time threads and context switches grows with the number of CPUs rather than with the
+ * number of streams. The per stream cpuAffinity and deadline scheduling settings don't apply to streams on a
+ * shared engine. If any of an engine's streams has the watchdog enabled (see PaAlsa_EnableWatchdog), the
+ * engine thread is put under it, checked at the shortest period among those streams, and
+ * PaAlsa_GetStreamWatchdogStatistics reports the engine thread's counters. The default is taken from the
+ * PA_ALSA_SHARED_ENGINE environment variable.
+ **/
+void PaAlsa_EnableSharedEngine( PaStream *s, int enable );
+
+/** Set the number of shared engine threads that streams are spread over.
+ *
+ * Applies to streams started after the call.
+ * @param count The number of threads, 0 for one per available CPU (the default).
+ */
+PaError PaAlsa_SetSharedEngineThreadCount( int count );
 
 /** Get the ALSA-lib card index of this stream's input device. */
 PaError PaAlsa_GetStreamInputCard( PaStream *s, int *card );
@@ -80,6 +216,27 @@ PaError PaAlsa_GetStreamInputCard( PaStream *s, int *card );
 /** Get the ALSA-lib card index of this stream's output device. */
 PaError PaAlsa_GetStreamOutputCard( PaStream *s, int *card );
 
+/** Get the estimated ratio between the sample rate of a further device of an aggregate and the stream's.
+ *
+ * @param isInput Whether to look at the aggregate of the stream's input or output.
+ * @param index The index of the device in PaAlsaStreamInfo::aggregateDevices.
+ * @param ratio Receives the number of frames of the device per frame of the stream, 0 until the clocks
+ * have been measured.
+ */
+PaError PaAlsa_GetStreamAggregateRatio( PaStream *s, int isInput, unsigned long index, double *ratio );
+
+/** Get the estimated ratio between the actual sample rate of a callback stream's device and its nominal one.
+ *
+ * The clock of each device of a callback stream is modelled with a delay-locked loop, fed with the hardware
+ * timestamps and delays reported by snd_pcm_status. The times in PaStreamCallbackTimeInfo are those at which
+ * the frames of a buffer pass the converters according to this model, so that they don't jitter with the
+ * scheduling of the callback thread, and Pa_GetStreamTime returns the time of the same clock. Until a device
+ * has reported timestamps, the times are estimated from the stream's latencies. For full duplex streams the
+ * ratio is that of the input device.
+ * @param ratio Receives the ratio, 1 until the clock has been measured.
+ */
+PaError PaAlsa_GetStreamRateRatio( PaStream *s, double *ratio );
+
 /** Set the number of periods (buffer fragments) to configure devices with.
  *
  * By default the number of periods is 4, this is the lowest number of periods that works well on
@@ -88,6 +245,20 @@ PaError PaAlsa_GetStreamOutputCard( PaStream *s, int *card );
  */
 PaError PaAlsa_SetNumPeriods( int numPeriods );
 
+/** Set whether streams wake up on a timer rather than on period interrupts.
+ *
+ * For callback streams opened after the call, the device is configured with a single large hardware buffer (up to
+ * two seconds) and as few period interrupts as it allows, none if it can do without. The callback thread instead
+ * sleeps until half the suggested latency worth of frames is due, going by snd_pcm_avail and the hardware
+ * timestamps, and refills playback up to the suggested latency, much like PulseAudio's timer-based scheduling. The
+ * thread wakes up slightly early, by a margin which grows on xruns and shrinks again while there are none. This
+ * suits many streams with large latencies, where small periods would cause many interrupts and wakeups, and large
+ * ones would be limited by what the hardware allows. Streams with timer scheduling don't run on a shared engine.
+ * The initial setting is taken from the PA_ALSA_TSCHED environment variable.
+ * @see PaAlsa_SetNumPeriods
+ */
+PaError PaAlsa_SetTimerScheduling( int enable );
+
 /** Set the maximum number of times to retry opening busy device (sleeping for a
  * short interval inbetween).
  */
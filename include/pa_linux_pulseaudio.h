@@ -42,6 +42,12 @@
 /** @file
  *  @ingroup public_header
  *  @brief PulseAudio-specific PortAudio API extension header file.
+ *
+ *  By default all streams share one PulseAudio mainloop thread and its lock.
+ *  Setting the PA_PULSEAUDIO_SHARDS environment variable to N (at most 16)
+ *  before Pa_Initialize() starts N mainloop threads, each with its own server
+ *  connection, and opens every new stream on the one with the fewest streams,
+ *  so that many concurrent streams don't all serialize on a single lock.
  */
 
 #include "portaudio.h"
@@ -72,6 +78,25 @@ PaError PaPulseAudio_RenameSource( PaStream *s, const char *streamName );
  */
 PaError PaPulseAudio_RenameSink( PaStream *s, const char *streamName );
 
+/**
+ * Lets the stream tune its PulseAudio buffering while it runs. Buffering
+ * grows when playback underflows or recording overflows and shrinks again
+ * after a while without either, always staying between minLatency and
+ * maxLatency. The latency in effect is reported by Pa_GetStreamInfo().
+ *
+ * May be called before Pa_StartStream() or on a running stream, in which
+ * case current buffering is brought within the new bounds.
+ *
+ * @param s The PortAudio stream to operate on.
+ * @param minLatency The smallest buffering allowed, in seconds.
+ * @param maxLatency The largest buffering allowed, in seconds. Passing 0 for
+ * both bounds turns adaptive mode off.
+ *
+ * @return paNoError on success, paInvalidFlag if the bounds are negative
+ * or reversed, paBadStreamPtr if s is NULL.
+ */
+PaError PaPulseAudio_SetAdaptiveLatency( PaStream *s, PaTime minLatency, PaTime maxLatency );
+
 #ifdef __cplusplus
 }
 #endif
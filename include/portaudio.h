@@ -657,7 +657,7 @@ typedef void PaStream;
 
  @see Pa_OpenStream, Pa_OpenDefaultStream
  @see paNoFlag, paClipOff, paDitherOff, paNeverDropInput,
-  paPrimeOutputBuffersUsingStreamCallback, paPlatformSpecificFlags
+  paPrimeOutputBuffersUsingStreamCallback, paLockMemory, paPlatformSpecificFlags
 */
 typedef unsigned long PaStreamFlags;
 
@@ -693,6 +693,21 @@ typedef unsigned long PaStreamFlags;
 */
 #define   paPrimeOutputBuffersUsingStreamCallback ((PaStreamFlags) 0x00000008)
 
+/** Lock the memory used by the stream's audio processing (conversion and
+ adaption buffers, host buffers and the callback thread stack where the host
+ API manages them) into physical memory and prefault it before the stream
+ starts, avoiding page faults in the audio thread. Where the platform
+ supports transparent huge pages they are used for large buffers. Locking may
+ be limited by the process' resource limits, in which case the memory is only
+ prefaulted.
+
+ Setting the PA_LOCK_MEMORY environment variable to a non-zero value before
+ Pa_Initialize() applies this flag to all streams.
+
+ @see PaStreamFlags
+*/
+#define   paLockMemory      ((PaStreamFlags) 0x00000010)
+
 /** A mask specifying the platform specific bits.
  @see PaStreamFlags
 */
@@ -1134,6 +1149,90 @@ PaTime Pa_GetStreamTime( PaStream *stream );
 double Pa_GetStreamCpuLoad( PaStream* stream );
 
 
+/** The number of bins in the loadHistogram field of PaStreamStatistics.
+ @see PaStreamStatistics
+*/
+#define paLoadHistogramBinCount (128)
+
+
+/** The width of each bin in the loadHistogram field of PaStreamStatistics,
+ as a fraction of the buffer period.
+ @see PaStreamStatistics
+*/
+#define paLoadHistogramBinWidth (1.0 / 64.0)
+
+
+/** A structure containing timing statistics for the buffers processed by a
+ callback stream.
+
+ The load of a single buffer is the time taken to process it divided by the
+ duration of the buffer, in the same units as Pa_GetStreamCpuLoad(). A buffer
+ with a load greater than 1.0 was not processed within its deadline. The
+ statistics are accumulated from when the stream is opened until it is closed;
+ stopping and restarting the stream does not reset them.
+
+ @see Pa_GetStreamStatistics
+*/
+typedef struct PaStreamStatistics
+{
+    /** this is struct version 1 */
+    int structVersion;
+
+    /** The number of buffers processed by the stream callback. */
+    unsigned long callbackCount;
+
+    /** The number of buffers whose load exceeded 1.0. */
+    unsigned long deadlineMissCount;
+
+    /** The smoothed load, as returned by Pa_GetStreamCpuLoad(). */
+    double averageLoad;
+
+    /** The largest load of any single buffer. */
+    double maximumLoad;
+
+    /** The load not exceeded by 99% of buffers, with the resolution of
+     paLoadHistogramBinWidth. */
+    double load99thPercentile;
+
+    /** The load not exceeded by 99.9% of buffers, with the resolution of
+     paLoadHistogramBinWidth. */
+    double load999thPercentile;
+
+    /** The distribution of per buffer loads. Element i counts the buffers
+     whose load was at least i * paLoadHistogramBinWidth and less than
+     (i + 1) * paLoadHistogramBinWidth. The last element also counts all
+     buffers with a larger load.
+    */
+    unsigned long loadHistogram[ paLoadHistogramBinCount ];
+
+    /** The number of bytes PortAudio currently holds locked in physical
+     memory on behalf of all open streams.
+     @see paLockMemory
+    */
+    unsigned long lockedMemoryBytes;
+
+} PaStreamStatistics;
+
+
+/** Retrieve timing statistics for the specified stream.
+
+ This function may be called from any thread, including the stream callback.
+ It does not block and does not interfere with the audio processing thread.
+ The statistics of blocking read/write streams are all zero.
+
+ @param stream A pointer to an open stream previously created with Pa_OpenStream().
+
+ @param statistics A pointer to a PaStreamStatistics structure which is
+ filled in by this function.
+
+ @return paNoError on success, or an error code if the stream pointer is
+ invalid.
+
+ @see PaStreamStatistics, Pa_GetStreamCpuLoad
+*/
+PaError Pa_GetStreamStatistics( PaStream *stream, PaStreamStatistics *statistics );
+
+
 /** Read samples from an input stream. The function doesn't return until
  the entire buffer has been filled - this may involve waiting for the operating
  system to supply the data.
@@ -1223,6 +1322,100 @@ signed long Pa_GetStreamReadAvailable( PaStream* stream );
 signed long Pa_GetStreamWriteAvailable( PaStream* stream );
 
 
+/** Get direct access to the samples that are to be read next from an input
+ stream, rather than having them copied by Pa_ReadStream. Waits until frames
+ are available, like Pa_ReadStream.
+
+ Where the host API supports it and the sample format, channel count and
+ interleaving of the stream are those of the device, the buffer is the host's
+ own buffer, so that no samples are copied or converted. Otherwise the samples
+ are read into a buffer of the stream's and returned from there.
+
+ The buffer remains valid until Pa_CommitReadStream is called, which must be
+ done before the stream is read from again.
+
+ @param stream A pointer to an open stream previously created with Pa_OpenStream().
+
+ @param buffer Receives a pointer to the samples, in the format specified by
+ the inputParameters used to open the stream. If non-interleaved samples were
+ requested using the paNonInterleaved sample format flag, it receives a pointer
+ to an array of buffer pointers, one for each channel.
+
+ @param frames On entry the maximum number of frames wanted, on exit the number
+ of frames in buffer, which is at least one.
+
+ @return On success paNoError will be returned, or paInputOverflowed if input
+ data was discarded by PortAudio after the previous read and before this call.
+
+ @see Pa_CommitReadStream, Pa_ReadStream
+*/
+PaError Pa_BeginReadStream( PaStream* stream,
+                            const void **buffer,
+                            unsigned long *frames );
+
+
+/** Release the frames obtained with Pa_BeginReadStream.
+
+ @param frames The number of frames which have been consumed, at most the number
+ returned by Pa_BeginReadStream. Frames which haven't been consumed are returned
+ again by the next read.
+
+ @return paBadBufferPtr if frames is more than was obtained, or if
+ Pa_BeginReadStream hasn't been called.
+*/
+PaError Pa_CommitReadStream( PaStream* stream, unsigned long frames );
+
+
+/** Get direct access to the buffer that is to be written next to an output
+ stream, rather than having the samples copied by Pa_WriteStream. Waits until
+ frames can be written, like Pa_WriteStream.
+
+ Where the host API supports it and the sample format, channel count and
+ interleaving of the stream are those of the device, the buffer is the host's
+ own buffer, so that no samples are copied or converted. Otherwise it is a buffer
+ of the stream's, which is written to the host as Pa_WriteStream does once it is
+ committed.
+
+ The buffer remains valid until Pa_CommitWriteStream is called, which must be
+ done before the stream is written to again.
+
+ The stream may be stopped, to prefill it before calling Pa_StartStream(). The
+ buffer is then always a buffer of the stream's, and the frames committed to it
+ are kept and written by Pa_StartStream().
+
+ @param stream A pointer to an open stream previously created with Pa_OpenStream().
+
+ @param buffer Receives a pointer to the buffer, for samples in the format
+ specified by the outputParameters used to open the stream. If non-interleaved
+ samples were requested using the paNonInterleaved sample format flag, it
+ receives a pointer to an array of buffer pointers, one for each channel.
+
+ @param frames On entry the maximum number of frames wanted, on exit the number
+ of frames that fit in buffer, which is at least one.
+
+ @return On success paNoError will be returned, or paOutputUnderflowed if
+ additional output data was inserted after the previous write and before this
+ call.
+
+ @see Pa_CommitWriteStream, Pa_WriteStream
+*/
+PaError Pa_BeginWriteStream( PaStream* stream,
+                             void **buffer,
+                             unsigned long *frames );
+
+
+/** Write the frames filled in since Pa_BeginWriteStream to the stream.
+
+ @param frames The number of frames which have been filled in from the start
+ of the buffer, at most the number returned by Pa_BeginWriteStream.
+
+ @return paBadBufferPtr if frames is more than was obtained, or if
+ Pa_BeginWriteStream hasn't been called. If the stream hasn't been started yet
+ the frames are kept to prefill it, they are written by Pa_StartStream().
+*/
+PaError Pa_CommitWriteStream( PaStream* stream, unsigned long frames );
+
+
 /* Miscellaneous utilities */
 
 
@@ -320,6 +320,7 @@ static int TestBadActions( void )
     PaQaData            myData;
     PaStreamParameters  opp;
     const PaDeviceInfo* info = NULL;
+    PaStreamStatistics  statistics;
 
     /* Setup data for synthesis thread. */
     myData.framesLeft = (unsigned long)(SAMPLE_RATE * 100); /* 100 seconds */
@@ -351,6 +352,7 @@ static int TestBadActions( void )
     HOPEFOR(((result = !Pa_GetStreamInfo(NULL))));
     HOPEFOR(((result = Pa_GetStreamTime(NULL))  == 0.0));
     HOPEFOR(((result = Pa_GetStreamCpuLoad(NULL))  == 0.0));
+    HOPEFOR(((result = Pa_GetStreamStatistics(NULL, &statistics))  == paBadStreamPtr));
     HOPEFOR(((result = Pa_ReadStream(NULL, NULL, 0))  == paBadStreamPtr));
     HOPEFOR(((result = Pa_WriteStream(NULL, NULL, 0))  == paBadStreamPtr));
 
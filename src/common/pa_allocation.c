@@ -44,15 +44,29 @@
 */
 
 
+#include <string.h> /* memset */
+#include <assert.h>
+
 #include "pa_allocation.h"
 #include "pa_util.h"
+#include "pa_types.h"
+#include "pa_atomic.h"
 
 
 /*
+    Small blocks are served from arenas. Each arena is a fixed size buffer
+    which is carved up by bumping the <used> offset. Blocks have power-of-two
+    sizes (the size class) and are preceded by a block header which records
+    the size class. When a small block is freed it is pushed onto the group's
+    free list for its size class.
+
+    Blocks which don't fit in the largest size class are allocated
+    individually and tracked using the link lists below.
+
     Maintain 3 singly linked lists...
     linkBlocks: the buffers used to allocate the links
     spareLinks: links available for use in the allocations list
-    allocations: the buffers currently allocated using PaUtil_ContextAllocateMemory()
+    allocations: the large blocks currently allocated using PaUtil_GroupAllocateZeroInitializedMemory()
 
     Link block size is doubled every time new links are allocated.
 */
@@ -60,12 +74,62 @@
 
 #define PA_INITIAL_LINK_COUNT_    16
 
+/* all arenas have the same size so that they can be shared through the cache */
+#define PA_ARENA_SIZE_            (64 * 1024)
+#define PA_ARENA_CACHE_SLOTS_     16
+
+#define PA_BLOCK_ALIGNMENT_       16
+#define PA_SMALLEST_BLOCK_SIZE_   32
+#define PA_LARGE_BLOCK_CLASS_     (-1)
+#define PA_BLOCK_MAGIC_           (0xA110)
+
+#define PA_ALIGN_UP_( value, alignment ) \
+    ( ((size_t)(value) + ((size_t)(alignment) - 1)) & ~((size_t)(alignment) - 1) )
+
 struct PaUtilAllocationGroupLink
 {
     struct PaUtilAllocationGroupLink *next;
     void *buffer;
+    unsigned long size;         /* size of buffer, for large blocks */
+    int locked;                 /* buffer was locked with PaUtil_LockMemory */
+};
+
+struct PaUtilAllocationArena
+{
+    struct PaUtilAllocationArena *next;
+    char *data;                 /* PA_BLOCK_ALIGNMENT_ aligned start of the block area */
+    unsigned long used;
+    unsigned long capacity;
+    int locked;
+};
+
+/*
+    The header immediately precedes every pointer returned to clients. For
+    aligned allocations the header may not be at the start of the block, so
+    the offset from the block start to the client pointer is stored.
+    While a block is on a free list the start of the block holds the
+    free list link instead.
+*/
+union PaUtilAllocationBlockHeader
+{
+    struct
+    {
+        PaUint16 magic;
+        PaInt16 sizeClass;      /* PA_LARGE_BLOCK_CLASS_ for blocks outside the arenas */
+        PaUint32 offset;        /* bytes from the start of the block to the client pointer */
+        PaUint32 size;          /* bytes requested by the client */
+        PaUint32 blockSize;     /* bytes occupied by the block */
+    } info;
+    union PaUtilAllocationBlockHeader *nextFree;
+    double alignment_[2];
 };
 
+typedef union PaUtilAllocationBlockHeader PaUtilAllocationBlockHeader;
+
+
+static struct PaUtilAllocationArena * volatile arenaCache_[ PA_ARENA_CACHE_SLOTS_ ];
+
+
 /*
     Allocate a block of links. The first link will have it's buffer member
     pointing to the block, and it's next member set to <nextBlock>. The remaining
@@ -100,6 +164,235 @@ static struct PaUtilAllocationGroupLink *AllocateLinks( long count,
 }
 
 
+static unsigned long SizeOfClass( int sizeClass )
+{
+    return (unsigned long)PA_SMALLEST_BLOCK_SIZE_ << sizeClass;
+}
+
+
+/* returns the smallest size class which can hold <bytes>, or PA_LARGE_BLOCK_CLASS_ */
+static int SizeClassForBytes( unsigned long bytes )
+{
+    int sizeClass = 0;
+
+    while( sizeClass < PA_ALLOCATION_SIZE_CLASS_COUNT )
+    {
+        if( SizeOfClass( sizeClass ) >= bytes )
+            return sizeClass;
+        ++sizeClass;
+    }
+
+    return PA_LARGE_BLOCK_CLASS_;
+}
+
+
+/* take an arena from the cache, or allocate a new one */
+static struct PaUtilAllocationArena *AcquireArena( void )
+{
+    struct PaUtilAllocationArena *result = 0;
+    int i;
+
+    for( i=0; i < PA_ARENA_CACHE_SLOTS_ && !result; ++i )
+    {
+        struct PaUtilAllocationArena *cached = arenaCache_[i];
+        if( cached && PaUtil_AtomicCompareAndSwapPointer( &arenaCache_[i], cached, 0 ) )
+            result = cached;
+    }
+
+    if( !result )
+    {
+        result = (struct PaUtilAllocationArena*)PaUtil_AllocateZeroInitializedMemory( PA_ARENA_SIZE_ );
+        if( result )
+        {
+            result->data = (char*)PA_ALIGN_UP_( result + 1, PA_BLOCK_ALIGNMENT_ );
+            result->capacity = PA_ARENA_SIZE_ - (unsigned long)(result->data - (char*)result);
+        }
+    }
+
+    if( result )
+    {
+        result->next = 0;
+        result->used = 0;
+        result->locked = 0;
+    }
+
+    return result;
+}
+
+
+/* return an arena to the cache, or free it if the cache is full */
+static void ReleaseArena( struct PaUtilAllocationArena *arena )
+{
+    int i;
+
+    if( arena->locked )
+    {
+        PaUtil_UnlockMemory( arena, PA_ARENA_SIZE_ );
+        arena->locked = 0;
+    }
+
+    for( i=0; i < PA_ARENA_CACHE_SLOTS_; ++i )
+    {
+        if( !arenaCache_[i] && PaUtil_AtomicCompareAndSwapPointer( &arenaCache_[i], 0, arena ) )
+            return;
+    }
+
+    PaUtil_FreeMemory( arena );
+}
+
+
+static void PushFreeBlock( PaUtilAllocationGroup* group, char *block, int sizeClass )
+{
+    PaUtilAllocationBlockHeader *header = (PaUtilAllocationBlockHeader*)block;
+
+    header->nextFree = group->freeLists[ sizeClass ];
+    group->freeLists[ sizeClass ] = header;
+}
+
+
+/*
+    Hand the unused tail of the current arena to the free lists so that it
+    isn't wasted when a new arena is started.
+*/
+static void RetireCurrentArena( PaUtilAllocationGroup* group )
+{
+    struct PaUtilAllocationArena *arena = group->arenas;
+    int sizeClass;
+
+    if( !arena )
+        return;
+
+    for( sizeClass = PA_ALLOCATION_SIZE_CLASS_COUNT - 1; sizeClass >= 0; --sizeClass )
+    {
+        while( arena->capacity - arena->used >= SizeOfClass( sizeClass ) )
+        {
+            PushFreeBlock( group, arena->data + arena->used, sizeClass );
+            arena->used += SizeOfClass( sizeClass );
+        }
+    }
+}
+
+
+static PaError LockArena( PaUtilAllocationGroup* group, struct PaUtilAllocationArena *arena )
+{
+    PaError result = paNoError;
+
+    if( !arena->locked )
+    {
+        result = PaUtil_LockMemory( arena, PA_ARENA_SIZE_ );
+        if( result == paNoError )
+        {
+            arena->locked = 1;
+            group->statistics.bytesLocked += PA_ARENA_SIZE_;
+        }
+    }
+
+    return result;
+}
+
+
+static PaError LockLargeBlock( PaUtilAllocationGroup* group, struct PaUtilAllocationGroupLink *link )
+{
+    PaError result = paNoError;
+
+    if( !link->locked )
+    {
+        result = PaUtil_LockMemory( link->buffer, link->size );
+        if( result == paNoError )
+        {
+            link->locked = 1;
+            group->statistics.bytesLocked += link->size;
+        }
+    }
+
+    return result;
+}
+
+
+static void UnlockLargeBlock( PaUtilAllocationGroup* group, struct PaUtilAllocationGroupLink *link )
+{
+    if( link->locked )
+    {
+        PaUtil_UnlockMemory( link->buffer, link->size );
+        group->statistics.bytesLocked -= link->size;
+        link->locked = 0;
+    }
+}
+
+
+static char *AllocateSmallBlock( PaUtilAllocationGroup* group, int sizeClass )
+{
+    struct PaUtilAllocationArena *arena;
+    unsigned long blockSize = SizeOfClass( sizeClass );
+    char *result = 0;
+
+    if( group->freeLists[ sizeClass ] )
+    {
+        result = (char*)group->freeLists[ sizeClass ];
+        group->freeLists[ sizeClass ] = group->freeLists[ sizeClass ]->nextFree;
+        return result;
+    }
+
+    arena = group->arenas;
+    if( !arena || arena->capacity - arena->used < blockSize )
+    {
+        RetireCurrentArena( group );
+
+        arena = AcquireArena();
+        if( !arena )
+            return 0;
+
+        arena->next = group->arenas;
+        group->arenas = arena;
+        group->statistics.arenaCount++;
+        group->statistics.bytesReserved += PA_ARENA_SIZE_;
+
+        if( group->lockMemory )
+            LockArena( group, arena );
+    }
+
+    result = arena->data + arena->used;
+    arena->used += blockSize;
+
+    return result;
+}
+
+
+static struct PaUtilAllocationGroupLink *TakeSpareLink( PaUtilAllocationGroup* group )
+{
+    struct PaUtilAllocationGroupLink *links, *link;
+
+    /* allocate more links if necessary */
+    if( !group->spareLinks )
+    {
+        /* double the link count on each block allocation */
+        links = AllocateLinks( group->linkCount, group->linkBlocks, group->spareLinks );
+        if( links )
+        {
+            group->linkCount += group->linkCount;
+            group->linkBlocks = &links[0];
+            group->spareLinks = &links[1];
+        }
+    }
+
+    link = group->spareLinks;
+    if( link )
+        group->spareLinks = link->next;
+
+    return link;
+}
+
+
+static void ReturnSpareLink( PaUtilAllocationGroup* group, struct PaUtilAllocationGroupLink *link )
+{
+    link->buffer = 0;
+    link->size = 0;
+    link->locked = 0;
+    link->next = group->spareLinks;
+    group->spareLinks = link;
+}
+
+
 PaUtilAllocationGroup* PaUtil_CreateAllocationGroup( void )
 {
     PaUtilAllocationGroup* result = 0;
@@ -117,6 +410,7 @@ PaUtilAllocationGroup* PaUtil_CreateAllocationGroup( void )
             result->linkBlocks = &links[0];
             result->spareLinks = &links[1];
             result->allocations = 0;
+            result->arenas = 0;
         }
         else
         {
@@ -132,6 +426,15 @@ void PaUtil_DestroyAllocationGroup( PaUtilAllocationGroup* group )
 {
     struct PaUtilAllocationGroupLink *current = group->linkBlocks;
     struct PaUtilAllocationGroupLink *next;
+    struct PaUtilAllocationArena *arena = group->arenas;
+    struct PaUtilAllocationArena *nextArena;
+
+    while( arena )
+    {
+        nextArena = arena->next;
+        ReleaseArena( arena );
+        arena = nextArena;
+    }
 
     while( current )
     {
@@ -144,77 +447,174 @@ void PaUtil_DestroyAllocationGroup( PaUtilAllocationGroup* group )
 }
 
 
-void* PaUtil_GroupAllocateZeroInitializedMemory( PaUtilAllocationGroup* group, long size )
+void* PaUtil_GroupAllocateAlignedZeroInitializedMemory( PaUtilAllocationGroup* group,
+        long size, long alignment )
 {
-    struct PaUtilAllocationGroupLink *links, *link;
-    void *result = 0;
+    struct PaUtilAllocationGroupLink *link;
+    PaUtilAllocationBlockHeader *header;
+    char *block;
+    char *result;
+    unsigned long blockSize;
+    int sizeClass;
 
-    /* allocate more links if necessary */
-    if( !group->spareLinks )
+    if( size < 0 || alignment <= 0 || (alignment & (alignment - 1)) != 0 )
+        return 0;
+
+    if( alignment < PA_BLOCK_ALIGNMENT_ )
+        alignment = PA_BLOCK_ALIGNMENT_;
+
+    /* arena blocks start on a PA_BLOCK_ALIGNMENT_ boundary */
+    blockSize = sizeof(PaUtilAllocationBlockHeader) + size + (alignment - PA_BLOCK_ALIGNMENT_);
+    sizeClass = SizeClassForBytes( blockSize );
+
+    if( sizeClass != PA_LARGE_BLOCK_CLASS_ )
     {
-        /* double the link count on each block allocation */
-        links = AllocateLinks( group->linkCount, group->linkBlocks, group->spareLinks );
-        if( links )
-        {
-            group->linkCount += group->linkCount;
-            group->linkBlocks = &links[0];
-            group->spareLinks = &links[1];
-        }
-    }
+        block = AllocateSmallBlock( group, sizeClass );
+        if( !block )
+            return 0;
 
-    if( group->spareLinks )
+        blockSize = SizeOfClass( sizeClass );
+    }
+    else
     {
-        result = PaUtil_AllocateZeroInitializedMemory( size );
-        if( result )
-        {
-            link = group->spareLinks;
-            group->spareLinks = link->next;
+        /* the system allocator gives no alignment guarantee beyond a pointer */
+        blockSize = sizeof(PaUtilAllocationBlockHeader) + size + (alignment - 1);
 
-            link->buffer = result;
-            link->next = group->allocations;
+        link = TakeSpareLink( group );
+        if( !link )
+            return 0;
 
-            group->allocations = link;
+        block = (char*)PaUtil_AllocateZeroInitializedMemory( blockSize );
+        if( !block )
+        {
+            ReturnSpareLink( group, link );
+            return 0;
         }
+
+        link->buffer = block;
+        link->size = blockSize;
+        link->next = group->allocations;
+        group->allocations = link;
+
+        group->statistics.largeBlockCount++;
+        group->statistics.bytesReserved += blockSize;
+
+        if( group->lockMemory )
+            LockLargeBlock( group, link );
     }
 
+    result = (char*)PA_ALIGN_UP_( block + sizeof(PaUtilAllocationBlockHeader), alignment );
+
+    header = ((PaUtilAllocationBlockHeader*)result) - 1;
+    header->info.magic = PA_BLOCK_MAGIC_;
+    header->info.sizeClass = (PaInt16)sizeClass;
+    header->info.offset = (PaUint32)(result - block);
+    header->info.size = (PaUint32)size;
+    header->info.blockSize = (PaUint32)blockSize;
+
+    /* recycled blocks are dirty */
+    memset( result, 0, size );
+
+    group->statistics.blockCount++;
+    group->statistics.bytesInUse += blockSize;
+    group->statistics.bytesRequested += size;
+    if( group->statistics.bytesInUse > group->statistics.peakBytesInUse )
+        group->statistics.peakBytesInUse = group->statistics.bytesInUse;
+
     return result;
 }
 
 
+void* PaUtil_GroupAllocateZeroInitializedMemory( PaUtilAllocationGroup* group, long size )
+{
+    return PaUtil_GroupAllocateAlignedZeroInitializedMemory( group, size, PA_BLOCK_ALIGNMENT_ );
+}
+
+
+/*
+    Client pointers are at least one header past the start of their block,
+    so a pointer is in a block from <start> if it is above <start> and not
+    past the end. Only then is it safe to read the header in front of it.
+*/
+static int IsInBlockArea( const char *start, unsigned long size, const char *buffer )
+{
+    return buffer > start && buffer < start + size;
+}
+
+
 void PaUtil_GroupFreeMemory( PaUtilAllocationGroup* group, void *buffer )
 {
     struct PaUtilAllocationGroupLink *current = group->allocations;
     struct PaUtilAllocationGroupLink *previous = 0;
+    struct PaUtilAllocationArena *arena;
+    PaUtilAllocationBlockHeader *header;
+    char *block;
 
     if( buffer == 0 )
         return;
 
+    header = ((PaUtilAllocationBlockHeader*)buffer) - 1;
+
+    for( arena = group->arenas; arena; arena = arena->next )
+    {
+        if( IsInBlockArea( arena->data, arena->used, (char*)buffer ) )
+            break;
+    }
+
+    if( arena )
+    {
+        /* a block on a free list has its link where the magic was, this catches double frees */
+        assert( header->info.magic == PA_BLOCK_MAGIC_ && header->info.sizeClass != PA_LARGE_BLOCK_CLASS_ );
+
+        block = (char*)buffer - header->info.offset;
+        header->info.magic = 0;
+
+        group->statistics.blockCount--;
+        group->statistics.bytesInUse -= header->info.blockSize;
+        group->statistics.bytesRequested -= header->info.size;
+
+        PushFreeBlock( group, block, header->info.sizeClass );
+        return;
+    }
+
     /* find the right link and remove it */
     while( current )
     {
-        if( current->buffer == buffer )
-        {
-            if( previous )
-            {
-                previous->next = current->next;
-            }
-            else
-            {
-                group->allocations = current->next;
-            }
-
-            current->buffer = 0;
-            current->next = group->spareLinks;
-            group->spareLinks = current;
-
+        if( IsInBlockArea( (char*)current->buffer, current->size, (char*)buffer ) )
             break;
-        }
 
         previous = current;
         current = current->next;
     }
 
-    PaUtil_FreeMemory( buffer ); /* free the memory whether we found it in the list or not */
+    if( !current )
+    {
+        assert( 0 ); /* not allocated through this group, or already freed */
+        return;
+    }
+
+    assert( header->info.magic == PA_BLOCK_MAGIC_ && header->info.sizeClass == PA_LARGE_BLOCK_CLASS_ );
+
+    if( previous )
+    {
+        previous->next = current->next;
+    }
+    else
+    {
+        group->allocations = current->next;
+    }
+
+    group->statistics.blockCount--;
+    group->statistics.bytesInUse -= header->info.blockSize;
+    group->statistics.bytesRequested -= header->info.size;
+    group->statistics.largeBlockCount--;
+    group->statistics.bytesReserved -= header->info.blockSize;
+
+    block = (char*)current->buffer;
+    UnlockLargeBlock( group, current );
+    ReturnSpareLink( group, current );
+
+    PaUtil_FreeMemory( block );
 }
 
 
@@ -222,10 +622,13 @@ void PaUtil_FreeAllAllocations( PaUtilAllocationGroup* group )
 {
     struct PaUtilAllocationGroupLink *current = group->allocations;
     struct PaUtilAllocationGroupLink *previous = 0;
+    struct PaUtilAllocationArena *arena, *nextArena;
+    int i;
 
     /* free all buffers in the allocations list */
     while( current )
     {
+        UnlockLargeBlock( group, current );
         PaUtil_FreeMemory( current->buffer );
         current->buffer = 0;
 
@@ -240,4 +643,78 @@ void PaUtil_FreeAllAllocations( PaUtilAllocationGroup* group )
         group->spareLinks = group->allocations;
         group->allocations = 0;
     }
+
+    /* reset the arenas in bulk. the first arena is kept for subsequent
+        allocations, the others go back to the cache */
+    arena = group->arenas;
+    if( arena )
+    {
+        nextArena = arena->next;
+        arena->next = 0;
+        arena->used = 0;
+        group->statistics.arenaCount = 1;
+        group->statistics.bytesLocked = arena->locked ? PA_ARENA_SIZE_ : 0;
+
+        while( nextArena )
+        {
+            arena = nextArena;
+            nextArena = arena->next;
+            ReleaseArena( arena );
+        }
+    }
+
+    for( i=0; i < PA_ALLOCATION_SIZE_CLASS_COUNT; ++i )
+        group->freeLists[i] = 0;
+
+    group->statistics.bytesReserved = group->statistics.arenaCount * (unsigned long)PA_ARENA_SIZE_;
+    group->statistics.bytesInUse = 0;
+    group->statistics.bytesRequested = 0;
+    group->statistics.blockCount = 0;
+    group->statistics.largeBlockCount = 0;
+}
+
+
+PaError PaUtil_LockAllocationGroupMemory( PaUtilAllocationGroup* group )
+{
+    PaError result = paNoError, lockResult;
+    struct PaUtilAllocationArena *arena;
+    struct PaUtilAllocationGroupLink *link;
+
+    group->lockMemory = 1;
+
+    for( arena = group->arenas; arena; arena = arena->next )
+    {
+        lockResult = LockArena( group, arena );
+        if( lockResult != paNoError )
+            result = lockResult;
+    }
+
+    for( link = group->allocations; link; link = link->next )
+    {
+        lockResult = LockLargeBlock( group, link );
+        if( lockResult != paNoError )
+            result = lockResult;
+    }
+
+    return result;
+}
+
+
+void PaUtil_GetAllocationGroupStatistics( PaUtilAllocationGroup* group,
+        PaUtilAllocationGroupStatistics *statistics )
+{
+    *statistics = group->statistics;
+}
+
+
+void PaUtil_ReleaseAllocationArenaCache( void )
+{
+    int i;
+
+    for( i=0; i < PA_ARENA_CACHE_SLOTS_; ++i )
+    {
+        struct PaUtilAllocationArena *cached = arenaCache_[i];
+        if( cached && PaUtil_AtomicCompareAndSwapPointer( &arenaCache_[i], cached, 0 ) )
+            PaUtil_FreeMemory( cached );
+    }
 }
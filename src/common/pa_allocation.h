@@ -51,23 +51,61 @@
  a list of allocated blocks, and can free all allocations at once. This
  can be useful for cleaning up after a partially initialized object fails.
 
- The allocation group implementation is built on top of the lower
- level allocation functions defined in pa_util.h
+ Small blocks are carved out of per-group arenas using power-of-two size
+ classes. Freed small blocks go onto per-class free lists and are reused by
+ later allocations of the same class, and PaUtil_FreeAllAllocations resets the
+ arenas in bulk without returning them to the system. Arenas released by
+ PaUtil_DestroyAllocationGroup are kept in a small process-wide cache so that
+ repeatedly opening and closing streams doesn't fragment the heap. Blocks
+ larger than the biggest size class are allocated individually using the lower
+ level allocation functions defined in pa_util.h.
+
+ Allocation group functions are not thread safe, a group should only be
+ used by one thread at a time. The arena cache is lock-free.
 */
 
 
+#include "portaudio.h"
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif /* __cplusplus */
 
 
-typedef struct
+/** The number of power-of-two size classes served from arenas. Class 0 holds
+ blocks of 32 bytes (including the block header) and the largest class holds
+ blocks of 32 << (PA_ALLOCATION_SIZE_CLASS_COUNT-1) bytes.
+*/
+#define PA_ALLOCATION_SIZE_CLASS_COUNT  (11)
+
+
+/** Memory usage counters for an allocation group.
+ @see PaUtil_GetAllocationGroupStatistics
+*/
+typedef struct PaUtilAllocationGroupStatistics
+{
+    unsigned long bytesReserved;    /**< arena and large block bytes obtained from the system */
+    unsigned long bytesInUse;       /**< bytes occupied by live blocks, including size class rounding */
+    unsigned long peakBytesInUse;   /**< high water mark of bytesInUse */
+    unsigned long bytesRequested;   /**< bytes requested by clients for live blocks */
+    long blockCount;                /**< number of live blocks */
+    long largeBlockCount;           /**< number of live blocks allocated outside the arenas */
+    long arenaCount;                /**< number of arenas owned by the group */
+    unsigned long bytesLocked;      /**< bytes locked into physical memory */
+}PaUtilAllocationGroupStatistics;
+
+
+typedef struct PaUtilAllocationGroup
 {
     long linkCount;
     struct PaUtilAllocationGroupLink *linkBlocks;
     struct PaUtilAllocationGroupLink *spareLinks;
-    struct PaUtilAllocationGroupLink *allocations;
+    struct PaUtilAllocationGroupLink *allocations; /**< large blocks */
+    struct PaUtilAllocationArena *arenas; /**< current arena first */
+    union PaUtilAllocationBlockHeader *freeLists[ PA_ALLOCATION_SIZE_CLASS_COUNT ];
+    PaUtilAllocationGroupStatistics statistics;
+    int lockMemory; /**< lock arenas and large blocks as they are acquired */
 }PaUtilAllocationGroup;
 
 
@@ -76,7 +114,9 @@ typedef struct
 */
 PaUtilAllocationGroup* PaUtil_CreateAllocationGroup( void );
 
-/** Destroy an allocation group, but not the memory allocated through the group.
+/** Destroy an allocation group. The group's arenas are returned to the arena
+ cache, so blocks allocated from them become invalid. Large blocks are not
+ freed. Clients should call PaUtil_FreeAllAllocations first.
 */
 void PaUtil_DestroyAllocationGroup( PaUtilAllocationGroup* group );
 
@@ -85,6 +125,14 @@ The allocated block is zero-initialized.
 */
 void* PaUtil_GroupAllocateZeroInitializedMemory( PaUtilAllocationGroup* group, long size );
 
+/** Allocate a block of memory aligned to a multiple of alignment bytes through
+ the specified allocation group. alignment must be a power of two. The
+ allocated block is zero-initialized and may be freed with
+ PaUtil_GroupFreeMemory.
+*/
+void* PaUtil_GroupAllocateAlignedZeroInitializedMemory( PaUtilAllocationGroup* group,
+        long size, long alignment );
+
 /** Free a block of memory that was allocated through the specified allocation
  group. Calling this function is a relatively time consuming operation.
  Under normal circumstances clients should call PaUtil_FreeAllAllocations to
@@ -98,6 +146,25 @@ void PaUtil_GroupFreeMemory( PaUtilAllocationGroup* group, void *buffer );
 */
 void PaUtil_FreeAllAllocations( PaUtilAllocationGroup* group );
 
+/** Lock all memory owned by the group into physical memory and prefault it,
+ using PaUtil_LockMemory. Arenas and large blocks acquired later are locked as
+ they are acquired, and unlocked when they are released.
+
+ @return paNoError if all memory could be locked. Memory which could not be
+ locked is still prefaulted.
+*/
+PaError PaUtil_LockAllocationGroupMemory( PaUtilAllocationGroup* group );
+
+/** Retrieve the memory usage counters of an allocation group.
+*/
+void PaUtil_GetAllocationGroupStatistics( PaUtilAllocationGroup* group,
+        PaUtilAllocationGroupStatistics *statistics );
+
+/** Return the arenas held in the process-wide arena cache to the system.
+ Called by Pa_Terminate.
+*/
+void PaUtil_ReleaseAllocationArenaCache( void );
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,101 @@
+#ifndef PA_ATOMIC_H
+#define PA_ATOMIC_H
+/*
+ * $Id$
+ * Portable Audio I/O Library
+ * Atomic operation utilities
+ *
+ * Based on the Open Source API proposed by Ross Bencina
+ * Copyright (c) 1999-2008 Ross Bencina, Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+/** @file
+ @ingroup common_src
+
+ @brief Minimal set of atomic read-modify-write primitives.
+
+ These complement the barriers in pa_memorybarrier.h. All operations imply a
+ full memory barrier. The primitives that are defined are:
+
+ PaUtil_AtomicCompareAndSwapPointer( ptr, oldValue, newValue )
+    if *ptr == oldValue store newValue, returns non-zero on success.
+
+ PaUtil_AtomicCompareAndSwapLong( ptr, oldValue, newValue )
+    as above for a volatile long.
+
+ PaUtil_AtomicAddLong( ptr, value )
+    adds value to *ptr and returns the new value.
+*/
+
+
+#if defined(__GNUC__)
+    /* GCC >= 4.1 and clang provide the __sync family of builtins */
+#   define PaUtil_AtomicCompareAndSwapPointer( ptr, oldValue, newValue ) \
+        __sync_bool_compare_and_swap( (void * volatile *)(ptr), (void*)(oldValue), (void*)(newValue) )
+#   define PaUtil_AtomicCompareAndSwapLong( ptr, oldValue, newValue ) \
+        __sync_bool_compare_and_swap( (volatile long *)(ptr), (long)(oldValue), (long)(newValue) )
+#   define PaUtil_AtomicAddLong( ptr, value ) \
+        __sync_add_and_fetch( (volatile long *)(ptr), (long)(value) )
+#elif defined(_MSC_VER) && (_MSC_VER >= 1400) && !defined(_WIN32_WCE)
+#   include <intrin.h>
+#   pragma intrinsic(_InterlockedCompareExchange)
+#   pragma intrinsic(_InterlockedExchangeAdd)
+#   if defined(_WIN64)
+#       pragma intrinsic(_InterlockedCompareExchangePointer)
+#       define PaUtil_AtomicCompareAndSwapPointer( ptr, oldValue, newValue ) \
+            ( _InterlockedCompareExchangePointer( (void * volatile *)(ptr), (void*)(newValue), (void*)(oldValue) ) == (void*)(oldValue) )
+#   else
+#       define PaUtil_AtomicCompareAndSwapPointer( ptr, oldValue, newValue ) \
+            ( _InterlockedCompareExchange( (volatile long *)(ptr), (long)(newValue), (long)(oldValue) ) == (long)(oldValue) )
+#   endif
+#   define PaUtil_AtomicCompareAndSwapLong( ptr, oldValue, newValue ) \
+        ( _InterlockedCompareExchange( (volatile long *)(ptr), (long)(newValue), (long)(oldValue) ) == (long)(oldValue) )
+#   define PaUtil_AtomicAddLong( ptr, value ) \
+        ( _InterlockedExchangeAdd( (volatile long *)(ptr), (long)(value) ) + (long)(value) )
+#else
+#   ifdef ALLOW_SMP_DANGERS
+#       warning Atomic operations not defined on this system or system unknown
+#       warning For SMP safety, you should fix this.
+        /* single threaded fallbacks, these are NOT atomic */
+#       define PaUtil_AtomicCompareAndSwapPointer( ptr, oldValue, newValue ) \
+            ( (*(void**)(ptr) == (void*)(oldValue)) ? (*(void**)(ptr) = (void*)(newValue), 1) : 0 )
+#       define PaUtil_AtomicCompareAndSwapLong( ptr, oldValue, newValue ) \
+            ( (*(long*)(ptr) == (long)(oldValue)) ? (*(long*)(ptr) = (long)(newValue), 1) : 0 )
+#       define PaUtil_AtomicAddLong( ptr, value ) \
+            ( *(long*)(ptr) += (long)(value) )
+#   else
+#       error Atomic operations are not defined on this system. You can still compile by defining ALLOW_SMP_DANGERS, but SMP safety will not be guaranteed.
+#   endif
+#endif
+
+#endif /* PA_ATOMIC_H */
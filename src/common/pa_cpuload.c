@@ -41,28 +41,47 @@
  @ingroup common_src
 
  @brief Functions to assist in measuring the CPU utilization of a callback
- stream. Used to implement the Pa_GetStreamCpuLoad() function.
-
- @todo Dynamically calculate the coefficients used to smooth the CPU Load
- Measurements over time to provide a uniform characterisation of CPU Load
- independent of rate at which PaUtil_BeginCpuLoadMeasurement /
- PaUtil_EndCpuLoadMeasurement are called. see http://www.portaudio.com/trac/ticket/113
+ stream. Used to implement the Pa_GetStreamCpuLoad() and
+ Pa_GetStreamStatistics() functions.
+
+ Each measurement is smoothed into the average load by a one pole low pass
+ filter whose coefficient is derived from the duration of the measured buffer,
+ so that the average has the same time constant regardless of the rate at which
+ PaUtil_BeginCpuLoadMeasurement / PaUtil_EndCpuLoadMeasurement are called (see
+ http://www.portaudio.com/trac/ticket/113). Each measurement is also counted
+ in a histogram, from which the tail of the load distribution is recovered.
 */
 
 
 #include "pa_cpuload.h"
 
 #include <assert.h>
+#include <math.h>
+
+#include "pa_util.h"   /* for PaUtil_GetNanoseconds() */
+#include "pa_memorybarrier.h"
+
 
-#include "pa_util.h"   /* for PaUtil_GetTime() */
+/* time constant of the average load low pass filter, in seconds. A buffer of
+   256 frames at 44100Hz gives the coefficient of 0.9 used historically. */
+#define PA_CPU_LOAD_TIME_CONSTANT_  (0.055)
 
 
 void PaUtil_InitializeCpuLoadMeasurer( PaUtilCpuLoadMeasurer* measurer, double sampleRate )
 {
+    int i;
+
     assert( sampleRate > 0 );
 
     measurer->samplingPeriod = 1. / sampleRate;
     measurer->averageLoad = 0.;
+    measurer->smoothingFrames = 0;
+    measurer->smoothingCoefficient = 0.;
+    measurer->sequence = 0;
+    measurer->maximumLoad = 0.;
+    measurer->deadlineMissCount = 0;
+    for( i=0; i < paLoadHistogramBinCount; ++i )
+        measurer->loadHistogram[i] = 0;
 }
 
 void PaUtil_ResetCpuLoadMeasurer( PaUtilCpuLoadMeasurer* measurer )
@@ -72,29 +91,53 @@ void PaUtil_ResetCpuLoadMeasurer( PaUtilCpuLoadMeasurer* measurer )
 
 void PaUtil_BeginCpuLoadMeasurement( PaUtilCpuLoadMeasurer* measurer )
 {
-    measurer->measurementStartTime = PaUtil_GetTime();
+    measurer->measurementStartTime = PaUtil_GetNanoseconds();
 }
 
 
 void PaUtil_EndCpuLoadMeasurement( PaUtilCpuLoadMeasurer* measurer, unsigned long framesProcessed )
 {
-    double measurementEndTime, secondsFor100Percent, measuredLoad;
+    PaInt64 measurementEndTime;
+    double secondsFor100Percent, measuredLoad;
+    long bin;
 
     if( framesProcessed > 0 ){
-        measurementEndTime = PaUtil_GetTime();
+        measurementEndTime = PaUtil_GetNanoseconds();
 
         assert( framesProcessed > 0 );
         secondsFor100Percent = framesProcessed * measurer->samplingPeriod;
 
-        measuredLoad = (measurementEndTime - measurer->measurementStartTime) / secondsFor100Percent;
+        measuredLoad = PA_NANOSECONDS_TO_PATIME( measurementEndTime - measurer->measurementStartTime ) / secondsFor100Percent;
+
+        /* Low pass filter the calculated CPU load to reduce jitter using a simple IIR low pass filter.
+           The coefficient only changes when the buffer size does, so it is cached. */
+        if( framesProcessed != measurer->smoothingFrames )
+        {
+            measurer->smoothingCoefficient = exp( -secondsFor100Percent / PA_CPU_LOAD_TIME_CONSTANT_ );
+            measurer->smoothingFrames = framesProcessed;
+        }
+
+        measurer->sequence = measurer->sequence + 1;
+        PaUtil_WriteMemoryBarrier();
 
-        /* Low pass filter the calculated CPU load to reduce jitter using a simple IIR low pass filter. */
-        /** FIXME @todo these coefficients shouldn't be hardwired see: http://www.portaudio.com/trac/ticket/113 */
-#define LOWPASS_COEFFICIENT_0   (0.9)
-#define LOWPASS_COEFFICIENT_1   (0.99999 - LOWPASS_COEFFICIENT_0)
+        measurer->averageLoad = (measurer->smoothingCoefficient * measurer->averageLoad) +
+                                ((1. - measurer->smoothingCoefficient) * measuredLoad);
 
-        measurer->averageLoad = (LOWPASS_COEFFICIENT_0 * measurer->averageLoad) +
-                                (LOWPASS_COEFFICIENT_1 * measuredLoad);
+        bin = (long)(measuredLoad * (1. / paLoadHistogramBinWidth));
+        if( bin < 0 )
+            bin = 0;
+        else if( bin >= paLoadHistogramBinCount )
+            bin = paLoadHistogramBinCount - 1;
+        measurer->loadHistogram[bin] = measurer->loadHistogram[bin] + 1;
+
+        if( measuredLoad > 1. )
+            measurer->deadlineMissCount = measurer->deadlineMissCount + 1;
+
+        if( measuredLoad > measurer->maximumLoad )
+            measurer->maximumLoad = measuredLoad;
+
+        PaUtil_WriteMemoryBarrier();
+        measurer->sequence = measurer->sequence + 1;
     }
 }
 
@@ -103,3 +146,64 @@ double PaUtil_GetCpuLoad( PaUtilCpuLoadMeasurer* measurer )
 {
     return measurer->averageLoad;
 }
+
+
+/* Return the upper edge of the histogram bin at which the cumulative count
+   reaches fraction of count, limited to maximumLoad. */
+static double LoadPercentile( const unsigned long *histogram, unsigned long count,
+        double fraction, double maximumLoad )
+{
+    unsigned long cumulative = 0;
+    double threshold = fraction * count;
+    double result;
+    int i;
+
+    if( count == 0 )
+        return 0.;
+
+    for( i=0; i < paLoadHistogramBinCount - 1; ++i )
+    {
+        cumulative += histogram[i];
+        if( cumulative >= threshold )
+            break;
+    }
+
+    result = (i + 1) * paLoadHistogramBinWidth;
+    return ( i == paLoadHistogramBinCount - 1 || result > maximumLoad ) ? maximumLoad : result;
+}
+
+
+void PaUtil_GetCpuLoadStatistics( PaUtilCpuLoadMeasurer* measurer, PaStreamStatistics *statistics )
+{
+    unsigned long count, sequence;
+    int i;
+
+    /* the histogram is copied along with the loads so that the count and
+       percentiles are consistent with each other, retrying if a measurement
+       completed meanwhile */
+    do
+    {
+        while( (sequence = measurer->sequence) & 1 )
+            ;
+        PaUtil_ReadMemoryBarrier();
+
+        count = 0;
+        for( i=0; i < paLoadHistogramBinCount; ++i )
+        {
+            statistics->loadHistogram[i] = measurer->loadHistogram[i];
+            count += statistics->loadHistogram[i];
+        }
+        statistics->deadlineMissCount = measurer->deadlineMissCount;
+        statistics->averageLoad = measurer->averageLoad;
+        statistics->maximumLoad = measurer->maximumLoad;
+
+        PaUtil_ReadMemoryBarrier();
+    }
+    while( sequence != measurer->sequence );
+
+    statistics->callbackCount = count;
+    statistics->load99thPercentile = LoadPercentile( statistics->loadHistogram,
+            count, .99, statistics->maximumLoad );
+    statistics->load999thPercentile = LoadPercentile( statistics->loadHistogram,
+            count, .999, statistics->maximumLoad );
+}
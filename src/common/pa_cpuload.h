@@ -43,28 +43,55 @@
  @ingroup common_src
 
  @brief Functions to assist in measuring the CPU utilization of a callback
- stream. Used to implement the Pa_GetStreamCpuLoad() function.
+ stream. Used to implement the Pa_GetStreamCpuLoad() and
+ Pa_GetStreamStatistics() functions.
 */
 
 
+#include "portaudio.h"
+#include "pa_types.h"
+
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif /* __cplusplus */
 
 
-typedef struct {
+/** The measurer is written only by the thread that calls
+ PaUtil_BeginCpuLoadMeasurement and PaUtil_EndCpuLoadMeasurement. The counters
+ may be read concurrently from other threads without locking. The doubles can't
+ be read in one access on every target, so sequence is odd while a measurement
+ updates them and readers retry until they see the same even value around
+ their read.
+*/
+typedef struct PaUtilCpuLoadMeasurer {
     double samplingPeriod;
-    double measurementStartTime;
+    PaInt64 measurementStartTime;       /**< nanoseconds, from PaUtil_GetNanoseconds */
     double averageLoad;
+    unsigned long smoothingFrames;      /**< frame count smoothingCoefficient was computed for */
+    double smoothingCoefficient;
+    volatile unsigned long sequence;
+    volatile double maximumLoad;
+    volatile unsigned long deadlineMissCount;
+    volatile unsigned long loadHistogram[ paLoadHistogramBinCount ];
 } PaUtilCpuLoadMeasurer; /**< @todo need better name than measurer */
 
 void PaUtil_InitializeCpuLoadMeasurer( PaUtilCpuLoadMeasurer* measurer, double sampleRate );
 void PaUtil_BeginCpuLoadMeasurement( PaUtilCpuLoadMeasurer* measurer );
 void PaUtil_EndCpuLoadMeasurement( PaUtilCpuLoadMeasurer* measurer, unsigned long framesProcessed );
+
+/** Reset the average load. The histogram and counters are only reset by
+ PaUtil_InitializeCpuLoadMeasurer.
+*/
 void PaUtil_ResetCpuLoadMeasurer( PaUtilCpuLoadMeasurer* measurer );
 double PaUtil_GetCpuLoad( PaUtilCpuLoadMeasurer* measurer );
 
+/** Fill in the load fields of a PaStreamStatistics structure. May be called
+ from any thread.
+*/
+void PaUtil_GetCpuLoadStatistics( PaUtilCpuLoadMeasurer* measurer, PaStreamStatistics *statistics );
+
 
 #ifdef __cplusplus
 }
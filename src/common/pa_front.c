@@ -70,10 +70,12 @@
 
 #include "portaudio.h"
 #include "pa_util.h"
+#include "pa_allocation.h"
 #include "pa_endianness.h"
 #include "pa_types.h"
 #include "pa_hostapi.h"
 #include "pa_stream.h"
+#include "pa_cpuload.h"
 #include "pa_trace.h" /* still useful?*/
 #include "pa_debugprint.h"
 
@@ -156,6 +158,7 @@ static int defaultHostApiIndex_ = 0;
 static int initializationCount_ = 0;
 static int initializing_ = 0;
 static int deviceCount_ = 0;
+static PaStreamFlags defaultStreamFlags_ = 0; /* ORed into the flags of every stream */
 
 PaUtilStreamRepresentation *firstOpenStream_ = NULL;
 
@@ -381,6 +384,12 @@ PaError Pa_Initialize( void )
 
         PaUtil_InitializeClock();
         PaUtil_ResetTraceMessages();
+        if( getenv( "PA_TRACE_FILE" ) )
+            PaUtil_EnableTraceEvents( 1 );
+
+        defaultStreamFlags_ = 0;
+        if( getenv( "PA_LOCK_MEMORY" ) && atoi( getenv( "PA_LOCK_MEMORY" ) ) )
+            defaultStreamFlags_ |= paLockMemory;
 
         result = InitializeHostApis();
         if( result == paNoError )
@@ -410,7 +419,22 @@ PaError Pa_Terminate( void )
 
             TerminateHostApis();
 
+            PaUtil_ReleaseAllocationArenaCache();
+
             PaUtil_DumpTraceMessages();
+
+            if( getenv( "PA_TRACE_FILE" ) )
+            {
+                const char *traceFile = getenv( "PA_TRACE_FILE" );
+                size_t length = strlen( traceFile );
+
+                PaUtil_EnableTraceEvents( 0 );
+                if( length > 5 && strcmp( traceFile + length - 5, ".json" ) == 0 )
+                    PaUtil_WriteChromeTrace( traceFile );
+                else
+                    PaUtil_DumpTraceEvents( traceFile );
+            }
+            PaUtil_TerminateTraceEvents();
         }
         --initializationCount_;
         result = paNoError;
@@ -780,6 +804,8 @@ const PaDeviceInfo* Pa_GetDeviceInfo( PaDeviceIndex device )
     }
     else
     {
+        if( hostApis_[hostApiIndex]->PrepareDeviceInfo )
+            hostApis_[hostApiIndex]->PrepareDeviceInfo( hostApis_[hostApiIndex], hostSpecificDeviceIndex );
         result = hostApis_[hostApiIndex]->deviceInfos[ hostSpecificDeviceIndex ];
 
         PA_LOGAPI(("Pa_GetDeviceInfo returned:\n" ));
@@ -1023,7 +1049,7 @@ static PaError ValidateOpenStreamParameters(
     if( (sampleRate < 1000.0) || (sampleRate > 768000.0) )
         return paInvalidSampleRate;
 
-    if( ((streamFlags & ~paPlatformSpecificFlags) & ~(paClipOff | paDitherOff | paNeverDropInput | paPrimeOutputBuffersUsingStreamCallback ) ) != 0 )
+    if( ((streamFlags & ~paPlatformSpecificFlags) & ~(paClipOff | paDitherOff | paNeverDropInput | paPrimeOutputBuffersUsingStreamCallback | paLockMemory ) ) != 0 )
         return paInvalidFlag;
 
     if( streamFlags & paNeverDropInput )
@@ -1149,6 +1175,132 @@ PaError Pa_IsFormatSupported( const PaStreamParameters *inputParameters,
 }
 
 
+/* Frames of one direction of a blocking stream, staged for Pa_BeginReadStream and Pa_BeginWriteStream where
+   the host API can't hand out its own buffers */
+typedef struct PaUtilStagingDirection
+{
+    PaSampleFormat sampleFormat;    /* including paNonInterleaved */
+    int channelCount;               /* 0 if the stream has no such direction */
+    unsigned char *samples;         /* non-interleaved: one plane of capacity frames per channel */
+    unsigned long capacity;
+    void **channels;                /* non-interleaved: the pointers handed out */
+    unsigned long offset, frames;   /* input: the frames read but not yet committed
+                                       output: where the last Begin call's frames start, and the frames
+                                       committed to a stopped stream, to be written when it is started */
+    unsigned long granted;          /* frames handed out by the last Begin call, until it is committed */
+    int direct;                     /* bool: the frames handed out are the host API's own */
+    int staged;                     /* bool: the host API can't hand out its own buffers for the stream */
+}
+PaUtilStagingDirection;
+
+struct PaUtilStagingBuffer
+{
+    PaUtilStagingDirection input, output;
+};
+
+
+static void InitializeStagingDirection( PaUtilStagingDirection *direction, const PaStreamParameters *parameters )
+{
+    memset( direction, 0, sizeof (PaUtilStagingDirection) );
+    if( parameters )
+    {
+        direction->sampleFormat = parameters->sampleFormat;
+        direction->channelCount = parameters->channelCount;
+    }
+}
+
+
+static PaError AllocateStagingBuffer( PaStream *stream, const PaStreamParameters *inputParameters,
+        const PaStreamParameters *outputParameters )
+{
+    struct PaUtilStagingBuffer *stagingBuffer =
+            (struct PaUtilStagingBuffer*)PaUtil_AllocateZeroInitializedMemory( sizeof (struct PaUtilStagingBuffer) );
+    if( !stagingBuffer )
+        return paInsufficientMemory;
+
+    InitializeStagingDirection( &stagingBuffer->input, inputParameters );
+    InitializeStagingDirection( &stagingBuffer->output, outputParameters );
+    PA_STREAM_REP( stream )->stagingBuffer = stagingBuffer;
+    return paNoError;
+}
+
+
+static void FreeStagingBuffer( PaStream *stream )
+{
+    struct PaUtilStagingBuffer *stagingBuffer = PA_STREAM_REP( stream )->stagingBuffer;
+    if( stagingBuffer )
+    {
+        PaUtil_FreeMemory( stagingBuffer->input.samples );
+        PaUtil_FreeMemory( stagingBuffer->input.channels );
+        PaUtil_FreeMemory( stagingBuffer->output.samples );
+        PaUtil_FreeMemory( stagingBuffer->output.channels );
+        PaUtil_FreeMemory( stagingBuffer );
+        PA_STREAM_REP( stream )->stagingBuffer = 0;
+    }
+}
+
+
+/* Make room for staging frames after the first direction->frames frames, which are kept */
+static PaError ReserveStagedFrames( PaUtilStagingDirection *direction, unsigned long frames )
+{
+    frames += direction->frames;
+    if( frames > direction->capacity )
+    {
+        int sampleSize = Pa_GetSampleSize( direction->sampleFormat ), i;
+        unsigned char *samples = (unsigned char*)PaUtil_AllocateZeroInitializedMemory(
+                frames * direction->channelCount * sampleSize );
+        if( !samples )
+            return paInsufficientMemory;
+
+        if( (direction->sampleFormat & paNonInterleaved) && !direction->channels )
+        {
+            direction->channels = (void**)PaUtil_AllocateZeroInitializedMemory(
+                    direction->channelCount * sizeof (void*) );
+            if( !direction->channels )
+            {
+                PaUtil_FreeMemory( samples );
+                return paInsufficientMemory;
+            }
+        }
+
+        if( direction->frames > 0 )
+        {
+            if( !(direction->sampleFormat & paNonInterleaved) )
+            {
+                memcpy( samples, direction->samples, direction->frames * direction->channelCount * sampleSize );
+            }
+            else
+            {
+                for( i = 0; i < direction->channelCount; ++i )
+                    memcpy( samples + i * frames * sampleSize,
+                            direction->samples + i * direction->capacity * sampleSize,
+                            direction->frames * sampleSize );
+            }
+        }
+
+        PaUtil_FreeMemory( direction->samples );
+        direction->samples = samples;
+        direction->capacity = frames;
+    }
+    direction->offset = 0;
+    return paNoError;
+}
+
+
+/* The staged frames from offset, laid out as they are passed to Pa_ReadStream and Pa_WriteStream */
+static void *GetStagedFrames( PaUtilStagingDirection *direction, unsigned long offset )
+{
+    int sampleSize = Pa_GetSampleSize( direction->sampleFormat ), i;
+
+    if( !(direction->sampleFormat & paNonInterleaved) )
+        return direction->samples + offset * direction->channelCount * sampleSize;
+
+    for( i = 0; i < direction->channelCount; ++i )
+        direction->channels[i] = direction->samples + ( i * direction->capacity + offset ) * sampleSize;
+    return direction->channels;
+}
+
+
 PaError Pa_OpenStream( PaStream** stream,
                        const PaStreamParameters *inputParameters,
                        const PaStreamParameters *outputParameters,
@@ -1267,9 +1419,25 @@ PaError Pa_OpenStream( PaStream** stream,
         hostApiOutputParametersPtr = NULL;
     }
 
+    streamFlags |= defaultStreamFlags_;
+
+    /* API calls aren't made from real-time threads, so the caller can be given a trace ring here */
+    PA_TRACE_REGISTER_THREAD();
+    PA_TRACE_BEGIN( "Pa_OpenStream", 0, 0, 0, 0 );
     result = hostApi->OpenStream( hostApi, stream,
                                   hostApiInputParametersPtr, hostApiOutputParametersPtr,
                                   sampleRate, framesPerBuffer, streamFlags, streamCallback, userData );
+    PA_TRACE_END( "Pa_OpenStream returned %ld", result, 0, 0, 0 );
+
+    if( result == paNoError && !streamCallback )
+    {
+        result = AllocateStagingBuffer( *stream, inputParameters, outputParameters );
+        if( result != paNoError )
+        {
+            PA_STREAM_INTERFACE(*stream)->Close( *stream );
+            *stream = NULL;
+        }
+    }
 
     if( result == paNoError )
         AddOpenStream( *stream );
@@ -1404,7 +1572,14 @@ PaError Pa_CloseStream( PaStream* stream )
             result = interface->Abort( stream );
 
         if( result == paNoError )                 /** @todo REVIEW: shouldn't we close anyway? see: http://www.portaudio.com/trac/ticket/115 */
+        {
+            FreeStagingBuffer( stream );
+
+            PA_TRACE_REGISTER_THREAD();
+            PA_TRACE_BEGIN( "Pa_CloseStream", 0, 0, 0, 0 );
             result = interface->Close( stream );
+            PA_TRACE_END( "Pa_CloseStream returned %ld", result, 0, 0, 0 );
+        }
     }
 
     PA_LOGAPI_EXIT_PAERROR( "Pa_CloseStream", result );
@@ -1458,7 +1633,30 @@ PaError Pa_StartStream( PaStream *stream )
         }
         else if( result == 1 )
         {
+            struct PaUtilStagingBuffer *stagingBuffer = PA_STREAM_REP( stream )->stagingBuffer;
+            if( stagingBuffer )
+            {
+                /* Frames left over from before the stream was stopped are stale, except for output that was
+                   staged to prefill the stream, see Pa_BeginWriteStream */
+                stagingBuffer->input.offset = stagingBuffer->input.frames = stagingBuffer->input.granted = 0;
+                if( stagingBuffer->output.direct )
+                    stagingBuffer->output.granted = 0;
+            }
+
+            PA_TRACE_REGISTER_THREAD();
+            PA_TRACE_BEGIN( "Pa_StartStream", 0, 0, 0, 0 );
             result = PA_STREAM_INTERFACE(stream)->Start( stream );
+            PA_TRACE_END( "Pa_StartStream returned %ld", result, 0, 0, 0 );
+
+            /* Write the frames that were committed to prefill the stream, see Pa_CommitWriteStream */
+            if( result == paNoError && stagingBuffer && stagingBuffer->output.frames > 0 )
+            {
+                result = PA_STREAM_INTERFACE(stream)->Write( stream,
+                        GetStagedFrames( &stagingBuffer->output, 0 ), stagingBuffer->output.frames );
+                stagingBuffer->output.frames = 0;
+                if( result == paOutputUnderflowed )
+                    result = paNoError;
+            }
         }
     }
 
@@ -1480,7 +1678,10 @@ PaError Pa_StopStream( PaStream *stream )
         result = PA_STREAM_INTERFACE(stream)->IsStopped( stream );
         if( result == 0 )
         {
+            PA_TRACE_REGISTER_THREAD();
+            PA_TRACE_BEGIN( "Pa_StopStream", 0, 0, 0, 0 );
             result = PA_STREAM_INTERFACE(stream)->Stop( stream );
+            PA_TRACE_END( "Pa_StopStream returned %ld", result, 0, 0, 0 );
         }
         else if( result == 1 )
         {
@@ -1506,7 +1707,10 @@ PaError Pa_AbortStream( PaStream *stream )
         result = PA_STREAM_INTERFACE(stream)->IsStopped( stream );
         if( result == 0 )
         {
+            PA_TRACE_REGISTER_THREAD();
+            PA_TRACE_BEGIN( "Pa_AbortStream", 0, 0, 0, 0 );
             result = PA_STREAM_INTERFACE(stream)->Abort( stream );
+            PA_TRACE_END( "Pa_AbortStream returned %ld", result, 0, 0, 0 );
         }
         else if( result == 1 )
         {
@@ -1648,6 +1852,34 @@ double Pa_GetStreamCpuLoad( PaStream* stream )
 }
 
 
+PaError Pa_GetStreamStatistics( PaStream *stream, PaStreamStatistics *statistics )
+{
+    PaError result = PaUtil_ValidateStreamPointer( stream );
+
+    PA_LOGAPI_ENTER_PARAMS( "Pa_GetStreamStatistics" );
+    PA_LOGAPI(("\tPaStream* stream: 0x%p\n", stream ));
+    PA_LOGAPI(("\tPaStreamStatistics* statistics: 0x%p\n", statistics ));
+
+    if( result == paNoError && statistics == NULL )
+        result = paBadBufferPtr;
+
+    if( result == paNoError )
+    {
+        memset( statistics, 0, sizeof(PaStreamStatistics) );
+        statistics->structVersion = 1;
+
+        if( PA_STREAM_REP( stream )->cpuLoadMeasurer )
+            PaUtil_GetCpuLoadStatistics( PA_STREAM_REP( stream )->cpuLoadMeasurer, statistics );
+
+        statistics->lockedMemoryBytes = PaUtil_GetLockedMemoryByteCount();
+    }
+
+    PA_LOGAPI_EXIT_PAERROR( "Pa_GetStreamStatistics", result );
+
+    return result;
+}
+
+
 PaError Pa_ReadStream( PaStream* stream,
                        void *buffer,
                        unsigned long frames )
@@ -1727,6 +1959,233 @@ PaError Pa_WriteStream( PaStream* stream,
     return result;
 }
 
+PaError Pa_BeginReadStream( PaStream* stream,
+                            const void **buffer,
+                            unsigned long *frames )
+{
+    PaError result = PaUtil_ValidateStreamPointer( stream );
+    PaUtilStagingDirection *direction;
+    PaUtilStreamInterface *interface;
+
+    PA_LOGAPI_ENTER_PARAMS( "Pa_BeginReadStream" );
+    PA_LOGAPI(("\tPaStream* stream: 0x%p\n", stream ));
+
+    if( result != paNoError )
+        goto done;
+
+    if( buffer == 0 || frames == 0 || *frames == 0 )
+    {
+        result = paBadBufferPtr;
+        goto done;
+    }
+    if( !PA_STREAM_REP( stream )->stagingBuffer )
+    {
+        result = paCanNotReadFromACallbackStream;
+        goto done;
+    }
+    direction = &PA_STREAM_REP( stream )->stagingBuffer->input;
+    if( direction->channelCount == 0 )
+    {
+        result = paCanNotReadFromAnOutputOnlyStream;
+        goto done;
+    }
+
+    interface = PA_STREAM_INTERFACE(stream);
+    result = interface->IsStopped( stream );
+    if( result == 1 )
+        result = paStreamIsStopped;
+    if( result != 0 )
+        goto done;
+
+    if( interface->BeginRead && !direction->staged )
+    {
+        result = interface->BeginRead( stream, buffer, frames );
+        if( result != paSampleFormatNotSupported )
+        {
+            direction->direct = 1;
+            direction->granted = ( result == paNoError || result == paInputOverflowed ) ? *frames : 0;
+            goto done;
+        }
+        direction->staged = 1;
+        result = paNoError;
+    }
+
+    if( direction->frames == 0 )
+    {
+        result = ReserveStagedFrames( direction, *frames );
+        if( result != paNoError )
+            goto done;
+        result = interface->Read( stream, GetStagedFrames( direction, 0 ), *frames );
+        if( result != paNoError && result != paInputOverflowed )
+            goto done;
+        direction->frames = *frames;
+    }
+
+    direction->direct = 0;
+    direction->granted = *frames < direction->frames ? *frames : direction->frames;
+    *buffer = GetStagedFrames( direction, direction->offset );
+    *frames = direction->granted;
+
+done:
+    PA_LOGAPI_EXIT_PAERROR( "Pa_BeginReadStream", result );
+
+    return result;
+}
+
+
+PaError Pa_CommitReadStream( PaStream* stream, unsigned long frames )
+{
+    PaError result = PaUtil_ValidateStreamPointer( stream );
+    PaUtilStagingDirection *direction;
+
+    PA_LOGAPI_ENTER_PARAMS( "Pa_CommitReadStream" );
+    PA_LOGAPI(("\tPaStream* stream: 0x%p\n", stream ));
+
+    if( result == paNoError )
+    {
+        direction = PA_STREAM_REP( stream )->stagingBuffer ? &PA_STREAM_REP( stream )->stagingBuffer->input : 0;
+        if( !direction || direction->granted == 0 || frames > direction->granted )
+        {
+            result = paBadBufferPtr;
+        }
+        else
+        {
+            direction->granted = 0;
+            if( direction->direct )
+            {
+                result = PA_STREAM_INTERFACE(stream)->CommitRead( stream, frames );
+            }
+            else
+            {
+                direction->offset += frames;
+                direction->frames -= frames;
+            }
+        }
+    }
+
+    PA_LOGAPI_EXIT_PAERROR( "Pa_CommitReadStream", result );
+
+    return result;
+}
+
+
+PaError Pa_BeginWriteStream( PaStream* stream,
+                             void **buffer,
+                             unsigned long *frames )
+{
+    PaError result = PaUtil_ValidateStreamPointer( stream );
+    PaUtilStagingDirection *direction;
+    PaUtilStreamInterface *interface;
+    int stopped;
+
+    PA_LOGAPI_ENTER_PARAMS( "Pa_BeginWriteStream" );
+    PA_LOGAPI(("\tPaStream* stream: 0x%p\n", stream ));
+
+    if( result != paNoError )
+        goto done;
+
+    if( buffer == 0 || frames == 0 || *frames == 0 )
+    {
+        result = paBadBufferPtr;
+        goto done;
+    }
+    if( !PA_STREAM_REP( stream )->stagingBuffer )
+    {
+        result = paCanNotWriteToACallbackStream;
+        goto done;
+    }
+    direction = &PA_STREAM_REP( stream )->stagingBuffer->output;
+    if( direction->channelCount == 0 )
+    {
+        result = paCanNotWriteToAnInputOnlyStream;
+        goto done;
+    }
+
+    /* A stopped stream gets the staging buffer, so that it can be prefilled. The frames committed
+       to it are written by Pa_StartStream */
+    interface = PA_STREAM_INTERFACE(stream);
+    stopped = interface->IsStopped( stream );
+    if( stopped < 0 )
+    {
+        result = stopped;
+        goto done;
+    }
+
+    if( interface->BeginWrite && !direction->staged && !stopped )
+    {
+        result = interface->BeginWrite( stream, buffer, frames );
+        if( result != paSampleFormatNotSupported )
+        {
+            direction->direct = 1;
+            direction->granted = ( result == paNoError || result == paOutputUnderflowed ) ? *frames : 0;
+            goto done;
+        }
+        direction->staged = 1;
+        result = paNoError;
+    }
+
+    /* The frames are written with Pa_WriteStream once they are committed, after any frames that were
+       committed to prefill the stream */
+    result = ReserveStagedFrames( direction, *frames );
+    if( result != paNoError )
+        goto done;
+    direction->direct = 0;
+    direction->granted = *frames;
+    direction->offset = direction->frames;
+    *buffer = GetStagedFrames( direction, direction->offset );
+
+done:
+    PA_LOGAPI_EXIT_PAERROR( "Pa_BeginWriteStream", result );
+
+    return result;
+}
+
+
+PaError Pa_CommitWriteStream( PaStream* stream, unsigned long frames )
+{
+    PaError result = PaUtil_ValidateStreamPointer( stream );
+    PaUtilStagingDirection *direction;
+
+    PA_LOGAPI_ENTER_PARAMS( "Pa_CommitWriteStream" );
+    PA_LOGAPI(("\tPaStream* stream: 0x%p\n", stream ));
+
+    if( result == paNoError )
+    {
+        direction = PA_STREAM_REP( stream )->stagingBuffer ? &PA_STREAM_REP( stream )->stagingBuffer->output : 0;
+        if( !direction || direction->granted == 0 || frames > direction->granted )
+        {
+            result = paBadBufferPtr;
+        }
+        else if( direction->direct )
+        {
+            direction->granted = 0;
+            result = PA_STREAM_INTERFACE(stream)->CommitWrite( stream, frames );
+        }
+        else if( frames > 0 && (result = PA_STREAM_INTERFACE(stream)->IsStopped( stream )) != 0 )
+        {
+            /* Keep the frames, Pa_StartStream writes them */
+            if( result == 1 )
+            {
+                direction->granted = 0;
+                direction->frames = direction->offset + frames;
+                result = paNoError;
+            }
+        }
+        else
+        {
+            direction->granted = 0;
+            if( frames > 0 )
+                result = PA_STREAM_INTERFACE(stream)->Write( stream,
+                        GetStagedFrames( direction, direction->offset ), frames );
+        }
+    }
+
+    PA_LOGAPI_EXIT_PAERROR( "Pa_CommitWriteStream", result );
+
+    return result;
+}
+
+
 signed long Pa_GetStreamReadAvailable( PaStream* stream )
 {
     PaError error = PaUtil_ValidateStreamPointer( stream );
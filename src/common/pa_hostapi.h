@@ -329,6 +329,17 @@ typedef struct PaUtilHostApiRepresentation {
                                   const PaStreamParameters *inputParameters,
                                   const PaStreamParameters *outputParameters,
                                   double sampleRate );
+
+    /**
+        (*PrepareDeviceInfo)() is optional and may be NULL. If supplied, it is
+        called by Pa_GetDeviceInfo() before deviceInfos[device] is returned, so
+        that an implementation can defer determining device capabilities which
+        are expensive to probe until they are first needed. device is a 0 based
+        index within the host api's own device index range. It may be called
+        from several threads at once, so the implementation must serialize
+        the probing and must not leave deviceInfos[device] partially written.
+    */
+    void (*PrepareDeviceInfo)( struct PaUtilHostApiRepresentation *hostApi, int device );
 } PaUtilHostApiRepresentation;
 
 
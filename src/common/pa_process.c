@@ -49,6 +49,13 @@
 
 #include "pa_process.h"
 #include "pa_util.h"
+#include "pa_allocation.h"
+#include "pa_trace.h"
+
+
+/* temp buffers are aligned to a cache line so that they don't share lines
+    with the buffer processor's bookkeeping data */
+#define PA_TEMP_BUFFER_ALIGNMENT_   64
 
 
 #define PA_FRAMES_PER_TEMP_BUFFER_WHEN_HOST_BUFFER_SIZE_IS_UNKNOWN_    1024
@@ -112,6 +119,16 @@ PaError PaUtil_InitializeBufferProcessor( PaUtilBufferProcessor* bp,
             return paInvalidFlag;
     }
 
+    /* all buffers are allocated from a per buffer processor allocation group */
+    bp->allocations = PaUtil_CreateAllocationGroup();
+    if( !bp->allocations )
+        return paInsufficientMemory;
+
+    /* buffers are locked as the group acquires them. failing to lock isn't
+        fatal, the memory is still prefaulted */
+    if( streamFlags & paLockMemory )
+        PaUtil_LockAllocationGroupMemory( bp->allocations );
+
     /* initialize buffer ptrs to zero so they can be freed if necessary in error */
     bp->tempInputBuffer = 0;
     bp->tempInputBufferPtrs = 0;
@@ -249,7 +266,8 @@ PaError PaUtil_InitializeBufferProcessor( PaUtilBufferProcessor* bp,
         tempInputBufferSize =
             bp->framesPerTempBuffer * bp->bytesPerUserInputSample * inputChannelCount;
 
-        bp->tempInputBuffer = PaUtil_AllocateZeroInitializedMemory( tempInputBufferSize );
+        bp->tempInputBuffer = PaUtil_GroupAllocateAlignedZeroInitializedMemory( bp->allocations,
+                tempInputBufferSize, PA_TEMP_BUFFER_ALIGNMENT_ );
         if( bp->tempInputBuffer == 0 )
         {
             result = paInsufficientMemory;
@@ -265,7 +283,7 @@ PaError PaUtil_InitializeBufferProcessor( PaUtilBufferProcessor* bp,
         if( userInputSampleFormat & paNonInterleaved )
         {
             bp->tempInputBufferPtrs =
-                (void **)PaUtil_AllocateZeroInitializedMemory( sizeof(void*)*inputChannelCount );
+                (void **)PaUtil_GroupAllocateZeroInitializedMemory( bp->allocations, sizeof(void*)*inputChannelCount );
             if( bp->tempInputBufferPtrs == 0 )
             {
                 result = paInsufficientMemory;
@@ -274,7 +292,7 @@ PaError PaUtil_InitializeBufferProcessor( PaUtilBufferProcessor* bp,
         }
 
         bp->hostInputChannels[0] = (PaUtilChannelDescriptor*)
-                PaUtil_AllocateZeroInitializedMemory( sizeof(PaUtilChannelDescriptor) * inputChannelCount * 2);
+                PaUtil_GroupAllocateZeroInitializedMemory( bp->allocations, sizeof(PaUtilChannelDescriptor) * inputChannelCount * 2 );
         if( bp->hostInputChannels[0] == 0 )
         {
             result = paInsufficientMemory;
@@ -322,7 +340,8 @@ PaError PaUtil_InitializeBufferProcessor( PaUtilBufferProcessor* bp,
         tempOutputBufferSize =
                 bp->framesPerTempBuffer * bp->bytesPerUserOutputSample * outputChannelCount;
 
-        bp->tempOutputBuffer = PaUtil_AllocateZeroInitializedMemory( tempOutputBufferSize );
+        bp->tempOutputBuffer = PaUtil_GroupAllocateAlignedZeroInitializedMemory( bp->allocations,
+                tempOutputBufferSize, PA_TEMP_BUFFER_ALIGNMENT_ );
         if( bp->tempOutputBuffer == 0 )
         {
             result = paInsufficientMemory;
@@ -338,7 +357,7 @@ PaError PaUtil_InitializeBufferProcessor( PaUtilBufferProcessor* bp,
         if( userOutputSampleFormat & paNonInterleaved )
         {
             bp->tempOutputBufferPtrs =
-                (void **)PaUtil_AllocateZeroInitializedMemory( sizeof(void*)*outputChannelCount );
+                (void **)PaUtil_GroupAllocateZeroInitializedMemory( bp->allocations, sizeof(void*)*outputChannelCount );
             if( bp->tempOutputBufferPtrs == 0 )
             {
                 result = paInsufficientMemory;
@@ -347,7 +366,7 @@ PaError PaUtil_InitializeBufferProcessor( PaUtilBufferProcessor* bp,
         }
 
         bp->hostOutputChannels[0] = (PaUtilChannelDescriptor*)
-                PaUtil_AllocateZeroInitializedMemory( sizeof(PaUtilChannelDescriptor)*outputChannelCount * 2 );
+                PaUtil_GroupAllocateZeroInitializedMemory( bp->allocations, sizeof(PaUtilChannelDescriptor)*outputChannelCount * 2 );
         if( bp->hostOutputChannels[0] == 0 )
         {
             result = paInsufficientMemory;
@@ -367,23 +386,12 @@ PaError PaUtil_InitializeBufferProcessor( PaUtilBufferProcessor* bp,
     return result;
 
 error:
-    if( bp->tempInputBuffer )
-        PaUtil_FreeMemory( bp->tempInputBuffer );
-
-    if( bp->tempInputBufferPtrs )
-        PaUtil_FreeMemory( bp->tempInputBufferPtrs );
-
-    if( bp->hostInputChannels[0] )
-        PaUtil_FreeMemory( bp->hostInputChannels[0] );
-
-    if( bp->tempOutputBuffer )
-        PaUtil_FreeMemory( bp->tempOutputBuffer );
-
-    if( bp->tempOutputBufferPtrs )
-        PaUtil_FreeMemory( bp->tempOutputBufferPtrs );
-
-    if( bp->hostOutputChannels[0] )
-        PaUtil_FreeMemory( bp->hostOutputChannels[0] );
+    if( bp->allocations )
+    {
+        PaUtil_FreeAllAllocations( bp->allocations );
+        PaUtil_DestroyAllocationGroup( bp->allocations );
+        bp->allocations = 0;
+    }
 
     return result;
 }
@@ -391,23 +399,12 @@ error:
 
 void PaUtil_TerminateBufferProcessor( PaUtilBufferProcessor* bp )
 {
-    if( bp->tempInputBuffer )
-        PaUtil_FreeMemory( bp->tempInputBuffer );
-
-    if( bp->tempInputBufferPtrs )
-        PaUtil_FreeMemory( bp->tempInputBufferPtrs );
-
-    if( bp->hostInputChannels[0] )
-        PaUtil_FreeMemory( bp->hostInputChannels[0] );
-
-    if( bp->tempOutputBuffer )
-        PaUtil_FreeMemory( bp->tempOutputBuffer );
-
-    if( bp->tempOutputBufferPtrs )
-        PaUtil_FreeMemory( bp->tempOutputBufferPtrs );
-
-    if( bp->hostOutputChannels[0] )
-        PaUtil_FreeMemory( bp->hostOutputChannels[0] );
+    if( bp->allocations )
+    {
+        PaUtil_FreeAllAllocations( bp->allocations );
+        PaUtil_DestroyAllocationGroup( bp->allocations );
+        bp->allocations = 0;
+    }
 }
 
 
@@ -434,6 +431,28 @@ void PaUtil_ResetBufferProcessor( PaUtilBufferProcessor* bp )
 }
 
 
+void PaUtil_SetBufferProcessorHostBufferSizeUnknown( PaUtilBufferProcessor* bp )
+{
+    if( bp->hostBufferSizeMode != paUtilFixedHostBufferSize )
+        return;
+
+    bp->hostBufferSizeMode = paUtilUnknownHostBufferSize;
+
+    /* the temp buffers always hold framesPerUserBuffer frames, as needed by
+        AdaptingProcess */
+    if( bp->framesPerUserBuffer == 0 || !bp->useNonAdaptingProcess )
+        return;
+
+    bp->useNonAdaptingProcess = 0;
+    if( bp->inputChannelCount > 0 && bp->outputChannelCount > 0 )
+    {
+        /* as for a variable host buffer size in PaUtil_InitializeBufferProcessor */
+        bp->initialFramesInTempOutputBuffer = bp->framesPerUserBuffer;
+        PaUtil_ResetBufferProcessor( bp );
+    }
+}
+
+
 unsigned long PaUtil_GetBufferProcessorInputLatencyFrames( PaUtilBufferProcessor* bp )
 {
     return bp->initialFramesInTempInputBuffer;
@@ -876,8 +895,10 @@ static unsigned long NonAdaptingProcess( PaUtilBufferProcessor *bp,
                 }
             }
 
+            PA_TRACE_BEGIN( "stream callback, %lu frames", frameCount, 0, 0, 0 );
             *streamCallbackResult = bp->streamCallback( userInput, userOutput,
                     frameCount, bp->timeInfo, bp->callbackStatusFlags, bp->userData );
+            PA_TRACE_END( "stream callback returned %ld", *streamCallbackResult, 0, 0, 0 );
 
             if( *streamCallbackResult == paAbort )
             {
@@ -1058,9 +1079,11 @@ static unsigned long AdaptingInputOnlyProcess( PaUtilBufferProcessor *bp,
             {
                 bp->timeInfo->outputBufferDacTime = 0;
 
+                PA_TRACE_BEGIN( "stream callback, %lu frames", bp->framesPerUserBuffer, 0, 0, 0 );
                 *streamCallbackResult = bp->streamCallback( userInput, userOutput,
                         bp->framesPerUserBuffer, bp->timeInfo,
                         bp->callbackStatusFlags, bp->userData );
+                PA_TRACE_END( "stream callback returned %ld", *streamCallbackResult, 0, 0, 0 );
 
                 bp->timeInfo->inputBufferAdcTime += bp->framesPerUserBuffer * bp->samplePeriod;
             }
@@ -1120,9 +1143,11 @@ static unsigned long AdaptingOutputOnlyProcess( PaUtilBufferProcessor *bp,
 
             bp->timeInfo->inputBufferAdcTime = 0;
 
+            PA_TRACE_BEGIN( "stream callback, %lu frames", bp->framesPerUserBuffer, 0, 0, 0 );
             *streamCallbackResult = bp->streamCallback( userInput, userOutput,
                     bp->framesPerUserBuffer, bp->timeInfo,
                     bp->callbackStatusFlags, bp->userData );
+            PA_TRACE_END( "stream callback returned %ld", *streamCallbackResult, 0, 0, 0 );
 
             if( *streamCallbackResult == paAbort )
             {
@@ -1454,9 +1479,11 @@ static unsigned long AdaptingProcess( PaUtilBufferProcessor *bp,
 
                 /* call streamCallback */
 
+                PA_TRACE_BEGIN( "stream callback, %lu frames", bp->framesPerUserBuffer, 0, 0, 0 );
                 *streamCallbackResult = bp->streamCallback( userInput, userOutput,
                         bp->framesPerUserBuffer, bp->timeInfo,
                         bp->callbackStatusFlags, bp->userData );
+                PA_TRACE_END( "stream callback returned %ld", *streamCallbackResult, 0, 0, 0 );
 
                 bp->timeInfo->inputBufferAdcTime += bp->framesPerUserBuffer * bp->samplePeriod;
                 bp->timeInfo->outputBufferDacTime += bp->framesPerUserBuffer * bp->samplePeriod;
@@ -1504,6 +1531,8 @@ unsigned long PaUtil_EndBufferProcessing( PaUtilBufferProcessor* bp, int *stream
             || *streamCallbackResult == paComplete
             || *streamCallbackResult == paAbort ); /* don't forget to pass in a valid callback result value */
 
+    PA_TRACE_BEGIN( "buffer processor", 0, 0, 0, 0 );
+
     if( bp->useNonAdaptingProcess )
     {
         if( bp->inputChannelCount != 0 && bp->outputChannelCount != 0 )
@@ -1655,6 +1684,8 @@ unsigned long PaUtil_EndBufferProcessing( PaUtilBufferProcessor* bp, int *stream
         }
     }
 
+    PA_TRACE_END( "buffer processor processed %lu frames", framesProcessed, 0, 0, 0 );
+
     return framesProcessed;
 }
 
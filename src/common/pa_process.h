@@ -277,6 +277,8 @@ typedef struct {
     unsigned long initialFramesInTempInputBuffer;
     unsigned long initialFramesInTempOutputBuffer;
 
+    struct PaUtilAllocationGroup *allocations; /**< owns the temp buffers and channel descriptors */
+
     void *tempInputBuffer;          /**< used for slips, block adaption, and conversion. */
     void **tempInputBufferPtrs;     /**< storage for non-interleaved buffer pointers, NULL for interleaved user input */
     unsigned long framesInTempInputBuffer; /**< frames remaining in input buffer from previous adaption iteration */
@@ -406,6 +408,20 @@ void PaUtil_TerminateBufferProcessor( PaUtilBufferProcessor* bufferProcessor );
 void PaUtil_ResetBufferProcessor( PaUtilBufferProcessor* bufferProcessor );
 
 
+/** Tell a buffer processor initialized with paUtilFixedHostBufferSize that
+ the host buffer size has changed. From then on it behaves as if it had been
+ initialized with paUtilUnknownHostBufferSize, adapting host buffers of any
+ size to the user buffer size. For full duplex streams this adds
+ framesPerUserBuffer frames of silence to the output.
+
+ Doesn't allocate memory, so it may be called from the processing thread,
+ but not between PaUtil_BeginBufferProcessing and PaUtil_EndBufferProcessing.
+
+ @param bufferProcessor The buffer processor to switch over.
+*/
+void PaUtil_SetBufferProcessorHostBufferSizeUnknown( PaUtilBufferProcessor* bufferProcessor );
+
+
 /** Retrieve the input latency of a buffer processor, in frames.
 
  @param bufferProcessor The buffer processor examine.
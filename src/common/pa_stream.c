@@ -74,6 +74,23 @@ void PaUtil_InitializeStreamInterface( PaUtilStreamInterface *streamInterface,
     streamInterface->Write = Write;
     streamInterface->GetReadAvailable = GetReadAvailable;
     streamInterface->GetWriteAvailable = GetWriteAvailable;
+    streamInterface->BeginRead = 0;
+    streamInterface->CommitRead = 0;
+    streamInterface->BeginWrite = 0;
+    streamInterface->CommitWrite = 0;
+}
+
+
+void PaUtil_SetDirectStreamInterface( PaUtilStreamInterface *streamInterface,
+                                      PaError (*BeginRead)( PaStream*, const void **, unsigned long * ),
+                                      PaError (*CommitRead)( PaStream*, unsigned long ),
+                                      PaError (*BeginWrite)( PaStream*, void **, unsigned long * ),
+                                      PaError (*CommitWrite)( PaStream*, unsigned long ) )
+{
+    streamInterface->BeginRead = BeginRead;
+    streamInterface->CommitRead = CommitRead;
+    streamInterface->BeginWrite = BeginWrite;
+    streamInterface->CommitWrite = CommitWrite;
 }
 
 
@@ -93,6 +110,9 @@ void PaUtil_InitializeStreamRepresentation( PaUtilStreamRepresentation *streamRe
     streamRepresentation->streamInfo.inputLatency = 0.;
     streamRepresentation->streamInfo.outputLatency = 0.;
     streamRepresentation->streamInfo.sampleRate = 0.;
+
+    streamRepresentation->cpuLoadMeasurer = 0;
+    streamRepresentation->stagingBuffer = 0;
 }
 
 
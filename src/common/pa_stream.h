@@ -77,6 +77,15 @@ typedef struct {
     PaError (*Write)( PaStream* stream, const void *buffer, unsigned long frames );
     signed long (*GetReadAvailable)( PaStream* stream );
     signed long (*GetWriteAvailable)( PaStream* stream );
+
+    /* Direct access to the host's buffers for Pa_BeginReadStream and friends, 0 if not supported. The Begin
+     functions return paSampleFormatNotSupported for streams whose buffers can't be handed out as they are,
+     in which case pa_front stages the frames and uses Read and Write instead.
+     @see PaUtil_SetDirectStreamInterface */
+    PaError (*BeginRead)( PaStream* stream, const void **buffer, unsigned long *frames );
+    PaError (*CommitRead)( PaStream* stream, unsigned long frames );
+    PaError (*BeginWrite)( PaStream* stream, void **buffer, unsigned long *frames );
+    PaError (*CommitWrite)( PaStream* stream, unsigned long frames );
 } PaUtilStreamInterface;
 
 
@@ -97,6 +106,16 @@ void PaUtil_InitializeStreamInterface( PaUtilStreamInterface *streamInterface,
     signed long (*GetWriteAvailable)( PaStream* stream ) );
 
 
+/** Set the functions giving direct access to the host's buffers of a blocking
+ stream interface. PaUtil_InitializeStreamInterface leaves them unset.
+*/
+void PaUtil_SetDirectStreamInterface( PaUtilStreamInterface *streamInterface,
+    PaError (*BeginRead)( PaStream* stream, const void **buffer, unsigned long *frames ),
+    PaError (*CommitRead)( PaStream* stream, unsigned long frames ),
+    PaError (*BeginWrite)( PaStream* stream, void **buffer, unsigned long *frames ),
+    PaError (*CommitWrite)( PaStream* stream, unsigned long frames ) );
+
+
 /** Dummy Read function for use in interfaces to a callback based streams.
  Pass to the Read parameter of PaUtil_InitializeStreamInterface.
  @return An error code indicating that the function has no effect
@@ -152,6 +171,8 @@ typedef struct PaUtilStreamRepresentation {
     PaStreamFinishedCallback *streamFinishedCallback;
     void *userData;
     PaStreamInfo streamInfo;
+    struct PaUtilCpuLoadMeasurer *cpuLoadMeasurer; /**< used by Pa_GetStreamStatistics, may be 0 */
+    struct PaUtilStagingBuffer *stagingBuffer; /**< used by pa_front for Pa_BeginReadStream and Pa_BeginWriteStream, may be 0 */
 } PaUtilStreamRepresentation;
 
 
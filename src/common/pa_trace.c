@@ -46,185 +46,416 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdarg.h>
 #include <string.h>
 #include <assert.h>
 #include "pa_trace.h"
 #include "pa_util.h"
 #include "pa_debugprint.h"
+#include "pa_memorybarrier.h"
+#include "pa_atomic.h"
 
-#if PA_TRACE_REALTIME_EVENTS
+#if defined(_MSC_VER) && (_MSC_VER < 1900)
+#define snprintf _snprintf
+#endif
 
-static char const *traceTextArray[PA_MAX_TRACE_RECORDS];
-static int traceIntArray[PA_MAX_TRACE_RECORDS];
-static int traceIndex = 0;
-static int traceBlock = 0;
+#if PA_TRACE_EVENTS
 
-/*********************************************************************/
-void PaUtil_ResetTraceMessages()
+#if defined(_MSC_VER)
+#define PA_THREAD_LOCAL_ __declspec(thread)
+#else
+#define PA_THREAD_LOCAL_ __thread
+#endif
+
+#define PA_TRACE_EVENT_ARG_COUNT_   (4)
+
+typedef struct PaUtilTraceRecord
 {
-    traceIndex = 0;
+    PaInt64 timestamp; /* nanoseconds, from PaUtil_GetNanoseconds */
+    const char *format;
+    long args[ PA_TRACE_EVENT_ARG_COUNT_ ];
+    int phase;
+} PaUtilTraceRecord;
+
+/* A ring is written only by the thread which owns it. writeIndex counts the
+   events ever written, it is published after the record is complete so that
+   readers can copy the ring and then detect which records were overwritten
+   while they were copying. */
+typedef struct PaUtilTraceRing
+{
+    struct PaUtilTraceRing *next;
+    volatile long owned;
+    const char *threadName;
+    long ringId;
+    volatile unsigned long writeIndex;
+    PaUtilTraceRecord records[ PA_TRACE_RING_RECORDS ];
+} PaUtilTraceRing;
+
+volatile int paUtilTraceEventsEnabled = 0;
+
+static PaUtilTraceRing * volatile rings_ = 0;
+static volatile long ringCount_ = 0;
+static volatile long generation_ = 0; /* incremented when the rings are freed */
+
+static PA_THREAD_LOCAL_ PaUtilTraceRing *threadRing_ = 0;
+static PA_THREAD_LOCAL_ long threadGeneration_ = -1;
+
+
+void PaUtil_EnableTraceEvents( int enable )
+{
+    paUtilTraceEventsEnabled = enable;
 }
 
-/*********************************************************************/
-void PaUtil_DumpTraceMessages()
+
+static PaUtilTraceRing* ClaimRing( const char *threadName )
 {
-    int i;
-    int messageCount = (traceIndex < PA_MAX_TRACE_RECORDS) ? traceIndex : PA_MAX_TRACE_RECORDS;
+    PaUtilTraceRing *ring = 0;
 
-    printf("DumpTraceMessages: traceIndex = %d\n", traceIndex );
-    for( i=0; i<messageCount; i++ )
+    if( ringCount_ >= PA_TRACE_MAX_RINGS )
     {
-        printf("%3d: %s = 0x%08X\n",
-               i, traceTextArray[i], traceIntArray[i] );
+        for( ring = rings_; ring != 0; ring = ring->next )
+        {
+            if( !ring->owned && PaUtil_AtomicCompareAndSwapLong( &ring->owned, 0, 1 ) )
+            {
+                ring->writeIndex = 0;
+                break;
+            }
+        }
     }
-    PaUtil_ResetTraceMessages();
-    fflush(stdout);
+
+    if( !ring )
+    {
+        ring = (PaUtilTraceRing*)PaUtil_AllocateZeroInitializedMemory( sizeof(PaUtilTraceRing) );
+        if( !ring )
+            return 0;
+
+        ring->owned = 1;
+        ring->ringId = PaUtil_AtomicAddLong( &ringCount_, 1 );
+        do{
+            ring->next = rings_;
+        }while( !PaUtil_AtomicCompareAndSwapPointer( &rings_, ring->next, ring ) );
+    }
+
+    ring->threadName = threadName;
+    threadRing_ = ring;
+    threadGeneration_ = generation_;
+    return ring;
 }
 
-/*********************************************************************/
-void PaUtil_AddTraceMessage( const char *msg, int data )
+
+void PaUtil_RegisterTraceThread( const char *threadName )
 {
-    if( (traceIndex == PA_MAX_TRACE_RECORDS) && (traceBlock == 0) )
+    if( threadRing_ && threadGeneration_ == generation_ )
     {
-        traceBlock = 1;
-        /*  PaUtil_DumpTraceMessages(); */
+        if( threadName )
+            threadRing_->threadName = threadName;
     }
-    else if( traceIndex < PA_MAX_TRACE_RECORDS )
+    else
+        ClaimRing( threadName );
+}
+
+
+void PaUtil_UnregisterTraceThread( void )
+{
+    if( threadRing_ && threadGeneration_ == generation_ )
     {
-        traceTextArray[traceIndex] = msg;
-        traceIntArray[traceIndex] = data;
-        traceIndex++;
+        PaUtil_FullMemoryBarrier();
+        threadRing_->owned = 0;
     }
+    threadRing_ = 0;
 }
 
-/************************************************************************/
-/* High performance log alternative                                     */
-/************************************************************************/
 
-typedef unsigned long long  PaUint64;
+void PaUtil_TraceEvent( int phase, const char *format, long arg0, long arg1, long arg2, long arg3 )
+{
+    PaUtilTraceRing *ring = threadRing_;
+    PaUtilTraceRecord *record;
+    unsigned long index;
+
+    /* Claiming a ring may allocate, which real-time threads must not do, so the
+       events of threads which haven't registered are dropped */
+    if( !ring || threadGeneration_ != generation_ )
+        return;
+
+    index = ring->writeIndex;
+    record = &ring->records[ index & (PA_TRACE_RING_RECORDS - 1) ];
+    record->timestamp = PaUtil_GetNanoseconds();
+    record->format = format;
+    record->phase = phase;
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    record->args[2] = arg2;
+    record->args[3] = arg3;
+    PaUtil_WriteMemoryBarrier();
+    ring->writeIndex = index + 1;
+}
 
-typedef struct __PaHighPerformanceLog
+
+typedef struct PaUtilTraceDumpRecord
 {
-    unsigned    magik;
-    int         writePtr;
-    int         readPtr;
-    int         size;
-    double      refTime;
-    char*       data;
-} PaHighPerformanceLog;
+    PaUtilTraceRecord record;
+    PaUtilTraceRing *ring;
+} PaUtilTraceDumpRecord;
+
 
-static const unsigned kMagik = 0xcafebabe;
+static int CompareDumpRecords( const void *a, const void *b )
+{
+    PaInt64 ta = ((const PaUtilTraceDumpRecord*)a)->record.timestamp;
+    PaInt64 tb = ((const PaUtilTraceDumpRecord*)b)->record.timestamp;
+    return ( ta < tb ) ? -1 : ( ta > tb ) ? 1 : 0;
+}
 
-#define USEC_PER_SEC    (1000000ULL)
 
-int PaUtil_InitializeHighSpeedLog( LogHandle* phLog, unsigned maxSizeInBytes )
+/* Copy the valid records of ring to dest, return the number copied. */
+static unsigned long CopyRing( PaUtilTraceRing *ring, PaUtilTraceDumpRecord *dest )
 {
-    PaHighPerformanceLog* pLog = (PaHighPerformanceLog*)PaUtil_AllocateZeroInitializedMemory(sizeof(PaHighPerformanceLog));
-    if (pLog == 0)
+    unsigned long begin, end, newEnd, i, count = 0;
+
+    end = ring->writeIndex;
+    PaUtil_ReadMemoryBarrier();
+    begin = ( end > PA_TRACE_RING_RECORDS ) ? end - PA_TRACE_RING_RECORDS : 0;
+
+    for( i = begin; i != end; ++i )
     {
-        return paInsufficientMemory;
+        dest[count].record = ring->records[ i & (PA_TRACE_RING_RECORDS - 1) ];
+        dest[count].ring = ring;
+        ++count;
     }
-    assert(phLog != 0);
-    *phLog = pLog;
 
-    pLog->data = (char*)PaUtil_AllocateZeroInitializedMemory(maxSizeInBytes);
-    if (pLog->data == 0)
+    PaUtil_ReadMemoryBarrier();
+    newEnd = ring->writeIndex;
+    if( newEnd < end )
+        return 0; /* the ring was reused meanwhile */
+
+    /* discard records which may have been overwritten while copying */
+    if( newEnd > PA_TRACE_RING_RECORDS && newEnd - PA_TRACE_RING_RECORDS > begin )
     {
-        PaUtil_FreeMemory(pLog);
-        return paInsufficientMemory;
+        unsigned long overwritten = newEnd - PA_TRACE_RING_RECORDS - begin;
+        if( overwritten >= count )
+            return 0;
+        memmove( dest, dest + overwritten, (count - overwritten) * sizeof(PaUtilTraceDumpRecord) );
+        count -= overwritten;
     }
-    pLog->magik = kMagik;
-    pLog->size = maxSizeInBytes;
-    pLog->refTime = PaUtil_GetTime();
-    return paNoError;
+
+    return count;
 }
 
-void PaUtil_ResetHighSpeedLogTimeRef( LogHandle hLog )
+
+/* Copy the events of all rings into an array sorted by timestamp, which the
+   caller must free with PaUtil_FreeMemory. */
+static PaError CollectEvents( PaUtilTraceDumpRecord **events, unsigned long *count )
 {
-    PaHighPerformanceLog* pLog = (PaHighPerformanceLog*)hLog;
-    assert(pLog->magik == kMagik);
-    pLog->refTime = PaUtil_GetTime();
+    PaUtilTraceRing *ring;
+    PaUtilTraceDumpRecord *dump;
+    unsigned long ringCount = 0, i;
+
+    *events = 0;
+    *count = 0;
+
+    for( ring = rings_; ring != 0; ring = ring->next )
+        ++ringCount;
+
+    if( ringCount == 0 )
+        return paNoError;
+
+    dump = (PaUtilTraceDumpRecord*)PaUtil_AllocateZeroInitializedMemory(
+            ringCount * PA_TRACE_RING_RECORDS * sizeof(PaUtilTraceDumpRecord) );
+    if( !dump )
+        return paInsufficientMemory;
+
+    /* rings are only ever pushed onto the front of the list, so the first
+       ringCount rings are still there */
+    for( ring = rings_, i = 0; ring != 0 && i < ringCount; ring = ring->next, ++i )
+        *count += CopyRing( ring, dump + *count );
+
+    qsort( dump, *count, sizeof(PaUtilTraceDumpRecord), CompareDumpRecords );
+
+    *events = dump;
+    return paNoError;
 }
 
-typedef struct __PaLogEntryHeader
+
+int PaUtil_DumpTraceEvents( const char *fileName )
 {
-    int    size;
-    double timeStamp;
-} PaLogEntryHeader;
+    PaUtilTraceDumpRecord *dump;
+    unsigned long count, i;
+    PaError result;
+    FILE *f;
 
-#ifdef __APPLE__
-#define _vsnprintf vsnprintf
-#define min(a,b) ((a)<(b)?(a):(b))
-#endif
+    result = CollectEvents( &dump, &count );
+    if( result != paNoError || count == 0 )
+        goto end;
+
+    f = (fileName != NULL) ? fopen( fileName, "w" ) : stdout;
+    if( !f )
+    {
+        result = paInternalError;
+        goto end;
+    }
+
+    for( i = 0; i < count; ++i )
+    {
+        const PaUtilTraceRecord *record = &dump[i].record;
+
+        fprintf( f, "%12.6f ", PA_NANOSECONDS_TO_PATIME( record->timestamp - dump[0].record.timestamp ) );
+        if( dump[i].ring->threadName )
+            fprintf( f, "%-24s ", dump[i].ring->threadName );
+        else
+            fprintf( f, "thread %-17ld ", dump[i].ring->ringId );
+        fprintf( f, ( record->phase == paUtilTraceBegin ) ? "> " : ( record->phase == paUtilTraceEnd ) ? "< " : "  " );
+        fprintf( f, record->format, record->args[0], record->args[1], record->args[2], record->args[3] );
+        fprintf( f, "\n" );
+    }
+
+    if( f != stdout )
+        fclose( f );
+    else
+        fflush( f );
+
+end:
+    if( dump )
+        PaUtil_FreeMemory( dump );
+    return result;
+}
 
 
-int PaUtil_AddHighSpeedLogMessage( LogHandle hLog, const char* fmt, ... )
+/* Write s as a JSON string literal */
+static void WriteJsonString( FILE *f, const char *s )
 {
-    va_list l;
-    int n = 0;
-    PaHighPerformanceLog* pLog = (PaHighPerformanceLog*)hLog;
-    if (pLog != 0)
+    fputc( '"', f );
+    for( ; *s; ++s )
     {
-        PaLogEntryHeader* pHeader;
-        char* p;
-        int maxN;
-        assert(pLog->magik == kMagik);
-        pHeader = (PaLogEntryHeader*)( pLog->data + pLog->writePtr );
-        p = (char*)( pHeader + 1 );
-        maxN = pLog->size - pLog->writePtr - 2 * sizeof(PaLogEntryHeader);
+        if( *s == '"' || *s == '\\' )
+            fprintf( f, "\\%c", *s );
+        else if( (unsigned char)*s < 0x20 )
+            fprintf( f, "\\u%04x", (unsigned)(unsigned char)*s );
+        else
+            fputc( *s, f );
+    }
+    fputc( '"', f );
+}
 
-        pHeader->timeStamp = PaUtil_GetTime() - pLog->refTime;
-        if (maxN > 0)
-        {
-            if (maxN > 32)
-            {
-                va_start(l, fmt);
-                n = _vsnprintf(p, min(1024, maxN), fmt, l);
-                va_end(l);
-            }
-            else {
-                n = sprintf(p, "End of log...");
-            }
-            n = ((n + sizeof(unsigned)) & ~(sizeof(unsigned)-1)) + sizeof(PaLogEntryHeader);
-            pHeader->size = n;
-#if 0
-            PaUtil_DebugPrint("%05u.%03u: %s\n", pHeader->timeStamp/1000, pHeader->timeStamp%1000, p);
-#endif
-            pLog->writePtr += n;
-        }
+
+int PaUtil_WriteChromeTrace( const char *fileName )
+{
+    PaUtilTraceDumpRecord *dump;
+    PaUtilTraceRing *ring;
+    unsigned long count, i;
+    char name[256];
+    PaError result;
+    FILE *f;
+
+    result = CollectEvents( &dump, &count );
+    if( result != paNoError )
+        goto end;
+
+    f = fopen( fileName, "w" );
+    if( !f )
+    {
+        result = paInternalError;
+        goto end;
+    }
+
+    fprintf( f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+    fprintf( f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"PortAudio\"}}" );
+
+    for( ring = rings_; ring != 0; ring = ring->next )
+    {
+        fprintf( f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%ld,\"args\":{\"name\":", ring->ringId );
+        if( ring->threadName )
+            WriteJsonString( f, ring->threadName );
+        else
+            fprintf( f, "\"thread %ld\"", ring->ringId );
+        fprintf( f, "}}" );
+    }
+
+    for( i = 0; i < count; ++i )
+    {
+        const PaUtilTraceRecord *record = &dump[i].record;
+
+        snprintf( name, sizeof(name), record->format,
+                record->args[0], record->args[1], record->args[2], record->args[3] );
+        name[ sizeof(name) - 1 ] = 0;
+
+        fprintf( f, ",\n{\"name\":" );
+        WriteJsonString( f, name );
+        fprintf( f, ",\"cat\":\"portaudio\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%ld%s}",
+                record->phase, (record->timestamp - dump[0].record.timestamp) * 1e-3,
+                dump[i].ring->ringId, ( record->phase == paUtilTraceInstant ) ? ",\"s\":\"t\"" : "" );
     }
-    return n;
+
+    fprintf( f, "\n]}\n" );
+    if( fclose( f ) != 0 )
+        result = paInternalError;
+
+end:
+    if( dump )
+        PaUtil_FreeMemory( dump );
+    return result;
 }
 
-void PaUtil_DumpHighSpeedLog( LogHandle hLog, const char* fileName )
+
+void PaUtil_TerminateTraceEvents( void )
 {
-    FILE* f = (fileName != NULL) ? fopen(fileName, "w") : stdout;
-    unsigned localWritePtr;
-    PaHighPerformanceLog* pLog = (PaHighPerformanceLog*)hLog;
-    assert(pLog->magik == kMagik);
-    localWritePtr = pLog->writePtr;
-    while (pLog->readPtr != localWritePtr)
+    PaUtilTraceRing *ring = rings_, *next;
+
+    rings_ = 0;
+    ringCount_ = 0;
+    PaUtil_AtomicAddLong( &generation_, 1 );
+
+    while( ring )
     {
-        const PaLogEntryHeader* pHeader = (const PaLogEntryHeader*)( pLog->data + pLog->readPtr );
-        const char* p = (const char*)( pHeader + 1 );
-        const PaUint64 ts = (const PaUint64)( pHeader->timeStamp * USEC_PER_SEC );
-        assert(pHeader->size < (1024+sizeof(unsigned)+sizeof(PaLogEntryHeader)));
-        fprintf(f, "%05u.%03u: %s\n", (unsigned)(ts/1000), (unsigned)(ts%1000), p);
-        pLog->readPtr += pHeader->size;
+        next = ring->next;
+        PaUtil_FreeMemory( ring );
+        ring = next;
     }
-    if (f != stdout)
+}
+
+#endif /* PA_TRACE_EVENTS */
+
+
+#if PA_TRACE_REALTIME_EVENTS
+
+static char const *traceTextArray[PA_MAX_TRACE_RECORDS];
+static int traceIntArray[PA_MAX_TRACE_RECORDS];
+static int traceIndex = 0;
+static int traceBlock = 0;
+
+/*********************************************************************/
+void PaUtil_ResetTraceMessages()
+{
+    traceIndex = 0;
+}
+
+/*********************************************************************/
+void PaUtil_DumpTraceMessages()
+{
+    int i;
+    int messageCount = (traceIndex < PA_MAX_TRACE_RECORDS) ? traceIndex : PA_MAX_TRACE_RECORDS;
+
+    printf("DumpTraceMessages: traceIndex = %d\n", traceIndex );
+    for( i=0; i<messageCount; i++ )
     {
-        fclose(f);
+        printf("%3d: %s = 0x%08X\n",
+               i, traceTextArray[i], traceIntArray[i] );
     }
+    PaUtil_ResetTraceMessages();
+    fflush(stdout);
 }
 
-void PaUtil_DiscardHighSpeedLog( LogHandle hLog )
+/*********************************************************************/
+void PaUtil_AddTraceMessage( const char *msg, int data )
 {
-    PaHighPerformanceLog* pLog = (PaHighPerformanceLog*)hLog;
-    assert(pLog->magik == kMagik);
-    PaUtil_FreeMemory(pLog->data);
-    PaUtil_FreeMemory(pLog);
+    if( (traceIndex == PA_MAX_TRACE_RECORDS) && (traceBlock == 0) )
+    {
+        traceBlock = 1;
+        /*  PaUtil_DumpTraceMessages(); */
+    }
+    else if( traceIndex < PA_MAX_TRACE_RECORDS )
+    {
+        traceTextArray[traceIndex] = msg;
+        traceIntArray[traceIndex] = data;
+        traceIndex++;
+    }
 }
 
 #else
@@ -44,13 +44,29 @@
 
  @brief Real-time safe event trace logging facility for debugging.
 
- Allows data to be logged to a fixed size trace buffer in a real-time
- execution context (such as at interrupt time). Each log entry consists
- of a message comprising a string pointer and an int.  The trace buffer
- may be dumped to stdout later.
-
- This facility is only active if PA_TRACE_REALTIME_EVENTS is set to 1,
- otherwise the trace functions expand to no-ops.
+ Two facilities are provided.
+
+ The binary event tracer records fixed size events, each consisting of a
+ timestamp, a phase, a printf format string and four integer arguments, into a
+ lock-free ring owned by the calling thread. Events are either instantaneous,
+ or mark the beginning or end of a span of activity on the calling thread. Recording an event only stores these values,
+ formatting is deferred until the trace is dumped, so events may be recorded
+ from real-time threads. When the ring is full the oldest events are
+ overwritten. The tracer is compiled in unless PA_TRACE_EVENTS is set to 0, and
+ records nothing until it is enabled at run time with PaUtil_EnableTraceEvents(),
+ so a disabled event costs a single test of a global flag. Pa_Initialize()
+ enables it when the PA_TRACE_FILE environment variable is set, and
+ Pa_Terminate() then writes the trace to the file named by that variable. If
+ the file name ends in .json the trace is written in the Chrome trace event
+ format, which can be loaded into chrome://tracing or the Perfetto UI to show
+ the activity of each thread on a timeline, otherwise it is written as text.
+
+ The trace message buffer allows data to be logged to a fixed size trace buffer
+ in a real-time execution context (such as at interrupt time). Each log entry
+ consists of a message comprising a string pointer and an int.  The trace buffer
+ may be dumped to stdout later. This facility is only active if
+ PA_TRACE_REALTIME_EVENTS is set to 1, otherwise the trace functions expand to
+ no-ops.
 
  @fn PaUtil_ResetTraceMessages
  @brief Clear the trace buffer.
@@ -73,40 +89,145 @@
 #define PA_MAX_TRACE_RECORDS      (2048)   /**< Maximum number of records stored in trace buffer */
 #endif
 
+#ifndef PA_TRACE_EVENTS
+#define PA_TRACE_EVENTS              (1)   /**< Set to 0 to compile out the binary event tracer */
+#endif
+
+#ifndef PA_TRACE_RING_RECORDS
+#define PA_TRACE_RING_RECORDS     (4096)   /**< Number of events stored per thread, must be a power of two */
+#endif
+
+#ifndef PA_TRACE_MAX_RINGS
+#define PA_TRACE_MAX_RINGS          (32)   /**< Number of rings allocated before rings released by exited threads are reused */
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif /* __cplusplus */
 
 
+#if PA_TRACE_EVENTS
+
+/** Non-zero while events are being recorded. Tested by PA_TRACE_EVENT before
+ calling PaUtil_TraceEvent.
+*/
+extern volatile int paUtilTraceEventsEnabled;
+
+/** Start or stop recording events. Events already recorded are retained.
+*/
+void PaUtil_EnableTraceEvents( int enable );
+
+/** Give the calling thread its own ring and name it in dumps. Only the events
+ of registered threads are recorded. Claiming a ring may allocate memory, so
+ real-time threads should register before they start processing. threadName
+ must remain valid until the trace is dumped, if it is NULL the name of an
+ already registered thread is kept.
+*/
+void PaUtil_RegisterTraceThread( const char *threadName );
+
+/** Release the calling thread's ring. Its events are retained, but once
+ PA_TRACE_MAX_RINGS rings exist the ring may be reused by another thread.
+ Should be called by threads which registered before they exit.
+*/
+void PaUtil_UnregisterTraceThread( void );
+
+/** The phase of an event. The values are those of the Chrome trace event format.
+*/
+typedef enum PaUtilTracePhase
+{
+    paUtilTraceInstant = 'i',
+    paUtilTraceBegin = 'B',     /**< begins a span, must be followed by a paUtilTraceEnd event on the same thread */
+    paUtilTraceEnd = 'E'
+} PaUtilTracePhase;
+
+/** Record an event in the calling thread's ring. Use PA_TRACE_EVENT,
+ PA_TRACE_BEGIN and PA_TRACE_END rather than calling this directly.
+ @param phase One of the PaUtilTracePhase values.
+ @param format A printf format string used when the trace is dumped, with at
+ most four conversions, all for long arguments (%ld, %lu or %lx). The pointer
+ is stored, so it must remain valid until the trace is dumped, usually only
+ string literals should be passed.
+*/
+void PaUtil_TraceEvent( int phase, const char *format, long arg0, long arg1, long arg2, long arg3 );
+
+/** Write the events of all threads, oldest first, to the named file, or to
+ stdout if fileName is NULL. May be called while events are being recorded.
+ @return paNoError, or paInternalError if the file couldn't be written.
+*/
+int PaUtil_DumpTraceEvents( const char *fileName );
+
+/** Write the events of all threads to the named file as a Chrome trace event
+ JSON document. Each ring appears as a thread named by
+ PaUtil_RegisterTraceThread, and each event is named by its formatted text.
+ May be called while events are being recorded.
+ @return paNoError, or paInternalError if the file couldn't be written.
+*/
+int PaUtil_WriteChromeTrace( const char *fileName );
+
+/** Free all rings. Threads must register again for their events to be
+ recorded. Must not be called while other threads are recording events.
+*/
+void PaUtil_TerminateTraceEvents( void );
+
+#define PA_TRACE_PHASE_( phase, format, arg0, arg1, arg2, arg3 ) \
+    do{ if( paUtilTraceEventsEnabled ) \
+            PaUtil_TraceEvent( (phase), (format), (long)(arg0), (long)(arg1), (long)(arg2), (long)(arg3) ); }while(0)
+
+/** Register the calling thread under threadName while events are being
+ recorded, so that no ring is claimed while tracing is disabled. For the
+ audio threads of host APIs, which call it before they start processing.
+*/
+#define PA_TRACE_REGISTER_NAMED_THREAD( threadName ) \
+    do{ if( paUtilTraceEventsEnabled ) PaUtil_RegisterTraceThread( threadName ); }while(0)
+
+/** Register the calling thread, keeping its name, while events are being
+ recorded. For threads which are never real-time, such as those calling the
+ PortAudio API.
+*/
+#define PA_TRACE_REGISTER_THREAD() PA_TRACE_REGISTER_NAMED_THREAD( 0 )
+
+/** Record an instantaneous event. */
+#define PA_TRACE_EVENT( format, arg0, arg1, arg2, arg3 ) \
+    PA_TRACE_PHASE_( paUtilTraceInstant, format, arg0, arg1, arg2, arg3 )
+
+/** Record the beginning of a span. */
+#define PA_TRACE_BEGIN( format, arg0, arg1, arg2, arg3 ) \
+    PA_TRACE_PHASE_( paUtilTraceBegin, format, arg0, arg1, arg2, arg3 )
+
+/** Record the end of the span most recently begun by the calling thread. */
+#define PA_TRACE_END( format, arg0, arg1, arg2, arg3 ) \
+    PA_TRACE_PHASE_( paUtilTraceEnd, format, arg0, arg1, arg2, arg3 )
+
+#else
+
+#define PaUtil_EnableTraceEvents( enable ) /* noop */
+#define PaUtil_RegisterTraceThread( threadName ) /* noop */
+#define PaUtil_UnregisterTraceThread() /* noop */
+#define PaUtil_DumpTraceEvents( fileName ) (0)
+#define PaUtil_WriteChromeTrace( fileName ) (0)
+#define PaUtil_TerminateTraceEvents() /* noop */
+#define PA_TRACE_REGISTER_NAMED_THREAD( threadName ) /* noop */
+#define PA_TRACE_REGISTER_THREAD() /* noop */
+#define PA_TRACE_EVENT( format, arg0, arg1, arg2, arg3 ) /* noop */
+#define PA_TRACE_BEGIN( format, arg0, arg1, arg2, arg3 ) /* noop */
+#define PA_TRACE_END( format, arg0, arg1, arg2, arg3 ) /* noop */
+
+#endif /* PA_TRACE_EVENTS */
+
+
 #if PA_TRACE_REALTIME_EVENTS
 
 void PaUtil_ResetTraceMessages();
 void PaUtil_AddTraceMessage( const char *msg, int data );
 void PaUtil_DumpTraceMessages();
 
-/* Alternative interface */
-
-typedef void* LogHandle;
-
-int PaUtil_InitializeHighSpeedLog(LogHandle* phLog, unsigned maxSizeInBytes);
-void PaUtil_ResetHighSpeedLogTimeRef(LogHandle hLog);
-int PaUtil_AddHighSpeedLogMessage(LogHandle hLog, const char* fmt, ...);
-void PaUtil_DumpHighSpeedLog(LogHandle hLog, const char* fileName);
-void PaUtil_DiscardHighSpeedLog(LogHandle hLog);
-
 #else
 
 #define PaUtil_ResetTraceMessages() /* noop */
 #define PaUtil_AddTraceMessage(msg,data) /* noop */
 #define PaUtil_DumpTraceMessages() /* noop */
 
-#define PaUtil_InitializeHighSpeedLog(phLog, maxSizeInBytes)  (0)
-#define PaUtil_ResetHighSpeedLogTimeRef(hLog)
-#define PaUtil_AddHighSpeedLogMessage(...)   (0)
-#define PaUtil_DumpHighSpeedLog(hLog, fileName)
-#define PaUtil_DiscardHighSpeedLog(hLog)
-
 #endif
 
 
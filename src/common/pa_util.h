@@ -50,6 +50,7 @@
 
 
 #include "portaudio.h"
+#include "pa_types.h"
 
 /** Preprocessor Utilities
 */
@@ -144,6 +145,32 @@ void PaUtil_FreeMemory( void *block );
 int PaUtil_CountCurrentlyAllocatedBlocks( void );
 
 
+/** Lock a region of memory into physical memory and fault in all of its
+ pages, so that touching it from a real-time thread never causes a page
+ fault. Where the platform supports transparent huge pages, large regions
+ are advised to use them. If the region can't be locked (for example because
+ of a resource limit) its pages are still prefaulted.
+
+ @return paNoError if the region was locked, otherwise paInsufficientMemory.
+
+ @see PaUtil_UnlockMemory, PaUtil_GetLockedMemoryByteCount
+*/
+PaError PaUtil_LockMemory( void *address, unsigned long size );
+
+
+/** Unlock a region previously locked with PaUtil_LockMemory(), passing the
+ same address and size. Locked regions may share pages, and a page stays
+ locked until every region covering it has been unlocked.
+*/
+void PaUtil_UnlockMemory( void *address, unsigned long size );
+
+
+/** Return the total number of bytes currently locked by PaUtil_LockMemory(),
+ counted in whole pages.
+*/
+unsigned long PaUtil_GetLockedMemoryByteCount( void );
+
+
 /** Initialize the clock used by PaUtil_GetTime(). Call this before calling
  PaUtil_GetTime.
 
@@ -165,6 +192,23 @@ void PaUtil_InitializeClock( void );
 double PaUtil_GetTime( void );
 
 
+/** Return a monotonic timestamp in nanoseconds. Used for timing on the audio
+ path, such as CPU load measurement and event tracing, where it avoids the
+ floating point conversion performed by PaUtil_GetTime.
+
+ The origin is unspecified and, depending on the clock source selected by
+ PaUtil_InitializeClock, may differ from that of PaUtil_GetTime, so timestamps
+ should only be subtracted from each other. Convert intervals to seconds with
+ PA_NANOSECONDS_TO_PATIME where a PaTime is needed at the API boundary.
+
+ @see PaUtil_InitializeClock
+*/
+PaInt64 PaUtil_GetNanoseconds( void );
+
+/** Convert a number of nanoseconds to a PaTime. */
+#define PA_NANOSECONDS_TO_PATIME( nanoseconds ) ( (PaTime)(nanoseconds) * 1e-9 )
+
+
 /* void Pa_Sleep( long msec );  must also be implemented in per-platform .c file */
 
 
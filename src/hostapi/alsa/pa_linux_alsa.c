@@ -55,12 +55,16 @@
 
 #include <sys/poll.h>
 #include <string.h> /* strlen() */
+#include <stddef.h> /* offsetof() */
 #include <limits.h>
 #include <math.h>
 #include <pthread.h>
 #include <signal.h>
 #include <time.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <signal.h> /* For sig_atomic_t */
 #ifdef PA_ALSA_DYNAMIC
     #include <dlfcn.h> /* For dlXXX functions */
@@ -76,6 +80,7 @@
 #include "pa_process.h"
 #include "pa_endianness.h"
 #include "pa_debugprint.h"
+#include "pa_trace.h"
 
 #include "pa_linux_alsa.h"
 
@@ -90,6 +95,58 @@
 /* The acceptable tolerance of sample rate set, to that requested (as a ratio, eg 50 is 2%, 100 is 1%) */
 #define RATE_MAX_DEVIATE_RATIO 100
 
+/* Memory locking, see paLockMemory */
+#define PA_ALSA_MAX_LOCKED_REGIONS_ 8
+#define PA_ALSA_LOCKED_STACK_SIZE_  (64 * 1024)
+
+/* SCHED_DEADLINE, see PaAlsa_EnableDeadlineScheduling. The runtime budget covers a period of the whole callback
+   loop: the 99.9th percentile load of buffer processing plus the CPU time the thread spent per period outside of
+   it, polling and moving frames to and from ALSA, both measured over the first iterations of the loop. This is
+   multiplied by the headroom factor, the fixed margin is added for what the measurement can't see, such as the
+   cost of waking up and of cache misses after being throttled, and the result is kept within the given bounds */
+#define PA_ALSA_DEADLINE_MEASUREMENT_PERIODS_   256
+#define PA_ALSA_DEADLINE_HEADROOM_              1.5
+#define PA_ALSA_DEADLINE_MARGIN_                50000   /* nanoseconds */
+#define PA_ALSA_DEADLINE_MIN_LOAD_              0.05
+#define PA_ALSA_DEADLINE_MAX_LOAD_              0.95
+#define PA_ALSA_DEADLINE_MIN_RUNTIME_           100000  /* nanoseconds */
+
+/* Timer scheduling, see PaAlsa_SetTimerScheduling. The watermark is how early the callback thread wakes up ahead of
+   the frames it waits for, it is doubled on every xrun and lowered again after a time without any */
+#define PA_ALSA_TSCHED_BUFFER_TIME_             2.0             /* seconds of hardware buffer to ask for */
+#define PA_ALSA_TSCHED_MIN_WATERMARK_           1000000         /* nanoseconds */
+#define PA_ALSA_TSCHED_WATERMARK_DECAY_TIME_    10000000000LL   /* nanoseconds without xruns */
+
+/* Delay-locked loops tracking the clocks of devices, see PaAlsaDll_Update. The loop starts out with a wide
+   bandwidth to lock quickly, and narrows it once locked to smooth out timestamp jitter */
+#define PA_ALSA_DLL_INITIAL_BANDWIDTH_          1.0     /* Hz */
+#define PA_ALSA_DLL_BANDWIDTH_                  0.1     /* Hz */
+#define PA_ALSA_DLL_LOCK_TIME_                  2.0     /* seconds with the initial bandwidth */
+#define PA_ALSA_DLL_MAX_INTERVAL_               1.0     /* seconds between updates before starting over */
+#define PA_ALSA_DLL_MAX_ERROR_                  0.01    /* seconds of error before starting over */
+#define PA_ALSA_DLL_MAX_DEVIATION_              0.01    /* of the rate from the nominal one */
+#ifndef M_PI
+    #define M_PI                                3.14159265358979323846
+#endif
+
+/* Aggregate devices, see PaAlsaStreamInfo::aggregateDevices. The resampling position of a member is steered towards
+   the one given by the clocks over the correction time, and jumps there if it is more than a period off */
+#define PA_ALSA_AGGREGATE_MIN_PERIODS_          4
+#define PA_ALSA_AGGREGATE_DELAY_MARGIN_         16      /* frames of capture delay beyond two periods of the members */
+#define PA_ALSA_AGGREGATE_CORRECTION_TIME_      1.0     /* seconds */
+#define PA_ALSA_AGGREGATE_MAX_CORRECTION_       0.001   /* of the resampling ratio */
+
+/* Device enumeration, see BuildDeviceList */
+#define PA_ALSA_MAX_PROBE_THREADS_              8
+#define PA_ALSA_DEVICE_CACHE_HEADER_            "PortAudio ALSA device cache 1\n"
+#ifndef PATH_MAX
+    #define PATH_MAX                            4096
+#endif
+
+/* Shared engine threads, see PaAlsa_EnableSharedEngine */
+#define PA_ALSA_MAX_ENGINES_                    64
+#define PA_ALSA_ENGINE_STALL_TIMEOUT_           2000000000  /* nanoseconds without a ready pcm before recovering */
+
 /* Defines Alsa function types and pointers to these functions. */
 #define _PA_DEFINE_FUNC(x)  typedef typeof(x) x##_ft; static x##_ft *alsa_##x = 0
 
@@ -106,6 +163,8 @@ _PA_DEFINE_FUNC(snd_pcm_resume);
 _PA_DEFINE_FUNC(snd_pcm_wait);
 _PA_DEFINE_FUNC(snd_pcm_state);
 _PA_DEFINE_FUNC(snd_pcm_avail_update);
+_PA_DEFINE_FUNC(snd_pcm_avail);
+_PA_DEFINE_FUNC(snd_pcm_htimestamp);
 _PA_DEFINE_FUNC(snd_pcm_areas_silence);
 _PA_DEFINE_FUNC(snd_pcm_mmap_begin);
 _PA_DEFINE_FUNC(snd_pcm_mmap_commit);
@@ -142,6 +201,8 @@ _PA_DEFINE_FUNC(snd_pcm_hw_params_set_buffer_size_min);
 //_PA_DEFINE_FUNC(snd_pcm_hw_params_set_period_time_near);
 _PA_DEFINE_FUNC(snd_pcm_hw_params_set_period_size_near);
 _PA_DEFINE_FUNC(snd_pcm_hw_params_set_periods_integer);
+_PA_DEFINE_FUNC(snd_pcm_hw_params_can_disable_period_wakeup);
+_PA_DEFINE_FUNC(snd_pcm_hw_params_set_period_wakeup);
 _PA_DEFINE_FUNC(snd_pcm_hw_params_set_periods_min);
 
 _PA_DEFINE_FUNC(snd_pcm_hw_params_get_buffer_size);
@@ -204,6 +265,9 @@ _PA_DEFINE_FUNC(snd_ctl_card_info_free);
 _PA_DEFINE_FUNC(snd_ctl_card_info);
 _PA_DEFINE_FUNC(snd_ctl_card_info_sizeof);
 _PA_DEFINE_FUNC(snd_ctl_card_info_get_name);
+_PA_DEFINE_FUNC(snd_ctl_card_info_get_id);
+_PA_DEFINE_FUNC(snd_ctl_card_info_get_driver);
+_PA_DEFINE_FUNC(snd_ctl_card_info_get_longname);
 #define alsa_snd_ctl_card_info_alloca(ptr) __alsa_snd_alloca(ptr, snd_ctl_card_info)
 
 _PA_DEFINE_FUNC(snd_config);
@@ -391,6 +455,8 @@ static int PaAlsa_LoadLibrary()
     _PA_LOAD_FUNC(snd_pcm_wait);
     _PA_LOAD_FUNC(snd_pcm_state);
     _PA_LOAD_FUNC(snd_pcm_avail_update);
+    _PA_LOAD_FUNC(snd_pcm_avail);
+    _PA_LOAD_FUNC(snd_pcm_htimestamp);
     _PA_LOAD_FUNC(snd_pcm_areas_silence);
     _PA_LOAD_FUNC(snd_pcm_mmap_begin);
     _PA_LOAD_FUNC(snd_pcm_mmap_commit);
@@ -427,6 +493,8 @@ static int PaAlsa_LoadLibrary()
 //    _PA_LOAD_FUNC(snd_pcm_hw_params_set_period_time_near);
     _PA_LOAD_FUNC(snd_pcm_hw_params_set_period_size_near);
     _PA_LOAD_FUNC(snd_pcm_hw_params_set_periods_integer);
+    _PA_LOAD_FUNC(snd_pcm_hw_params_can_disable_period_wakeup);
+    _PA_LOAD_FUNC(snd_pcm_hw_params_set_period_wakeup);
     _PA_LOAD_FUNC(snd_pcm_hw_params_set_periods_min);
 
     _PA_LOAD_FUNC(snd_pcm_hw_params_get_buffer_size);
@@ -486,6 +554,9 @@ static int PaAlsa_LoadLibrary()
     _PA_LOAD_FUNC(snd_ctl_card_info);
     _PA_LOAD_FUNC(snd_ctl_card_info_sizeof);
     _PA_LOAD_FUNC(snd_ctl_card_info_get_name);
+    _PA_LOAD_FUNC(snd_ctl_card_info_get_id);
+    _PA_LOAD_FUNC(snd_ctl_card_info_get_driver);
+    _PA_LOAD_FUNC(snd_ctl_card_info_get_longname);
 
     _PA_LOAD_FUNC(snd_config);
     _PA_LOAD_FUNC(snd_config_update);
@@ -592,6 +663,7 @@ static void PaAlsa_CloseLibrary()
 
 static int numPeriods_ = 4;
 static int busyRetries_ = 100;
+static int timerScheduling_ = -1;   /* -1 to take the setting from the environment */
 
 int PaAlsa_SetNumPeriods( int numPeriods )
 {
@@ -599,15 +671,62 @@ int PaAlsa_SetNumPeriods( int numPeriods )
     return paNoError;
 }
 
+PaError PaAlsa_SetTimerScheduling( int enable )
+{
+    timerScheduling_ = enable != 0;
+    return paNoError;
+}
+
 typedef enum
 {
     StreamDirection_In,
     StreamDirection_Out
 } StreamDirection;
 
+/* A delay-locked loop, filtering the frame position of a device against time */
+typedef struct
+{
+    double nominalRate;
+    double rate;            /* frames per second */
+    double position;        /* filtered frame position at time */
+    double time;            /* seconds, as of the last update */
+    double lockTime;        /* when the loop started over */
+    int valid;
+}
+PaAlsaDll;
+
+/* A further device of an aggregate, resampled to the clock of the component it belongs to */
+typedef struct
+{
+    snd_pcm_t *pcm;
+    StreamDirection streamDir;
+    int numChannels;
+    int firstChannel;                   /* index of the device's first channel among the stream's */
+    PaSampleFormat deviceFormat;        /* interleaved samples as transferred with the device */
+    snd_pcm_uframes_t framesPerPeriod, bufferSize;
+    double sampleRate;                  /* nominal rate of the device */
+    PaAlsaDll dll;
+    PaInt64 framesTransferred;          /* read from or written to the device since it was started */
+    double ratio;                       /* estimated frames of the device per frame of the stream */
+
+    /* Capture: frames read from the device. Playback: frames of the stream waiting to be written */
+    float *fifo;
+    unsigned long fifoSize, fifoFrames;
+    double fifoStart;                   /* position of the first frame in the fifo, in frames of its clock */
+    double phase;                       /* position in the fifo's clock of the next frame to resample */
+    int synced;                         /* bool: has phase been set from the clocks */
+
+    float *scratch;                     /* resampled frames */
+    void *deviceBuffer;
+    void *hostBuffer;                   /* frames in the stream's host format, registered with the buffer processor */
+    PaUtilConverter *toFloat, *fromFloat;
+}
+PaAlsaAggregateMember;
+
 typedef struct
 {
     PaSampleFormat hostSampleFormat;
+    int userFormatIsHost;   /* bool: the user's sample format is hostSampleFormat, so no conversion is needed */
     int numUserChannels, numHostChannels;
     int userInterleaved, hostInterleaved;
     int canMmap;
@@ -626,9 +745,43 @@ typedef struct
     snd_pcm_uframes_t offset;
     StreamDirection streamDir;
 
+    int timerScheduling;    /* bool: framesPerPeriod is the number of frames per timer wakeup, not a hardware period */
+    snd_pcm_uframes_t latencyFrames;    /* with timerScheduling, playback keeps this many frames buffered */
+
     snd_pcm_channel_area_t *channelAreas;  /* Needed for channel adaption */
+
+    /* Aggregate devices, whose channels follow numUserChannels */
+    PaAlsaAggregateMember *members;
+    int memberCount;
+    PaAlsaDll dll;                      /* the clock the members are resampled to */
+    PaInt64 framesTransferred;          /* committed since the device was started */
+    unsigned long delayFrames;          /* capture: the device's own channels are delayed so the members catch up */
+    unsigned long delayShift;           /* frames consumed from the delay buffer by the last period */
+    unsigned char *delayBuffer;
+    PaUtilConverter *delayCopier;
 } PaAlsaStreamComponent;
 
+struct PaAlsaEngine;
+
+/* State of a stream serviced by a shared engine thread. While the stream is attached only the engine
+ * thread touches it, except for stopRequested, and finished which is guarded by the engine's mutex */
+typedef struct
+{
+    struct PaAlsaEngine *engine;            /* NULL unless attached to an engine */
+    struct PaAlsaStream *next;
+    int polled;                             /* bool: are pfds of the stream part of the current poll? */
+    int pollCapture, pollPlayback;          /* directions still being waited for in the current period */
+    int pollTimeout;
+    struct pollfd *capturePfds, *playbackPfds;
+    int callbackResult;
+    PaStreamCallbackFlags cbFlags;
+    unsigned long framesAvail;
+    PaInt64 lastReadyTime;                  /* PaUtil_GetNanoseconds time the stream was last ready */
+    PaInt64 deadline;                       /* when the stream under- or overruns if it isn't serviced */
+    volatile sig_atomic_t stopRequested;    /* 1 to stop, 2 to abort */
+    int finished;                           /* bool: the engine has stopped the stream and let go of it */
+} PaAlsaEngineSlot;
+
 /* Implementation specific stream structure */
 typedef struct PaAlsaStream
 {
@@ -643,6 +796,15 @@ typedef struct PaAlsaStream
     int callbackMode;              /* bool: are we running in callback mode? */
     int pcmsSynced;                /* Have we successfully synced pcms */
     int rtSched;
+    int deadlineSched;             /* bool: switch the callback thread to SCHED_DEADLINE once its cost is known */
+    int useWatchdog;               /* bool: put the callback thread under the watchdog */
+    int useCpuAffinity;            /* bool: pin the callback thread to cpuAffinity rather than the default CPUs */
+    PaUnixCpuSet cpuAffinity;
+    int useSharedEngine;           /* bool: service the stream from a shared engine thread */
+    PaAlsaEngineSlot engineSlot;
+    int timerScheduling;           /* bool: wake up on a timer rather than on period interrupts */
+    snd_pcm_uframes_t tschedWatermark;  /* frames to wake up early by */
+    PaInt64 tschedWatermarkTime;        /* PaUtil_GetNanoseconds time the watermark was last changed */
 
     /* the callback thread uses these to poll the sound device(s), waiting
      * for data to be ready/available */
@@ -657,6 +819,16 @@ typedef struct PaAlsaStream
 
     int neverDropInput;
 
+    /* memory locked for the audio path, see paLockMemory */
+    int lockMemory;
+    struct
+    {
+        void *address;
+        unsigned long size;
+    } lockedRegions[PA_ALSA_MAX_LOCKED_REGIONS_];
+    int lockedRegionCount;
+    unsigned long lockedBytes;
+
     PaTime underrun;
     PaTime overrun;
 
@@ -664,6 +836,54 @@ typedef struct PaAlsaStream
 }
 PaAlsaStream;
 
+/* A shared engine thread, servicing the callback streams attached to it */
+typedef struct PaAlsaEngine
+{
+    PaUnixThread thread;
+    int running;                        /* bool: guarded by enginesMtx_ */
+    int streamCount;                    /* streams attached, guarded by enginesMtx_ */
+    volatile sig_atomic_t stopRequested;
+    int wakeFd;                         /* eventfd interrupting poll() when the set of streams changes */
+
+    PaUnixMutex mtx;                    /* guards the stream list, nfds, listCount and exited */
+    pthread_cond_t finishedCond;        /* signalled when the engine has let go of streams */
+    PaAlsaStream *streams;
+    unsigned int nfds;                  /* poll descriptors needed by the streams in the list */
+    unsigned int listCount;
+    int exited;                         /* bool: the engine thread has quit and let go of all streams */
+
+    /* Owned by the engine thread */
+    PaInt64 watchdogPeriod;             /* the engine thread's watchdog period, 0 before it is started */
+    int watchdogFailed;                 /* bool: the watchdog couldn't be started for the engine thread */
+    struct pollfd *pfds;
+    unsigned int pfdsSize;
+    PaAlsaStream **ready;
+    unsigned int readySize;
+}
+PaAlsaEngine;
+
+/* The capabilities of a device as remembered in the device cache, see BuildDeviceList */
+typedef struct
+{
+    char *key;                  /* Device name and fingerprint of its configuration */
+    int used;                   /* Looked up or stored during this session, only such entries are saved */
+    int minInputChannels, maxInputChannels;
+    int minOutputChannels, maxOutputChannels;
+    double defaultLowInputLatency, defaultHighInputLatency;
+    double defaultLowOutputLatency, defaultHighOutputLatency;
+    double defaultSampleRate;
+}
+PaAlsaCachedDevice;
+
+typedef struct
+{
+    char *path;                 /* NULL if the cache is disabled */
+    PaAlsaCachedDevice *devices;
+    size_t count, size;
+    int dirty;
+}
+PaAlsaDeviceCache;
+
 /* PaAlsaHostApiRepresentation - host api datastructure specific to this implementation */
 
 typedef struct PaAlsaHostApiRepresentation
@@ -676,6 +896,9 @@ typedef struct PaAlsaHostApiRepresentation
 
     PaHostApiIndex hostApiIndex;
     PaUint32 alsaLibVersion; /* Retrieved from the library at run-time */
+
+    int probeBlocking;      /* Mode to open devices with when probing them, see PA_ALSA_INITIALIZE_BLOCK */
+    PaAlsaDeviceCache deviceCache;
 }
 PaAlsaHostApiRepresentation;
 
@@ -686,6 +909,11 @@ typedef struct PaAlsaDeviceInfo
     int isPlug;
     int minInputChannels;
     int minOutputChannels;
+
+    char *cacheKey;
+    int probePending;       /* Capabilities are yet to be probed, see PA_ALSA_LAZY_PROBE */
+    int hasPlayback;
+    int hasCapture;
 }
 PaAlsaDeviceInfo;
 
@@ -714,18 +942,27 @@ static PaError IsStreamActive( PaStream *stream );
 static PaTime GetStreamTime( PaStream *stream );
 static double GetStreamCpuLoad( PaStream* stream );
 static PaError BuildDeviceList( PaAlsaHostApiRepresentation *hostApi );
+static void PrepareDeviceInfo( PaUtilHostApiRepresentation *hostApi, int device );
+static void SaveDeviceCache( PaAlsaDeviceCache *cache );
+static void FreeDeviceCache( PaAlsaDeviceCache *cache );
 static int SetApproximateSampleRate( snd_pcm_t *pcm, snd_pcm_hw_params_t *hwParams, double sampleRate );
 static int GetExactSampleRate( snd_pcm_hw_params_t *hwParams, double *sampleRate );
 static PaUint32 PaAlsaVersionNum(void);
 
 /* Callback prototypes */
 static void *CallbackThreadFunc( void *userData );
+static PaError AttachToEngine( PaAlsaStream *stream );
+static PaError DetachFromEngine( PaAlsaStream *stream, int abort );
 
 /* Blocking prototypes */
 static signed long GetStreamReadAvailable( PaStream* s );
 static signed long GetStreamWriteAvailable( PaStream* s );
 static PaError ReadStream( PaStream* stream, void *buffer, unsigned long frames );
 static PaError WriteStream( PaStream* stream, const void *buffer, unsigned long frames );
+static PaError BeginReadStream( PaStream* stream, const void **buffer, unsigned long *frames );
+static PaError CommitReadStream( PaStream* stream, unsigned long frames );
+static PaError BeginWriteStream( PaStream* stream, void **buffer, unsigned long *frames );
+static PaError CommitWriteStream( PaStream* stream, unsigned long frames );
 
 
 static const PaAlsaDeviceInfo *GetDeviceInfo( const PaUtilHostApiRepresentation *hostApi, int device )
@@ -763,6 +1000,7 @@ PaError PaAlsa_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex
     (*hostApi)->Terminate = Terminate;
     (*hostApi)->OpenStream = OpenStream;
     (*hostApi)->IsFormatSupported = IsFormatSupported;
+    (*hostApi)->PrepareDeviceInfo = PrepareDeviceInfo;
 
     /** If AlsaErrorHandler is to be used, do not forget to unregister callback pointer in
         Terminate function.
@@ -788,6 +1026,9 @@ PaError PaAlsa_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex
                                       ReadStream, WriteStream,
                                       GetStreamReadAvailable,
                                       GetStreamWriteAvailable );
+    PaUtil_SetDirectStreamInterface( &alsaHostApi->blockingStreamInterface,
+                                     BeginReadStream, CommitReadStream,
+                                     BeginWriteStream, CommitWriteStream );
 
     PA_ENSURE( PaUnixThreading_Initialize() );
 
@@ -796,6 +1037,7 @@ PaError PaAlsa_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex
 error:
     if( alsaHostApi )
     {
+        FreeDeviceCache( &alsaHostApi->deviceCache );
         if( alsaHostApi->allocations )
         {
             PaUtil_FreeAllAllocations( alsaHostApi->allocations );
@@ -818,6 +1060,10 @@ static void Terminate( struct PaUtilHostApiRepresentation *hostApi )
     */
     /*snd_lib_error_set_handler(NULL);*/
 
+    /* Devices probed since the device list was built */
+    SaveDeviceCache( &alsaHostApi->deviceCache );
+    FreeDeviceCache( &alsaHostApi->deviceCache );
+
     if( alsaHostApi->allocations )
     {
         PaUtil_FreeAllAllocations( alsaHostApi->allocations );
@@ -1006,6 +1252,7 @@ typedef struct
     int isPlug;
     int hasPlayback;
     int hasCapture;
+    char *cacheKey;
 } HwDevInfo;
 
 
@@ -1169,16 +1416,343 @@ static int OpenPcm( snd_pcm_t **pcmp, const char *name, snd_pcm_stream_t stream,
     return ret;
 }
 
-static PaError FillInDevInfo( PaAlsaHostApiRepresentation *alsaApi, HwDevInfo* deviceHwInfo, int blocking,
-        PaAlsaDeviceInfo* devInfo, int* devIdx )
+/* Device cache
+ *
+ * Determining the capabilities of a device means opening it and exploring its configuration space, which takes
+ * tens of milliseconds per device and more for plugins layered on hardware such as dmix. The outcome is remembered
+ * between processes in a cache file, keyed by the ALSA name of the device together with a fingerprint of what its
+ * capabilities depend on: the identity of its card for hw devices, and the identities of all cards along with the
+ * ALSA configuration for plugins.
+ */
+
+#define PA_ALSA_HASH_SEED_  0xcbf29ce484222325ULL
+
+/* 64-bit FNV-1a hash of a string, including the terminator so that consecutive strings don't run together */
+static PaUint64 HashString( PaUint64 hash, const char *str )
+{
+    do
+    {
+        hash ^= (unsigned char)*str;
+        hash *= 0x100000001b3ULL;
+    }
+    while( *str++ );
+
+    return hash;
+}
+
+/* Hash the path and, if it exists, the modification time and size of a configuration file or directory */
+static PaUint64 HashConfigFile( PaUint64 hash, const char *path )
+{
+    struct stat st;
+    char buf[64];
+
+    hash = HashString( hash, path );
+    if( stat( path, &st ) == 0 )
+    {
+        snprintf( buf, sizeof (buf), "%lld %lld", (long long)st.st_mtime, (long long)st.st_size );
+        hash = HashString( hash, buf );
+    }
+
+    return hash;
+}
+
+/* Hash the ALSA configuration, which defines the plugins and what they are layered on */
+static PaUint64 HashAlsaConfig( PaUint64 hash )
+{
+    const char *home = getenv( "HOME" ), *configHome = getenv( "XDG_CONFIG_HOME" ),
+          *configPath = getenv( "ALSA_CONFIG_PATH" );
+    char path[PATH_MAX];
+
+    if( configPath )
+        hash = HashConfigFile( hash, configPath );
+    hash = HashConfigFile( hash, "/usr/share/alsa/alsa.conf" );
+    hash = HashConfigFile( hash, "/usr/share/alsa/alsa.conf.d" );
+    hash = HashConfigFile( hash, "/etc/asound.conf" );
+    hash = HashConfigFile( hash, "/etc/alsa/conf.d" );
+    if( home )
+    {
+        snprintf( path, sizeof (path), "%s/.asoundrc", home );
+        hash = HashConfigFile( hash, path );
+    }
+    if( configHome && *configHome )
+    {
+        snprintf( path, sizeof (path), "%s/alsa/asoundrc", configHome );
+        hash = HashConfigFile( hash, path );
+    }
+    else if( home )
+    {
+        snprintf( path, sizeof (path), "%s/.config/alsa/asoundrc", home );
+        hash = HashConfigFile( hash, path );
+    }
+
+    return hash;
+}
+
+/* Hash the identity of a card, which determines the capabilities of its hw devices */
+static PaUint64 HashCard( PaUint64 hash, snd_ctl_card_info_t *cardInfo )
+{
+    hash = HashString( hash, alsa_snd_ctl_card_info_get_id( cardInfo ) );
+    hash = HashString( hash, alsa_snd_ctl_card_info_get_driver( cardInfo ) );
+    return HashString( hash, alsa_snd_ctl_card_info_get_longname( cardInfo ) );
+}
+
+static PaError MakeCacheKey( PaAlsaHostApiRepresentation *alsaApi, char **key, const char *alsaName,
+        PaUint64 fingerprint )
+{
+    PaError result = paNoError;
+    size_t len = snprintf( NULL, 0, "%s@%016llx", alsaName, (unsigned long long)fingerprint ) + 1;
+
+    PA_UNLESS( *key = (char *)PaUtil_GroupAllocateZeroInitializedMemory( alsaApi->allocations, len ),
+            paInsufficientMemory );
+    snprintf( *key, len, "%s@%016llx", alsaName, (unsigned long long)fingerprint );
+
+error:
+    return result;
+}
+
+static char *CopyString( const char *str )
+{
+    size_t len = strlen( str ) + 1;
+    char *copy = (char *)PaUtil_AllocateZeroInitializedMemory( (long)len );
+
+    if( copy )
+        memcpy( copy, str, len );
+    return copy;
+}
+
+/* The cache is only used when PA_ALSA_DEVICE_CACHE is set, to "1" for portaudio/alsa-devices in the user's cache
+ * directory or to the name of the cache file, see pa_linux_alsa.h */
+static char *GetDeviceCachePath( void )
+{
+    const char *path = getenv( "PA_ALSA_DEVICE_CACHE" ), *dir;
+    char buf[PATH_MAX];
+
+    if( !path || !*path || !strcmp( path, "0" ) )
+        return NULL;
+    if( strcmp( path, "1" ) )
+        return CopyString( path );
+
+    if( ( dir = getenv( "XDG_CACHE_HOME" ) ) && *dir )
+        snprintf( buf, sizeof (buf), "%s/portaudio/alsa-devices", dir );
+    else if( ( dir = getenv( "HOME" ) ) && *dir )
+        snprintf( buf, sizeof (buf), "%s/.cache/portaudio/alsa-devices", dir );
+    else
+        return NULL;
+
+    return CopyString( buf );
+}
+
+static PaAlsaCachedDevice *FindCachedDevice( PaAlsaDeviceCache *cache, const char *key )
+{
+    size_t i;
+
+    for( i = 0; i < cache->count; ++i )
+    {
+        if( !strcmp( cache->devices[i].key, key ) )
+        {
+            cache->devices[i].used = 1;
+            return &cache->devices[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Add or replace a cache entry. Failures are ignored, as the cache merely saves time */
+static void PutCachedDevice( PaAlsaDeviceCache *cache, const char *key, const PaAlsaCachedDevice *device )
+{
+    PaAlsaCachedDevice *entry;
+    char *entryKey;
+
+    if( !cache->path || strpbrk( key, "\t\n" ) )
+        return;
+
+    if( !( entry = FindCachedDevice( cache, key ) ) )
+    {
+        if( cache->count == cache->size )
+        {
+            size_t size = cache->size ? cache->size * 2 : 32;
+            PaAlsaCachedDevice *devices = (PaAlsaCachedDevice *)PaUtil_AllocateZeroInitializedMemory(
+                    (long)( size * sizeof (*devices) ) );
+
+            if( !devices )
+                return;
+            if( cache->count )
+                memcpy( devices, cache->devices, cache->count * sizeof (*devices) );
+            PaUtil_FreeMemory( cache->devices );
+            cache->devices = devices;
+            cache->size = size;
+        }
+        entry = &cache->devices[cache->count];
+        if( !( entry->key = CopyString( key ) ) )
+            return;
+        ++cache->count;
+    }
+
+    entryKey = entry->key;
+    *entry = *device;
+    entry->key = entryKey;
+    entry->used = 1;
+    cache->dirty = 1;
+}
+
+/* Latencies and sample rates are stored as integers, so that the file doesn't depend on the locale */
+static long long ToFixedPoint( double value, double scale )
+{
+    return (long long)floor( value * scale + .5 );
+}
+
+static void LoadDeviceCache( PaAlsaDeviceCache *cache )
+{
+    FILE *file;
+    char line[1024], *tab;
+    PaAlsaCachedDevice device;
+    long long latencies[4], sampleRate;
+    size_t i;
+
+    if( !cache->path || !( file = fopen( cache->path, "r" ) ) )
+        return;
+
+    if( fgets( line, sizeof (line), file ) && !strcmp( line, PA_ALSA_DEVICE_CACHE_HEADER_ ) )
+    {
+        while( fgets( line, sizeof (line), file ) )
+        {
+            if( !( tab = strchr( line, '\t' ) ) )
+                continue;
+            *tab = '\0';
+            if( sscanf( tab + 1, "%d %d %d %d %lld %lld %lld %lld %lld", &device.minInputChannels,
+                        &device.maxInputChannels, &device.minOutputChannels, &device.maxOutputChannels,
+                        &latencies[0], &latencies[1], &latencies[2], &latencies[3], &sampleRate ) != 9 )
+                continue;
+
+            device.defaultLowInputLatency = latencies[0] * 1e-9;
+            device.defaultHighInputLatency = latencies[1] * 1e-9;
+            device.defaultLowOutputLatency = latencies[2] * 1e-9;
+            device.defaultHighOutputLatency = latencies[3] * 1e-9;
+            device.defaultSampleRate = sampleRate * 1e-3;
+            PutCachedDevice( cache, line, &device );
+        }
+    }
+    fclose( file );
+
+    /* Entries that aren't looked up in this session are dropped when the cache is saved */
+    for( i = 0; i < cache->count; ++i )
+        cache->devices[i].used = 0;
+    cache->dirty = 0;
+}
+
+/* Write the entries used in this session to a temporary file which then replaces the cache file, so that other
+ * processes never see a partially written cache */
+static void SaveDeviceCache( PaAlsaDeviceCache *cache )
+{
+    char tmpPath[PATH_MAX], *slash;
+    FILE *file;
+    size_t i;
+
+    if( !cache->path || !cache->dirty )
+        return;
+
+    /* Create the directories leading to the file */
+    snprintf( tmpPath, sizeof (tmpPath), "%s", cache->path );
+    for( slash = strchr( tmpPath + 1, '/' ); slash; slash = strchr( slash + 1, '/' ) )
+    {
+        *slash = '\0';
+        mkdir( tmpPath, 0755 );
+        *slash = '/';
+    }
+
+    snprintf( tmpPath, sizeof (tmpPath), "%s.%ld", cache->path, (long)getpid() );
+    if( !( file = fopen( tmpPath, "w" ) ) )
+    {
+        PA_DEBUG(( "%s: Unable to write device cache %s\n", __FUNCTION__, tmpPath ));
+        return;
+    }
+
+    fputs( PA_ALSA_DEVICE_CACHE_HEADER_, file );
+    for( i = 0; i < cache->count; ++i )
+    {
+        const PaAlsaCachedDevice *device = &cache->devices[i];
+
+        if( !device->used )
+            continue;
+        fprintf( file, "%s\t%d %d %d %d %lld %lld %lld %lld %lld\n", device->key, device->minInputChannels,
+                device->maxInputChannels, device->minOutputChannels, device->maxOutputChannels,
+                ToFixedPoint( device->defaultLowInputLatency, 1e9 ), ToFixedPoint( device->defaultHighInputLatency, 1e9 ),
+                ToFixedPoint( device->defaultLowOutputLatency, 1e9 ), ToFixedPoint( device->defaultHighOutputLatency, 1e9 ),
+                ToFixedPoint( device->defaultSampleRate, 1e3 ) );
+    }
+
+    if( fclose( file ) != 0 || rename( tmpPath, cache->path ) != 0 )
+    {
+        PA_DEBUG(( "%s: Unable to write device cache %s\n", __FUNCTION__, cache->path ));
+        unlink( tmpPath );
+        return;
+    }
+    cache->dirty = 0;
+}
+
+static void FreeDeviceCache( PaAlsaDeviceCache *cache )
+{
+    size_t i;
+
+    for( i = 0; i < cache->count; ++i )
+        PaUtil_FreeMemory( cache->devices[i].key );
+    PaUtil_FreeMemory( cache->devices );
+    PaUtil_FreeMemory( cache->path );
+    memset( cache, 0, sizeof (*cache) );
+}
+
+static void StoreDeviceInCache( PaAlsaDeviceCache *cache, const PaAlsaDeviceInfo *devInfo )
+{
+    const PaDeviceInfo *baseDeviceInfo = &devInfo->baseDeviceInfo;
+    PaAlsaCachedDevice device;
+
+    if( !devInfo->cacheKey )
+        return;
+
+    device.minInputChannels = devInfo->minInputChannels;
+    device.maxInputChannels = baseDeviceInfo->maxInputChannels;
+    device.minOutputChannels = devInfo->minOutputChannels;
+    device.maxOutputChannels = baseDeviceInfo->maxOutputChannels;
+    device.defaultLowInputLatency = baseDeviceInfo->defaultLowInputLatency;
+    device.defaultHighInputLatency = baseDeviceInfo->defaultHighInputLatency;
+    device.defaultLowOutputLatency = baseDeviceInfo->defaultLowOutputLatency;
+    device.defaultHighOutputLatency = baseDeviceInfo->defaultHighOutputLatency;
+    device.defaultSampleRate = baseDeviceInfo->defaultSampleRate;
+    PutCachedDevice( cache, devInfo->cacheKey, &device );
+}
+
+static void LoadDeviceFromCache( const PaAlsaCachedDevice *device, PaAlsaDeviceInfo *devInfo )
+{
+    PaDeviceInfo *baseDeviceInfo = &devInfo->baseDeviceInfo;
+
+    InitializeDeviceInfo( baseDeviceInfo );
+    devInfo->minInputChannels = device->minInputChannels;
+    baseDeviceInfo->maxInputChannels = device->maxInputChannels;
+    devInfo->minOutputChannels = device->minOutputChannels;
+    baseDeviceInfo->maxOutputChannels = device->maxOutputChannels;
+    baseDeviceInfo->defaultLowInputLatency = device->defaultLowInputLatency;
+    baseDeviceInfo->defaultHighInputLatency = device->defaultHighInputLatency;
+    baseDeviceInfo->defaultLowOutputLatency = device->defaultLowOutputLatency;
+    baseDeviceInfo->defaultHighOutputLatency = device->defaultHighOutputLatency;
+    baseDeviceInfo->defaultSampleRate = device->defaultSampleRate;
+}
+
+/** Determine the capabilities of a device by opening it.
+ *
+ * This only writes to devInfo, so different devices may be probed concurrently. If the device can't be groped,
+ * both channel counts are left at zero, so that the device is ignored.
+ * @param busy Set if the device couldn't be opened because it was busy.
+ */
+static void ProbeDevice( const HwDevInfo *deviceHwInfo, int blocking, PaAlsaDeviceInfo *devInfo, int *busy )
 {
-    PaError result = 0;
     PaDeviceInfo *baseDeviceInfo = &devInfo->baseDeviceInfo;
     snd_pcm_t *pcm = NULL;
-    PaUtilHostApiRepresentation *baseApi = &alsaApi->baseHostApiRep;
+    int ret;
 
     PA_DEBUG(( "%s: Filling device info for: %s\n", __FUNCTION__, deviceHwInfo->name ));
 
+    *busy = 0;
     /* Zero fields */
     InitializeDeviceInfo( baseDeviceInfo );
 
@@ -1186,29 +1760,57 @@ static PaError FillInDevInfo( PaAlsaHostApiRepresentation *alsaApi, HwDevInfo* d
      * hardware parameter configuration space */
 
     /* Query capture */
-    if( deviceHwInfo->hasCapture &&
-        OpenPcm( &pcm, deviceHwInfo->alsaName, SND_PCM_STREAM_CAPTURE, blocking, 0 ) >= 0 )
+    if( deviceHwInfo->hasCapture )
     {
-        if( GropeDevice( pcm, deviceHwInfo->isPlug, StreamDirection_In, blocking, devInfo ) != paNoError )
+        if( ( ret = OpenPcm( &pcm, deviceHwInfo->alsaName, SND_PCM_STREAM_CAPTURE, blocking, 0 ) ) >= 0 )
         {
-            /* Error */
-            PA_DEBUG(( "%s: Failed groping %s for capture\n", __FUNCTION__, deviceHwInfo->alsaName ));
-            goto end;
+            if( GropeDevice( pcm, deviceHwInfo->isPlug, StreamDirection_In, blocking, devInfo ) != paNoError )
+            {
+                /* Error */
+                PA_DEBUG(( "%s: Failed groping %s for capture\n", __FUNCTION__, deviceHwInfo->alsaName ));
+                goto error;
+            }
         }
+        else if( -EBUSY == ret )
+            *busy = 1;
     }
 
     /* Query playback */
-    if( deviceHwInfo->hasPlayback &&
-        OpenPcm( &pcm, deviceHwInfo->alsaName, SND_PCM_STREAM_PLAYBACK, blocking, 0 ) >= 0 )
+    if( deviceHwInfo->hasPlayback )
     {
-        if( GropeDevice( pcm, deviceHwInfo->isPlug, StreamDirection_Out, blocking, devInfo ) != paNoError )
+        if( ( ret = OpenPcm( &pcm, deviceHwInfo->alsaName, SND_PCM_STREAM_PLAYBACK, blocking, 0 ) ) >= 0 )
         {
-            /* Error */
-            PA_DEBUG(( "%s: Failed groping %s for playback\n", __FUNCTION__, deviceHwInfo->alsaName ));
-            goto end;
+            if( GropeDevice( pcm, deviceHwInfo->isPlug, StreamDirection_Out, blocking, devInfo ) != paNoError )
+            {
+                /* Error */
+                PA_DEBUG(( "%s: Failed groping %s for playback\n", __FUNCTION__, deviceHwInfo->alsaName ));
+                goto error;
+            }
         }
+        else if( -EBUSY == ret )
+            *busy = 1;
     }
 
+    return;
+
+error:
+    baseDeviceInfo->maxInputChannels = 0;
+    baseDeviceInfo->maxOutputChannels = 0;
+}
+
+/** Add a device to the device list, unless it supports neither capture nor playback.
+ *
+ * Devices are added in the order in which this is called, which also determines the default devices.
+ */
+static void AddDevice( PaAlsaHostApiRepresentation *alsaApi, const HwDevInfo *deviceHwInfo,
+        PaAlsaDeviceInfo *devInfo, int *devIdx )
+{
+    PaDeviceInfo *baseDeviceInfo = &devInfo->baseDeviceInfo;
+    PaUtilHostApiRepresentation *baseApi = &alsaApi->baseHostApiRep;
+    /* A device whose probing is deferred is assumed to work in the directions the card reports */
+    int hasInput = devInfo->probePending ? deviceHwInfo->hasCapture : baseDeviceInfo->maxInputChannels > 0;
+    int hasOutput = devInfo->probePending ? deviceHwInfo->hasPlayback : baseDeviceInfo->maxOutputChannels > 0;
+
     baseDeviceInfo->structVersion = 2;
     baseDeviceInfo->hostApi = alsaApi->hostApiIndex;
     baseDeviceInfo->name = deviceHwInfo->name;
@@ -1218,17 +1820,17 @@ static PaError FillInDevInfo( PaAlsaHostApiRepresentation *alsaApi, HwDevInfo* d
     /* A: Storing pointer to PaAlsaDeviceInfo object as pointer to PaDeviceInfo object.
      * Should now be safe to add device info, unless the device supports neither capture nor playback
      */
-    if( baseDeviceInfo->maxInputChannels > 0 || baseDeviceInfo->maxOutputChannels > 0 )
+    if( hasInput || hasOutput )
     {
         /* Make device default if there isn't already one or it is the ALSA "default" device */
         if( ( baseApi->info.defaultInputDevice == paNoDevice ||
-            !strcmp( deviceHwInfo->alsaName, "default" ) ) && baseDeviceInfo->maxInputChannels > 0 )
+            !strcmp( deviceHwInfo->alsaName, "default" ) ) && hasInput )
         {
             baseApi->info.defaultInputDevice = *devIdx;
             PA_DEBUG(( "Default input device: %s\n", deviceHwInfo->name ));
         }
         if( ( baseApi->info.defaultOutputDevice == paNoDevice ||
-            !strcmp( deviceHwInfo->alsaName, "default" ) ) && baseDeviceInfo->maxOutputChannels > 0 )
+            !strcmp( deviceHwInfo->alsaName, "default" ) ) && hasOutput )
         {
             baseApi->info.defaultOutputDevice = *devIdx;
             PA_DEBUG(( "Default output device: %s\n", deviceHwInfo->name ));
@@ -1241,12 +1843,119 @@ static PaError FillInDevInfo( PaAlsaHostApiRepresentation *alsaApi, HwDevInfo* d
     {
         PA_DEBUG(( "%s: Skipped device: %s, all channels == 0\n", __FUNCTION__, deviceHwInfo->name ));
     }
+}
+
+/* Devices probed concurrently while building the device list */
+typedef struct
+{
+    const HwDevInfo *hwDevInfos;
+    PaAlsaDeviceInfo *deviceInfos;
+    int *busy;
+    const size_t *indices;      /* The devices to probe */
+    size_t count;
+    size_t next;                /* Guarded by mtx */
+    int blocking;
+    pthread_mutex_t mtx;
+}
+PaAlsaProbeQueue;
+
+static void *ProbeThreadFunc( void *userData )
+{
+    PaAlsaProbeQueue *queue = (PaAlsaProbeQueue *)userData;
+
+    for( ;; )
+    {
+        size_t i;
+
+        pthread_mutex_lock( &queue->mtx );
+        if( queue->next == queue->count )
+        {
+            pthread_mutex_unlock( &queue->mtx );
+            break;
+        }
+        i = queue->indices[queue->next++];
+        pthread_mutex_unlock( &queue->mtx );
+
+        ProbeDevice( &queue->hwDevInfos[i], queue->blocking, &queue->deviceInfos[i], &queue->busy[i] );
+    }
+
+    return NULL;
+}
+
+/* Probe the queued devices with up to threadCount threads, the calling thread being one of them */
+static void ProbeDevices( PaAlsaProbeQueue *queue, int threadCount )
+{
+    pthread_t threads[PA_ALSA_MAX_PROBE_THREADS_];
+    int i, started = 0;
+
+    if( (size_t)threadCount > queue->count )
+        threadCount = (int)queue->count;
+    threadCount = PA_MIN( threadCount, PA_ALSA_MAX_PROBE_THREADS_ );
+
+    PA_ASSERT_CALL( pthread_mutex_init( &queue->mtx, NULL ), 0 );
+    for( i = 1; i < threadCount; ++i )
+    {
+        /* Should a thread fail to start, the others do its share */
+        if( pthread_create( &threads[started], NULL, ProbeThreadFunc, queue ) == 0 )
+            ++started;
+    }
+    ProbeThreadFunc( queue );
+    for( i = 0; i < started; ++i )
+        PA_ASSERT_CALL( pthread_join( threads[i], NULL ), 0 );
+    PA_ASSERT_CALL( pthread_mutex_destroy( &queue->mtx ), 0 );
+}
+
+/* Serializes the deferred probes of PrepareDeviceInfo, which may be called from any thread */
+static pthread_mutex_t probeMtx_ = PTHREAD_MUTEX_INITIALIZER;
+
+/** Probe a device whose probing was deferred when building the device list, see PA_ALSA_LAZY_PROBE.
+ *
+ * The device is probed into a copy, so that the published info never appears zeroed to another thread. A device that
+ * was busy stays pending and is probed again by the next call.
+ */
+static void PrepareDeviceInfo( PaUtilHostApiRepresentation *hostApi, int device )
+{
+    PaAlsaHostApiRepresentation *alsaApi = (PaAlsaHostApiRepresentation *)hostApi;
+    PaAlsaDeviceInfo *devInfo = (PaAlsaDeviceInfo *)hostApi->deviceInfos[device];
+    PaAlsaDeviceInfo probed;
+    HwDevInfo hwInfo;
+    int busy;
+
+    PA_ASSERT_CALL( pthread_mutex_lock( &probeMtx_ ), 0 );
+    if( !devInfo->probePending )
+        goto end;
+
+    probed = *devInfo;
+    hwInfo.alsaName = devInfo->alsaName;
+    hwInfo.name = (char *)devInfo->baseDeviceInfo.name;
+    hwInfo.isPlug = devInfo->isPlug;
+    hwInfo.hasPlayback = devInfo->hasPlayback;
+    hwInfo.hasCapture = devInfo->hasCapture;
+    hwInfo.cacheKey = devInfo->cacheKey;
+    ProbeDevice( &hwInfo, alsaApi->probeBlocking, &probed, &busy );
+
+    /* ProbeDevice resets the identity of the device along with its capabilities */
+    probed.baseDeviceInfo.structVersion = 2;
+    probed.baseDeviceInfo.hostApi = alsaApi->hostApiIndex;
+    probed.baseDeviceInfo.name = devInfo->baseDeviceInfo.name;
+    /* A device that's busy now may have other capabilities once it's free, probe it again next time */
+    probed.probePending = busy;
+    *devInfo = probed;
+
+    if( !busy )
+        StoreDeviceInCache( &alsaApi->deviceCache, devInfo );
 
 end:
-    return result;
+    PA_ASSERT_CALL( pthread_mutex_unlock( &probeMtx_ ), 0 );
 }
 
-/* Build PaDeviceInfo list, ignore devices for which we cannot determine capabilities (possibly busy, sigh) */
+/** Build PaDeviceInfo list, ignore devices for which we cannot determine capabilities (possibly busy, sigh)
+ *
+ * As opening every device is what makes initialization slow, devices are probed concurrently where alsa-lib is
+ * thread safe, and their capabilities may be cached on disk, see GetDeviceCachePath. If PA_ALSA_LAZY_PROBE is set,
+ * hw devices that aren't in the cache are listed without being probed, and are probed once their device info is
+ * first asked for or a stream is opened on them.
+ */
 static PaError BuildDeviceList( PaAlsaHostApiRepresentation *alsaApi )
 {
     PaUtilHostApiRepresentation *baseApi = &alsaApi->baseHostApiRep;
@@ -1255,7 +1964,13 @@ static PaError BuildDeviceList( PaAlsaHostApiRepresentation *alsaApi )
     snd_ctl_card_info_t *cardInfo;
     PaError result = paNoError;
     size_t numDeviceNames = 0, maxDeviceNames = 1, i;
+    size_t numCardDevices, numConcurrent = 0, numProbed = 0;
     HwDevInfo *hwDevInfos = NULL;
+    PaAlsaProbeQueue probeQueue;
+    size_t *probeIndices = NULL;
+    int *busy = NULL;
+    int lazyProbe = 0;
+    PaUint64 baseHash, configHash;
     snd_config_t *topNode = NULL;
     snd_pcm_info_t *pcmInfo;
     int res;
@@ -1269,6 +1984,17 @@ static PaError BuildDeviceList( PaAlsaHostApiRepresentation *alsaApi )
 
     if( getenv( "PA_ALSA_INITIALIZE_BLOCK" ) && atoi( getenv( "PA_ALSA_INITIALIZE_BLOCK" ) ) )
         blocking = 0;
+    alsaApi->probeBlocking = blocking;
+
+    if( getenv( "PA_ALSA_LAZY_PROBE" ) && atoi( getenv( "PA_ALSA_LAZY_PROBE" ) ) )
+        lazyProbe = 1;
+
+    alsaApi->deviceCache.path = GetDeviceCachePath();
+    LoadDeviceCache( &alsaApi->deviceCache );
+    /* What capabilities depend on besides the device itself */
+    baseHash = HashString( PA_ALSA_HASH_SEED_, alsa_snd_asoundlib_version() );
+    baseHash = HashString( baseHash, blocking ? "nonblock" : "block" );
+    configHash = baseHash;
 
     /* If PA_ALSA_PLUGHW is 1 (non-zero), use the plughw: pcm throughout instead of hw: */
     if( getenv( "PA_ALSA_PLUGHW" ) && atoi( getenv( "PA_ALSA_PLUGHW" ) ) )
@@ -1299,6 +2025,7 @@ static PaError BuildDeviceList( PaAlsaHostApiRepresentation *alsaApi )
         int devIdx = -1;
         snd_ctl_t *ctl;
         char buf[66];
+        PaUint64 cardHash;
 
         snprintf( alsaCardName, sizeof (alsaCardName), "hw:%d", cardIdx );
 
@@ -1310,6 +2037,8 @@ static PaError BuildDeviceList( PaAlsaHostApiRepresentation *alsaApi )
             continue;
         }
         alsa_snd_ctl_card_info( ctl, cardInfo );
+        cardHash = HashCard( baseHash, cardInfo );
+        configHash = HashCard( configHash, cardInfo );
 
         PA_ENSURE( PaAlsa_StrDup( alsaApi, &cardName, alsa_snd_ctl_card_info_get_name( cardInfo )) );
 
@@ -1367,9 +2096,13 @@ static PaError BuildDeviceList( PaAlsaHostApiRepresentation *alsaApi )
             hwDevInfos[ numDeviceNames - 1 ].isPlug = usePlughw;
             hwDevInfos[ numDeviceNames - 1 ].hasPlayback = hasPlayback;
             hwDevInfos[ numDeviceNames - 1 ].hasCapture = hasCapture;
+            PA_ENSURE( MakeCacheKey( alsaApi, &hwDevInfos[ numDeviceNames - 1 ].cacheKey, alsaDeviceName, cardHash ) );
         }
         alsa_snd_ctl_close( ctl );
     }
+    numCardDevices = numDeviceNames;
+    /* Plugins may be layered on any card */
+    configHash = HashAlsaConfig( configHash );
 
     /* Iterate over plugin devices */
     if( NULL == (*alsa_snd_config) )
@@ -1442,6 +2175,7 @@ static PaError BuildDeviceList( PaAlsaHostApiRepresentation *alsaApi )
                 hwDevInfos[numDeviceNames - 1].hasPlayback = 1;
                 hwDevInfos[numDeviceNames - 1].hasCapture  = 1;
             }
+            PA_ENSURE( MakeCacheKey( alsaApi, &hwDevInfos[numDeviceNames - 1].cacheKey, alsaDeviceName, configHash ) );
         }
     }
     else
@@ -1455,40 +2189,96 @@ static PaError BuildDeviceList( PaAlsaHostApiRepresentation *alsaApi )
     PA_UNLESS( deviceInfoArray = (PaAlsaDeviceInfo*)PaUtil_GroupAllocateZeroInitializedMemory(
             alsaApi->allocations, sizeof(PaAlsaDeviceInfo) * numDeviceNames ), paInsufficientMemory );
 
-    /* Loop over list of cards, filling in info. If a device is deemed unavailable (can't get name),
-     * it's ignored.
+    PA_UNLESS( probeIndices = (size_t *)PaUtil_AllocateZeroInitializedMemory(
+            sizeof (size_t) * (numDeviceNames + 1) ), paInsufficientMemory );
+    PA_UNLESS( busy = (int *)PaUtil_AllocateZeroInitializedMemory( sizeof (int) * (numDeviceNames + 1) ),
+            paInsufficientMemory );
+
+    /* Take what is known from the cache, and defer probing hw devices if asked to.
      *
-     * Note that we do this in two stages. This is a workaround owing to the fact that the 'dmix'
+     * The rest are probed in two stages. This is a workaround owing to the fact that the 'dmix'
      * plugin may cause the underlying hardware device to be busy for a short while even after it
      * (dmix) is closed. The 'default' plugin may also point to the dmix plugin, so the same goes
      * for this.
      */
-    PA_DEBUG(( "%s: Filling device info for %d devices\n", __FUNCTION__, numDeviceNames ));
-    for( i = 0, devIdx = 0; i < numDeviceNames; ++i )
+    for( i = 0; i < numDeviceNames; ++i )
     {
         PaAlsaDeviceInfo* devInfo = &deviceInfoArray[i];
         HwDevInfo* hwInfo = &hwDevInfos[i];
-        if( !strcmp( hwInfo->name, "dmix" ) || !strcmp( hwInfo->name, "default" ) )
+        const PaAlsaCachedDevice *cached;
+
+        devInfo->cacheKey = hwInfo->cacheKey;
+        if( ( cached = FindCachedDevice( &alsaApi->deviceCache, hwInfo->cacheKey ) ) )
         {
-            continue;
+            PA_DEBUG(( "%s: Found device %s in the cache\n", __FUNCTION__, hwInfo->name ));
+            LoadDeviceFromCache( cached, devInfo );
         }
+        else if( lazyProbe && i < numCardDevices )
+        {
+            InitializeDeviceInfo( &devInfo->baseDeviceInfo );
+            devInfo->probePending = 1;
+            devInfo->hasPlayback = hwInfo->hasPlayback;
+            devInfo->hasCapture = hwInfo->hasCapture;
+        }
+        else if( strcmp( hwInfo->name, "dmix" ) && strcmp( hwInfo->name, "default" ) )
+            probeIndices[numConcurrent++] = i;
+    }
+    numProbed = numConcurrent;
+    for( i = 0; i < numDeviceNames; ++i )
+    {
+        if( !( strcmp( hwDevInfos[i].name, "dmix" ) && strcmp( hwDevInfos[i].name, "default" ) ) &&
+                !FindCachedDevice( &alsaApi->deviceCache, hwDevInfos[i].cacheKey ) )
+            probeIndices[numProbed++] = i;
+    }
 
-        PA_ENSURE( FillInDevInfo( alsaApi, hwInfo, blocking, devInfo, &devIdx ) );
+    /* Opening devices from several threads requires a thread safe alsa-lib */
+    PA_DEBUG(( "%s: Filling device info for %d devices\n", __FUNCTION__, numProbed ));
+    probeQueue.hwDevInfos = hwDevInfos;
+    probeQueue.deviceInfos = deviceInfoArray;
+    probeQueue.busy = busy;
+    probeQueue.indices = probeIndices;
+    probeQueue.count = numConcurrent;
+    probeQueue.next = 0;
+    probeQueue.blocking = blocking;
+    ProbeDevices( &probeQueue,
+            alsaApi->alsaLibVersion >= ALSA_VERSION_INT( 1, 1, 2 ) ? PA_ALSA_MAX_PROBE_THREADS_ : 1 );
+
+    /* Devices may have been busy because they were probed at the same time as plugins layered on them, try those
+     * again one at a time */
+    for( i = 0; i < numConcurrent; ++i )
+    {
+        size_t j = probeIndices[i];
+        if( busy[j] )
+            ProbeDevice( &hwDevInfos[j], blocking, &deviceInfoArray[j], &busy[j] );
     }
-    assert( devIdx <= numDeviceNames );
+
     /* Now inspect 'dmix' and 'default' plugins */
-    for( i = 0; i < numDeviceNames; ++i )
+    for( i = numConcurrent; i < numProbed; ++i )
     {
-        PaAlsaDeviceInfo* devInfo = &deviceInfoArray[i];
-        HwDevInfo* hwInfo = &hwDevInfos[i];
-        if( strcmp( hwInfo->name, "dmix" ) && strcmp( hwInfo->name, "default" ) )
-        {
-            continue;
-        }
+        size_t j = probeIndices[i];
+        ProbeDevice( &hwDevInfos[j], blocking, &deviceInfoArray[j], &busy[j] );
+    }
 
-        PA_ENSURE( FillInDevInfo( alsaApi, hwInfo, blocking, devInfo, &devIdx ) );
+    /* Whether a busy device works can't be told, don't remember it */
+    for( i = 0; i < numProbed; ++i )
+    {
+        if( !busy[probeIndices[i]] )
+            StoreDeviceInCache( &alsaApi->deviceCache, &deviceInfoArray[probeIndices[i]] );
     }
-    free( hwDevInfos );
+    SaveDeviceCache( &alsaApi->deviceCache );
+
+    /* Add the devices in the order in which they were found, 'dmix' and 'default' last */
+    for( i = 0, devIdx = 0; i < numDeviceNames; ++i )
+    {
+        if( strcmp( hwDevInfos[i].name, "dmix" ) && strcmp( hwDevInfos[i].name, "default" ) )
+            AddDevice( alsaApi, &hwDevInfos[i], &deviceInfoArray[i], &devIdx );
+    }
+    for( i = 0; i < numDeviceNames; ++i )
+    {
+        if( !( strcmp( hwDevInfos[i].name, "dmix" ) && strcmp( hwDevInfos[i].name, "default" ) ) )
+            AddDevice( alsaApi, &hwDevInfos[i], &deviceInfoArray[i], &devIdx );
+    }
+    assert( devIdx <= numDeviceNames );
 
     baseApi->info.deviceCount = devIdx;   /* Number of successfully queried devices */
 
@@ -1497,6 +2287,11 @@ static PaError BuildDeviceList( PaAlsaHostApiRepresentation *alsaApi )
 #endif
 
 end:
+    free( hwDevInfos );
+    if( probeIndices )
+        PaUtil_FreeMemory( probeIndices );
+    if( busy )
+        PaUtil_FreeMemory( busy );
     return result;
 
 error:
@@ -1504,38 +2299,73 @@ error:
     goto end;
 }
 
+/** The number of channels of the further devices of an aggregate, see PaAlsaStreamInfo::aggregateDevices. */
+static int GetAggregateChannelCount( const PaStreamParameters *parameters )
+{
+    const PaAlsaStreamInfo *streamInfo = parameters->hostApiSpecificStreamInfo;
+    int count = 0;
+    unsigned long i;
+
+    if( streamInfo && streamInfo->version >= 3 )
+    {
+        for( i = 0; i < streamInfo->aggregateDeviceCount; ++i )
+            count += streamInfo->aggregateDevices[i].channelCount;
+    }
+    return count;
+}
+
 /* Check against known device capabilities */
 static PaError ValidateParameters( const PaStreamParameters *parameters, PaUtilHostApiRepresentation *hostApi, StreamDirection mode )
 {
     PaError result = paNoError;
     int maxChans;
     const PaAlsaDeviceInfo *deviceInfo = NULL;
+    const PaAlsaStreamInfo *streamInfo;
     assert( parameters );
 
+    streamInfo = parameters->hostApiSpecificStreamInfo;
+    if( streamInfo )
+    {
+        unsigned long i;
+
+        PA_UNLESS( ( streamInfo->size == sizeof (PaAlsaStreamInfo) && streamInfo->version == 3 ) ||
+                ( streamInfo->size == offsetof( PaAlsaStreamInfo, aggregateDevices ) && streamInfo->version == 2 ) ||
+                ( streamInfo->size == offsetof( PaAlsaStreamInfo, cpuAffinity ) && streamInfo->version == 1 ),
+                paIncompatibleHostApiSpecificStreamInfo );
+        if( streamInfo->version >= 3 && streamInfo->aggregateDeviceCount > 0 )
+        {
+            PA_UNLESS( streamInfo->aggregateDevices != NULL, paIncompatibleHostApiSpecificStreamInfo );
+            for( i = 0; i < streamInfo->aggregateDeviceCount; ++i )
+            {
+                PA_UNLESS( streamInfo->aggregateDevices[i].deviceString != NULL, paInvalidDevice );
+                PA_UNLESS( streamInfo->aggregateDevices[i].channelCount > 0, paInvalidChannelCount );
+            }
+            /* The stream's own device needs channels as well */
+            PA_UNLESS( parameters->channelCount > GetAggregateChannelCount( parameters ), paInvalidChannelCount );
+        }
+    }
+
     if( parameters->device != paUseHostApiSpecificDeviceSpecification )
     {
         assert( parameters->device < hostApi->info.deviceCount );
-        PA_UNLESS( parameters->hostApiSpecificStreamInfo == NULL, paBadIODeviceCombination );
+        /* Version 2 stream info may be used with a device index to set the callback thread's CPU affinity */
+        PA_UNLESS( streamInfo == NULL || ( streamInfo->version >= 2 && streamInfo->deviceString == NULL ),
+                paBadIODeviceCombination );
+        PrepareDeviceInfo( hostApi, parameters->device );
         deviceInfo = GetDeviceInfo( hostApi, parameters->device );
     }
     else
     {
-        const PaAlsaStreamInfo *streamInfo = parameters->hostApiSpecificStreamInfo;
-
-        PA_UNLESS( parameters->device == paUseHostApiSpecificDeviceSpecification, paInvalidDevice );
-        PA_UNLESS( streamInfo->size == sizeof (PaAlsaStreamInfo) && streamInfo->version == 1,
-                paIncompatibleHostApiSpecificStreamInfo );
-        PA_UNLESS( streamInfo->deviceString != NULL, paInvalidDevice );
+        PA_UNLESS( streamInfo != NULL && streamInfo->deviceString != NULL, paInvalidDevice );
 
         /* Skip further checking */
         return paNoError;
     }
 
     assert( deviceInfo );
-    assert( parameters->hostApiSpecificStreamInfo == NULL );
     maxChans = ( StreamDirection_In == mode ? deviceInfo->baseDeviceInfo.maxInputChannels :
         deviceInfo->baseDeviceInfo.maxOutputChannels );
-    PA_UNLESS( parameters->channelCount <= maxChans, paInvalidChannelCount );
+    PA_UNLESS( parameters->channelCount - GetAggregateChannelCount( parameters ) <= maxChans, paInvalidChannelCount );
 
 error:
     return result;
@@ -1741,15 +2571,14 @@ static PaError AlsaOpen( const PaUtilHostApiRepresentation *hostApi, const PaStr
     int ret;
     const char* deviceName = "";
     const PaAlsaDeviceInfo *deviceInfo = NULL;
-    PaAlsaStreamInfo *streamInfo = (PaAlsaStreamInfo *)params->hostApiSpecificStreamInfo;
 
-    if( !streamInfo )
+    if( params->device != paUseHostApiSpecificDeviceSpecification )
     {
         deviceInfo = GetDeviceInfo( hostApi, params->device );
         deviceName = deviceInfo->alsaName;
     }
     else
-        deviceName = streamInfo->deviceString;
+        deviceName = ((PaAlsaStreamInfo *)params->hostApiSpecificStreamInfo)->deviceString;
 
     PA_DEBUG(( "%s: Opening device %s\n", __FUNCTION__, deviceName ));
     if( (ret = OpenPcm( pcm, deviceName, streamDir == StreamDirection_In ? SND_PCM_STREAM_CAPTURE : SND_PCM_STREAM_PLAYBACK,
@@ -1778,16 +2607,18 @@ static PaError TestParameters( const PaUtilHostApiRepresentation *hostApi, const
     unsigned int numHostChannels;
     PaSampleFormat hostFormat;
     snd_pcm_hw_params_t *hwParams;
+    /* Only the stream's own device of an aggregate is tested */
+    int channelCount = parameters->channelCount - GetAggregateChannelCount( parameters );
     alsa_snd_pcm_hw_params_alloca( &hwParams );
 
-    if( !parameters->hostApiSpecificStreamInfo )
+    if( parameters->device != paUseHostApiSpecificDeviceSpecification )
     {
         const PaAlsaDeviceInfo *devInfo = GetDeviceInfo( hostApi, parameters->device );
-        numHostChannels = PA_MAX( parameters->channelCount, StreamDirection_In == streamDir ?
+        numHostChannels = PA_MAX( channelCount, StreamDirection_In == streamDir ?
                 devInfo->minInputChannels : devInfo->minOutputChannels );
     }
     else
-        numHostChannels = parameters->channelCount;
+        numHostChannels = channelCount;
 
     PA_ENSURE( AlsaOpen( hostApi, parameters, streamDir, &pcm ) );
 
@@ -1893,242 +2724,874 @@ error:
 }
 
 
-static PaError PaAlsaStreamComponent_Initialize( PaAlsaStreamComponent *self, PaAlsaHostApiRepresentation *alsaApi,
-        const PaStreamParameters *params, StreamDirection streamDir, int callbackMode )
+/* Device clocks, modelled by delay-locked loops */
+
+/** Start a delay-locked loop over, at the nominal rate of its clock. */
+static void PaAlsaDll_Reset( PaAlsaDll *self, double nominalRate )
 {
-    PaError result = paNoError;
-    PaSampleFormat userSampleFormat = params->sampleFormat, hostSampleFormat = paNoError;
-    assert( params->channelCount > 0 );
+    memset( self, 0, sizeof (PaAlsaDll) );
+    self->nominalRate = self->rate = nominalRate;
+}
 
-    /* Make sure things have an initial value */
-    memset( self, 0, sizeof (PaAlsaStreamComponent) );
+/** Feed a delay-locked loop with the frame position of its device at a given time.
+ *
+ * This is the second order loop of Fons Adriaensen's "Using a DLL to filter time", generalized to updates at
+ * irregular intervals, as timestamps are only taken when the hardware position is updated. The loop starts over
+ * if there has been no update for a long time, or the position is far off, as after an xrun.
+ */
+static void PaAlsaDll_Update( PaAlsaDll *self, double position, double time )
+{
+    double elapsed = time - self->time, predicted, error, omega;
 
-    if( NULL == params->hostApiSpecificStreamInfo )
-    {
-        const PaAlsaDeviceInfo *devInfo = GetDeviceInfo( &alsaApi->baseHostApiRep, params->device );
-        self->numHostChannels = PA_MAX( params->channelCount, StreamDirection_In == streamDir ? devInfo->minInputChannels
-                : devInfo->minOutputChannels );
-        self->deviceIsPlug = devInfo->isPlug;
-        PA_DEBUG(( "%s: Host Chans %c %i\n", __FUNCTION__, streamDir == StreamDirection_In ? 'C' : 'P', self->numHostChannels ));
-    }
-    else
+    if( self->valid && elapsed <= 0. )
+        return; /* The hardware position hasn't been updated since */
+
+    predicted = self->position + self->rate * elapsed;
+    error = position - predicted;
+    if( !self->valid || elapsed > PA_ALSA_DLL_MAX_INTERVAL_ || fabs( error ) > PA_ALSA_DLL_MAX_ERROR_ * self->nominalRate )
     {
-        /* We're blissfully unaware of the minimum channelCount */
-        self->numHostChannels = params->channelCount;
-        /* Check if device name does not start with hw: to determine if it is a 'plug' device */
-        if( strncmp( "hw:", ((PaAlsaStreamInfo *)params->hostApiSpecificStreamInfo)->deviceString, 3 ) != 0  )
-            self->deviceIsPlug = 1; /* An Alsa plug device, not a direct hw device */
+        self->position = position;
+        self->time = self->lockTime = time;
+        self->valid = 1;
+        return;
     }
-    if( self->deviceIsPlug && alsaApi->alsaLibVersion < ALSA_VERSION_INT( 1, 0, 16 ) )
-        self->useReventFix = 1; /* Prior to Alsa1.0.16, plug devices may stutter without this fix */
 
-    self->device = params->device;
+    omega = 2. * M_PI * elapsed * ( time - self->lockTime < PA_ALSA_DLL_LOCK_TIME_ ? PA_ALSA_DLL_INITIAL_BANDWIDTH_ :
+            PA_ALSA_DLL_BANDWIDTH_ );
+    omega = PA_MIN( omega, .5 );
+    self->position = predicted + sqrt( 2. ) * omega * error;
+    self->rate += omega * omega * error / elapsed;
+    self->rate = PA_MAX( PA_MIN( self->rate, self->nominalRate * ( 1. + PA_ALSA_DLL_MAX_DEVIATION_ ) ),
+            self->nominalRate * ( 1. - PA_ALSA_DLL_MAX_DEVIATION_ ) );
+    self->time = time;
+}
 
-    PA_ENSURE( AlsaOpen( &alsaApi->baseHostApiRep, params, streamDir, &self->pcm ) );
-    self->nfds = alsa_snd_pcm_poll_descriptors_count( self->pcm );
+/** The frame position at a given time, according to a delay-locked loop. */
+static double PaAlsaDll_GetPosition( const PaAlsaDll *self, double time )
+{
+    return self->position + ( time - self->time ) * self->rate;
+}
 
-    PA_ENSURE( hostSampleFormat = PaUtil_SelectClosestAvailableFormat( GetAvailableFormats( self->pcm ), userSampleFormat ) );
+/** The time at which a frame position is reached, according to a delay-locked loop. */
+static double PaAlsaDll_GetTime( const PaAlsaDll *self, double position )
+{
+    return self->time + ( position - self->position ) / self->rate;
+}
 
-    self->hostSampleFormat = hostSampleFormat;
-    self->nativeFormat = Pa2AlsaFormat( hostSampleFormat );
-    self->hostInterleaved = self->userInterleaved = !( userSampleFormat & paNonInterleaved );
-    self->numUserChannels = params->channelCount;
-    self->streamDir = streamDir;
-    self->canMmap = 0;
-    self->nonMmapBuffer = NULL;
-    self->nonMmapBufferSize = 0;
+/** The current time on the clock of ALSA's timestamps, gettimeofday() unless configured otherwise. */
+static PaTime GetAlsaTime( void )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_REALTIME, &now );
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
 
-    if( !callbackMode && !self->userInterleaved )
-    {
-        /* Pre-allocate non-interleaved user provided buffers */
-        PA_UNLESS( self->userBuffers = PaUtil_AllocateZeroInitializedMemory( sizeof (void *) * self->numUserChannels ),
-                paInsufficientMemory );
-    }
+/** Feed a delay-locked loop with the hardware position of a running pcm, from its status.
+ *
+ * The position counts frames from the start of the device as captured or played, rather than as transferred.
+ * @param framesTransferred The number of frames transferred since the start, not counting any in progress.
+ */
+static void UpdateClock( PaAlsaDll *dll, snd_pcm_t *pcm, StreamDirection streamDir, PaInt64 framesTransferred )
+{
+    snd_pcm_status_t *status;
+    snd_htimestamp_t stamp;
+    snd_pcm_sframes_t delay;
 
-error:
+    alsa_snd_pcm_status_alloca( &status );
+    if( alsa_snd_pcm_status( pcm, status ) < 0 || alsa_snd_pcm_status_get_state( status ) != SND_PCM_STATE_RUNNING )
+        return;
+    alsa_snd_pcm_status_get_htstamp( status, &stamp );
+    if( !stamp.tv_sec && !stamp.tv_nsec )
+        return;
+
+    /* The timestamp is that of the last hardware position update, which the delay is counted from */
+    delay = alsa_snd_pcm_status_get_delay( status );
+    PaAlsaDll_Update( dll, (double)framesTransferred + ( StreamDirection_In == streamDir ? delay : -delay ),
+            stamp.tv_sec + stamp.tv_nsec * 1e-9 );
+}
 
-    /* Log all available formats. */
-    if ( hostSampleFormat == paSampleFormatNotSupported )
-    {
-        LogAllAvailableFormats( self->pcm );
-        PA_DEBUG(( "%s: Please provide the log output to PortAudio developers, your hardware does not have any sample format implemented yet.\n", __FUNCTION__ ));
-    }
+/* Aggregate devices, see PaAlsaStreamInfo::aggregateDevices */
 
-    return result;
+static int IsXrun( long err )
+{
+    // ESTRPIPE is provided by the Linux kernel headers, and is unavailable
+    // on the BSDs, which can still use alsalib.
+#if defined(ESTRPIPE) && ESTRPIPE != EPIPE
+    if( err == -ESTRPIPE )
+        return 1;
+#endif
+    return err == -EPIPE;
 }
 
-static void PaAlsaStreamComponent_Terminate( PaAlsaStreamComponent *self )
+/* 4-point, 3rd-order Hermite interpolation between y1 and y2 */
+static float Interpolate( float y0, float y1, float y2, float y3, float t )
 {
-    alsa_snd_pcm_close( self->pcm );
-    PaUtil_FreeMemory( self->userBuffers ); /* (Ptr can be NULL; PaUtil_FreeMemory includes a NULL check) */
-    PaUtil_FreeMemory( self->nonMmapBuffer );
+    float c1 = .5f * ( y2 - y0 );
+    float c2 = y0 - 2.5f * y1 + 2.f * y2 - .5f * y3;
+    float c3 = .5f * ( y3 - y0 ) + 1.5f * ( y1 - y2 );
+    return ( ( c3 * t + c2 ) * t + c1 ) * t + y1;
 }
 
-/*
-static int nearbyint_(float value) {
-    if(  value - (int)value > .5 )
-        return (int)ceil( value );
-    return (int)floor( value );
+/** Drop frames from the front of a member's fifo. */
+static void PaAlsaAggregateMember_Discard( PaAlsaAggregateMember *self, unsigned long frames )
+{
+    frames = PA_MIN( frames, self->fifoFrames );
+    memmove( self->fifo, self->fifo + frames * self->numChannels, ( self->fifoFrames - frames ) * self->numChannels *
+            sizeof (float) );
+    self->fifoFrames -= frames;
+    self->fifoStart += frames;
 }
-*/
 
-/** Initiate configuration, preparing for determining a period size suitable for both capture and playback components.
+/** Get the resampling step that steers a member's phase towards the target position given by the clocks.
  *
+ * Small errors are corrected gradually over PA_ALSA_AGGREGATE_CORRECTION_TIME_, which keeps the pitch steady.
+ * @param maxError The error beyond which phase is set to the target right away.
+ * @param framesPerSecond Of the resampler's output.
  */
-static PaError PaAlsaStreamComponent_InitialConfigure( PaAlsaStreamComponent *self, const PaStreamParameters *params,
-        int primeBuffers, snd_pcm_hw_params_t *hwParams, double *sampleRate )
+static double PaAlsaAggregateMember_Steer( PaAlsaAggregateMember *self, double target, double ratio, double maxError,
+        double framesPerSecond )
 {
-    /* Configuration consists of setting all of ALSA's parameters.
-     * These parameters come in two flavors: hardware parameters
-     * and software parameters.  Hardware parameters will affect
-     * the way the device is initialized, software parameters
-     * affect the way ALSA interacts with me, the user-level client.
-     */
-
-    PaError result = paNoError;
-    snd_pcm_access_t accessMode, alternateAccessMode;
-    int dir = 0;
-    snd_pcm_t *pcm = self->pcm;
-    double sr = *sampleRate;
-    unsigned int minPeriods = 2;
-
-    /* self->framesPerPeriod = framesPerHostBuffer; */
-
-    /* ... fill up the configuration space with all possible
-     * combinations of parameters this device will accept */
-    ENSURE_( alsa_snd_pcm_hw_params_any( pcm, hwParams ), paUnanticipatedHostError );
+    double error = target - self->phase, correction;
 
-    ENSURE_( alsa_snd_pcm_hw_params_set_periods_integer( pcm, hwParams ), paUnanticipatedHostError );
-    /* I think there should be at least 2 periods (even though ALSA doesn't appear to enforce this) */
-    dir = 0;
-    ENSURE_( alsa_snd_pcm_hw_params_set_periods_min( pcm, hwParams, &minPeriods, &dir ), paUnanticipatedHostError );
-
-    if( self->userInterleaved )
+    if( !self->synced || fabs( error ) > maxError )
     {
-        accessMode          = SND_PCM_ACCESS_MMAP_INTERLEAVED;
-        alternateAccessMode = SND_PCM_ACCESS_MMAP_NONINTERLEAVED;
-
-        /* test if MMAP supported */
-        self->canMmap = alsa_snd_pcm_hw_params_test_access( pcm, hwParams, accessMode ) >= 0 ||
-                        alsa_snd_pcm_hw_params_test_access( pcm, hwParams, alternateAccessMode ) >= 0;
+        PA_DEBUG(( "%s: Resyncing by %f frames\n", __FUNCTION__, self->synced ? error : 0. ));
+        self->phase = target;
+        self->synced = 1;
+        return ratio;
+    }
 
-        PA_DEBUG(( "%s: device MMAP SND_PCM_ACCESS_MMAP_INTERLEAVED: %s\n", __FUNCTION__, ( alsa_snd_pcm_hw_params_test_access( pcm, hwParams, accessMode ) >= 0 ? "YES" : "NO" ) ));
-        PA_DEBUG(( "%s: device MMAP SND_PCM_ACCESS_MMAP_NONINTERLEAVED: %s\n", __FUNCTION__, ( alsa_snd_pcm_hw_params_test_access( pcm, hwParams, alternateAccessMode ) >= 0 ? "YES" : "NO" ) ));
+    correction = error / ( framesPerSecond * PA_ALSA_AGGREGATE_CORRECTION_TIME_ );
+    return ratio + PA_MAX( PA_MIN( correction, ratio * PA_ALSA_AGGREGATE_MAX_CORRECTION_ ),
+            -ratio * PA_ALSA_AGGREGATE_MAX_CORRECTION_ );
+}
 
-        if( !self->canMmap )
+/** Resample the fifo of a member into its scratch buffer, from phase on in steps of step fifo frames.
+ *
+ * Frames that have already been discarded from the fifo are silent, as are frames not in yet if padMissing is set,
+ * otherwise resampling stops at those. Frames of the fifo that are no longer needed are discarded.
+ * @return The number of frames resampled.
+ */
+static unsigned long PaAlsaAggregateMember_Resample( PaAlsaAggregateMember *self, unsigned long frames, double step,
+        int padMissing )
+{
+    float *out = self->scratch;
+    const float *in;
+    unsigned long i;
+    long index;
+    double position;
+    int n = self->numChannels, c;
+
+    for( i = 0; i < frames; ++i, out += n )
+    {
+        position = self->phase - self->fifoStart;
+        index = (long)floor( position );
+        if( index + 2 >= (long)self->fifoFrames && !padMissing )
+            break;
+
+        if( index < 1 || index + 2 >= (long)self->fifoFrames )
+            memset( out, 0, n * sizeof (float) );
+        else
         {
-            accessMode          = SND_PCM_ACCESS_RW_INTERLEAVED;
-            alternateAccessMode = SND_PCM_ACCESS_RW_NONINTERLEAVED;
+            in = self->fifo + ( index - 1 ) * n;
+            for( c = 0; c < n; ++c )
+                out[c] = Interpolate( in[c], in[c + n], in[c + 2 * n], in[c + 3 * n], (float)( position - index ) );
         }
+        self->phase += step;
     }
-    else
-    {
-        accessMode          = SND_PCM_ACCESS_MMAP_NONINTERLEAVED;
-        alternateAccessMode = SND_PCM_ACCESS_MMAP_INTERLEAVED;
 
-        /* test if MMAP supported */
-        self->canMmap = alsa_snd_pcm_hw_params_test_access( pcm, hwParams, accessMode ) >= 0 ||
-                        alsa_snd_pcm_hw_params_test_access( pcm, hwParams, alternateAccessMode ) >= 0;
+    /* Keep a frame before the next position to interpolate from */
+    position = floor( self->phase - self->fifoStart ) - 1.;
+    if( position > 0. )
+        PaAlsaAggregateMember_Discard( self, (unsigned long)PA_MIN( position, (double)self->fifoFrames ) );
 
-        PA_DEBUG((" %s: device MMAP SND_PCM_ACCESS_MMAP_NONINTERLEAVED: %s\n", __FUNCTION__, ( alsa_snd_pcm_hw_params_test_access( pcm, hwParams, accessMode ) >= 0 ? "YES" : "NO" ) ));
-        PA_DEBUG(( "%s: device MMAP SND_PCM_ACCESS_MMAP_INTERLEAVED: %s\n", __FUNCTION__, ( alsa_snd_pcm_hw_params_test_access( pcm, hwParams, alternateAccessMode ) >= 0 ? "YES" : "NO" ) ));
+    return i;
+}
 
-        if( !self->canMmap )
-        {
-            accessMode          = SND_PCM_ACCESS_RW_NONINTERLEAVED;
-            alternateAccessMode = SND_PCM_ACCESS_RW_INTERLEAVED;
-        }
-    }
+/** Restart a member from scratch, when the stream is started or it has run into an xrun. */
+static PaError PaAlsaAggregateMember_Start( PaAlsaAggregateMember *self )
+{
+    PaError result = paNoError;
 
-    PA_DEBUG(( "%s: device can MMAP: %s\n", __FUNCTION__, ( self->canMmap ? "YES" : "NO" ) ));
+    PaAlsaDll_Reset( &self->dll, self->sampleRate );
+    self->framesTransferred = 0;
+    self->fifoFrames = 0;
+    self->synced = 0;
 
-    /* If requested access mode fails, try alternate mode */
-    if( alsa_snd_pcm_hw_params_set_access( pcm, hwParams, accessMode ) < 0 )
+    ENSURE_( alsa_snd_pcm_prepare( self->pcm ), paUnanticipatedHostError );
+    if( StreamDirection_Out == self->streamDir )
     {
-        int err = 0;
-        if( ( err = alsa_snd_pcm_hw_params_set_access( pcm, hwParams, alternateAccessMode )) < 0 )
-        {
-            result = paUnanticipatedHostError;
-            PaUtil_SetLastHostErrorInfo( paALSA, err, alsa_snd_strerror( err ) );
-            goto error;
-        }
-        /* Flip mode */
-        self->hostInterleaved = !self->userInterleaved;
+        /* A period of silence to run on until the clocks are known */
+        snd_pcm_sframes_t written;
+        memset( self->deviceBuffer, 0, self->framesPerPeriod * self->numChannels * Pa_GetSampleSize( self->deviceFormat ) );
+        ENSURE_( written = alsa_snd_pcm_writei( self->pcm, self->deviceBuffer, self->framesPerPeriod ),
+                paUnanticipatedHostError );
+        self->framesTransferred = written;
     }
+    ENSURE_( alsa_snd_pcm_start( self->pcm ), paUnanticipatedHostError );
 
-    /* Some specific hardware (reported: Audio8 DJ) can fail with assertion during this step. */
-    ENSURE_( alsa_snd_pcm_hw_params_set_format( pcm, hwParams, self->nativeFormat ), paUnanticipatedHostError );
+error:
+    return result;
+}
 
-    if( ( result = SetApproximateSampleRate( pcm, hwParams, sr )) != paUnanticipatedHostError )
+/** Read what a capture member has got into its fifo. */
+static PaError PaAlsaAggregateMember_Read( PaAlsaAggregateMember *self, int *xrun )
+{
+    PaError result = paNoError;
+    snd_pcm_sframes_t frames;
+
+    UpdateClock( &self->dll, self->pcm, self->streamDir, self->framesTransferred );
+    do
     {
-        ENSURE_( GetExactSampleRate( hwParams, &sr ), paUnanticipatedHostError );
-        if( result == paInvalidSampleRate ) /* From the SetApproximateSampleRate() call above */
-        { /* The sample rate was returned as 'out of tolerance' of the one requested */
-            PA_DEBUG(( "%s: Wanted %.3f, closest sample rate was %.3f\n", __FUNCTION__, sampleRate, sr ));
-            PA_ENSURE( paInvalidSampleRate );
+        /* Make room for a whole buffer, in case the stream fell behind */
+        if( self->fifoFrames + self->bufferSize > self->fifoSize )
+            PaAlsaAggregateMember_Discard( self, self->fifoFrames + self->bufferSize - self->fifoSize );
+
+        frames = alsa_snd_pcm_readi( self->pcm, self->deviceBuffer, self->bufferSize );
+        if( -EAGAIN == frames )
+            break;
+        if( IsXrun( frames ) )
+        {
+            PA_DEBUG(( "%s: Capture member xrun\n", __FUNCTION__ ));
+            *xrun = 1;
+            PA_ENSURE( PaAlsaAggregateMember_Start( self ) );
+            break;
         }
+        ENSURE_( frames, paUnanticipatedHostError );
+
+        if( 0 == self->fifoFrames )
+            self->fifoStart = (double)self->framesTransferred;
+        self->toFloat( self->fifo + self->fifoFrames * self->numChannels, 1, self->deviceBuffer, 1,
+                frames * self->numChannels, NULL );
+        self->fifoFrames += frames;
+        self->framesTransferred += frames;
     }
-    else
-    {
-        PA_ENSURE( paUnanticipatedHostError );
-    }
+    while( (snd_pcm_uframes_t)frames == self->bufferSize );
 
-    ENSURE_( alsa_snd_pcm_hw_params_set_channels( pcm, hwParams, self->numHostChannels ), paInvalidChannelCount );
+error:
+    return result;
+}
 
-    *sampleRate = sr;
+/** Write what a playback member can take from its fifo.
+ *
+ * @param clock The clock of the stream, which the fifo is in frames of.
+ */
+static PaError PaAlsaAggregateMember_Write( PaAlsaAggregateMember *self, const PaAlsaDll *clock,
+        snd_pcm_uframes_t maxError, PaUtilBufferProcessor *bp, int *xrun )
+{
+    PaError result = paNoError;
+    snd_pcm_sframes_t space, written;
+    unsigned long frames;
+    double step;
+
+    UpdateClock( &self->dll, self->pcm, self->streamDir, self->framesTransferred );
+    space = alsa_snd_pcm_avail_update( self->pcm );
+    if( IsXrun( space ) )
+        goto xrun;
+    ENSURE_( space, paUnanticipatedHostError );
+    if( !clock->valid || !self->dll.valid )
+        goto end;
+
+    /* Resample the stream from the frame that is played when the next frame of the device is */
+    self->ratio = self->dll.rate / clock->rate;
+    step = PaAlsaAggregateMember_Steer( self, PaAlsaDll_GetPosition( clock, PaAlsaDll_GetTime( &self->dll,
+                    (double)self->framesTransferred ) ), 1. / self->ratio, maxError, self->sampleRate );
+    frames = PaAlsaAggregateMember_Resample( self, PA_MIN( (snd_pcm_uframes_t)space, self->bufferSize ), step, 0 );
+    if( 0 == frames )
+        goto end;
+
+    self->fromFloat( self->deviceBuffer, 1, self->scratch, 1, frames * self->numChannels, &bp->ditherGenerator );
+    written = alsa_snd_pcm_writei( self->pcm, self->deviceBuffer, frames );
+    if( IsXrun( written ) )
+        goto xrun;
+    ENSURE_( written, paUnanticipatedHostError );
+    self->framesTransferred += written;
 
 end:
+error:
     return result;
 
-error:
-    /* No particular action */
+xrun:
+    PA_DEBUG(( "%s: Playback member xrun\n", __FUNCTION__ ));
+    *xrun = 1;
+    result = PaAlsaAggregateMember_Start( self );
     goto end;
 }
 
-/** Finish the configuration of the component's ALSA device.
- *
- * As part of this method, the component's alsaBufferSize attribute will be set.
- * @param latency: The latency for this component.
- */
-static PaError PaAlsaStreamComponent_FinishConfigure( PaAlsaStreamComponent *self, snd_pcm_hw_params_t* hwParams,
-        const PaStreamParameters *params, int primeBuffers, double sampleRate, PaTime* latency )
+/** Open the further devices of an aggregate, if the stream info asks for any. */
+static PaError PaAlsaStreamComponent_OpenMembers( PaAlsaStreamComponent *self, const PaStreamParameters *params,
+        int callbackMode )
 {
     PaError result = paNoError;
-    snd_pcm_sw_params_t* swParams;
-    snd_pcm_uframes_t bufSz = 0;
-    *latency = -1.;
-
-    alsa_snd_pcm_sw_params_alloca( &swParams );
+    const PaAlsaStreamInfo *streamInfo = params->hostApiSpecificStreamInfo;
+    int i, ret, firstChannel = self->numUserChannels;
 
-    bufSz = params->suggestedLatency * sampleRate + self->framesPerPeriod;
-    ENSURE_( alsa_snd_pcm_hw_params_set_buffer_size_near( self->pcm, hwParams, &bufSz ), paUnanticipatedHostError );
+    if( !streamInfo || streamInfo->version < 3 || 0 == streamInfo->aggregateDeviceCount )
+        goto end;
+    /* Members are serviced along with the callback */
+    PA_UNLESS( callbackMode, paIncompatibleHostApiSpecificStreamInfo );
 
-    /* Set the parameters! */
+    PA_UNLESS( self->members = (PaAlsaAggregateMember *)PaUtil_AllocateZeroInitializedMemory(
+                streamInfo->aggregateDeviceCount * sizeof (PaAlsaAggregateMember) ), paInsufficientMemory );
+    for( i = 0; i < (int)streamInfo->aggregateDeviceCount; ++i )
     {
-        int r = alsa_snd_pcm_hw_params( self->pcm, hwParams );
-#ifdef PA_ENABLE_DEBUG_OUTPUT
-        if( r < 0 )
+        PaAlsaAggregateMember *member = self->members + i;
+
+        PA_DEBUG(( "%s: Opening aggregate device %s\n", __FUNCTION__, streamInfo->aggregateDevices[i].deviceString ));
+        /* Members are left non-blocking, they are only ever read or written as far as they can be */
+        if( ( ret = OpenPcm( &member->pcm, streamInfo->aggregateDevices[i].deviceString, StreamDirection_In ==
+                        self->streamDir ? SND_PCM_STREAM_CAPTURE : SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK, 1 ) ) < 0 )
         {
-            snd_output_t *output = NULL;
-            alsa_snd_output_stdio_attach( &output, stderr, 0 );
-            alsa_snd_pcm_hw_params_dump( hwParams, output );
+            member->pcm = NULL;
+            ENSURE_( ret, -EBUSY == ret ? paDeviceUnavailable : paBadIODeviceCombination );
         }
-#endif
-        ENSURE_( r, paUnanticipatedHostError );
+        ++self->memberCount;
+
+        member->streamDir = self->streamDir;
+        member->numChannels = streamInfo->aggregateDevices[i].channelCount;
+        member->firstChannel = firstChannel;
+        firstChannel += member->numChannels;
     }
+
+end:
+error:
+    return result;
+}
+
+/** Set up a member's device to run alongside the component's, at about the same rate and period size. */
+static PaError PaAlsaAggregateMember_Configure( PaAlsaAggregateMember *self, const PaAlsaStreamComponent *owner,
+        double sampleRate )
+{
+    PaError result = paNoError;
+    snd_pcm_hw_params_t *hwParams;
+    snd_pcm_sw_params_t *swParams;
+    snd_pcm_uframes_t framesPerPeriod, bufferSize;
+    int dir = 0;
+
+    alsa_snd_pcm_hw_params_alloca( &hwParams );
+    alsa_snd_pcm_sw_params_alloca( &swParams );
+
+    /* Samples are resampled as floats, so that is the format of choice */
+    PA_ENSURE( self->deviceFormat = PaUtil_SelectClosestAvailableFormat( GetAvailableFormats( self->pcm ), paFloat32 ) );
+
+    ENSURE_( alsa_snd_pcm_hw_params_any( self->pcm, hwParams ), paUnanticipatedHostError );
+    ENSURE_( alsa_snd_pcm_hw_params_set_access( self->pcm, hwParams, SND_PCM_ACCESS_RW_INTERLEAVED ),
+            paUnanticipatedHostError );
+    ENSURE_( alsa_snd_pcm_hw_params_set_format( self->pcm, hwParams, Pa2AlsaFormat( self->deviceFormat ) ),
+            paUnanticipatedHostError );
+    ENSURE_( alsa_snd_pcm_hw_params_set_channels( self->pcm, hwParams, self->numChannels ), paInvalidChannelCount );
+    PA_ENSURE( SetApproximateSampleRate( self->pcm, hwParams, sampleRate ) );
+    ENSURE_( GetExactSampleRate( hwParams, &self->sampleRate ), paUnanticipatedHostError );
+
+    /* Transfer about as often as the component, and buffer at least as much */
+    framesPerPeriod = owner->framesPerPeriod * self->sampleRate / sampleRate;
+    ENSURE_( alsa_snd_pcm_hw_params_set_period_size_near( self->pcm, hwParams, &framesPerPeriod, &dir ),
+            paUnanticipatedHostError );
+    bufferSize = PA_MAX( owner->alsaBufferSize * self->sampleRate / sampleRate + framesPerPeriod,
+            PA_ALSA_AGGREGATE_MIN_PERIODS_ * framesPerPeriod );
+    ENSURE_( alsa_snd_pcm_hw_params_set_buffer_size_near( self->pcm, hwParams, &bufferSize ), paUnanticipatedHostError );
+    ENSURE_( alsa_snd_pcm_hw_params( self->pcm, hwParams ), paUnanticipatedHostError );
+    self->framesPerPeriod = framesPerPeriod;
+    self->bufferSize = bufferSize;
     if( alsa_snd_pcm_hw_params_get_buffer_size != NULL )
     {
-        ENSURE_( alsa_snd_pcm_hw_params_get_buffer_size( hwParams, &self->alsaBufferSize ), paUnanticipatedHostError );
-    }
-    else
-    {
-        self->alsaBufferSize = bufSz;
+        ENSURE_( alsa_snd_pcm_hw_params_get_buffer_size( hwParams, &self->bufferSize ), paUnanticipatedHostError );
     }
 
-    /* Latency in seconds */
-    *latency = (self->alsaBufferSize - self->framesPerPeriod) / sampleRate;
-
-    /* Now software parameters... */
+    /* The device is started along with the stream, and timestamped for its clock to be tracked */
+    ENSURE_( alsa_snd_pcm_sw_params_current( self->pcm, swParams ), paUnanticipatedHostError );
+    ENSURE_( alsa_snd_pcm_sw_params_set_start_threshold( self->pcm, swParams, self->bufferSize ), paUnanticipatedHostError );
+    ENSURE_( alsa_snd_pcm_sw_params_set_stop_threshold( self->pcm, swParams, self->bufferSize ), paUnanticipatedHostError );
+    ENSURE_( alsa_snd_pcm_sw_params_set_avail_min( self->pcm, swParams, self->framesPerPeriod ), paUnanticipatedHostError );
+    ENSURE_( alsa_snd_pcm_sw_params_set_tstamp_mode( self->pcm, swParams, SND_PCM_TSTAMP_ENABLE ), paUnanticipatedHostError );
+    ENSURE_( alsa_snd_pcm_sw_params( self->pcm, swParams ), paUnanticipatedHostError );
+
+    PA_DEBUG(( "%s: Aggregate member at %f Hz, period size: %lu, buffer size: %lu\n", __FUNCTION__, self->sampleRate,
+                self->framesPerPeriod, self->bufferSize ));
+
+error:
+    return result;
+}
+
+/** Allocate the buffers of a member, once the capture delay of the component is known. */
+static PaError PaAlsaAggregateMember_AllocateBuffers( PaAlsaAggregateMember *self, const PaAlsaStreamComponent *owner,
+        double sampleRate, unsigned long maxFramesPerHostBuffer )
+{
+    PaError result = paNoError;
+    PaSampleFormat floatFormat = paFloat32;
+    unsigned long scratchFrames;
+
+    if( StreamDirection_In == self->streamDir )
+    {
+        /* The fifo holds frames of the device from those going with the delayed frames of the stream to the latest */
+        self->fifoSize = self->bufferSize + 2 * ( owner->delayFrames + maxFramesPerHostBuffer ) * self->sampleRate /
+            sampleRate + 4;
+        scratchFrames = maxFramesPerHostBuffer;
+        self->toFloat = PaUtil_SelectConverter( self->deviceFormat, floatFormat, paNoFlag );
+        self->fromFloat = PaUtil_SelectConverter( floatFormat, owner->hostSampleFormat, paNoFlag );
+    }
+    else
+    {
+        /* The fifo holds frames of the stream, from those being played to those just written */
+        self->fifoSize = owner->alsaBufferSize + 2 * maxFramesPerHostBuffer + 4;
+        scratchFrames = self->bufferSize;
+        self->toFloat = PaUtil_SelectConverter( owner->hostSampleFormat, floatFormat, paNoFlag );
+        self->fromFloat = PaUtil_SelectConverter( floatFormat, self->deviceFormat, paNoFlag );
+    }
+    PA_UNLESS( self->toFloat && self->fromFloat, paSampleFormatNotSupported );
+
+    PA_UNLESS( self->fifo = (float *)PaUtil_AllocateZeroInitializedMemory( self->fifoSize * self->numChannels *
+                sizeof (float) ), paInsufficientMemory );
+    PA_UNLESS( self->scratch = (float *)PaUtil_AllocateZeroInitializedMemory( scratchFrames * self->numChannels *
+                sizeof (float) ), paInsufficientMemory );
+    PA_UNLESS( self->deviceBuffer = PaUtil_AllocateZeroInitializedMemory( self->bufferSize * self->numChannels *
+                Pa_GetSampleSize( self->deviceFormat ) ), paInsufficientMemory );
+    PA_UNLESS( self->hostBuffer = PaUtil_AllocateZeroInitializedMemory( maxFramesPerHostBuffer * self->numChannels *
+                Pa_GetSampleSize( owner->hostSampleFormat ) ), paInsufficientMemory );
+
+error:
+    return result;
+}
+
+/** Configure the members of a component, after the component itself.
+ *
+ * A captured aggregate delays the component's own channels by a little over two periods of the slowest member,
+ * so that the members have always delivered the frames that go with them.
+ */
+static PaError PaAlsaStreamComponent_ConfigureMembers( PaAlsaStreamComponent *self, double sampleRate,
+        unsigned long maxFramesPerHostBuffer )
+{
+    PaError result = paNoError;
+    int i;
+
+    for( i = 0; i < self->memberCount; ++i )
+    {
+        PaAlsaAggregateMember *member = self->members + i;
+
+        PA_ENSURE( PaAlsaAggregateMember_Configure( member, self, sampleRate ) );
+        if( StreamDirection_In == self->streamDir )
+            self->delayFrames = PA_MAX( self->delayFrames, (unsigned long)( 2 * member->framesPerPeriod * sampleRate /
+                        member->sampleRate ) + PA_ALSA_AGGREGATE_DELAY_MARGIN_ );
+    }
+    for( i = 0; i < self->memberCount; ++i )
+        PA_ENSURE( PaAlsaAggregateMember_AllocateBuffers( self->members + i, self, sampleRate, maxFramesPerHostBuffer ) );
+
+    if( StreamDirection_In == self->streamDir )
+    {
+        PA_UNLESS( self->delayBuffer = (unsigned char *)PaUtil_AllocateZeroInitializedMemory( ( self->delayFrames +
+                        maxFramesPerHostBuffer ) * self->numUserChannels * Pa_GetSampleSize( self->hostSampleFormat ) ),
+                paInsufficientMemory );
+        self->delayCopier = PaUtil_SelectConverter( self->hostSampleFormat, self->hostSampleFormat, paNoFlag );
+    }
+
+error:
+    return result;
+}
+
+static void PaAlsaStreamComponent_CloseMembers( PaAlsaStreamComponent *self )
+{
+    int i;
+
+    for( i = 0; i < self->memberCount; ++i )
+    {
+        PaAlsaAggregateMember *member = self->members + i;
+
+        alsa_snd_pcm_close( member->pcm );
+        PaUtil_FreeMemory( member->fifo );
+        PaUtil_FreeMemory( member->scratch );
+        PaUtil_FreeMemory( member->deviceBuffer );
+        PaUtil_FreeMemory( member->hostBuffer );
+    }
+    PaUtil_FreeMemory( self->members );
+    PaUtil_FreeMemory( self->delayBuffer );
+}
+
+/** Start the members of a component, once the component's device has been started. */
+static PaError PaAlsaStreamComponent_StartMembers( PaAlsaStreamComponent *self )
+{
+    PaError result = paNoError;
+    int i;
+
+    if( self->delayBuffer )
+    {
+        PaUtil_SelectZeroer( self->hostSampleFormat )( self->delayBuffer, 1, self->delayFrames * self->numUserChannels );
+        self->delayShift = 0;
+    }
+    for( i = 0; i < self->memberCount; ++i )
+        PA_ENSURE( PaAlsaAggregateMember_Start( self->members + i ) );
+
+error:
+    return result;
+}
+
+static void PaAlsaStreamComponent_StopMembers( PaAlsaStreamComponent *self )
+{
+    int i;
+
+    for( i = 0; i < self->memberCount; ++i )
+        alsa_snd_pcm_drop( self->members[i].pcm );
+}
+
+/** Resample the capture members to the frames about to be processed, and delay the component's own channels.
+ *
+ * Called once the component's channels have been registered with the buffer processor. The members' channels are
+ * registered as well.
+ */
+static PaError PaAlsaStreamComponent_CaptureMembers( PaAlsaStreamComponent *self, PaUtilBufferProcessor *bp,
+        unsigned long numFrames, double sampleRate, int *xrun )
+{
+    PaError result = paNoError;
+    int sampleSize = Pa_GetSampleSize( self->hostSampleFormat ), i, c;
+    unsigned long frameSize = self->numUserChannels * sampleSize;
+    /* Position in the component's clock of the first frame handed to the callback */
+    double position = (double)self->framesTransferred - self->delayFrames;
+
+    /* Queue the component's frames behind those delayed from earlier periods, and hand out the oldest */
+    memmove( self->delayBuffer, self->delayBuffer + self->delayShift * frameSize, self->delayFrames * frameSize );
+    for( i = 0; i < self->numUserChannels; ++i )
+    {
+        PaUtilChannelDescriptor *channel = &bp->hostInputChannels[0][i];
+        self->delayCopier( self->delayBuffer + self->delayFrames * frameSize + i * sampleSize, self->numUserChannels,
+                channel->data, channel->stride, numFrames, NULL );
+        PaUtil_SetInputChannel( bp, i, self->delayBuffer + i * sampleSize, self->numUserChannels );
+    }
+    self->delayShift = numFrames;
+
+    for( i = 0; i < self->memberCount; ++i )
+    {
+        PaAlsaAggregateMember *member = self->members + i;
+
+        PA_ENSURE( PaAlsaAggregateMember_Read( member, xrun ) );
+        if( self->dll.valid && member->dll.valid )
+        {
+            /* Resample the device from the frame captured when the first frame of the component was */
+            double step;
+            member->ratio = member->dll.rate / self->dll.rate;
+            step = PaAlsaAggregateMember_Steer( member, PaAlsaDll_GetPosition( &member->dll, PaAlsaDll_GetTime(
+                            &self->dll, position ) ), member->ratio, member->framesPerPeriod, sampleRate );
+            PaAlsaAggregateMember_Resample( member, numFrames, step, 1 );
+        }
+        else
+            memset( member->scratch, 0, numFrames * member->numChannels * sizeof (float) );
+
+        member->fromFloat( member->hostBuffer, 1, member->scratch, 1, numFrames * member->numChannels,
+                &bp->ditherGenerator );
+        for( c = 0; c < member->numChannels; ++c )
+        {
+            PaUtil_SetInputChannel( bp, member->firstChannel + c, (unsigned char *)member->hostBuffer + c * sampleSize,
+                    member->numChannels );
+        }
+    }
+
+error:
+    return result;
+}
+
+/** Register the channels of the playback members with the buffer processor. */
+static void PaAlsaStreamComponent_RegisterMembers( PaAlsaStreamComponent *self, PaUtilBufferProcessor *bp )
+{
+    int sampleSize = Pa_GetSampleSize( self->hostSampleFormat ), i, c;
+
+    for( i = 0; i < self->memberCount; ++i )
+    {
+        PaAlsaAggregateMember *member = self->members + i;
+        for( c = 0; c < member->numChannels; ++c )
+        {
+            PaUtil_SetOutputChannel( bp, member->firstChannel + c, (unsigned char *)member->hostBuffer + c * sampleSize,
+                    member->numChannels );
+        }
+    }
+}
+
+/** Queue the frames processed for the playback members, and write what the members can take.
+ *
+ * Called before the component's frames are committed.
+ */
+static PaError PaAlsaStreamComponent_PlayMembers( PaAlsaStreamComponent *self, PaUtilBufferProcessor *bp,
+        unsigned long numFrames, int *xrun )
+{
+    PaError result = paNoError;
+    int i;
+
+    for( i = 0; i < self->memberCount; ++i )
+    {
+        PaAlsaAggregateMember *member = self->members + i;
+
+        if( member->fifoFrames + numFrames > member->fifoSize )
+            PaAlsaAggregateMember_Discard( member, member->fifoFrames + numFrames - member->fifoSize );
+        if( 0 == member->fifoFrames )
+            member->fifoStart = (double)self->framesTransferred;
+        member->toFloat( member->fifo + member->fifoFrames * member->numChannels, 1, member->hostBuffer, 1,
+                numFrames * member->numChannels, NULL );
+        member->fifoFrames += numFrames;
+
+        PA_ENSURE( PaAlsaAggregateMember_Write( member, &self->dll, self->framesPerPeriod, bp, xrun ) );
+    }
+
+error:
+    return result;
+}
+
+static PaError PaAlsaStreamComponent_Initialize( PaAlsaStreamComponent *self, PaAlsaHostApiRepresentation *alsaApi,
+        const PaStreamParameters *params, StreamDirection streamDir, int callbackMode )
+{
+    PaError result = paNoError;
+    PaSampleFormat userSampleFormat = params->sampleFormat, hostSampleFormat = paNoError;
+    /* The channels of an aggregate's further devices come after those of the component's own */
+    int channelCount = params->channelCount - GetAggregateChannelCount( params );
+    assert( channelCount > 0 );
+
+    /* Make sure things have an initial value */
+    memset( self, 0, sizeof (PaAlsaStreamComponent) );
+
+    if( params->device != paUseHostApiSpecificDeviceSpecification )
+    {
+        const PaAlsaDeviceInfo *devInfo = GetDeviceInfo( &alsaApi->baseHostApiRep, params->device );
+        self->numHostChannels = PA_MAX( channelCount, StreamDirection_In == streamDir ? devInfo->minInputChannels
+                : devInfo->minOutputChannels );
+        self->deviceIsPlug = devInfo->isPlug;
+        PA_DEBUG(( "%s: Host Chans %c %i\n", __FUNCTION__, streamDir == StreamDirection_In ? 'C' : 'P', self->numHostChannels ));
+    }
+    else
+    {
+        /* We're blissfully unaware of the minimum channelCount */
+        self->numHostChannels = channelCount;
+        /* Check if device name does not start with hw: to determine if it is a 'plug' device */
+        if( strncmp( "hw:", ((PaAlsaStreamInfo *)params->hostApiSpecificStreamInfo)->deviceString, 3 ) != 0  )
+            self->deviceIsPlug = 1; /* An Alsa plug device, not a direct hw device */
+    }
+    if( self->deviceIsPlug && alsaApi->alsaLibVersion < ALSA_VERSION_INT( 1, 0, 16 ) )
+        self->useReventFix = 1; /* Prior to Alsa1.0.16, plug devices may stutter without this fix */
+
+    self->device = params->device;
+
+    PA_ENSURE( AlsaOpen( &alsaApi->baseHostApiRep, params, streamDir, &self->pcm ) );
+    self->nfds = alsa_snd_pcm_poll_descriptors_count( self->pcm );
+
+    PA_ENSURE( hostSampleFormat = PaUtil_SelectClosestAvailableFormat( GetAvailableFormats( self->pcm ), userSampleFormat ) );
+
+    self->hostSampleFormat = hostSampleFormat;
+    self->userFormatIsHost = ( userSampleFormat & ~paNonInterleaved ) == hostSampleFormat;
+    self->nativeFormat = Pa2AlsaFormat( hostSampleFormat );
+    self->hostInterleaved = self->userInterleaved = !( userSampleFormat & paNonInterleaved );
+    self->numUserChannels = channelCount;
+    self->streamDir = streamDir;
+    self->canMmap = 0;
+    self->nonMmapBuffer = NULL;
+    self->nonMmapBufferSize = 0;
+
+    PA_ENSURE( PaAlsaStreamComponent_OpenMembers( self, params, callbackMode ) );
+
+    if( !callbackMode && !self->userInterleaved )
+    {
+        /* Pre-allocate non-interleaved user provided buffers */
+        PA_UNLESS( self->userBuffers = PaUtil_AllocateZeroInitializedMemory( sizeof (void *) * self->numUserChannels ),
+                paInsufficientMemory );
+    }
+
+error:
+
+    /* Log all available formats. */
+    if ( hostSampleFormat == paSampleFormatNotSupported )
+    {
+        LogAllAvailableFormats( self->pcm );
+        PA_DEBUG(( "%s: Please provide the log output to PortAudio developers, your hardware does not have any sample format implemented yet.\n", __FUNCTION__ ));
+    }
+
+    return result;
+}
+
+static void PaAlsaStreamComponent_Terminate( PaAlsaStreamComponent *self )
+{
+    PaAlsaStreamComponent_CloseMembers( self );
+    alsa_snd_pcm_close( self->pcm );
+    PaUtil_FreeMemory( self->userBuffers ); /* (Ptr can be NULL; PaUtil_FreeMemory includes a NULL check) */
+    PaUtil_FreeMemory( self->nonMmapBuffer );
+}
+
+/*
+static int nearbyint_(float value) {
+    if(  value - (int)value > .5 )
+        return (int)ceil( value );
+    return (int)floor( value );
+}
+*/
+
+/** Initiate configuration, preparing for determining a period size suitable for both capture and playback components.
+ *
+ */
+static PaError PaAlsaStreamComponent_InitialConfigure( PaAlsaStreamComponent *self, const PaStreamParameters *params,
+        int primeBuffers, snd_pcm_hw_params_t *hwParams, double *sampleRate )
+{
+    /* Configuration consists of setting all of ALSA's parameters.
+     * These parameters come in two flavors: hardware parameters
+     * and software parameters.  Hardware parameters will affect
+     * the way the device is initialized, software parameters
+     * affect the way ALSA interacts with me, the user-level client.
+     */
+
+    PaError result = paNoError;
+    snd_pcm_access_t accessMode, alternateAccessMode;
+    int dir = 0;
+    snd_pcm_t *pcm = self->pcm;
+    double sr = *sampleRate;
+    unsigned int minPeriods = 2;
+
+    /* self->framesPerPeriod = framesPerHostBuffer; */
+
+    /* ... fill up the configuration space with all possible
+     * combinations of parameters this device will accept */
+    ENSURE_( alsa_snd_pcm_hw_params_any( pcm, hwParams ), paUnanticipatedHostError );
+
+    ENSURE_( alsa_snd_pcm_hw_params_set_periods_integer( pcm, hwParams ), paUnanticipatedHostError );
+    /* I think there should be at least 2 periods (even though ALSA doesn't appear to enforce this) */
+    dir = 0;
+    ENSURE_( alsa_snd_pcm_hw_params_set_periods_min( pcm, hwParams, &minPeriods, &dir ), paUnanticipatedHostError );
+
+    if( self->userInterleaved )
+    {
+        accessMode          = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+        alternateAccessMode = SND_PCM_ACCESS_MMAP_NONINTERLEAVED;
+
+        /* test if MMAP supported */
+        self->canMmap = alsa_snd_pcm_hw_params_test_access( pcm, hwParams, accessMode ) >= 0 ||
+                        alsa_snd_pcm_hw_params_test_access( pcm, hwParams, alternateAccessMode ) >= 0;
+
+        PA_DEBUG(( "%s: device MMAP SND_PCM_ACCESS_MMAP_INTERLEAVED: %s\n", __FUNCTION__, ( alsa_snd_pcm_hw_params_test_access( pcm, hwParams, accessMode ) >= 0 ? "YES" : "NO" ) ));
+        PA_DEBUG(( "%s: device MMAP SND_PCM_ACCESS_MMAP_NONINTERLEAVED: %s\n", __FUNCTION__, ( alsa_snd_pcm_hw_params_test_access( pcm, hwParams, alternateAccessMode ) >= 0 ? "YES" : "NO" ) ));
+
+        if( !self->canMmap )
+        {
+            accessMode          = SND_PCM_ACCESS_RW_INTERLEAVED;
+            alternateAccessMode = SND_PCM_ACCESS_RW_NONINTERLEAVED;
+        }
+    }
+    else
+    {
+        accessMode          = SND_PCM_ACCESS_MMAP_NONINTERLEAVED;
+        alternateAccessMode = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+
+        /* test if MMAP supported */
+        self->canMmap = alsa_snd_pcm_hw_params_test_access( pcm, hwParams, accessMode ) >= 0 ||
+                        alsa_snd_pcm_hw_params_test_access( pcm, hwParams, alternateAccessMode ) >= 0;
+
+        PA_DEBUG((" %s: device MMAP SND_PCM_ACCESS_MMAP_NONINTERLEAVED: %s\n", __FUNCTION__, ( alsa_snd_pcm_hw_params_test_access( pcm, hwParams, accessMode ) >= 0 ? "YES" : "NO" ) ));
+        PA_DEBUG(( "%s: device MMAP SND_PCM_ACCESS_MMAP_INTERLEAVED: %s\n", __FUNCTION__, ( alsa_snd_pcm_hw_params_test_access( pcm, hwParams, alternateAccessMode ) >= 0 ? "YES" : "NO" ) ));
+
+        if( !self->canMmap )
+        {
+            accessMode          = SND_PCM_ACCESS_RW_NONINTERLEAVED;
+            alternateAccessMode = SND_PCM_ACCESS_RW_INTERLEAVED;
+        }
+    }
+
+    PA_DEBUG(( "%s: device can MMAP: %s\n", __FUNCTION__, ( self->canMmap ? "YES" : "NO" ) ));
+
+    /* If requested access mode fails, try alternate mode */
+    if( alsa_snd_pcm_hw_params_set_access( pcm, hwParams, accessMode ) < 0 )
+    {
+        int err = 0;
+        if( ( err = alsa_snd_pcm_hw_params_set_access( pcm, hwParams, alternateAccessMode )) < 0 )
+        {
+            result = paUnanticipatedHostError;
+            PaUtil_SetLastHostErrorInfo( paALSA, err, alsa_snd_strerror( err ) );
+            goto error;
+        }
+        /* Flip mode */
+        self->hostInterleaved = !self->userInterleaved;
+    }
+
+    /* Some specific hardware (reported: Audio8 DJ) can fail with assertion during this step. */
+    ENSURE_( alsa_snd_pcm_hw_params_set_format( pcm, hwParams, self->nativeFormat ), paUnanticipatedHostError );
+
+    if( ( result = SetApproximateSampleRate( pcm, hwParams, sr )) != paUnanticipatedHostError )
+    {
+        ENSURE_( GetExactSampleRate( hwParams, &sr ), paUnanticipatedHostError );
+        if( result == paInvalidSampleRate ) /* From the SetApproximateSampleRate() call above */
+        { /* The sample rate was returned as 'out of tolerance' of the one requested */
+            PA_DEBUG(( "%s: Wanted %.3f, closest sample rate was %.3f\n", __FUNCTION__, sampleRate, sr ));
+            PA_ENSURE( paInvalidSampleRate );
+        }
+    }
+    else
+    {
+        PA_ENSURE( paUnanticipatedHostError );
+    }
+
+    ENSURE_( alsa_snd_pcm_hw_params_set_channels( pcm, hwParams, self->numHostChannels ), paInvalidChannelCount );
+
+    *sampleRate = sr;
+
+end:
+    return result;
+
+error:
+    /* No particular action */
+    goto end;
+}
+
+/** Finish the configuration of the component's ALSA device.
+ *
+ * As part of this method, the component's alsaBufferSize attribute will be set.
+ * @param latency: The latency for this component.
+ */
+static PaError PaAlsaStreamComponent_FinishConfigure( PaAlsaStreamComponent *self, snd_pcm_hw_params_t* hwParams,
+        const PaStreamParameters *params, int primeBuffers, double sampleRate, PaTime* latency )
+{
+    PaError result = paNoError;
+    snd_pcm_sw_params_t* swParams;
+    snd_pcm_uframes_t bufSz = 0;
+    *latency = -1.;
+
+    alsa_snd_pcm_sw_params_alloca( &swParams );
+
+    /* With timer scheduling the buffer size has been chosen along with the period size */
+    if( self->timerScheduling )
+    {
+        bufSz = self->alsaBufferSize;
+    }
+    else
+    {
+        bufSz = params->suggestedLatency * sampleRate + self->framesPerPeriod;
+        ENSURE_( alsa_snd_pcm_hw_params_set_buffer_size_near( self->pcm, hwParams, &bufSz ), paUnanticipatedHostError );
+    }
+
+    /* Set the parameters! */
+    {
+        int r = alsa_snd_pcm_hw_params( self->pcm, hwParams );
+#ifdef PA_ENABLE_DEBUG_OUTPUT
+        if( r < 0 )
+        {
+            snd_output_t *output = NULL;
+            alsa_snd_output_stdio_attach( &output, stderr, 0 );
+            alsa_snd_pcm_hw_params_dump( hwParams, output );
+        }
+#endif
+        ENSURE_( r, paUnanticipatedHostError );
+    }
+    if( alsa_snd_pcm_hw_params_get_buffer_size != NULL )
+    {
+        ENSURE_( alsa_snd_pcm_hw_params_get_buffer_size( hwParams, &self->alsaBufferSize ), paUnanticipatedHostError );
+    }
+    else
+    {
+        self->alsaBufferSize = bufSz;
+    }
+
+    if( self->timerScheduling )
+    {
+        /* Playback is only filled up to the latency, capture is read once a wakeup's worth of frames is in */
+        self->latencyFrames = PA_MIN( self->latencyFrames, self->alsaBufferSize );
+        self->framesPerPeriod = PA_MAX( PA_MIN( self->framesPerPeriod, self->latencyFrames / 2 ), 1 );
+        *latency = ( StreamDirection_Out == self->streamDir ? self->latencyFrames : self->framesPerPeriod ) / sampleRate;
+    }
+    else
+    {
+        /* Latency in seconds */
+        *latency = (self->alsaBufferSize - self->framesPerPeriod) / sampleRate;
+    }
+
+    /* Now software parameters... */
     ENSURE_( alsa_snd_pcm_sw_params_current( self->pcm, swParams ), paUnanticipatedHostError );
 
     ENSURE_( alsa_snd_pcm_sw_params_set_start_threshold( self->pcm, swParams, self->framesPerPeriod ), paUnanticipatedHostError );
@@ -2154,6 +3617,19 @@ error:
     return result;
 }
 
+/** Take the callback thread's CPU affinity from the stream info of params, if it specifies one.
+ */
+static PaError GetRequestedCpuAffinity( PaAlsaStream *self, const PaStreamParameters *params )
+{
+    const PaAlsaStreamInfo *streamInfo = params ? params->hostApiSpecificStreamInfo : NULL;
+
+    if( !streamInfo || streamInfo->version < 2 || !streamInfo->cpuAffinity )
+        return paNoError;
+
+    self->useCpuAffinity = 1;
+    return PaUnixCpuSet_Parse( &self->cpuAffinity, streamInfo->cpuAffinity );
+}
+
 static PaError PaAlsaStream_Initialize( PaAlsaStream *self, PaAlsaHostApiRepresentation *alsaApi, const PaStreamParameters *inParams,
         const PaStreamParameters *outParams, double sampleRate, unsigned long framesPerUserBuffer, PaStreamCallback callback,
         PaStreamFlags streamFlags, void *userData )
@@ -2179,6 +3655,15 @@ static PaError PaAlsaStream_Initialize( PaAlsaStream *self, PaAlsaHostApiReprese
 
     self->framesPerUserBuffer = framesPerUserBuffer;
     self->neverDropInput = streamFlags & paNeverDropInput;
+    self->lockMemory = ( streamFlags & paLockMemory ) != 0;
+    if( getenv( "PA_ALSA_SHARED_ENGINE" ) && atoi( getenv( "PA_ALSA_SHARED_ENGINE" ) ) )
+        self->useSharedEngine = 1;
+    /* Only a callback thread knows when to wake up without period interrupts */
+    if( timerScheduling_ >= 0 ? timerScheduling_ : getenv( "PA_ALSA_TSCHED" ) && atoi( getenv( "PA_ALSA_TSCHED" ) ) )
+        self->timerScheduling = self->callbackMode;
+    /* The output stream info takes precedence if both specify an affinity */
+    PA_ENSURE( GetRequestedCpuAffinity( self, inParams ) );
+    PA_ENSURE( GetRequestedCpuAffinity( self, outParams ) );
     /* XXX: Ignore paPrimeOutputBuffersUsingStreamCallback until buffer priming is fully supported in pa_process.c */
     /*
     if( outParams & streamFlags & paPrimeOutputBuffersUsingStreamCallback )
@@ -2201,6 +3686,7 @@ static PaError PaAlsaStream_Initialize( PaAlsaStream *self, PaAlsaHostApiReprese
                     self->playback.nfds ) * sizeof( struct pollfd ) ), paInsufficientMemory );
 
     PaUtil_InitializeCpuLoadMeasurer( &self->cpuLoadMeasurer, sampleRate );
+    self->streamRepresentation.cpuLoadMeasurer = &self->cpuLoadMeasurer;
     ASSERT_CALL_( PaUnixMutex_Initialize( &self->stateMtx ), paNoError );
 
 error:
@@ -2213,8 +3699,14 @@ error:
  */
 static void PaAlsaStream_Terminate( PaAlsaStream *self )
 {
+    int i;
+
     assert( self );
 
+    for( i = 0; i < self->lockedRegionCount; ++i )
+        PaUtil_UnlockMemory( self->lockedRegions[i].address, self->lockedRegions[i].size );
+    self->lockedRegionCount = 0;
+
     if( self->capture.pcm )
     {
         PaAlsaStreamComponent_Terminate( &self->capture );
@@ -2721,6 +4213,76 @@ error:
     return result;
 }
 
+/** Configure a component for timer scheduling, see PaAlsa_SetTimerScheduling.
+ *
+ * The hardware buffer is made as large as the device allows up to PA_ALSA_TSCHED_BUFFER_TIME_, with periods as
+ * large as possible and without period interrupts where the device can do without. The latency then no longer
+ * follows from the buffer and period sizes: framesPerPeriod becomes the number of frames processed per timer
+ * wakeup, half the requested latency, and playback is only filled up to latencyFrames.
+ */
+static PaError PaAlsaStreamComponent_ConfigureTimerScheduling( PaAlsaStreamComponent *self, const PaStreamParameters
+        *params, unsigned long framesPerUserBuffer, double sampleRate, snd_pcm_hw_params_t *hwParams )
+{
+    PaError result = paNoError;
+    snd_pcm_uframes_t bufferSize, periodSize;
+    int dir = 0;
+
+    self->timerScheduling = 1;
+    self->latencyFrames = PaAlsa_GetFramesPerHostBuffer( framesPerUserBuffer, params->suggestedLatency, sampleRate );
+    self->framesPerPeriod = PA_MAX( self->latencyFrames / 2, 1 );
+
+    ENSURE_( alsa_snd_pcm_hw_params_get_buffer_size_max( hwParams, &bufferSize ), paUnanticipatedHostError );
+    bufferSize = PA_MIN( bufferSize, (snd_pcm_uframes_t)( PA_ALSA_TSCHED_BUFFER_TIME_ * sampleRate ) );
+    ENSURE_( alsa_snd_pcm_hw_params_set_buffer_size_near( self->pcm, hwParams, &bufferSize ), paUnanticipatedHostError );
+    self->alsaBufferSize = bufferSize;
+
+    dir = 0;
+    ENSURE_( alsa_snd_pcm_hw_params_get_period_size_max( hwParams, &periodSize, &dir ), paUnanticipatedHostError );
+    dir = 0;
+    ENSURE_( alsa_snd_pcm_hw_params_set_period_size_near( self->pcm, hwParams, &periodSize, &dir ),
+            paUnanticipatedHostError );
+
+    if( alsa_snd_pcm_hw_params_can_disable_period_wakeup != NULL && alsa_snd_pcm_hw_params_set_period_wakeup != NULL &&
+            alsa_snd_pcm_hw_params_can_disable_period_wakeup( hwParams ) )
+    {
+        if( alsa_snd_pcm_hw_params_set_period_wakeup( self->pcm, hwParams, 0 ) < 0 )
+            PA_DEBUG(( "%s: Unable to disable period wakeups\n", __FUNCTION__ ));
+    }
+
+    PA_DEBUG(( "%s: buffer size: %lu, period size: %lu, frames per wakeup: %lu\n", __FUNCTION__, bufferSize,
+                periodSize, self->framesPerPeriod ));
+
+error:
+    return result;
+}
+
+/** Configure the stream for timer scheduling, rather than determining a number of frames per period.
+ */
+static PaError PaAlsaStream_ConfigureTimerScheduling( PaAlsaStream* self, double sampleRate, const PaStreamParameters*
+        inputParameters, const PaStreamParameters* outputParameters, unsigned long framesPerUserBuffer,
+        snd_pcm_hw_params_t* hwParamsCapture, snd_pcm_hw_params_t* hwParamsPlayback,
+        PaUtilHostBufferSizeMode* hostBufferSizeMode )
+{
+    PaError result = paNoError;
+
+    if( self->capture.pcm )
+        PA_ENSURE( PaAlsaStreamComponent_ConfigureTimerScheduling( &self->capture, inputParameters, framesPerUserBuffer,
+                    sampleRate, hwParamsCapture ) );
+    if( self->playback.pcm )
+        PA_ENSURE( PaAlsaStreamComponent_ConfigureTimerScheduling( &self->playback, outputParameters, framesPerUserBuffer,
+                    sampleRate, hwParamsPlayback ) );
+
+    /* The number of frames at a wakeup depends on its timing, so this is merely an upper bound per host buffer */
+    self->maxFramesPerHostBuffer = PA_MAX( self->capture.framesPerPeriod, self->playback.framesPerPeriod );
+    *hostBufferSizeMode = paUtilBoundedHostBufferSize;
+
+    self->tschedWatermark = PA_MIN( (snd_pcm_uframes_t)( 2 * PA_ALSA_TSCHED_MIN_WATERMARK_ * 1e-9 * sampleRate ),
+            self->maxFramesPerHostBuffer / 2 );
+
+error:
+    return result;
+}
+
 /** Set up ALSA stream parameters.
  *
  */
@@ -2742,8 +4304,16 @@ static PaError PaAlsaStream_Configure( PaAlsaStream *self, const PaStreamParamet
         PA_ENSURE( PaAlsaStreamComponent_InitialConfigure( &self->playback, outParams, self->primeBuffers, hwParamsPlayback,
                     &realSr ) );
 
-    PA_ENSURE( PaAlsaStream_DetermineFramesPerBuffer( self, realSr, inParams, outParams, framesPerUserBuffer,
-                hwParamsCapture, hwParamsPlayback, hostBufferSizeMode ) );
+    if( self->timerScheduling )
+    {
+        PA_ENSURE( PaAlsaStream_ConfigureTimerScheduling( self, realSr, inParams, outParams, framesPerUserBuffer,
+                    hwParamsCapture, hwParamsPlayback, hostBufferSizeMode ) );
+    }
+    else
+    {
+        PA_ENSURE( PaAlsaStream_DetermineFramesPerBuffer( self, realSr, inParams, outParams, framesPerUserBuffer,
+                    hwParamsCapture, hwParamsPlayback, hostBufferSizeMode ) );
+    }
 
     if( self->capture.pcm )
     {
@@ -2759,6 +4329,15 @@ static PaError PaAlsaStream_Configure( PaAlsaStream *self, const PaStreamParamet
                     outputLatency ) );
         PA_DEBUG(( "%s: Playback period size: %lu, latency: %f\n", __FUNCTION__, self->playback.framesPerPeriod, *outputLatency ));
     }
+    if( self->capture.memberCount > 0 )
+    {
+        PA_ENSURE( PaAlsaStreamComponent_ConfigureMembers( &self->capture, realSr, self->maxFramesPerHostBuffer ) );
+        *inputLatency += self->capture.delayFrames / realSr;
+    }
+    if( self->playback.memberCount > 0 )
+    {
+        PA_ENSURE( PaAlsaStreamComponent_ConfigureMembers( &self->playback, realSr, self->maxFramesPerHostBuffer ) );
+    }
 
     /* Should be exact now */
     self->streamRepresentation.streamInfo.sampleRate = realSr;
@@ -2780,9 +4359,6 @@ static PaError PaAlsaStream_Configure( PaAlsaStream *self, const PaStreamParamet
         unsigned long minFramesPerHostBuffer = PA_MIN( self->capture.pcm ? self->capture.framesPerPeriod : ULONG_MAX,
             self->playback.pcm ? self->playback.framesPerPeriod : ULONG_MAX );
         self->pollTimeout = CalculatePollTimeout( self, minFramesPerHostBuffer );    /* Period in msecs, rounded up */
-
-        /* Time before watchdog unthrottles realtime thread == 1/4 of period time in msecs */
-        /* self->threading.throttledSleepTime = (unsigned long) (minFramesPerHostBuffer / sampleRate / 4 * 1000); */
     }
 
     if( self->callbackMode )
@@ -2810,6 +4386,66 @@ error:
     return result;
 }
 
+static void PaAlsaStream_LockRegion( PaAlsaStream *self, void *address, unsigned long size )
+{
+    if( !address || !size || self->lockedRegionCount == PA_ALSA_MAX_LOCKED_REGIONS_ )
+        return;
+
+    /* Regions which can't be locked are still prefaulted */
+    if( PaUtil_LockMemory( address, size ) == paNoError )
+    {
+        self->lockedRegions[self->lockedRegionCount].address = address;
+        self->lockedRegions[self->lockedRegionCount].size = size;
+        ++self->lockedRegionCount;
+        self->lockedBytes += size;
+    }
+}
+
+/** Lock the memory touched by the callback thread.
+ *
+ * The buffer processor locks its own buffers. For devices that can't be mmapped, the intermediate host
+ * buffer is allocated up front at its largest size so that it is never reallocated in the audio thread.
+ */
+static PaError PaAlsaStreamComponent_LockMemory( PaAlsaStreamComponent *self, PaAlsaStream *stream )
+{
+    PaError result = paNoError;
+
+    if( !self->canMmap )
+    {
+        unsigned int bufferSize = self->numHostChannels * alsa_snd_pcm_format_size( self->nativeFormat,
+                self->alsaBufferSize );
+        if( bufferSize > self->nonMmapBufferSize )
+        {
+            PA_UNLESS( self->nonMmapBuffer = realloc( self->nonMmapBuffer, ( self->nonMmapBufferSize = bufferSize ) ),
+                    paInsufficientMemory );
+        }
+        PaAlsaStream_LockRegion( stream, self->nonMmapBuffer, self->nonMmapBufferSize );
+    }
+
+    PaAlsaStream_LockRegion( stream, self->userBuffers, sizeof (void *) * self->numUserChannels );
+
+error:
+    return result;
+}
+
+static PaError PaAlsaStream_LockMemory( PaAlsaStream *self )
+{
+    PaError result = paNoError;
+
+    PaAlsaStream_LockRegion( self, self, sizeof (PaAlsaStream) );
+    PaAlsaStream_LockRegion( self, self->pfds, ( self->capture.nfds + self->playback.nfds ) * sizeof (struct pollfd) );
+    if( self->capture.pcm )
+        PA_ENSURE( PaAlsaStreamComponent_LockMemory( &self->capture, self ) );
+    if( self->playback.pcm )
+        PA_ENSURE( PaAlsaStreamComponent_LockMemory( &self->playback, self ) );
+
+    PA_DEBUG(( "%s: Locked %lu stream bytes, %lu bytes locked in total\n", __FUNCTION__,
+                self->lockedBytes, PaUtil_GetLockedMemoryByteCount() ));
+
+error:
+    return result;
+}
+
 static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
                            PaStream** s,
                            const PaStreamParameters *inputParameters,
@@ -2865,6 +4501,10 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     hostInputSampleFormat = stream->capture.hostSampleFormat | (!stream->capture.hostInterleaved ? paNonInterleaved : 0);
     hostOutputSampleFormat = stream->playback.hostSampleFormat | (!stream->playback.hostInterleaved ? paNonInterleaved : 0);
 
+    /* The buffer processor locks its own memory */
+    if( stream->lockMemory )
+        PA_ENSURE( PaAlsaStream_LockMemory( stream ) );
+
     PA_ENSURE( PaUtil_InitializeBufferProcessor( &stream->bufferProcessor,
                     numInputChannels, inputSampleFormat, hostInputSampleFormat,
                     numOutputChannels, outputSampleFormat, hostOutputSampleFormat,
@@ -2913,6 +4553,9 @@ static void SilenceBuffer( PaAlsaStream *stream )
     const snd_pcm_channel_area_t *areas;
     snd_pcm_uframes_t frames = (snd_pcm_uframes_t)alsa_snd_pcm_avail_update( stream->playback.pcm ), offset;
 
+    /* With timer scheduling the buffer is only filled up to the latency */
+    if( stream->playback.timerScheduling )
+        frames = PA_MIN( frames, stream->playback.latencyFrames );
     alsa_snd_pcm_mmap_begin( stream->playback.pcm, &areas, &offset, &frames );
     alsa_snd_pcm_areas_silence( areas, offset, stream->playback.numHostChannels, frames, stream->playback.nativeFormat );
     alsa_snd_pcm_mmap_commit( stream->playback.pcm, offset, frames );
@@ -2931,6 +4574,11 @@ static PaError AlsaStart( PaAlsaStream *stream, int priming )
 {
     PaError result = paNoError;
 
+    /* The clocks of the devices start over along with them */
+    PaAlsaDll_Reset( &stream->capture.dll, stream->streamRepresentation.streamInfo.sampleRate );
+    PaAlsaDll_Reset( &stream->playback.dll, stream->streamRepresentation.streamInfo.sampleRate );
+    stream->capture.framesTransferred = stream->playback.framesTransferred = 0;
+
     if( stream->playback.pcm )
     {
         if( stream->callbackMode )
@@ -2954,6 +4602,14 @@ static PaError AlsaStart( PaAlsaStream *stream, int priming )
         /* For a blocking stream we want to start capture as well, since nothing will happen otherwise */
         ENSURE_( alsa_snd_pcm_start( stream->capture.pcm ), paUnanticipatedHostError );
     }
+    if( stream->capture.memberCount > 0 )
+    {
+        PA_ENSURE( PaAlsaStreamComponent_StartMembers( &stream->capture ) );
+    }
+    if( stream->playback.memberCount > 0 )
+    {
+        PA_ENSURE( PaAlsaStreamComponent_StartMembers( &stream->playback ) );
+    }
 
 end:
     return result;
@@ -3002,6 +4658,8 @@ error:
 }
 #endif
 
+static PaError AlsaStop( PaAlsaStream *stream, int abort );
+
 static PaError StartStream( PaStream *s )
 {
     PaError result = paNoError;
@@ -3014,14 +4672,21 @@ static PaError StartStream( PaStream *s )
     /* Set now, so we can test for activity further down */
     stream->isActive = 1;
 
-    if( stream->callbackMode )
+    /* A shared engine waits for period interrupts, timer scheduled streams keep a thread of their own */
+    if( stream->callbackMode && ( !stream->useSharedEngine || stream->timerScheduling ) )
     {
-        PA_ENSURE( PaUnixThread_New( &stream->thread, &CallbackThreadFunc, stream, 1., stream->rtSched ) );
+        PA_ENSURE( PaUnixThread_New( &stream->thread, &CallbackThreadFunc, stream, 1., stream->rtSched || stream->deadlineSched,
+                    stream->useCpuAffinity ? &stream->cpuAffinity : NULL ) );
     }
     else
     {
         PA_ENSURE( AlsaStart( stream, 0 ) );
         streamStarted = 1;
+
+        if( stream->callbackMode )
+        {
+            PA_ENSURE( AttachToEngine( stream ) );
+        }
     }
 
 end:
@@ -3029,7 +4694,7 @@ end:
 error:
     if( streamStarted )
     {
-        AbortStream( stream );
+        AlsaStop( stream, 1 );
     }
     stream->isActive = 0;
 
@@ -3041,8 +4706,10 @@ error:
 static PaError AlsaStop( PaAlsaStream *stream, int abort )
 {
     PaError result = paNoError;
-    /* XXX: alsa_snd_pcm_drain tends to lock up, avoid it until we find out more */
-    abort = 1;
+    /* XXX: alsa_snd_pcm_drain tends to lock up, avoid it until we find out more. Timer scheduled streams never
+     * drain, they wait out what is buffered for playback instead */
+    if( !stream->timerScheduling )
+        abort = 1;
     /*
     if( stream->capture.pcm && !strcmp( Pa_GetDeviceInfo( stream->capture.device )->name,
                 "dmix" ) )
@@ -3071,7 +4738,15 @@ static PaError AlsaStop( PaAlsaStream *stream, int abort )
     }
     else
     {
-        if( stream->playback.pcm )
+        if( stream->playback.pcm && stream->timerScheduling )
+        {
+            /* Draining waits for a period interrupt that may never come, so wait for what is buffered instead */
+            snd_pcm_sframes_t delay;
+            if( alsa_snd_pcm_delay( stream->playback.pcm, &delay ) == 0 && delay > 0 )
+                Pa_Sleep( (long)ceil( 1000 * delay / stream->streamRepresentation.streamInfo.sampleRate ) );
+            ENSURE_( alsa_snd_pcm_drop( stream->playback.pcm ), paUnanticipatedHostError );
+        }
+        else if( stream->playback.pcm )
         {
             ENSURE_( alsa_snd_pcm_nonblock( stream->playback.pcm, 0 ), paUnanticipatedHostError );
             if( alsa_snd_pcm_drain( stream->playback.pcm ) < 0 )
@@ -3079,7 +4754,11 @@ static PaError AlsaStop( PaAlsaStream *stream, int abort )
                 PA_DEBUG(( "%s: Draining playback handle failed!\n", __FUNCTION__ ));
             }
         }
-        if( stream->capture.pcm && !stream->pcmsSynced )
+        if( stream->capture.pcm && !stream->pcmsSynced && stream->timerScheduling )
+        {
+            ENSURE_( alsa_snd_pcm_drop( stream->capture.pcm ), paUnanticipatedHostError );
+        }
+        else if( stream->capture.pcm && !stream->pcmsSynced )
         {
             /* We don't need to retrieve any remaining frames */
             if( alsa_snd_pcm_drain( stream->capture.pcm ) < 0 )
@@ -3088,6 +4767,8 @@ static PaError AlsaStop( PaAlsaStream *stream, int abort )
             }
         }
     }
+    PaAlsaStreamComponent_StopMembers( &stream->capture );
+    PaAlsaStreamComponent_StopMembers( &stream->playback );
 
 end:
     return result;
@@ -3111,7 +4792,13 @@ static PaError RealStop( PaAlsaStream *stream, int abort )
     /* First deal with the callback thread, cancelling and/or joining
      * it if necessary
      */
-    if( stream->callbackMode )
+    if( stream->engineSlot.engine )
+    {
+        /* The engine thread stops the stream */
+        PA_ENSURE( DetachFromEngine( stream, abort ) );
+        stream->callback_finished = 0;
+    }
+    else if( stream->callbackMode )
     {
         PaError threadRes;
         stream->callbackAbort = abort;
@@ -3125,10 +4812,6 @@ static PaError RealStop( PaAlsaStream *stream, int abort )
         {
             PA_DEBUG(( "Callback thread returned: %d\n", threadRes ));
         }
-#if 0
-        if( watchdogRes != paNoError )
-            PA_DEBUG(( "Watchdog thread returned: %d\n", watchdogRes ));
-#endif
 
         stream->callback_finished = 0;
     }
@@ -3196,30 +4879,11 @@ static PaTime StatusToTime( const snd_pcm_status_t *status, int trigger, snd_pcm
     return timestamp.tv_sec + ( (PaTime)timestamp.tv_nsec * 1e-9 );
 }
 
+/* Stream times are those of ALSA's timestamps, which the clocks of the devices are modelled in, see CalculateTimeInfo */
 static PaTime GetStreamTime( PaStream *s )
 {
-    PaAlsaStream *stream = (PaAlsaStream*)s;
-
-    snd_timestamp_t timestamp;
-    snd_pcm_status_t* status;
-    alsa_snd_pcm_status_alloca( &status );
-
-    /* TODO: what if we have both?  does it really matter? */
-
-    /* TODO: if running in callback mode, this will mean
-     * libasound routines are being called from multiple threads.
-     * need to verify that libasound is thread-safe. */
-
-    if( stream->capture.pcm )
-    {
-        alsa_snd_pcm_status( stream->capture.pcm, status );
-    }
-    else if( stream->playback.pcm )
-    {
-        alsa_snd_pcm_status( stream->playback.pcm, status );
-    }
-
-    return StatusToTime( status, 0, NULL );
+    (void)s;
+    return GetAlsaTime();
 }
 
 static double GetStreamCpuLoad( PaStream* s )
@@ -3285,7 +4949,8 @@ static PaError AlsaRestart( PaAlsaStream *stream )
     PaError result = paNoError;
 
     PA_ENSURE( PaUnixMutex_Lock( &stream->stateMtx ) );
-    PA_ENSURE( AlsaStop( stream, 0 ) );
+    /* What is left after an xrun is not worth waiting for */
+    PA_ENSURE( AlsaStop( stream, 1 ) );
     PA_ENSURE( AlsaStart( stream, 0 ) );
 
     PA_DEBUG(( "%s: Restarted audio\n", __FUNCTION__ ));
@@ -3307,6 +4972,7 @@ static PaError PaAlsaStream_HandleXrun( PaAlsaStream *self )
     snd_timestamp_t t;
     int restartAlsa = 0; /* do not restart Alsa by default */
 
+    PA_TRACE_BEGIN( "ALSA xrun recovery", 0, 0, 0, 0 );
     alsa_snd_pcm_status_alloca( &st );
 
     if( self->playback.pcm )
@@ -3316,6 +4982,7 @@ static PaError PaAlsaStream_HandleXrun( PaAlsaStream *self )
         {
             alsa_snd_pcm_status_get_trigger_tstamp( st, &t );
             self->underrun = ( now - StatusToTime( st, 1, NULL ) ) * 1000;
+            PA_TRACE_EVENT( "ALSA playback xrun, %ld ms ago", (long)self->underrun, 0, 0, 0 );
 
             if( !self->playback.canMmap )
             {
@@ -3335,6 +5002,7 @@ static PaError PaAlsaStream_HandleXrun( PaAlsaStream *self )
         if( alsa_snd_pcm_status_get_state( st ) == SND_PCM_STATE_XRUN )
         {
             self->overrun = ( now - StatusToTime( st, 1, NULL ) ) * 1000;
+            PA_TRACE_EVENT( "ALSA capture xrun, %ld ms ago", (long)self->overrun, 0, 0, 0 );
 
             if (!self->capture.canMmap)
             {
@@ -3356,6 +5024,7 @@ static PaError PaAlsaStream_HandleXrun( PaAlsaStream *self )
     }
 
 end:
+    PA_TRACE_END( "ALSA xrun recovery, restarted %ld", restartAlsa, 0, 0, 0 );
     return result;
 error:
     goto end;
@@ -3422,12 +5091,10 @@ error:
 
 /* Callback interface */
 
-static void OnExit( void *data )
+/** Stop the pcms of a callback stream once its callback has finished, and tell the user.
+ */
+static void FinishCallbackStream( PaAlsaStream *stream )
 {
-    PaAlsaStream *stream = (PaAlsaStream *) data;
-
-    assert( data );
-
     PaUtil_ResetCpuLoadMeasurer( &stream->cpuLoadMeasurer );
 
     stream->callback_finished = 1;  /* Let the outside world know stream was stopped in callback */
@@ -3444,44 +5111,43 @@ static void OnExit( void *data )
     stream->isActive = 0;
 }
 
-static void CalculateTimeInfo( PaAlsaStream *stream, PaStreamCallbackTimeInfo *timeInfo )
+static void OnExit( void *data )
 {
-    snd_pcm_status_t *status;
-    PaTime capture_time = 0., playback_time = 0.;
+    PaAlsaStream *stream = (PaAlsaStream *) data;
 
-    alsa_snd_pcm_status_alloca( &status );
+    assert( data );
 
+    FinishCallbackStream( stream );
+    PaUnixThread_StopWatchdog( &stream->thread );
+    PaUtil_UnregisterTraceThread();
+}
+
+static void CalculateTimeInfo( PaAlsaStream *stream, PaStreamCallbackTimeInfo *timeInfo )
+{
+    timeInfo->currentTime = GetAlsaTime();
+
+    /* The times of the frames about to be processed come from the models of the devices' clocks, rather than from
+     * when this happens to run. Until the clocks are known, the times are estimated from the latency */
     if( stream->capture.pcm )
     {
-        snd_pcm_sframes_t capture_delay;
-
-        alsa_snd_pcm_status( stream->capture.pcm, status );
-        capture_time = StatusToTime( status, 0, &capture_delay );
+        PaAlsaStreamComponent *capture = &stream->capture;
 
-        timeInfo->currentTime = capture_time;
-        timeInfo->inputBufferAdcTime = capture_time -
-            (PaTime)capture_delay / stream->streamRepresentation.streamInfo.sampleRate;
+        UpdateClock( &capture->dll, capture->pcm, capture->streamDir, capture->framesTransferred );
+        if( capture->dll.valid )
+            timeInfo->inputBufferAdcTime = PaAlsaDll_GetTime( &capture->dll, (double)capture->framesTransferred -
+                    capture->delayFrames );
+        else
+            timeInfo->inputBufferAdcTime = timeInfo->currentTime - stream->streamRepresentation.streamInfo.inputLatency;
     }
     if( stream->playback.pcm )
     {
-        snd_pcm_sframes_t playback_delay;
-        PaTime playback_time;
-
-        alsa_snd_pcm_status( stream->playback.pcm, status );
-        playback_time = StatusToTime( status, 0, &playback_delay );
+        PaAlsaStreamComponent *playback = &stream->playback;
 
-        if( stream->capture.pcm ) /* Full duplex */
-        {
-            /* Hmm, we have both a playback and a capture timestamp.
-             * Hopefully they are the same... */
-            if( fabs( capture_time - playback_time ) > 0.01 )
-                PA_DEBUG(( "Capture time and playback time differ by %f\n", fabs( capture_time-playback_time ) ));
-        }
+        UpdateClock( &playback->dll, playback->pcm, playback->streamDir, playback->framesTransferred );
+        if( playback->dll.valid )
+            timeInfo->outputBufferDacTime = PaAlsaDll_GetTime( &playback->dll, (double)playback->framesTransferred );
         else
-            timeInfo->currentTime = playback_time;
-
-        timeInfo->outputBufferDacTime = timeInfo->currentTime +
-            (PaTime)playback_delay / stream->streamRepresentation.streamInfo.sampleRate;
+            timeInfo->outputBufferDacTime = timeInfo->currentTime + stream->streamRepresentation.streamInfo.outputLatency;
     }
 }
 
@@ -3541,6 +5207,7 @@ static PaError PaAlsaStreamComponent_EndProcessing( PaAlsaStreamComponent *self,
     else
     {
         ENSURE_( res, paUnanticipatedHostError );
+        self->framesTransferred += numFrames;
     }
 
 end:
@@ -3639,6 +5306,13 @@ static PaError PaAlsaStream_EndProcessing( PaAlsaStream *self, unsigned long num
         {
             PA_ENSURE( PaAlsaStreamComponent_DoChannelAdaption( &self->playback, &self->bufferProcessor, numFrames ) );
         }
+        if( self->playback.ready && self->playback.memberCount > 0 )
+        {
+            int memberXrun = 0;
+            PA_ENSURE( PaAlsaStreamComponent_PlayMembers( &self->playback, &self->bufferProcessor, numFrames, &memberXrun ) );
+            if( memberXrun )
+                self->underrun = 1.;
+        }
         PA_ENSURE( PaAlsaStreamComponent_EndProcessing( &self->playback, numFrames, &xrun ) );
     }
 
@@ -3787,6 +5461,192 @@ error:
     return result;
 }
 
+/** Get the number of available frames for the pcms that are marked ready from poll.
+ *
+ * @concern FullDuplex If only one direction is marked ready (from poll), the number of frames available for
+ * the other direction is returned. Output is normally preferred over capture however, so capture frames may be
+ * discarded to avoid overrun unless paNeverDropInput is specified.
+ */
+static PaError PaAlsaStream_GetReadyFrames( PaAlsaStream *self, unsigned long *framesAvail, int *xrunOccurred )
+{
+    PaError result = paNoError;
+    int captureReady = self->capture.pcm ? self->capture.ready : 0,
+        playbackReady = self->playback.pcm ? self->playback.ready : 0;
+
+    PA_ENSURE( PaAlsaStream_GetAvailableFrames( self, captureReady, playbackReady, framesAvail, xrunOccurred ) );
+
+    if( self->capture.pcm && self->playback.pcm )
+    {
+        if( !self->playback.ready && !self->neverDropInput )
+        {
+            /* Drop input, a period's worth */
+            assert( self->capture.ready );
+            PaAlsaStreamComponent_EndProcessing( &self->capture, PA_MIN( self->capture.framesPerPeriod,
+                        *framesAvail ), xrunOccurred );
+            *framesAvail = 0;
+            self->capture.ready = 0;
+        }
+    }
+    else if( self->capture.pcm )
+        assert( self->capture.ready );
+    else
+        assert( self->playback.ready );
+
+error:
+    return result;
+}
+
+/** Get the number of frames available for a component with timer scheduling.
+ *
+ * Without period interrupts the hardware pointer is only updated on request, which snd_pcm_avail makes. Drivers
+ * which only know the pointer at a coarse granularity report when they last updated it, the frames that have
+ * passed since are returned as pending. Playback is only filled up to latencyFrames, so the frames that would
+ * fill the buffer further don't count as available.
+ *
+ * @param pending Frames which should have become available in addition to numFrames, going by the timestamp
+ */
+static PaError PaAlsaStreamComponent_GetTimedAvailableFrames( PaAlsaStreamComponent *self, double sampleRate,
+        unsigned long *numFrames, unsigned long *pending, int *xrunOccurred )
+{
+    PaError result = paNoError;
+    snd_pcm_sframes_t framesAvail;
+    snd_pcm_uframes_t expected, stampedAvail, headroom;
+    snd_htimestamp_t stamp;
+    struct timespec now;
+
+    *numFrames = *pending = 0;
+    *xrunOccurred = 0;
+
+    framesAvail = alsa_snd_pcm_avail != NULL ? alsa_snd_pcm_avail( self->pcm ) : alsa_snd_pcm_avail_update( self->pcm );
+    if( -EPIPE == framesAvail )
+    {
+        *xrunOccurred = 1;
+        goto end;
+    }
+    ENSURE_( framesAvail, paUnanticipatedHostError );
+    expected = framesAvail;
+
+    /* ALSA timestamps are taken with gettimeofday() unless configured otherwise */
+    if( alsa_snd_pcm_htimestamp != NULL && alsa_snd_pcm_htimestamp( self->pcm, &stampedAvail, &stamp ) == 0 &&
+            ( stamp.tv_sec || stamp.tv_nsec ) && clock_gettime( CLOCK_REALTIME, &now ) == 0 )
+    {
+        double elapsed = ( now.tv_sec - stamp.tv_sec ) + ( now.tv_nsec - stamp.tv_nsec ) * 1e-9;
+
+        /* A stale timestamp, as from before the stream was started, says nothing */
+        if( elapsed > 0. && elapsed * sampleRate < self->framesPerPeriod )
+            expected = PA_MAX( expected, stampedAvail + (snd_pcm_uframes_t)( elapsed * sampleRate ) );
+    }
+
+    if( StreamDirection_Out == self->streamDir )
+    {
+        headroom = self->alsaBufferSize - self->latencyFrames;
+        framesAvail = (snd_pcm_uframes_t)framesAvail > headroom ? framesAvail - headroom : 0;
+        expected = expected > headroom ? expected - headroom : 0;
+    }
+    *numFrames = framesAvail;
+    *pending = expected - framesAvail;
+
+end:
+error:
+    return result;
+}
+
+/** Wait for frames with timer scheduling, see PaAlsa_SetTimerScheduling.
+ *
+ * Rather than polling for period interrupts, the callback thread sleeps until a wakeup's worth of frames is
+ * expected to be available, less the watermark. The watermark leaves time to refill playback before it runs dry,
+ * it is doubled on every xrun and lowered again once there has been none for PA_ALSA_TSCHED_WATERMARK_DECAY_TIME_.
+ */
+static PaError PaAlsaStream_WaitForTimer( PaAlsaStream *self, unsigned long *framesAvail, int *xrunOccurred )
+{
+    PaError result = paNoError;
+    double sampleRate = self->streamRepresentation.streamInfo.sampleRate;
+    unsigned long framesPerWakeup = PA_MIN( self->capture.pcm ? self->capture.framesPerPeriod : ULONG_MAX,
+            self->playback.pcm ? self->playback.framesPerPeriod : ULONG_MAX );
+    snd_pcm_uframes_t minWatermark = PA_MIN( (snd_pcm_uframes_t)( PA_ALSA_TSCHED_MIN_WATERMARK_ * 1e-9 * sampleRate ),
+            framesPerWakeup / 2 );
+    unsigned long frames = 0;
+
+    *xrunOccurred = 0;
+
+    while( !PaUnixThread_StopRequested( &self->thread ) )
+    {
+        unsigned long captureFrames = ULONG_MAX, capturePending = 0, playbackFrames = ULONG_MAX, playbackPending = 0;
+        unsigned long expected;
+        long sleepFrames;
+        PaInt64 now = PaUtil_GetNanoseconds(), sleepNanoseconds;
+        struct timespec sleepTime;
+
+        if( self->capture.pcm )
+        {
+            PA_ENSURE( PaAlsaStreamComponent_GetTimedAvailableFrames( &self->capture, sampleRate, &captureFrames,
+                        &capturePending, xrunOccurred ) );
+            if( *xrunOccurred )
+                break;
+        }
+        if( self->playback.pcm )
+        {
+            PA_ENSURE( PaAlsaStreamComponent_GetTimedAvailableFrames( &self->playback, sampleRate, &playbackFrames,
+                        &playbackPending, xrunOccurred ) );
+            if( *xrunOccurred )
+                break;
+        }
+        frames = PA_MIN( captureFrames, playbackFrames );
+        expected = PA_MIN( captureFrames + capturePending, playbackFrames + playbackPending );
+
+        if( !self->tschedWatermarkTime )
+            self->tschedWatermarkTime = now;
+        else if( now - self->tschedWatermarkTime > PA_ALSA_TSCHED_WATERMARK_DECAY_TIME_ &&
+                self->tschedWatermark > minWatermark )
+        {
+            self->tschedWatermark = PA_MAX( self->tschedWatermark - self->tschedWatermark / 4, minWatermark );
+            self->tschedWatermarkTime = now;
+            PA_DEBUG(( "%s: Lowered watermark to %lu frames\n", __FUNCTION__, self->tschedWatermark ));
+        }
+
+        if( frames > 0 && expected + self->tschedWatermark >= framesPerWakeup )
+            break;
+
+        /* Sleep until the frames are due, but not in too small steps if the hardware pointer lags behind */
+        sleepFrames = PA_MAX( (long)framesPerWakeup - (long)self->tschedWatermark - (long)expected,
+                (long)minWatermark / 2 + 1 );
+        sleepNanoseconds = (PaInt64)( sleepFrames * 1e9 / sampleRate );
+        sleepTime.tv_sec = sleepNanoseconds / 1000000000;
+        sleepTime.tv_nsec = sleepNanoseconds % 1000000000;
+
+        PA_TRACE_BEGIN( "ALSA timer sleep, %ld us", (long)( sleepNanoseconds / 1000 ), 0, 0, 0 );
+#ifdef PTHREAD_CANCELED
+        /* Abort may cancel the thread while it sleeps, as with poll() in PaAlsaStream_WaitForFrames */
+        pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+#endif
+        nanosleep( &sleepTime, NULL );
+#ifdef PTHREAD_CANCELED
+        pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+#endif
+        PA_TRACE_END( "ALSA timer sleep, %lu frames expected", expected, 0, 0, 0 );
+        frames = 0;
+    }
+
+    if( *xrunOccurred )
+    {
+        frames = 0;
+        self->tschedWatermark = PA_MIN( PA_MAX( self->tschedWatermark * 2, minWatermark ), framesPerWakeup / 2 );
+        self->tschedWatermarkTime = PaUtil_GetNanoseconds();
+        PA_DEBUG(( "%s: Raised watermark to %lu frames\n", __FUNCTION__, self->tschedWatermark ));
+    }
+    else if( frames > 0 )
+    {
+        if( self->capture.pcm )
+            self->capture.ready = 1;
+        if( self->playback.pcm )
+            self->playback.ready = 1;
+    }
+    *framesAvail = frames;
+
+error:
+    return result;
+}
+
 /** Wait for and report available buffer space from ALSA.
  *
  * Unless ALSA reports a minimum of frames available for I/O, we poll the ALSA filedescriptors for more.
@@ -3808,6 +5668,12 @@ static PaError PaAlsaStream_WaitForFrames( PaAlsaStream *self, unsigned long *fr
     assert( self );
     assert( framesAvail );
 
+    if( self->timerScheduling )
+    {
+        PA_ENSURE( PaAlsaStream_WaitForTimer( self, framesAvail, &xrun ) );
+        goto end;
+    }
+
     if( !self->callbackMode )
     {
         /* In blocking mode we will only wait if necessary */
@@ -3870,7 +5736,9 @@ static PaError PaAlsaStream_WaitForFrames( PaAlsaStream *self, unsigned long *fr
         }
 #endif
 
+        PA_TRACE_BEGIN( "ALSA poll, timeout %ld ms", pollTimeout, 0, 0, 0 );
         pollResults = poll( self->pfds, totalFds, pollTimeout );
+        PA_TRACE_END( "ALSA poll returned %ld", pollResults, 0, 0, 0 );
 
 #ifdef PTHREAD_CANCELED
         if( self->callbackMode )
@@ -3956,31 +5824,7 @@ static PaError PaAlsaStream_WaitForFrames( PaAlsaStream *self, unsigned long *fr
 
     if( !xrun )
     {
-        /* Get the number of available frames for the pcms that are marked ready.
-         * @concern FullDuplex If only one direction is marked ready (from poll), the number of frames available for
-         * the other direction is returned. Output is normally preferred over capture however, so capture frames may be
-         * discarded to avoid overrun unless paNeverDropInput is specified.
-         */
-        int captureReady = self->capture.pcm ? self->capture.ready : 0,
-            playbackReady = self->playback.pcm ? self->playback.ready : 0;
-        PA_ENSURE( PaAlsaStream_GetAvailableFrames( self, captureReady, playbackReady, framesAvail, &xrun ) );
-
-        if( self->capture.pcm && self->playback.pcm )
-        {
-            if( !self->playback.ready && !self->neverDropInput )
-            {
-                /* Drop input, a period's worth */
-                assert( self->capture.ready );
-                PaAlsaStreamComponent_EndProcessing( &self->capture, PA_MIN( self->capture.framesPerPeriod,
-                            *framesAvail ), &xrun );
-                *framesAvail = 0;
-                self->capture.ready = 0;
-            }
-        }
-        else if( self->capture.pcm )
-            assert( self->capture.ready );
-        else
-            assert( self->playback.ready );
+        PA_ENSURE( PaAlsaStream_GetReadyFrames( self, framesAvail, &xrun ) );
     }
 
 end:
@@ -4212,28 +6056,221 @@ static PaError PaAlsaStream_SetUpBuffers( PaAlsaStream* self, unsigned long* num
     {
         if( self->playback.ready )
         {
-            PaUtil_SetOutputFrameCount( &self->bufferProcessor, commonFrames );
+            PaUtil_SetOutputFrameCount( &self->bufferProcessor, commonFrames );
+        }
+        else
+        {
+            /* We have output underflow, but keeping input data (paNeverDropInput) */
+            assert( self->neverDropInput );
+            assert( self->capture.pcm != NULL );
+            PA_DEBUG(( "%s: Setting output buffers to NULL\n", __FUNCTION__ ));
+            PaUtil_SetNoOutput( &self->bufferProcessor );
+        }
+    }
+
+    /* The channels of aggregate members follow those of the stream's own devices */
+    if( self->capture.ready && self->capture.memberCount > 0 )
+    {
+        int memberXrun = 0;
+        PA_ENSURE( PaAlsaStreamComponent_CaptureMembers( &self->capture, &self->bufferProcessor, commonFrames,
+                    self->streamRepresentation.streamInfo.sampleRate, &memberXrun ) );
+        if( memberXrun )
+            self->overrun = 1.;
+    }
+    if( self->playback.ready && self->playback.memberCount > 0 )
+        PaAlsaStreamComponent_RegisterMembers( &self->playback, &self->bufferProcessor );
+
+end:
+    *numFrames = commonFrames;
+error:
+    if( xrun )
+    {
+        PA_ENSURE( PaAlsaStream_HandleXrun( self ) );
+        *numFrames = 0;
+    }
+    *xrunOccurred = xrun;
+
+    return result;
+}
+
+/** Get the duration of an ALSA period in nanoseconds. */
+static PaInt64 GetPeriodNanoseconds( PaAlsaStream *stream )
+{
+    snd_pcm_uframes_t framesPerPeriod = stream->playback.pcm ? stream->playback.framesPerPeriod :
+        stream->capture.framesPerPeriod;
+    return (PaInt64)( framesPerPeriod * 1e9 / stream->streamRepresentation.streamInfo.sampleRate );
+}
+
+/** Read the CPU time of the calling thread in nanoseconds, 0 if the clock isn't available. */
+static PaInt64 GetThreadCpuTime( void )
+{
+    struct timespec ts;
+
+    if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) != 0 )
+        return 0;
+    return (PaInt64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Switch the callback thread to SCHED_DEADLINE.
+ *
+ * The period and deadline are those of the ALSA period, the runtime budget is the measured cost of
+ * a period of the callback loop with some headroom, see PA_ALSA_DEADLINE_HEADROOM_. If the kernel
+ * refuses, the thread stays under SCHED_FIFO.
+ * @param cpuTime The CPU time the thread used since it started measuring, in nanoseconds.
+ * @param elapsed The time since it started measuring, in seconds.
+ */
+static void EnterDeadlineScheduling( PaAlsaStream *stream, PaInt64 cpuTime, PaTime elapsed )
+{
+    PaStreamStatistics statistics;
+    PaInt64 period = GetPeriodNanoseconds( stream );
+    PaInt64 runtime;
+    double load, overhead = 0.;
+
+    PaUtil_GetCpuLoadStatistics( &stream->cpuLoadMeasurer, &statistics );
+    /* The loop's CPU time per period that isn't spent processing buffers, as a fraction of the period */
+    if( cpuTime > 0 && elapsed > 0. )
+        overhead = PA_MAX( cpuTime / ( elapsed * 1e9 ) - statistics.averageLoad, 0. );
+    load = ( PA_MAX( statistics.load999thPercentile, statistics.averageLoad ) + overhead ) * PA_ALSA_DEADLINE_HEADROOM_;
+    load = PA_MIN( PA_MAX( load, PA_ALSA_DEADLINE_MIN_LOAD_ ), PA_ALSA_DEADLINE_MAX_LOAD_ );
+    runtime = PA_MAX( (PaInt64)( period * load ) + PA_ALSA_DEADLINE_MARGIN_, PA_ALSA_DEADLINE_MIN_RUNTIME_ );
+    if( runtime > period )
+        runtime = period;
+    PA_DEBUG(( "%s: Processing load %g, loop overhead %g\n", __FUNCTION__, statistics.load999thPercentile,
+                overhead ));
+
+    if( PaUnixThread_SetDeadlineScheduling( &stream->thread, runtime, period, period ) != paNoError )
+        PA_DEBUG(( "%s: Staying with SCHED_FIFO\n", __FUNCTION__ ));
+}
+
+/** Has a callback stream finished?
+ *
+ * @concern StreamStop if the main thread has requested a stop and the stream has not been effectively
+ * stopped we signal this condition by modifying callbackResult (we'll want to flush buffered output).
+ *
+ * @param stopRequested Has a stop been requested
+ * @param callbackResult The last value returned by the callback
+ */
+static int IsCallbackDone( PaAlsaStream *stream, int stopRequested, int *callbackResult )
+{
+    if( stopRequested && paContinue == *callbackResult )
+    {
+        PA_DEBUG(( "Setting callbackResult to paComplete\n" ));
+        *callbackResult = paComplete;
+    }
+
+    if( paContinue != *callbackResult )
+    {
+        stream->callbackAbort = ( paAbort == *callbackResult );
+        if( stream->callbackAbort ||
+                /** @concern BlockAdaption: Go on if adaption buffers are empty */
+                PaUtil_IsBufferProcessorOutputEmpty( &stream->bufferProcessor ) )
+        {
+            return 1;
+        }
+
+        PA_DEBUG(( "%s: Flushing buffer processor\n", __FUNCTION__ ));
+        /* There is still buffered output that needs to be processed */
+    }
+
+    return 0;
+}
+
+/** Run the callback on the frames that have become available.
+ *
+ * @param framesAvail The number of frames reported by PaAlsaStream_WaitForFrames
+ * @param callbackResult Updated with the value returned by the callback
+ * @param cbFlags Flags to pass on to the callback, cleared once they have been
+ */
+static PaError ProcessFrames( PaAlsaStream *stream, unsigned long framesAvail, int *callbackResult,
+        PaStreamCallbackFlags *cbFlags )
+{
+    PaError result = paNoError;
+    PaStreamCallbackTimeInfo timeInfo = {0, 0, 0};
+    unsigned long framesGot;
+    int xrun;
+
+    /* Consume buffer space. Once we have a number of frames available for consumption we must retrieve the
+     * mmapped buffers from ALSA, this is contiguously accessible memory however, so we may receive smaller
+     * portions at a time than is available as a whole. Therefore we should be prepared to process several
+     * chunks successively. The buffers are passed to the PA buffer processor.
+     */
+    while( framesAvail > 0 )
+    {
+        xrun = 0;
+
+        /** @concern Xruns Under/overflows are to be reported to the callback */
+        if( stream->underrun > 0.0 )
+        {
+            *cbFlags |= paOutputUnderflow;
+            stream->underrun = 0.0;
+        }
+        if( stream->overrun > 0.0 )
+        {
+            *cbFlags |= paInputOverflow;
+            stream->overrun = 0.0;
+        }
+        if( stream->capture.pcm && stream->playback.pcm )
+        {
+            /** @concern FullDuplex It's possible that only one direction is being processed to avoid an
+             * under- or overflow, this should be reported correspondingly */
+            if( !stream->capture.ready )
+            {
+                *cbFlags |= paInputUnderflow;
+                PA_DEBUG(( "%s: Input underflow\n", __FUNCTION__ ));
+            }
+            else if( !stream->playback.ready )
+            {
+                *cbFlags |= paOutputOverflow;
+                PA_DEBUG(( "%s: Output overflow\n", __FUNCTION__ ));
+            }
+        }
+
+        CalculateTimeInfo( stream, &timeInfo );
+        PaUtil_BeginBufferProcessing( &stream->bufferProcessor, &timeInfo, *cbFlags );
+        *cbFlags = 0;
+
+        /* CPU load measurement should include processing activity external to the stream callback */
+        PaUtil_BeginCpuLoadMeasurement( &stream->cpuLoadMeasurer );
+        PA_TRACE_BEGIN( "ALSA period, %lu frames available", framesAvail, 0, 0, 0 );
+
+        framesGot = framesAvail;
+        if( paUtilFixedHostBufferSize == stream->bufferProcessor.hostBufferSizeMode )
+        {
+            /* We've committed to a fixed host buffer size, stick to that */
+            framesGot = framesGot >= stream->maxFramesPerHostBuffer ? stream->maxFramesPerHostBuffer : 0;
+        }
+        else
+        {
+            /* We've committed to an upper bound on the size of host buffers */
+            assert( paUtilBoundedHostBufferSize == stream->bufferProcessor.hostBufferSizeMode );
+            framesGot = PA_MIN( framesGot, stream->maxFramesPerHostBuffer );
+        }
+        PA_ENSURE( PaAlsaStream_SetUpBuffers( stream, &framesGot, &xrun ) );
+        /* Check the host buffer size against the buffer processor configuration */
+        framesAvail -= framesGot;
+
+        if( framesGot > 0 )
+        {
+            assert( !xrun );
+            PaUtil_EndBufferProcessing( &stream->bufferProcessor, callbackResult );
+            PA_ENSURE( PaAlsaStream_EndProcessing( stream, framesGot, &xrun ) );
+            /* In engine mode the engine thread is the one being watched */
+            PaUnixThread_NotifyWatchdog( stream->engineSlot.engine ? &stream->engineSlot.engine->thread : &stream->thread, xrun );
         }
-        else
+        PA_TRACE_END( "ALSA period, %lu frames processed", framesGot, 0, 0, 0 );
+        PaUtil_EndCpuLoadMeasurement( &stream->cpuLoadMeasurer, framesGot );
+
+        if( 0 == framesGot )
         {
-            /* We have output underflow, but keeping input data (paNeverDropInput) */
-            assert( self->neverDropInput );
-            assert( self->capture.pcm != NULL );
-            PA_DEBUG(( "%s: Setting output buffers to NULL\n", __FUNCTION__ ));
-            PaUtil_SetNoOutput( &self->bufferProcessor );
+            /* Go back to polling for more frames */
+            break;
         }
-    }
 
-end:
-    *numFrames = commonFrames;
-error:
-    if( xrun )
-    {
-        PA_ENSURE( PaAlsaStream_HandleXrun( self ) );
-        *numFrames = 0;
+        if( paContinue != *callbackResult )
+            break;
     }
-    *xrunOccurred = xrun;
 
+error:
     return result;
 }
 
@@ -4249,11 +6286,13 @@ static void *CallbackThreadFunc( void *userData )
 {
     PaError result = paNoError;
     PaAlsaStream *stream = (PaAlsaStream*) userData;
-    PaStreamCallbackTimeInfo timeInfo = {0, 0, 0};
     snd_pcm_sframes_t startThreshold = 0;
     int callbackResult = paContinue;
     PaStreamCallbackFlags cbFlags = 0;  /* We might want to keep state across iterations */
     int streamStarted = 0;
+    unsigned long periodsUntilDeadlineSched = stream->deadlineSched ? PA_ALSA_DEADLINE_MEASUREMENT_PERIODS_ : 0;
+    PaInt64 measureCpuTime = 0;
+    PaTime measureStart = 0.;
 
     assert( stream );
     /* Not implemented */
@@ -4261,6 +6300,16 @@ static void *CallbackThreadFunc( void *userData )
 
     /* Execute OnExit when exiting */
     pthread_cleanup_push( &OnExit, stream );
+
+    if( stream->lockMemory )
+    {
+        /* Failure isn't fatal, the stack is prefaulted anyway */
+        PaUnixThread_LockStack( &stream->thread, PA_ALSA_LOCKED_STACK_SIZE_ );
+    }
+    PA_TRACE_REGISTER_NAMED_THREAD( "ALSA callback" );
+    if( stream->useWatchdog && PaUnixThread_StartWatchdog( &stream->thread, GetPeriodNanoseconds( stream ) ) != paNoError )
+        PA_DEBUG(( "%s: Running without watchdog\n", __FUNCTION__ ));
+
 #ifdef PTHREAD_CANCELED
     /* 'Abort' will use thread cancellation to terminate the callback thread, but the Alsa-lib functions
      * are NOT cancel-safe, (and can end up in an inconsistent state).  So, disable cancelability for
@@ -4299,35 +6348,27 @@ static void *CallbackThreadFunc( void *userData )
 
     while( 1 )
     {
-        unsigned long framesAvail, framesGot;
+        unsigned long framesAvail;
         int xrun = 0;
 
 #ifdef PTHREAD_CANCELED
         pthread_testcancel();
 #endif
 
-        /* @concern StreamStop if the main thread has requested a stop and the stream has not been effectively
-         * stopped we signal this condition by modifying callbackResult (we'll want to flush buffered output).
-         */
-        if( PaUnixThread_StopRequested( &stream->thread ) && paContinue == callbackResult )
+        if( IsCallbackDone( stream, PaUnixThread_StopRequested( &stream->thread ), &callbackResult ) )
         {
-            PA_DEBUG(( "Setting callbackResult to paComplete\n" ));
-            callbackResult = paComplete;
+            goto end;
         }
 
-        if( paContinue != callbackResult )
+        /* Once the cost of a period has been measured, the runtime budget for SCHED_DEADLINE can be derived */
+        if( periodsUntilDeadlineSched == PA_ALSA_DEADLINE_MEASUREMENT_PERIODS_ )
         {
-            stream->callbackAbort = ( paAbort == callbackResult );
-            if( stream->callbackAbort ||
-                    /** @concern BlockAdaption: Go on if adaption buffers are empty */
-                    PaUtil_IsBufferProcessorOutputEmpty( &stream->bufferProcessor ) )
-            {
-                goto end;
-            }
-
-            PA_DEBUG(( "%s: Flushing buffer processor\n", __FUNCTION__ ));
-            /* There is still buffered output that needs to be processed */
+            measureCpuTime = GetThreadCpuTime();
+            measureStart = PaUtil_GetTime();
         }
+        if( periodsUntilDeadlineSched > 0 && --periodsUntilDeadlineSched == 0 )
+            EnterDeadlineScheduling( stream, measureCpuTime ? GetThreadCpuTime() - measureCpuTime : 0,
+                    PaUtil_GetTime() - measureStart );
 
         /* Wait for data to become available, this comes down to polling the ALSA file descriptors until we have
          * a number of available frames.
@@ -4336,6 +6377,7 @@ static void *CallbackThreadFunc( void *userData )
         if( xrun )
         {
             assert( 0 == framesAvail );
+            PaUnixThread_NotifyWatchdog( &stream->thread, 1 );
             continue;
 
             /* XXX: Report xruns to the user? A situation is conceivable where the callback is never invoked due
@@ -4343,99 +6385,559 @@ static void *CallbackThreadFunc( void *userData )
              */
         }
 
-        /* Consume buffer space. Once we have a number of frames available for consumption we must retrieve the
-         * mmapped buffers from ALSA, this is contiguously accessible memory however, so we may receive smaller
-         * portions at a time than is available as a whole. Therefore we should be prepared to process several
-         * chunks successively. The buffers are passed to the PA buffer processor.
-         */
-        while( framesAvail > 0 )
+        PA_ENSURE( ProcessFrames( stream, framesAvail, &callbackResult, &cbFlags ) );
+    }
+
+end:
+    ; /* Hack to fix "label at end of compound statement" error caused by pthread_cleanup_pop(1) macro. */
+    /* Match pthread_cleanup_push */
+    pthread_cleanup_pop( 1 );
+
+    PA_DEBUG(( "%s: Thread %d exiting\n ", __FUNCTION__, pthread_self() ));
+    PaUnixThreading_EXIT( result );
+
+error:
+    PA_DEBUG(( "%s: Thread %d is canceled due to error %d\n ", __FUNCTION__, pthread_self(), result ));
+    goto end;
+}
+
+/* Shared engine threads */
+
+static PaAlsaEngine engines_[PA_ALSA_MAX_ENGINES_];
+static PaUnixMutex enginesMtx_ = { PTHREAD_MUTEX_INITIALIZER };   /* guards starting and stopping engines */
+static int engineThreadCount_ = 0;  /* 0 means one per available CPU */
+
+static void WakeEngine( PaAlsaEngine *engine )
+{
+    eventfd_write( engine->wakeFd, 1 );
+}
+
+/** Make room for the pollfds and ready list of the streams attached to an engine.
+ *
+ * Only called when streams have been attached, so the engine thread doesn't allocate in the steady state.
+ */
+static PaError EngineReserve( PaAlsaEngine *engine, unsigned int nfds, unsigned int streamCount )
+{
+    PaError result = paNoError;
+
+    if( nfds > engine->pfdsSize )
+    {
+        PaUtil_FreeMemory( engine->pfds );
+        engine->pfdsSize = 0;
+        PA_UNLESS( engine->pfds = (struct pollfd *) PaUtil_AllocateZeroInitializedMemory(
+                    sizeof (struct pollfd) * nfds ), paInsufficientMemory );
+        engine->pfdsSize = nfds;
+    }
+    if( streamCount > engine->readySize )
+    {
+        PaUtil_FreeMemory( engine->ready );
+        engine->readySize = 0;
+        PA_UNLESS( engine->ready = (PaAlsaStream **) PaUtil_AllocateZeroInitializedMemory(
+                    sizeof (PaAlsaStream *) * streamCount ), paInsufficientMemory );
+        engine->readySize = streamCount;
+    }
+
+error:
+    return result;
+}
+
+/** Stop a list of streams taken off the engine as in OnExit, and wake up whoever is waiting for them in
+ * DetachFromEngine.
+ */
+static PaError EngineFinishStreams( PaAlsaEngine *engine, PaAlsaStream *finished )
+{
+    PaError result = paNoError;
+    PaAlsaStream *stream, *next;
+
+    /* The finished callback is called without holding the mutex */
+    for( stream = finished; stream; stream = stream->engineSlot.next )
+        FinishCallbackStream( stream );
+
+    PA_ENSURE( PaUnixMutex_Lock( &engine->mtx ) );
+    for( stream = finished; stream; stream = next )
+    {
+        /* The stream may be closed as soon as it is marked finished */
+        next = stream->engineSlot.next;
+        stream->engineSlot.finished = 1;
+    }
+    PA_ASSERT_CALL( pthread_cond_broadcast( &engine->finishedCond ), 0 );
+    ASSERT_CALL_( PaUnixMutex_Unlock( &engine->mtx ), paNoError );
+
+error:
+    return result;
+}
+
+/** Let go of the streams that have finished, or that have been asked to stop.
+ *
+ * @see EngineFinishStreams
+ */
+static PaError EngineRetireStreams( PaAlsaEngine *engine )
+{
+    PaError result = paNoError;
+    PaAlsaStream *stream, **link, *retired = NULL;
+
+    PA_ENSURE( PaUnixMutex_Lock( &engine->mtx ) );
+    link = &engine->streams;
+    while( ( stream = *link ) != NULL )
+    {
+        PaAlsaEngineSlot *slot = &stream->engineSlot;
+
+        if( 2 == slot->stopRequested )
+            slot->callbackResult = paAbort;
+        if( IsCallbackDone( stream, slot->stopRequested, &slot->callbackResult ) )
         {
-            xrun = 0;
+            *link = slot->next;
+            engine->nfds -= stream->capture.nfds + stream->playback.nfds;
+            --engine->listCount;
 
-            /** @concern Xruns Under/overflows are to be reported to the callback */
-            if( stream->underrun > 0.0 )
-            {
-                cbFlags |= paOutputUnderflow;
-                stream->underrun = 0.0;
-            }
-            if( stream->overrun > 0.0 )
-            {
-                cbFlags |= paInputOverflow;
-                stream->overrun = 0.0;
-            }
-            if( stream->capture.pcm && stream->playback.pcm )
-            {
-                /** @concern FullDuplex It's possible that only one direction is being processed to avoid an
-                 * under- or overflow, this should be reported correspondingly */
-                if( !stream->capture.ready )
-                {
-                    cbFlags |= paInputUnderflow;
-                    PA_DEBUG(( "%s: Input underflow\n", __FUNCTION__ ));
-                }
-                else if( !stream->playback.ready )
-                {
-                    cbFlags |= paOutputOverflow;
-                    PA_DEBUG(( "%s: Output overflow\n", __FUNCTION__ ));
-                }
-            }
+            slot->next = retired;
+            retired = stream;
+        }
+        else
+            link = &slot->next;
+    }
+    ASSERT_CALL_( PaUnixMutex_Unlock( &engine->mtx ), paNoError );
 
-#if 0
-            CallbackUpdate( &stream->threading );
-#endif
+    if( retired )
+        PA_ENSURE( EngineFinishStreams( engine, retired ) );
 
-            CalculateTimeInfo( stream, &timeInfo );
-            PaUtil_BeginBufferProcessing( &stream->bufferProcessor, &timeInfo, cbFlags );
-            cbFlags = 0;
+error:
+    return result;
+}
 
-            /* CPU load measurement should include processing activity external to the stream callback */
-            PaUtil_BeginCpuLoadMeasurement( &stream->cpuLoadMeasurer );
+/** Let go of all the streams still attached to an engine whose thread is quitting.
+ *
+ * Called on the way out of the engine thread, so that nobody waits in DetachFromEngine for a thread that is
+ * gone. Streams can't be attached to the engine anymore after this.
+ */
+static void EngineAbandonStreams( PaAlsaEngine *engine )
+{
+    PaAlsaStream *stream, *abandoned;
+
+    /* Locking only fails if the mutex is broken, in which case going on is the lesser evil */
+    ASSERT_CALL_( PaUnixMutex_Lock( &engine->mtx ), paNoError );
+    abandoned = engine->streams;
+    engine->streams = NULL;
+    engine->nfds = 0;
+    engine->listCount = 0;
+    engine->exited = 1;
+    ASSERT_CALL_( PaUnixMutex_Unlock( &engine->mtx ), paNoError );
+
+    for( stream = abandoned; stream; stream = stream->engineSlot.next )
+        stream->engineSlot.callbackResult = paAbort;
+    if( abandoned )
+        ASSERT_CALL_( EngineFinishStreams( engine, abandoned ), paNoError );
+}
 
-            framesGot = framesAvail;
-            if( paUtilFixedHostBufferSize == stream->bufferProcessor.hostBufferSizeMode )
-            {
-                /* We've committed to a fixed host buffer size, stick to that */
-                framesGot = framesGot >= stream->maxFramesPerHostBuffer ? stream->maxFramesPerHostBuffer : 0;
-            }
-            else
-            {
-                /* We've committed to an upper bound on the size of host buffers */
-                assert( paUtilBoundedHostBufferSize == stream->bufferProcessor.hostBufferSizeMode );
-                framesGot = PA_MIN( framesGot, stream->maxFramesPerHostBuffer );
-            }
-            PA_ENSURE( PaAlsaStream_SetUpBuffers( stream, &framesGot, &xrun ) );
-            /* Check the host buffer size against the buffer processor configuration */
-            framesAvail -= framesGot;
+/** Add the pollfds of a stream to the engine's poll, unless it is already waiting for them.
+ *
+ * @param nfds The number of pollfds in use, updated
+ * @param pollTimeout The timeout of the engine's poll, lowered to that of the stream
+ */
+static void EngineBeginPolling( PaAlsaEngine *engine, PaAlsaStream *stream, unsigned int *nfds, int *pollTimeout )
+{
+    PaAlsaEngineSlot *slot = &stream->engineSlot;
 
-            if( framesGot > 0 )
-            {
-                assert( !xrun );
-                PaUtil_EndBufferProcessing( &stream->bufferProcessor, &callbackResult );
-                PA_ENSURE( PaAlsaStream_EndProcessing( stream, framesGot, &xrun ) );
-            }
-            PaUtil_EndCpuLoadMeasurement( &stream->cpuLoadMeasurer, framesGot );
+    slot->polled = 0;
+    if( !slot->pollCapture && !slot->pollPlayback )
+    {
+        /* Start waiting for the next period */
+        slot->pollCapture = stream->capture.pcm != NULL;
+        slot->pollPlayback = stream->playback.pcm != NULL;
+        slot->pollTimeout = stream->pollTimeout;
+    }
+
+    if( slot->pollCapture )
+    {
+        slot->capturePfds = engine->pfds + *nfds;
+        if( PaAlsaStreamComponent_BeginPolling( &stream->capture, slot->capturePfds ) != paNoError )
+            goto xrun;
+        *nfds += stream->capture.nfds;
+    }
+    if( slot->pollPlayback )
+    {
+        slot->playbackPfds = engine->pfds + *nfds;
+        if( PaAlsaStreamComponent_BeginPolling( &stream->playback, slot->playbackPfds ) != paNoError )
+            goto xrun;
+        *nfds += stream->playback.nfds;
+    }
+
+    slot->polled = 1;
+    if( *pollTimeout < 0 || slot->pollTimeout < *pollTimeout )
+        *pollTimeout = slot->pollTimeout;
+    return;
+
+xrun:
+    /* The stream isn't part of this poll, come back for it within a period so that it can't be left waiting
+     * on the other streams, or on nothing at all. An aborted stream is retired right away */
+    slot->pollCapture = slot->pollPlayback = 0;
+    PaUnixThread_NotifyWatchdog( &engine->thread, 1 );
+    if( PaAlsaStream_HandleXrun( stream ) != paNoError )
+    {
+        slot->callbackResult = paAbort;
+        *pollTimeout = 0;
+    }
+    else if( *pollTimeout < 0 || stream->pollTimeout < *pollTimeout )
+        *pollTimeout = stream->pollTimeout;
+}
+
+/** Examine the results of the engine's poll for a stream, in the same way as PaAlsaStream_WaitForFrames.
+ *
+ * @param ready Set if the stream has frames to process, in which case its deadline is set to the time at
+ * which it under- or overruns unless it is serviced.
+ */
+static PaError EngineEndPolling( PaAlsaEngine *engine, PaAlsaStream *stream, PaInt64 now, int *ready )
+{
+    PaError result = paNoError;
+    PaAlsaEngineSlot *slot = &stream->engineSlot;
+    snd_pcm_uframes_t bufferFrames;
+    int xrun = 0;
+
+    *ready = 0;
+    if( !slot->polled )
+        goto end;
+
+    if( slot->pollCapture )
+    {
+        PA_ENSURE( PaAlsaStreamComponent_EndPolling( &stream->capture, slot->capturePfds, &slot->pollCapture, &xrun ) );
+    }
+    if( slot->pollPlayback )
+    {
+        PA_ENSURE( PaAlsaStreamComponent_EndPolling( &stream->playback, slot->playbackPfds, &slot->pollPlayback, &xrun ) );
+    }
+
+    /* @concern FullDuplex See PaAlsaStream_WaitForFrames */
+    if( !xrun && stream->capture.pcm && stream->playback.pcm )
+    {
+        if( slot->pollCapture && !slot->pollPlayback )
+        {
+            PA_ENSURE( ContinuePoll( stream, StreamDirection_In, &slot->pollTimeout, &slot->pollCapture ) );
+        }
+        else if( slot->pollPlayback && !slot->pollCapture )
+        {
+            PA_ENSURE( ContinuePoll( stream, StreamDirection_Out, &slot->pollTimeout, &slot->pollPlayback ) );
+        }
+    }
+
+    if( !xrun && ( slot->pollCapture || slot->pollPlayback ) )
+    {
+        /* Keep waiting, unless the device has stopped delivering altogether */
+        if( now - slot->lastReadyTime < PA_ALSA_ENGINE_STALL_TIMEOUT_ )
+            goto end;
+
+        PA_DEBUG(( "%s: poll timed out\n", __FUNCTION__ ));
+        xrun = 1; /* try recovering device */
+    }
+
+    slot->pollCapture = slot->pollPlayback = 0;
+    slot->lastReadyTime = now;
+    slot->framesAvail = 0;
+    if( !xrun )
+    {
+        PA_ENSURE( PaAlsaStream_GetReadyFrames( stream, &slot->framesAvail, &xrun ) );
+    }
+    if( xrun )
+    {
+        PaUnixThread_NotifyWatchdog( &engine->thread, 1 );
+        PA_ENSURE( PaAlsaStream_HandleXrun( stream ) );
+        slot->framesAvail = 0;
+    }
+    if( 0 == slot->framesAvail )
+        goto end;
+
+    bufferFrames = stream->playback.pcm ? stream->playback.alsaBufferSize : stream->capture.alsaBufferSize;
+    if( stream->capture.pcm )
+        bufferFrames = PA_MIN( bufferFrames, stream->capture.alsaBufferSize );
+    bufferFrames = bufferFrames > slot->framesAvail ? bufferFrames - slot->framesAvail : 0;
+    slot->deadline = now + (PaInt64)( bufferFrames * 1e9 / stream->streamRepresentation.streamInfo.sampleRate );
+    *ready = 1;
+
+end:
+error:
+    return result;
+}
+
+/** Put the engine thread under the watchdog once a stream that asked for it is attached, see
+ * PaAlsa_EnableWatchdog. Called every iteration, the watchdog checks the thread at the shortest period among
+ * the streams and is re-armed when a stream with a shorter period joins.
+ */
+static void EngineStartWatchdog( PaAlsaEngine *engine, PaAlsaStream *first )
+{
+    PaAlsaStream *stream;
+    PaInt64 period = 0;
+
+    for( stream = first; stream; stream = stream->engineSlot.next )
+    {
+        if( stream->useWatchdog && ( 0 == period || GetPeriodNanoseconds( stream ) < period ) )
+            period = GetPeriodNanoseconds( stream );
+    }
+    if( 0 == period || engine->watchdogFailed )
+        return;
+
+    if( 0 == engine->watchdogPeriod )
+    {
+        if( PaUnixThread_StartWatchdog( &engine->thread, period ) != paNoError )
+        {
+            PA_DEBUG(( "%s: Running engine without watchdog\n", __FUNCTION__ ));
+            engine->watchdogFailed = 1;
+            return;
+        }
+    }
+    else if( period < engine->watchdogPeriod )
+        PaUnixThread_SetWatchdogPeriod( &engine->thread, period );
+    else
+        return;
+    engine->watchdogPeriod = period;
+}
+
+/** Shared engine thread's function.
+ *
+ * Each iteration polls the pcms of all attached streams at once, then runs the callbacks of the streams that
+ * have become ready in order of their deadlines, so that the stream closest to an xrun is serviced first.
+ */
+static void *EngineThreadFunc( void *userData )
+{
+    PaError result = paNoError;
+    PaAlsaEngine *engine = (PaAlsaEngine *) userData;
+
+    /* Failure isn't fatal, the stack is prefaulted anyway */
+    PaUnixThread_LockStack( &engine->thread, PA_ALSA_LOCKED_STACK_SIZE_ );
+    PA_TRACE_REGISTER_NAMED_THREAD( "ALSA engine" );
+
+    while( !engine->stopRequested )
+    {
+        PaAlsaStream *first, *stream;
+        unsigned int nfds, listCount, readyCount = 0, i;
+        int pollTimeout = -1, pollResults;
+        PaInt64 now;
+
+        PA_ENSURE( EngineRetireStreams( engine ) );
+
+        /* Streams attached from now on are picked up in the next iteration, and only this thread detaches them */
+        PA_ENSURE( PaUnixMutex_Lock( &engine->mtx ) );
+        first = engine->streams;
+        nfds = engine->nfds + 1;
+        listCount = engine->listCount;
+        ASSERT_CALL_( PaUnixMutex_Unlock( &engine->mtx ), paNoError );
+
+        if( EngineReserve( engine, nfds, listCount ) != paNoError )
+        {
+            for( stream = first; stream; stream = stream->engineSlot.next )
+                stream->engineSlot.callbackResult = paAbort;
+            continue;
+        }
+        EngineStartWatchdog( engine, first );
+
+        engine->pfds[0].fd = engine->wakeFd;
+        engine->pfds[0].events = POLLIN;
+        engine->pfds[0].revents = 0;
+        nfds = 1;
+        for( stream = first; stream; stream = stream->engineSlot.next )
+            EngineBeginPolling( engine, stream, &nfds, &pollTimeout );
+
+        PA_TRACE_BEGIN( "ALSA engine poll, timeout %ld ms", pollTimeout, 0, 0, 0 );
+        pollResults = poll( engine->pfds, nfds, pollTimeout );
+        PA_TRACE_END( "ALSA engine poll returned %ld", pollResults, 0, 0, 0 );
+
+        if( pollResults < 0 )
+        {
+            if( errno != EINTR )
+                PA_DEBUG(( "%s: poll failed: %s\n", __FUNCTION__, strerror( errno ) ));
+            Pa_Sleep( 1 ); /* avoid hot loop */
+            continue;
+        }
+        if( engine->pfds[0].revents & POLLIN )
+        {
+            eventfd_t count;
+            eventfd_read( engine->wakeFd, &count );
+        }
+
+        /* Sort the ready streams by deadline, there are few enough for an insertion sort */
+        now = PaUtil_GetNanoseconds();
+        for( stream = first; stream; stream = stream->engineSlot.next )
+        {
+            int ready;
+
+            if( EngineEndPolling( engine, stream, now, &ready ) != paNoError )
+                stream->engineSlot.callbackResult = paAbort;
+            if( !ready )
+                continue;
+
+            for( i = readyCount++; i > 0 && engine->ready[i - 1]->engineSlot.deadline > stream->engineSlot.deadline; --i )
+                engine->ready[i] = engine->ready[i - 1];
+            engine->ready[i] = stream;
+        }
+
+        for( i = 0; i < readyCount; ++i )
+        {
+            PaAlsaEngineSlot *slot = &engine->ready[i]->engineSlot;
+
+            if( ProcessFrames( engine->ready[i], slot->framesAvail, &slot->callbackResult, &slot->cbFlags ) != paNoError )
+                slot->callbackResult = paAbort;
+        }
+    }
+
+end:
+    EngineAbandonStreams( engine );
+    PaUnixThread_StopWatchdog( &engine->thread );
+    PaUtil_UnregisterTraceThread();
+    PaUnixThreading_EXIT( result );
+
+error:
+    PA_DEBUG(( "%s: Engine thread exiting due to error %d\n", __FUNCTION__, result ));
+    goto end;
+}
+
+/** Start the engine thread, pinned to cpu. Called with enginesMtx_ held. */
+static PaError StartEngine( PaAlsaEngine *engine, unsigned long cpu )
+{
+    PaError result = paNoError;
+    PaUnixCpuSet cpuAffinity;
+    int mutexInitialized = 0, condInitialized = 0;
+
+    memset( engine, 0, sizeof (PaAlsaEngine) );
+    memset( &cpuAffinity, 0, sizeof (PaUnixCpuSet) );
+    PaUnixCpuSet_Add( &cpuAffinity, cpu );
+
+    engine->wakeFd = eventfd( 0, EFD_CLOEXEC );
+    PA_UNLESS( engine->wakeFd >= 0, paInternalError );
+    PA_ENSURE( PaUnixMutex_Initialize( &engine->mtx ) );
+    mutexInitialized = 1;
+    PA_ENSURE_SYSTEM( pthread_cond_init( &engine->finishedCond, NULL ), 0 );
+    condInitialized = 1;
+
+    PA_ENSURE( PaUnixThread_New( &engine->thread, &EngineThreadFunc, engine, 0., 1, &cpuAffinity ) );
+    engine->running = 1;
+    PA_DEBUG(( "%s: Started engine on CPU %lu\n", __FUNCTION__, cpu ));
+
+end:
+    return result;
+
+error:
+    if( condInitialized )
+        pthread_cond_destroy( &engine->finishedCond );
+    if( mutexInitialized )
+        PaUnixMutex_Terminate( &engine->mtx );
+    if( engine->wakeFd >= 0 )
+        close( engine->wakeFd );
+    goto end;
+}
+
+/** Stop the engine thread, once no streams are attached. Called with enginesMtx_ held. */
+static void StopEngine( PaAlsaEngine *engine )
+{
+    PaError threadRes;
+
+    engine->stopRequested = 1;
+    WakeEngine( engine );
+    if( PaUnixThread_Terminate( &engine->thread, 1, &threadRes ) != paNoError || threadRes != paNoError )
+        PA_DEBUG(( "%s: Engine thread returned: %d\n", __FUNCTION__, threadRes ));
+
+    close( engine->wakeFd );
+    PaUnixMutex_Terminate( &engine->mtx );
+    pthread_cond_destroy( &engine->finishedCond );
+    PaUtil_FreeMemory( engine->pfds );
+    PaUtil_FreeMemory( engine->ready );
+    engine->running = 0;
+}
+
+/** Hand a started callback stream over to the least loaded engine.
+ *
+ * There is one engine per CPU available to audio threads, unless set otherwise with
+ * PaAlsa_SetSharedEngineThreadCount, and engines are started as they are needed.
+ */
+static PaError AttachToEngine( PaAlsaStream *stream )
+{
+    PaError result = paNoError;
+    PaAlsaEngineSlot *slot = &stream->engineSlot;
+    PaAlsaEngine *engine = NULL;
+    PaUnixCpuSet cpus;
+    unsigned long cpu, cpuCount = 0, engineCpu;
+    int i, engineCount, locked = 0;
+
+    PaUnixThreading_GetAvailableCpus( &cpus );
+    for( cpu = 0; cpu < PA_UNIX_MAX_CPUS; ++cpu )
+        cpuCount += PaUnixCpuSet_Contains( &cpus, cpu );
+    assert( cpuCount > 0 );
+
+    engineCount = engineThreadCount_ > 0 ? engineThreadCount_ : (int)cpuCount;
+    engineCount = PA_MIN( engineCount, PA_ALSA_MAX_ENGINES_ );
+
+    PA_ENSURE( PaUnixMutex_Lock( &enginesMtx_ ) );
+    locked = 1;
+
+    for( i = 0; i < engineCount; ++i )
+    {
+        if( !engine || engines_[i].streamCount < engine->streamCount )
+            engine = &engines_[i];
+    }
+    if( !engine->running )
+    {
+        /* Engines are spread over the available CPUs in order */
+        engineCpu = ( engine - engines_ ) % cpuCount;
+        for( cpu = 0; !PaUnixCpuSet_Contains( &cpus, cpu ) || engineCpu-- > 0; ++cpu )
+            ;
+        PA_ENSURE( StartEngine( engine, cpu ) );
+    }
+    ++engine->streamCount;
 
-            if( 0 == framesGot )
-            {
-                /* Go back to polling for more frames */
-                break;
-            }
+    memset( slot, 0, sizeof (PaAlsaEngineSlot) );
+    slot->engine = engine;
+    slot->callbackResult = paContinue;
+    slot->lastReadyTime = PaUtil_GetNanoseconds();
 
-            if( paContinue != callbackResult )
-                break;
-        }
+    PA_ENSURE( PaUnixMutex_Lock( &engine->mtx ) );
+    if( engine->exited )
+    {
+        /* The engine thread quit on an error, it is stopped along with its last stream */
+        ASSERT_CALL_( PaUnixMutex_Unlock( &engine->mtx ), paNoError );
+        slot->engine = NULL;
+        if( --engine->streamCount == 0 )
+            StopEngine( engine );
+        PA_ENSURE( paInternalError );
     }
+    slot->next = engine->streams;
+    engine->streams = stream;
+    engine->nfds += stream->capture.nfds + stream->playback.nfds;
+    ++engine->listCount;
+    ASSERT_CALL_( PaUnixMutex_Unlock( &engine->mtx ), paNoError );
 
-end:
-    ; /* Hack to fix "label at end of compound statement" error caused by pthread_cleanup_pop(1) macro. */
-    /* Match pthread_cleanup_push */
-    pthread_cleanup_pop( 1 );
+    WakeEngine( engine );
 
-    PA_DEBUG(( "%s: Thread %d exiting\n ", __FUNCTION__, pthread_self() ));
-    PaUnixThreading_EXIT( result );
+error:
+    if( locked )
+        ASSERT_CALL_( PaUnixMutex_Unlock( &enginesMtx_ ), paNoError );
+    return result;
+}
+
+/** Have the engine stop a stream, flushing its buffered output unless aborting, and wait until it has.
+ *
+ * The engine is stopped if this was the last stream attached to it.
+ */
+static PaError DetachFromEngine( PaAlsaStream *stream, int abort )
+{
+    PaError result = paNoError;
+    PaAlsaEngineSlot *slot = &stream->engineSlot;
+    PaAlsaEngine *engine = slot->engine;
+
+    assert( engine );
+
+    slot->stopRequested = abort ? 2 : 1;
+    WakeEngine( engine );
+
+    PA_ENSURE( PaUnixMutex_Lock( &engine->mtx ) );
+    while( !slot->finished )
+        PA_ASSERT_CALL( pthread_cond_wait( &engine->finishedCond, &engine->mtx.mtx ), 0 );
+    ASSERT_CALL_( PaUnixMutex_Unlock( &engine->mtx ), paNoError );
+    slot->engine = NULL;
+
+    PA_ENSURE( PaUnixMutex_Lock( &enginesMtx_ ) );
+    if( --engine->streamCount == 0 )
+        StopEngine( engine );
+    ASSERT_CALL_( PaUnixMutex_Unlock( &enginesMtx_ ), paNoError );
 
 error:
-    PA_DEBUG(( "%s: Thread %d is canceled due to error %d\n ", __FUNCTION__, pthread_self(), result ));
-    goto end;
+    return result;
 }
 
 /* Blocking interface */
@@ -4500,10 +7002,30 @@ error:
     goto end;
 }
 
-static PaError WriteStream( PaStream* s, const void *buffer, unsigned long frames )
+/* Start a blocking stream's playback once a period's worth of frames has been written */
+static PaError PaAlsaStream_StartPrimedPlayback( PaAlsaStream *stream )
 {
     PaError result = paNoError;
     signed long err;
+    snd_pcm_uframes_t hwAvail;
+
+    /* Frames residing in buffer */
+    PA_ENSURE( err = GetStreamWriteAvailable( stream ) );
+    hwAvail = stream->playback.alsaBufferSize - err;
+
+    if( alsa_snd_pcm_state( stream->playback.pcm ) == SND_PCM_STATE_PREPARED &&
+            hwAvail >= stream->playback.framesPerPeriod )
+    {
+        ENSURE_( alsa_snd_pcm_start( stream->playback.pcm ), paUnanticipatedHostError );
+    }
+
+error:
+    return result;
+}
+
+static PaError WriteStream( PaStream* s, const void *buffer, unsigned long frames )
+{
+    PaError result = paNoError;
     PaAlsaStream *stream = (PaAlsaStream*)s;
     snd_pcm_uframes_t framesGot, framesAvail;
     const void *userBuffer;
@@ -4533,7 +7055,6 @@ static PaError WriteStream( PaStream* s, const void *buffer, unsigned long frame
     while( frames > 0 )
     {
         int xrun = 0;
-        snd_pcm_uframes_t hwAvail;
 
         PA_ENSURE( PaAlsaStream_WaitForFrames( stream, &framesAvail, &xrun ) );
         framesGot = PA_MIN( framesAvail, frames );
@@ -4546,20 +7067,162 @@ static PaError WriteStream( PaStream* s, const void *buffer, unsigned long frame
             frames -= framesGot;
         }
 
-        /* Start stream after one period of samples worth */
+        PA_ENSURE( PaAlsaStream_StartPrimedPlayback( stream ) );
+    }
 
-        /* Frames residing in buffer */
-        PA_ENSURE( err = GetStreamWriteAvailable( stream ) );
-        framesAvail = err;
-        hwAvail = stream->playback.alsaBufferSize - framesAvail;
+end:
+    stream->capture.pcm = save;
+    return result;
+error:
+    goto end;
+}
 
-        if( alsa_snd_pcm_state( stream->playback.pcm ) == SND_PCM_STATE_PREPARED &&
-                hwAvail >= stream->playback.framesPerPeriod )
-        {
-            ENSURE_( alsa_snd_pcm_start( stream->playback.pcm ), paUnanticipatedHostError );
-        }
+/* Blocking I/O straight from and to the mmap area, for streams whose samples need neither conversion nor
+ * channel adaption. Other streams are staged by pa_front, see Pa_BeginReadStream */
+
+static int PaAlsaStreamComponent_CanAccessDirectly( const PaAlsaStreamComponent *self )
+{
+    return self->canMmap && self->userFormatIsHost && self->userInterleaved == self->hostInterleaved &&
+        self->numUserChannels == self->numHostChannels;
+}
+
+/** Map the available part of the mmap area, to be committed with PaAlsaStreamComponent_EndProcessing.
+ *
+ * @param numFrames On entrance the maximum number of frames, on exit the number mapped
+ * @param buffer Receives the frames, laid out as user buffers
+ */
+static PaError PaAlsaStreamComponent_BeginDirectAccess( PaAlsaStreamComponent *self, void **buffer,
+        unsigned long *numFrames, int *xrun )
+{
+    PaError result = paNoError;
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t frames = *numFrames;
+    unsigned long framesAvail;
+    int i;
+
+    /* This _must_ be called before mmap_begin */
+    PA_ENSURE( PaAlsaStreamComponent_GetAvailableFrames( self, &framesAvail, xrun ) );
+    if( *xrun )
+    {
+        *numFrames = 0;
+        goto end;
+    }
+
+    ENSURE_( alsa_snd_pcm_mmap_begin( self->pcm, &areas, &self->offset, &frames ), paUnanticipatedHostError );
+    self->channelAreas = (snd_pcm_channel_area_t *)areas;
+    self->ready = 1;
+
+    if( self->hostInterleaved )
+    {
+        *buffer = ExtractAddress( areas, self->offset );
+    }
+    else
+    {
+        for( i = 0; i < self->numUserChannels; ++i )
+            self->userBuffers[i] = ExtractAddress( areas + i, self->offset );
+        *buffer = self->userBuffers;
+    }
+    *numFrames = frames;
+
+end:
+error:
+    return result;
+}
+
+static PaError BeginReadStream( PaStream* s, const void **buffer, unsigned long *frames )
+{
+    PaError result = paNoError;
+    PaAlsaStream *stream = (PaAlsaStream*)s;
+    unsigned long framesGot = 0, framesAvail;
+    void *directBuffer = NULL;
+    snd_pcm_t *save = stream->playback.pcm;
+
+    PA_UNLESS( stream->capture.pcm, paCanNotReadFromAnOutputOnlyStream );
+    if( !PaAlsaStreamComponent_CanAccessDirectly( &stream->capture ) )
+        return paSampleFormatNotSupported;
+
+    /* Disregard playback */
+    stream->playback.pcm = NULL;
+
+    if( stream->overrun > 0. )
+    {
+        result = paInputOverflowed;
+        stream->overrun = 0.0;
+    }
+
+    /* Start stream if in prepared state */
+    if( alsa_snd_pcm_state( stream->capture.pcm ) == SND_PCM_STATE_PREPARED )
+    {
+        ENSURE_( alsa_snd_pcm_start( stream->capture.pcm ), paUnanticipatedHostError );
+    }
+
+    while( framesGot == 0 )
+    {
+        int xrun = 0;
+        PA_ENSURE( PaAlsaStream_WaitForFrames( stream, &framesAvail, &xrun ) );
+        if( xrun )
+            continue;
+
+        framesGot = PA_MIN( framesAvail, *frames );
+        PA_ENSURE( PaAlsaStreamComponent_BeginDirectAccess( &stream->capture, &directBuffer, &framesGot, &xrun ) );
+    }
+    *buffer = directBuffer;
+    *frames = framesGot;
+
+end:
+    stream->playback.pcm = save;
+    return result;
+error:
+    goto end;
+}
+
+static PaError CommitReadStream( PaStream* s, unsigned long frames )
+{
+    PaError result = paNoError;
+    PaAlsaStream *stream = (PaAlsaStream*)s;
+    int xrun = 0;
+
+    /* An overrun is picked up by the next wait */
+    PA_ENSURE( PaAlsaStreamComponent_EndProcessing( &stream->capture, frames, &xrun ) );
+
+error:
+    return result;
+}
+
+static PaError BeginWriteStream( PaStream* s, void **buffer, unsigned long *frames )
+{
+    PaError result = paNoError;
+    PaAlsaStream *stream = (PaAlsaStream*)s;
+    unsigned long framesGot = 0, framesAvail;
+    void *directBuffer = NULL;
+    snd_pcm_t *save = stream->capture.pcm;
+
+    PA_UNLESS( stream->playback.pcm, paCanNotWriteToAnInputOnlyStream );
+    if( !PaAlsaStreamComponent_CanAccessDirectly( &stream->playback ) )
+        return paSampleFormatNotSupported;
+
+    /* Disregard capture */
+    stream->capture.pcm = NULL;
+
+    if( stream->underrun > 0. )
+    {
+        result = paOutputUnderflowed;
+        stream->underrun = 0.0;
     }
 
+    while( framesGot == 0 )
+    {
+        int xrun = 0;
+        PA_ENSURE( PaAlsaStream_WaitForFrames( stream, &framesAvail, &xrun ) );
+        if( xrun )
+            continue;
+
+        framesGot = PA_MIN( framesAvail, *frames );
+        PA_ENSURE( PaAlsaStreamComponent_BeginDirectAccess( &stream->playback, &directBuffer, &framesGot, &xrun ) );
+    }
+    *buffer = directBuffer;
+    *frames = framesGot;
+
 end:
     stream->capture.pcm = save;
     return result;
@@ -4567,6 +7230,20 @@ error:
     goto end;
 }
 
+static PaError CommitWriteStream( PaStream* s, unsigned long frames )
+{
+    PaError result = paNoError;
+    PaAlsaStream *stream = (PaAlsaStream*)s;
+    int xrun = 0;
+
+    /* An underrun is picked up by the next wait */
+    PA_ENSURE( PaAlsaStreamComponent_EndProcessing( &stream->playback, frames, &xrun ) );
+    PA_ENSURE( PaAlsaStream_StartPrimedPlayback( stream ) );
+
+error:
+    return result;
+}
+
 /* Return frames available for reading. In the event of an overflow, the capture pcm will be restarted */
 static signed long GetStreamReadAvailable( PaStream* s )
 {
@@ -4621,25 +7298,76 @@ error:
 
 void PaAlsa_InitializeStreamInfo( PaAlsaStreamInfo *info )
 {
-    info->size = sizeof (PaAlsaStreamInfo);
+    /* The structure may have been allocated by an application built against the version 1 header */
+    info->size = offsetof( PaAlsaStreamInfo, cpuAffinity );
     info->hostApiType = paALSA;
     info->version = 1;
     info->deviceString = NULL;
 }
 
+PaError PaAlsa_InitializeStreamInfoVersion( PaAlsaStreamInfo *info, unsigned long version )
+{
+    if( version < 1 || version > 3 )
+        return paIncompatibleHostApiSpecificStreamInfo;
+
+    PaAlsa_InitializeStreamInfo( info );
+    if( version >= 2 )
+    {
+        info->size = offsetof( PaAlsaStreamInfo, aggregateDevices );
+        info->cpuAffinity = NULL;
+    }
+    if( version >= 3 )
+    {
+        info->size = sizeof (PaAlsaStreamInfo);
+        info->aggregateDevices = NULL;
+        info->aggregateDeviceCount = 0;
+    }
+    info->version = version;
+
+    return paNoError;
+}
+
 void PaAlsa_EnableRealtimeScheduling( PaStream *s, int enable )
 {
     PaAlsaStream *stream = (PaAlsaStream *) s;
     stream->rtSched = enable;
 }
 
-#if 0
+void PaAlsa_EnableDeadlineScheduling( PaStream *s, int enable )
+{
+    PaAlsaStream *stream = (PaAlsaStream *) s;
+    stream->deadlineSched = enable;
+}
+
+PaError PaAlsa_SetDefaultCpuAffinity( const char *cpuList )
+{
+    PaError result = paNoError;
+    PaUnixCpuSet cpuAffinity;
+
+    PA_ENSURE( PaUnixCpuSet_Parse( &cpuAffinity, cpuList ) );
+    PA_ENSURE( PaUnixThreading_SetDefaultCpuAffinity( &cpuAffinity ) );
+
+error:
+    return result;
+}
+
 void PaAlsa_EnableWatchdog( PaStream *s, int enable )
 {
     PaAlsaStream *stream = (PaAlsaStream *) s;
-    stream->thread.useWatchdog = enable;
+    stream->useWatchdog = enable;
+}
+
+void PaAlsa_EnableSharedEngine( PaStream *s, int enable )
+{
+    PaAlsaStream *stream = (PaAlsaStream *) s;
+    stream->useSharedEngine = enable;
+}
+
+PaError PaAlsa_SetSharedEngineThreadCount( int count )
+{
+    engineThreadCount_ = count;
+    return paNoError;
 }
-#endif
 
 static PaError GetAlsaStreamPointer( PaStream* s, PaAlsaStream** stream )
 {
@@ -4660,6 +7388,67 @@ error:
     return paNoError;
 }
 
+/** The thread running the callback of a stream, its own or that of the engine it is attached to. */
+static PaUnixThread *GetCallbackThread( PaAlsaStream *stream )
+{
+    return stream->engineSlot.engine ? &stream->engineSlot.engine->thread : &stream->thread;
+}
+
+PaError PaAlsa_GetStreamSchedulingPolicy( PaStream *s, int *policy )
+{
+    PaAlsaStream *stream;
+    PaError result = paNoError;
+    struct sched_param spm;
+
+    stream = NULL;
+    PA_ENSURE( GetAlsaStreamPointer( s, &stream ) );
+    PA_UNLESS( stream->callbackMode && stream->isActive, paStreamIsStopped );
+
+    if( GetCallbackThread( stream )->deadlineScheduling )
+        *policy = SCHED_DEADLINE;
+    else
+        PA_ENSURE_SYSTEM( pthread_getschedparam( GetCallbackThread( stream )->thread, policy, &spm ), 0 );
+
+error:
+    return result;
+}
+
+PaError PaAlsa_GetStreamWatchdogStatistics( PaStream* s, PaAlsaWatchdogStatistics* statistics )
+{
+    PaAlsaStream *stream;
+    PaError result = paNoError;
+    PaUnixWatchdogStatistics watchdogStatistics;
+
+    stream = NULL;
+    PA_ENSURE( GetAlsaStreamPointer( s, &stream ) );
+    PA_UNLESS( statistics, paBadBufferPtr );
+
+    PaUnixThread_GetWatchdogStatistics( GetCallbackThread( stream ), &watchdogStatistics );
+    statistics->throttleCount = watchdogStatistics.throttleCount;
+    statistics->stallCount = watchdogStatistics.stallCount;
+    statistics->throttled = watchdogStatistics.throttled;
+    statistics->cpuFraction = watchdogStatistics.cpuFraction;
+    statistics->maximumCpuFraction = watchdogStatistics.maximumCpuFraction;
+
+error:
+    return result;
+}
+
+PaError PaAlsa_GetStreamCpuAffinity( PaStream* s, char* cpuList, unsigned long size )
+{
+    PaAlsaStream *stream;
+    PaError result = paNoError;
+
+    stream = NULL;
+    PA_ENSURE( GetAlsaStreamPointer( s, &stream ) );
+    PA_UNLESS( cpuList && size > 0, paBadBufferPtr );
+
+    PaUnixCpuSet_Format( &GetCallbackThread( stream )->cpuAffinity, cpuList, size );
+
+error:
+    return result;
+}
+
 PaError PaAlsa_GetStreamInputCard( PaStream* s, int* card )
 {
     PaAlsaStream *stream;
@@ -4680,6 +7469,37 @@ error:
     return result;
 }
 
+PaError PaAlsa_GetStreamRateRatio( PaStream *s, double *ratio )
+{
+    PaAlsaStream *stream;
+    const PaAlsaDll *clock;
+    PaError result = paNoError;
+
+    PA_ENSURE( GetAlsaStreamPointer( s, &stream ) );
+    clock = stream->capture.pcm ? &stream->capture.dll : &stream->playback.dll;
+
+    *ratio = clock->nominalRate > 0. ? clock->rate / clock->nominalRate : 1.;
+
+error:
+    return result;
+}
+
+PaError PaAlsa_GetStreamAggregateRatio( PaStream *s, int isInput, unsigned long index, double *ratio )
+{
+    PaAlsaStream *stream;
+    PaAlsaStreamComponent *component;
+    PaError result = paNoError;
+
+    PA_ENSURE( GetAlsaStreamPointer( s, &stream ) );
+    component = isInput ? &stream->capture : &stream->playback;
+    PA_UNLESS( index < (unsigned long)component->memberCount, paInvalidDevice );
+
+    *ratio = component->members[index].ratio;
+
+error:
+    return result;
+}
+
 PaError PaAlsa_GetStreamOutputCard( PaStream* s, int* card )
 {
     PaAlsaStream *stream;
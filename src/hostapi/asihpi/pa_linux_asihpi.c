@@ -160,6 +160,7 @@
 #include "pa_process.h"      /* Buffer processor */
 #include "pa_converters.h"   /* PaUtilZeroer */
 #include "pa_debugprint.h"
+#include "pa_trace.h"
 
 /* -------------------------------------------------------------------------- */
 
@@ -1792,6 +1793,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
         stream->callbackMode = 0;
     }
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, sampleRate );
+    stream->baseStreamRep.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
     /* Following pa_linux_alsa's lead, we operate with fixed host buffer size by default, */
     /* since other modes will invariably lead to block adaption (maybe Bounded better?) */
@@ -2009,7 +2011,7 @@ static PaError StartStream( PaStream *s )
     {
         /* Create and start callback engine thread */
         /* Also waits 1 second for stream to be started by engine thread (otherwise aborts) */
-        PA_ENSURE_( PaUnixThread_New( &stream->thread, &CallbackThreadFunc, stream, 1., 0 /*rtSched*/ ) );
+        PA_ENSURE_( PaUnixThread_New( &stream->thread, &CallbackThreadFunc, stream, 1., 0 /*rtSched*/, NULL ) );
     }
     else
     {
@@ -2261,6 +2263,8 @@ static void PaAsiHpi_OnThreadExit( void *userData )
      end up here - need another flag to remind us which is the case */
     if( stream->callbackFinished )
         stream->state = paAsiHpiCallbackFinishedState;
+
+    PaUtil_UnregisterTraceThread();
 }
 
 
@@ -2571,6 +2575,7 @@ static void *CallbackThreadFunc( void *userData )
 
     /* Cleanup routine stops streams on thread exit */
     pthread_cleanup_push( &PaAsiHpi_OnThreadExit, stream );
+    PA_TRACE_REGISTER_NAMED_THREAD( "ASIHPI callback" );
 
     /* Start HPI streams and notify parent when we're done */
     PA_ENSURE_( PaUnixThread_PrepareNotify( &stream->thread ) );
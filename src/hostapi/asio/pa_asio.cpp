@@ -2209,6 +2209,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
 
 
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, sampleRate );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
 
     stream->asioBufferInfos = (ASIOBufferInfo*)PaUtil_AllocateZeroInitializedMemory(
@@ -64,6 +64,7 @@
 #include "pa_stream.h"
 #include "pa_cpuload.h"
 #include "pa_process.h"
+#include "pa_trace.h"
 
 #ifndef AUDIOIO_MAX_DEVICES
 #define AUDIOIO_MAX_DEVICES    (32)
@@ -712,6 +713,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     PA_ENSURE( PaUtil_InitializeThreading( &stream->threading ) );
 
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, sampleRate );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
     /* we assume a fixed host buffer size in this example, but the buffer processor
         can also support bounded and unknown host buffer sizes by passing
@@ -759,6 +761,8 @@ static void *PaAudioIO_AudioThreadProc( void *userData )
     unsigned int pframes, rframes;
     size_t off;
 
+    PA_TRACE_REGISTER_NAMED_THREAD( "audioio callback" );
+
     while(!stream->stopped)
     {
         pframes = rframes = 0;
@@ -837,6 +841,7 @@ static void *PaAudioIO_AudioThreadProc( void *userData )
 error:
     PaUtil_ResetCpuLoadMeasurer( &stream->cpuLoadMeasurer );
     stream->active = false;
+    PaUtil_UnregisterTraceThread();
     PA_DEBUG(("PaAudioIO %s: Thread exited\n", __FUNCTION__));
     pthread_exit( NULL );
 }
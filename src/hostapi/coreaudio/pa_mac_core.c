@@ -1807,6 +1807,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     }
 
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, sampleRate );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
 
     if( inputParameters )
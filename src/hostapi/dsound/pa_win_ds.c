@@ -86,6 +86,7 @@
 #include "pa_cpuload.h"
 #include "pa_process.h"
 #include "pa_debugprint.h"
+#include "pa_trace.h"
 
 #include "pa_win_util.h"
 #include "pa_win_ds.h"
@@ -2027,6 +2028,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     stream->streamFlags = streamFlags;
 
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, sampleRate );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
     /* These are all the formats that can be represented in WAVEFORMATEX */
     const PaSampleFormat nativeFormats = paUInt8 | paInt16 | paInt24 | paInt32 | paFloat32;
@@ -2739,6 +2741,9 @@ PA_THREAD_FUNC ProcessingThreadProc( void *pArg )
     if( timerPeriodMs < 1 )
         timerPeriodMs = 1;
 
+    /* the timer callbacks run in this thread */
+    PA_TRACE_REGISTER_NAMED_THREAD( "DirectSound processing" );
+
 #ifdef PA_WIN_DS_USE_WAITABLE_TIMER_OBJECT
     assert( stream->waitableTimer != NULL );
 
@@ -2769,6 +2774,7 @@ PA_THREAD_FUNC ProcessingThreadProc( void *pArg )
     }
 #endif /* PA_WIN_DS_USE_WAITABLE_TIMER_OBJECT */
 
+    PaUtil_UnregisterTraceThread();
     return 0;
 }
 
@@ -53,17 +53,17 @@
 #include <stdio.h>
 #include <assert.h>
 #include <sys/types.h>
-#include <errno.h>  /* EBUSY */
+#include <errno.h>  /* ETIMEDOUT */
 #include <signal.h> /* sig_atomic_t */
 #include <math.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <time.h>
 
 #include <jack/types.h>
 #include <jack/jack.h>
 
 #include "pa_util.h"
-#include "pa_pthread_util.h"
 #include "pa_hostapi.h"
 #include "pa_stream.h"
 #include "pa_process.h"
@@ -71,6 +71,9 @@
 #include "pa_cpuload.h"
 #include "pa_ringbuffer.h"
 #include "pa_debugprint.h"
+#include "pa_memorybarrier.h"
+#include "pa_atomic.h"
+#include "pa_trace.h"
 
 #include "pa_jack.h"
 
@@ -167,15 +170,15 @@ typedef struct
     int jack_buffer_size;
     PaHostApiIndex hostApiIndex;
 
-    pthread_mutex_t mtx;
-    pthread_cond_t cond;
-    PaUtilClockId condClockId;
     unsigned long inputBase, outputBase;
 
     /* For dealing with the process thread */
     volatile int xrun;     /* Received xrun notification from JACK? */
-    struct PaJackStream * volatile toAdd, * volatile toRemove;
-    struct PaJackStream *processQueue;
+    /* Streams waiting to be added to or removed from processQueue, pushed lock-free by the main thread and
+     * taken all at once by the process thread, see PostQueueRequest() and UpdateQueue() */
+    struct PaJackStream * volatile queueRequests;
+    struct PaJackStream *processQueue;   /* Only touched by the process thread */
+    int queuedStreams;                   /* Streams added and not yet removed, main thread only */
     volatile sig_atomic_t jackIsDown;
 }
 PaJackHostApiRepresentation;
@@ -201,13 +204,18 @@ typedef struct PaJackStream
     int num_outgoing_connections;
 
     jack_client_t *jack_client;
+    /* Set if jack_client is the stream's own rather than the host API's, see PaJackStreamInfo::ownClient */
+    int ownClient;
+    int ownClientActive;
+    volatile sig_atomic_t ownClientIsDown;
 
     /* The stream is running if it's still producing samples.
      * The stream is active if samples it produced are still being heard.
      */
     volatile sig_atomic_t is_running;
     volatile sig_atomic_t is_active;
-    /* Used to signal processing thread that stream should start or stop, respectively */
+    /* Used to signal processing thread that stream should start or stop, respectively. Each holds the id of the
+     * request while it is pending, see WaitStreamState() */
     volatile sig_atomic_t doStart, doStop, doAbort;
 
     jack_nframes_t t0;
@@ -230,6 +238,15 @@ typedef struct PaJackStream
     int                     bytesPerFrame;
     int                     samplesPerFrame;
 
+    /* Posted by the process thread when it has carried out a queue request or a start/stop, after it has set
+     * stateRequestDone to the id of that request */
+    sem_t                   stateSemaphore;
+    int                     stateRequestId;     /* Id of the latest request, main thread only */
+    volatile sig_atomic_t   stateRequestDone;
+    int                     queueRequest;
+    int                     queueRequestId;
+    struct PaJackStream     *nextQueueRequest;
+
     struct PaJackStream *next;
 }
 PaJackStream;
@@ -241,11 +258,25 @@ PaJackStream;
 #define TRUE 1
 #define FALSE 0
 
+/* Values of PaJackStream::queueRequest */
+#define QUEUE_ADD 1
+#define QUEUE_REMOVE 2
+
+/* Stored in PaJackHostApiRepresentation::queueRequests once the JACK server has shut down, so that no more requests
+ * can be pushed */
+static PaJackStream queueClosed_;
+#define QUEUE_CLOSED (&queueClosed_)
+
+/* Longest that the main thread waits for the process thread to act on a request */
+#define STATE_TIMEOUT_SECONDS (10 * 60)
+
 /*
  * Functions specific to this API
  */
 
 static int JackCallback( jack_nframes_t frames, void *userData );
+static int JackStreamCallback( jack_nframes_t frames, void *userData );
+static void JackThreadInit( void *userData );
 
 
 /*
@@ -718,19 +749,30 @@ static void JackOnShutdown( void *arg )
 {
     PaJackHostApiRepresentation *jackApi = (PaJackHostApiRepresentation *)arg;
     PaJackStream *stream = jackApi->processQueue;
+    PaJackStream *requests;
 
     PA_DEBUG(( "%s: JACK server is shutting down\n", __FUNCTION__ ));
+    jackApi->jackIsDown = 1;
+    PaUtil_FullMemoryBarrier();
+
+    /* Make sure that the main thread doesn't get stuck waiting on a stream, whether it is being processed or
+     * is still waiting to be queued */
     for( ; stream; stream = stream->next )
     {
         stream->is_active = 0;
+        sem_post( &stream->stateSemaphore );
+    }
+    /* Close the stack of queue requests while taking it, so that the main thread can't push a stream that nobody
+     * would ever wake, and the process thread can't take the requests while they are being walked */
+    do
+    {
+        requests = jackApi->queueRequests;
+    }
+    while( !PaUtil_AtomicCompareAndSwapPointer( &jackApi->queueRequests, requests, QUEUE_CLOSED ) );
+    for( stream = requests; stream && stream != QUEUE_CLOSED; stream = stream->nextQueueRequest )
+    {
+        sem_post( &stream->stateSemaphore );
     }
-
-    /* Make sure that the main thread doesn't get stuck waiting on the condition */
-    ASSERT_CALL( pthread_mutex_lock( &jackApi->mtx ), 0 );
-    jackApi->jackIsDown = 1;
-    ASSERT_CALL( pthread_cond_signal( &jackApi->cond ), 0 );
-    ASSERT_CALL( pthread_mutex_unlock( &jackApi->mtx ), 0 );
-
 }
 
 static int JackSrCb( jack_nframes_t nframes, void *arg )
@@ -761,6 +803,36 @@ static int JackXRunCb(void *arg) {
     return 0;
 }
 
+/* Callbacks of the JACK client of a stream opened with PaJackStreamInfo::ownClient */
+
+static void JackStreamOnShutdown( void *arg )
+{
+    PaJackStream *stream = (PaJackStream *)arg;
+
+    PA_DEBUG(( "%s: JACK server is shutting down\n", __FUNCTION__ ));
+    stream->ownClientIsDown = 1;
+    PaUtil_FullMemoryBarrier();
+
+    stream->is_active = 0;
+    sem_post( &stream->stateSemaphore );
+}
+
+static int JackStreamSrCb( jack_nframes_t nframes, void *arg )
+{
+    PaJackStream *stream = (PaJackStream *)arg;
+
+    if( stream->streamRepresentation.streamInfo.sampleRate != (double)nframes )
+        UpdateSampleRate( stream, (double)nframes );
+    return 0;
+}
+
+static int JackStreamXRunCb( void *arg )
+{
+    PaJackStream *stream = (PaJackStream *)arg;
+    stream->xrun = TRUE;
+    return 0;
+}
+
 PaError PaJack_Initialize( PaUtilHostApiRepresentation **hostApi,
                            PaHostApiIndex hostApiIndex )
 {
@@ -769,18 +841,12 @@ PaError PaJack_Initialize( PaUtilHostApiRepresentation **hostApi,
     int activated = 0;
     jack_status_t jackStatus = 0;
     *hostApi = NULL;    /* Initialize to NULL */
-    pthread_condattr_t cattr;
 
     UNLESS( jackHostApi = (PaJackHostApiRepresentation*)
         PaUtil_AllocateZeroInitializedMemory( sizeof(PaJackHostApiRepresentation) ), paInsufficientMemory );
     UNLESS( jackHostApi->deviceInfoMemory = PaUtil_CreateAllocationGroup(), paInsufficientMemory );
 
     mainThread_ = pthread_self();
-    ASSERT_CALL( pthread_mutex_init( &jackHostApi->mtx, NULL ), 0 );
-
-    ASSERT_CALL( pthread_condattr_init( &cattr ), 0 );
-    jackHostApi->condClockId = PaPthreadUtil_NegotiateCondAttrClock( &cattr );
-    ASSERT_CALL( pthread_cond_init( &jackHostApi->cond, &cattr), 0 );
 
     /* Try to become a client of the JACK server.  If we cannot do
      * this, then this API cannot be used.
@@ -833,8 +899,9 @@ PaError PaJack_Initialize( PaUtilHostApiRepresentation **hostApi,
 
     jackHostApi->inputBase = jackHostApi->outputBase = 0;
     jackHostApi->xrun = 0;
-    jackHostApi->toAdd = jackHostApi->toRemove = NULL;
+    jackHostApi->queueRequests = NULL;
     jackHostApi->processQueue = NULL;
+    jackHostApi->queuedStreams = 0;
     jackHostApi->jackIsDown = 0;
 
     jack_on_shutdown( jackHostApi->jack_client, JackOnShutdown, jackHostApi );
@@ -844,6 +911,7 @@ PaError PaJack_Initialize( PaUtilHostApiRepresentation **hostApi,
     jack_set_sample_rate_callback( jackHostApi->jack_client, JackSrCb, jackHostApi );
     UNLESS( !jack_set_xrun_callback( jackHostApi->jack_client, JackXRunCb, jackHostApi ), paUnanticipatedHostError );
     UNLESS( !jack_set_process_callback( jackHostApi->jack_client, JackCallback, jackHostApi ), paUnanticipatedHostError );
+    jack_set_thread_init_callback( jackHostApi->jack_client, JackThreadInit, NULL );
     UNLESS( !jack_activate( jackHostApi->jack_client ), paUnanticipatedHostError );
     activated = 1;
 
@@ -878,9 +946,6 @@ static void Terminate( struct PaUtilHostApiRepresentation *hostApi )
      * client is not allowed to have any ports connected */
     ASSERT_CALL( jack_deactivate( jackHostApi->jack_client ), 0 );
 
-    ASSERT_CALL( pthread_mutex_destroy( &jackHostApi->mtx ), 0 );
-    ASSERT_CALL( pthread_cond_destroy( &jackHostApi->cond ), 0 );
-
     ASSERT_CALL( jack_client_close( jackHostApi->jack_client ), 0 );
 
     if( jackHostApi->deviceInfoMemory )
@@ -895,6 +960,22 @@ static void Terminate( struct PaUtilHostApiRepresentation *hostApi )
     jackErr_ = NULL;
 }
 
+/* Check the PaJackStreamInfo of parameters, if any, and set *ownClient (unless NULL) if it asks for a client of the
+ * stream's own */
+static PaError ValidateStreamInfo( const PaStreamParameters *parameters, int *ownClient )
+{
+    const PaJackStreamInfo *streamInfo = parameters->hostApiSpecificStreamInfo;
+
+    if( !streamInfo )
+        return paNoError;
+    if( streamInfo->size != sizeof (PaJackStreamInfo) || streamInfo->hostApiType != paJACK || streamInfo->version != 1 )
+        return paIncompatibleHostApiSpecificStreamInfo;
+
+    if( streamInfo->ownClient && ownClient )
+        *ownClient = 1;
+    return paNoError;
+}
+
 static PaError IsFormatSupported( struct PaUtilHostApiRepresentation *hostApi,
                                   const PaStreamParameters *inputParameters,
                                   const PaStreamParameters *outputParameters,
@@ -919,8 +1000,8 @@ static PaError IsFormatSupported( struct PaUtilHostApiRepresentation *hostApi,
             return paInvalidChannelCount;
 
         /* validate inputStreamInfo */
-        if( inputParameters->hostApiSpecificStreamInfo )
-            return paIncompatibleHostApiSpecificStreamInfo; /* this implementation doesn't use custom stream info */
+        if( ValidateStreamInfo( inputParameters, NULL ) != paNoError )
+            return paIncompatibleHostApiSpecificStreamInfo;
     }
     else
     {
@@ -943,8 +1024,8 @@ static PaError IsFormatSupported( struct PaUtilHostApiRepresentation *hostApi,
             return paInvalidChannelCount;
 
         /* validate outputStreamInfo */
-        if( outputParameters->hostApiSpecificStreamInfo )
-            return paIncompatibleHostApiSpecificStreamInfo; /* this implementation doesn't use custom stream info */
+        if( ValidateStreamInfo( outputParameters, NULL ) != paNoError )
+            return paIncompatibleHostApiSpecificStreamInfo;
     }
     else
     {
@@ -989,6 +1070,7 @@ static PaError InitializeStream( PaJackStream *stream, PaJackHostApiRepresentati
     assert( stream );
 
     memset( stream, 0, sizeof (PaJackStream) );
+    sem_init( &stream->stateSemaphore, 0, 0 );
     UNLESS( stream->stream_memory = PaUtil_CreateAllocationGroup(), paInsufficientMemory );
     stream->jack_client = hostApi->jack_client;
     stream->hostApi = hostApi;
@@ -1033,6 +1115,10 @@ static void CleanUpStream( PaJackStream *stream, int terminateStreamRepresentati
     int i;
     assert( stream );
 
+    /* Stop the process callback of the stream's own client before taking the stream apart */
+    if( stream->ownClientActive && !stream->ownClientIsDown )
+        ASSERT_CALL( jack_deactivate( stream->jack_client ), 0 );
+
     if( stream->isBlockingStream )
         BlockingEnd( stream );
 
@@ -1046,6 +1132,8 @@ static void CleanUpStream( PaJackStream *stream, int terminateStreamRepresentati
         if( stream->local_output_ports[i] )
             ASSERT_CALL( jack_port_unregister( stream->jack_client, stream->local_output_ports[i] ), 0 );
     }
+    if( stream->ownClient )
+        ASSERT_CALL( jack_client_close( stream->jack_client ), 0 );
 
     if( terminateStreamRepresentation )
         PaUtil_TerminateStreamRepresentation( &stream->streamRepresentation );
@@ -1057,26 +1145,73 @@ static void CleanUpStream( PaJackStream *stream, int terminateStreamRepresentati
         PaUtil_FreeAllAllocations( stream->stream_memory );
         PaUtil_DestroyAllocationGroup( stream->stream_memory );
     }
+    sem_destroy( &stream->stateSemaphore );
     PaUtil_FreeMemory( stream );
 }
 
-static PaError WaitCondition( PaJackHostApiRepresentation *hostApi )
+/* Wait for sem until deadline, which is on CLOCK_MONOTONIC. sem_timedwait() only takes CLOCK_REALTIME, which may
+ * be stepped while we wait, so wait in slices of at most a second and check the deadline between them.
+ * @return 0 once sem was taken, else ETIMEDOUT or another errno value.
+ */
+static int WaitSemaphoreUntil( sem_t *sem, const struct timespec *deadline )
 {
-    PaError result = paNoError;
-    int err = 0;
-    struct timespec ts;
+    struct timespec now, slice;
 
-    if( PaPthreadUtil_GetTime( hostApi->condClockId, &ts ) == 0 )
+    for( ;; )
     {
-        ts.tv_sec += 10 * 60; /* 10 minutes */
+        if( clock_gettime( CLOCK_MONOTONIC, &now ) )
+            return errno;
+        if( now.tv_sec > deadline->tv_sec ||
+                ( now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec ) )
+            return ETIMEDOUT;
+
+        if( clock_gettime( CLOCK_REALTIME, &slice ) )
+            return errno;
+        if( deadline->tv_sec - now.tv_sec > 1 )
+            slice.tv_sec += 1;
+        else
+        {
+            slice.tv_sec += deadline->tv_sec - now.tv_sec;
+            slice.tv_nsec += deadline->tv_nsec - now.tv_nsec;
+            if( slice.tv_nsec < 0 )
+            {
+                slice.tv_nsec += 1000000000;
+                --slice.tv_sec;
+            }
+            else if( slice.tv_nsec >= 1000000000 )
+            {
+                slice.tv_nsec -= 1000000000;
+                ++slice.tv_sec;
+            }
+        }
 
-        /* XXX: Best enclose in loop, in case of spurious wakeups? */
-        err = pthread_cond_timedwait( &hostApi->cond, &hostApi->mtx, &ts );
+        if( !sem_timedwait( sem, &slice ) )
+            return 0;
+        if( errno != EINTR && errno != ETIMEDOUT )
+            return errno;
     }
-    else
+}
+
+/* Wait for the process thread to carry out the request with id requestId, or for the JACK server to shut down.
+ *
+ * A request that timed out may still be acknowledged later on, such posts of stateSemaphore are told apart by
+ * stateRequestDone and skipped.
+ */
+static PaError WaitStreamState( PaJackStream *stream, int requestId )
+{
+    PaError result = paNoError;
+    int err = 0;
+    struct timespec deadline;
+
+    ASSERT_CALL( clock_gettime( CLOCK_MONOTONIC, &deadline ), 0 );
+    deadline.tv_sec += STATE_TIMEOUT_SECONDS;
+
+    while( !(err = WaitSemaphoreUntil( &stream->stateSemaphore, &deadline )) )
     {
-        /* XXX: Best enclose in loop, in case of spurious wakeups? */
-        err = pthread_cond_wait( &hostApi->cond, &hostApi->mtx );
+        if( stream->stateRequestDone == requestId ||
+                ( stream->ownClient ? stream->ownClientIsDown : stream->hostApi->jackIsDown ) )
+            break;
+        PA_DEBUG(( "%s: Skipping the acknowledgement of an earlier request\n", __FUNCTION__ ));
     }
 
     /* Make sure we didn't time out */
@@ -1087,22 +1222,61 @@ error:
     return result;
 }
 
-static PaError AddStream( PaJackStream *stream )
+/* Get the id of a new request to the process thread for stream, never 0 */
+static int NextStateRequestId( PaJackStream *stream )
+{
+    if( ++stream->stateRequestId <= 0 )
+        stream->stateRequestId = 1;
+    return stream->stateRequestId;
+}
+
+/* Hand stream over to the process thread to be added to or removed from the processing queue, and wait until it
+ * has done so. Requests are pushed onto a lock-free stack so that any number of them can be pending, and the
+ * process thread takes them without ever touching a mutex.
+ */
+static PaError PostQueueRequest( PaJackStream *stream, int request )
 {
     PaError result = paNoError;
     PaJackHostApiRepresentation *hostApi = stream->hostApi;
-    /* Add to queue of streams that should be processed */
-    ASSERT_CALL( pthread_mutex_lock( &hostApi->mtx ), 0 );
-    if( !hostApi->jackIsDown )
+    PaJackStream *head;
+
+    UNLESS( !hostApi->jackIsDown, paDeviceUnavailable );
+
+    stream->queueRequest = request;
+    stream->queueRequestId = NextStateRequestId( stream );
+    do
     {
-        hostApi->toAdd = stream;
-        /* Unlock mutex and await signal from processing thread */
-        result = WaitCondition( stream->hostApi );
+        head = hostApi->queueRequests;
+        /* JackOnShutdown() closed the stack */
+        UNLESS( head != QUEUE_CLOSED, paDeviceUnavailable );
+        stream->nextQueueRequest = head;
     }
-    ASSERT_CALL( pthread_mutex_unlock( &hostApi->mtx ), 0 );
-    ENSURE_PA( result );
+    while( !PaUtil_AtomicCompareAndSwapPointer( &hostApi->queueRequests, head, stream ) );
 
-    UNLESS( !hostApi->jackIsDown, paDeviceUnavailable );
+    ENSURE_PA( WaitStreamState( stream, stream->queueRequestId ) );
+
+error:
+    return result;
+}
+
+static PaError AddStream( PaJackStream *stream )
+{
+    PaError result = paNoError;
+    PaJackHostApiRepresentation *hostApi = stream->hostApi;
+
+    if( stream->ownClient )
+    {
+        /* A client of the stream's own processes nothing but the stream */
+        UNLESS( !jack_activate( stream->jack_client ), paUnanticipatedHostError );
+        stream->ownClientActive = 1;
+    }
+    else
+    {
+        /* Add to queue of streams that should be processed */
+        ENSURE_PA( PostQueueRequest( stream, QUEUE_ADD ) );
+        UNLESS( !hostApi->jackIsDown, paDeviceUnavailable );
+        ++hostApi->queuedStreams;
+    }
 
 error:
     return result;
@@ -1114,16 +1288,12 @@ static PaError RemoveStream( PaJackStream *stream )
     PaError result = paNoError;
     PaJackHostApiRepresentation *hostApi = stream->hostApi;
 
-    /* Add to queue over streams that should be processed */
-    ASSERT_CALL( pthread_mutex_lock( &hostApi->mtx ), 0 );
+    if( stream->ownClient )
+        return paNoError;   /* Deactivated by CleanUpStream() */
+
     if( !hostApi->jackIsDown )
-    {
-        hostApi->toRemove = stream;
-        /* Unlock mutex and await signal from processing thread */
-        result = WaitCondition( stream->hostApi );
-    }
-    ASSERT_CALL( pthread_mutex_unlock( &hostApi->mtx ), 0 );
-    ENSURE_PA( result );
+        ENSURE_PA( PostQueueRequest( stream, QUEUE_REMOVE ) );
+    --hostApi->queuedStreams;
 
 error:
     return result;
@@ -1156,6 +1326,9 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     const double jackSr = jack_get_sample_rate( jackHostApi->jack_client );
     PaSampleFormat inputSampleFormat = 0, outputSampleFormat = 0;
     int bpInitialized = 0, srInitialized = 0;   /* Initialized buffer processor and stream representation? */
+    jack_nframes_t jackBufferSize;
+    PaUtilHostBufferSizeMode hostBufferSizeMode = paUtilUnknownHostBufferSize;
+    int ownClient = 0;
     unsigned long ofs;
 
     /* validate platform specific flags */
@@ -1191,8 +1364,8 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
             return paInvalidChannelCount;
 
         /* validate inputStreamInfo */
-        if( inputParameters->hostApiSpecificStreamInfo )
-            return paIncompatibleHostApiSpecificStreamInfo; /* this implementation doesn't use custom stream info */
+        if( ValidateStreamInfo( inputParameters, &ownClient ) != paNoError )
+            return paIncompatibleHostApiSpecificStreamInfo;
     }
     else
     {
@@ -1215,8 +1388,8 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
             return paInvalidChannelCount;
 
         /* validate outputStreamInfo */
-        if( outputParameters->hostApiSpecificStreamInfo )
-            return paIncompatibleHostApiSpecificStreamInfo; /* this implementation doesn't use custom stream info */
+        if( ValidateStreamInfo( outputParameters, &ownClient ) != paNoError )
+            return paIncompatibleHostApiSpecificStreamInfo;
     }
     else
     {
@@ -1234,6 +1407,21 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     UNLESS( stream = (PaJackStream*)PaUtil_AllocateZeroInitializedMemory( sizeof(PaJackStream) ), paInsufficientMemory );
     ENSURE_PA( InitializeStream( stream, jackHostApi, inputChannelCount, outputChannelCount ) );
 
+    if( ownClient )
+    {
+        jack_status_t jackStatus = 0;
+
+        UNLESS( stream->jack_client = jack_client_open( clientName_, JackNoStartServer, &jackStatus ),
+                paUnanticipatedHostError );
+        stream->ownClient = 1;
+        jack_on_shutdown( stream->jack_client, JackStreamOnShutdown, stream );
+        /* Don't check for error, may not be supported (deprecated in at least jackdmp) */
+        jack_set_sample_rate_callback( stream->jack_client, JackStreamSrCb, stream );
+        UNLESS( !jack_set_xrun_callback( stream->jack_client, JackStreamXRunCb, stream ), paUnanticipatedHostError );
+        UNLESS( !jack_set_process_callback( stream->jack_client, JackStreamCallback, stream ), paUnanticipatedHostError );
+        jack_set_thread_init_callback( stream->jack_client, JackThreadInit, NULL );
+    }
+
     /* the blocking emulation, if necessary */
     stream->isBlockingStream = !streamCallback;
     if( stream->isBlockingStream )
@@ -1270,6 +1458,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     }
     srInitialized = 1;
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, jackSr );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
     /* create the JACK ports.  We cannot connect them until audio
      * processing begins */
@@ -1277,25 +1466,28 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     /* Register a unique set of ports for this stream
      * TODO: Robust allocation of new port names */
 
-    ofs = jackHostApi->inputBase;
+    /* A client of the stream's own numbers its ports from 0 */
+    ofs = stream->ownClient ? 0 : jackHostApi->inputBase;
     for( i = 0; i < inputChannelCount; i++ )
     {
         snprintf( port_string, jack_port_name_size(), "in_%lu", ofs + i );
         UNLESS( stream->local_input_ports[i] = jack_port_register(
-              jackHostApi->jack_client, port_string,
+              stream->jack_client, port_string,
               JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0 ), paInsufficientMemory );
     }
-    jackHostApi->inputBase += inputChannelCount;
+    if( !stream->ownClient )
+        jackHostApi->inputBase += inputChannelCount;
 
-    ofs = jackHostApi->outputBase;
+    ofs = stream->ownClient ? 0 : jackHostApi->outputBase;
     for( i = 0; i < outputChannelCount; i++ )
     {
         snprintf( port_string, jack_port_name_size(), "out_%lu", ofs + i );
         UNLESS( stream->local_output_ports[i] = jack_port_register(
-             jackHostApi->jack_client, port_string,
+             stream->jack_client, port_string,
              JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0 ), paInsufficientMemory );
     }
-    jackHostApi->outputBase += outputChannelCount;
+    if( !stream->ownClient )
+        jackHostApi->outputBase += outputChannelCount;
 
     /* look up the jack_port_t's for the remote ports.  We could do
      * this at stream start time, but doing it here ensures the
@@ -1355,6 +1547,14 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
         UNLESS( i == outputChannelCount, paInternalError );
     }
 
+    /* Buffer size may vary on JACK's discretion, but when the user buffer is exactly one JACK period we tell the
+     * buffer processor it is fixed. It then calls the callback straight from the JACK port buffers, without
+     * copying them at all if the user format is paFloat32 | paNonInterleaved. Should the period change later on,
+     * the process callback switches the buffer processor over to adapting, see RealProcess. */
+    jackBufferSize = jack_get_buffer_size( jackHostApi->jack_client );
+    if( framesPerBuffer == jackBufferSize )
+        hostBufferSizeMode = paUtilFixedHostBufferSize;
+
     ENSURE_PA( PaUtil_InitializeBufferProcessor(
                   &stream->bufferProcessor,
                   inputChannelCount,
@@ -1366,8 +1566,8 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
                   jackSr,
                   streamFlags,
                   framesPerBuffer,
-                  0,                            /* Ignored */
-                  paUtilUnknownHostBufferSize,  /* Buffer size may vary on JACK's discretion */
+                  jackBufferSize,
+                  hostBufferSizeMode,
                   streamCallback,
                   userData ) );
     bpInitialized = 1;
@@ -1406,13 +1606,7 @@ error:
  */
 static void CheckAndResetPortBase( PaJackHostApiRepresentation *jackApi )
 {
-    int noStreams;
-
-    ASSERT_CALL( pthread_mutex_lock( &jackApi->mtx ), 0 );
-    noStreams = jackApi->jackIsDown || jackApi->processQueue == NULL;
-    ASSERT_CALL( pthread_mutex_unlock( &jackApi->mtx ), 0 );
-
-    if ( noStreams ) {
+    if ( jackApi->jackIsDown || jackApi->queuedStreams == 0 ) {
         jackApi->inputBase = 0;
         jackApi->outputBase = 0;
     }
@@ -1475,6 +1669,13 @@ static PaError RealProcess( PaJackStream *stream, jack_nframes_t frames )
         cbFlags = paOutputUnderflow | paInputOverflow;
         stream->xrun = FALSE;
     }
+    if( paUtilFixedHostBufferSize == stream->bufferProcessor.hostBufferSizeMode &&
+            frames != stream->bufferProcessor.framesPerHostBuffer )
+    {
+        /* The JACK period has changed since the stream was opened, the callback must still get framesPerBuffer
+         * frames at a time. Doesn't allocate */
+        PaUtil_SetBufferProcessorHostBufferSizeUnknown( &stream->bufferProcessor );
+    }
     PaUtil_BeginBufferProcessing( &stream->bufferProcessor, &timeInfo,
             cbFlags );
 
@@ -1516,84 +1717,147 @@ end:
     return result;
 }
 
-/* Update the JACK callback's stream processing queue. */
+/* Update the JACK callback's stream processing queue. Runs in the process thread. */
 static PaError UpdateQueue( PaJackHostApiRepresentation *hostApi )
 {
     PaError result = paNoError;
-    int queueModified = 0;
     const double jackSr = jack_get_sample_rate( hostApi->jack_client );
-    int err;
+    PaJackStream *requests, *request, *reversed = NULL, *node, *prev;
 
-    if( (err = pthread_mutex_trylock( &hostApi->mtx )) != 0 )
-    {
-        assert( err == EBUSY );
+    if( !hostApi->queueRequests || hostApi->queueRequests == QUEUE_CLOSED )
         return paNoError;
+
+    /* Take all pending requests at once, the main thread only ever pushes onto the stack so this can't fail
+     * for other reasons than a concurrent push, or JackOnShutdown() closing it */
+    do
+    {
+        requests = hostApi->queueRequests;
+        if( requests == QUEUE_CLOSED )
+            return paNoError;
     }
+    while( !PaUtil_AtomicCompareAndSwapPointer( &hostApi->queueRequests, requests, NULL ) );
 
-    if( hostApi->toAdd )
+    /* Stack is last in, first out, act on requests in the order they were made */
+    while( requests )
     {
-        if( hostApi->processQueue )
+        request = requests;
+        requests = request->nextQueueRequest;
+        request->nextQueueRequest = reversed;
+        reversed = request;
+    }
+
+    while( reversed )
+    {
+        request = reversed;
+        reversed = request->nextQueueRequest;
+        request->nextQueueRequest = NULL;
+
+        /* Find the end of the queue, or the stream to remove */
+        prev = NULL;
+        for( node = hostApi->processQueue; node && node != request; node = node->next )
+            prev = node;
+
+        if( request->queueRequest == QUEUE_ADD )
         {
-            PaJackStream *node = hostApi->processQueue;
-            /* Advance to end of queue */
-            while( node->next )
-                node = node->next;
+            assert( !node );
+            request->next = NULL;
+            if( prev )
+                prev->next = request;
+            else
+                hostApi->processQueue = request;   /* The only queue entry. */
 
-            node->next = hostApi->toAdd;
+            /* If necessary, update stream state */
+            if( request->streamRepresentation.streamInfo.sampleRate != jackSr )
+                UpdateSampleRate( request, jackSr );
+        }
+        else if( node )
+        {
+            if( prev )
+                prev->next = node->next;
+            else
+                hostApi->processQueue = node->next;
+            PA_DEBUG(( "%s: Removed stream from processing queue\n", __FUNCTION__ ));
         }
         else
         {
-            /* The only queue entry. */
-            hostApi->processQueue = (PaJackStream *)hostApi->toAdd;
+            /* Carry on with the rest of the requests, their streams are waiting too */
+            result = paInternalError;
         }
 
-        /* If necessary, update stream state */
-        if( hostApi->toAdd->streamRepresentation.streamInfo.sampleRate != jackSr )
-            UpdateSampleRate( hostApi->toAdd, jackSr );
+        /* Signal that we've done what was asked of us */
+        request->stateRequestDone = request->queueRequestId;
+        sem_post( &request->stateSemaphore );
+    }
+
+    return result;
+}
+
+/* Act on start and stop requests of stream and process a cycle of it. Runs in the process thread. */
+static PaError ProcessStream( PaJackStream *stream, jack_nframes_t frames )
+{
+    PaError result = paNoError;
 
-        hostApi->toAdd = NULL;
-        queueModified = 1;
+    /* See if this stream is to be started */
+    if( stream->doStart )
+    {
+        stream->callbackResult = paContinue;
+        stream->isSilenced = 0;
+        stream->is_active = 1;
+        stream->stateRequestDone = stream->doStart;
+        stream->doStart = 0;
+        PA_DEBUG(( "%s: Starting stream\n", __FUNCTION__ ));
+        sem_post( &stream->stateSemaphore );
     }
-    if( hostApi->toRemove )
+    else if( stream->doStop || stream->doAbort )    /* Should we stop/abort stream? */
     {
-        int removed = 0;
-        PaJackStream *node = hostApi->processQueue, *prev = NULL;
-        assert( hostApi->processQueue );
-
-        while( node )
+        if( stream->callbackResult == paContinue )     /* Ok, make it stop */
         {
-            if( node == hostApi->toRemove )
-            {
-                if( prev )
-                    prev->next = node->next;
-                else
-                    hostApi->processQueue = (PaJackStream *)node->next;
+            PA_DEBUG(( "%s: Stopping stream\n", __FUNCTION__ ));
+            stream->callbackResult = stream->doStop ? paComplete : paAbort;
+        }
+    }
 
-                removed = 1;
-                break;
-            }
+    if( stream->is_active )
+        ENSURE_PA( RealProcess( stream, frames ) );
+    /* If we have just entered inactive state, silence output */
+    if( !stream->is_active && !stream->isSilenced )
+    {
+        int i;
 
-            prev = node;
-            node = node->next;
+        /* Silence buffer after entering inactive state */
+        PA_DEBUG(( "Silencing the output\n" ));
+        for( i = 0; i < stream->num_outgoing_connections; ++i )
+        {
+            jack_default_audio_sample_t *buffer = jack_port_get_buffer( stream->local_output_ports[i], frames );
+            memset( buffer, 0, sizeof (jack_default_audio_sample_t) * frames );
         }
-        UNLESS( removed, paInternalError );
-        hostApi->toRemove = NULL;
-        PA_DEBUG(( "%s: Removed stream from processing queue\n", __FUNCTION__ ));
-        queueModified = 1;
+
+        stream->isSilenced = 1;
     }
 
-    if( queueModified )
+    if( stream->doStop || stream->doAbort )
     {
-        /* Signal that we've done what was asked of us */
-        ASSERT_CALL( pthread_cond_signal( &hostApi->cond ), 0 );
+        /* See if RealProcess has acted on the request */
+        if( !stream->is_active )   /* Ok, signal to the main thread that we've carried out the operation */
+        {
+            stream->stateRequestDone = stream->doStop ? stream->doStop : stream->doAbort;
+            stream->doStop = stream->doAbort = 0;
+            sem_post( &stream->stateSemaphore );
+        }
     }
 
 error:
-    ASSERT_CALL( pthread_mutex_unlock( &hostApi->mtx ), 0 );
-
     return result;
 }
 
+/* Invoked by JACK in its process thread before the first process callback, where the trace ring can be
+ * allocated. The thread exits along with the client, the ring is freed with the other ones */
+static void JackThreadInit( void *userData )
+{
+    (void) userData;
+    PA_TRACE_REGISTER_NAMED_THREAD( "JACK process" );
+}
+
 /* Audio processing callback invoked periodically from JACK. */
 static int JackCallback( jack_nframes_t frames, void *userData )
 {
@@ -1614,72 +1878,7 @@ static int JackCallback( jack_nframes_t frames, void *userData )
         if( xrun )  /* Don't override if already set */
             stream->xrun = 1;
 
-        /* See if this stream is to be started */
-        if( stream->doStart )
-        {
-            /* If we can't obtain a lock, we'll try next time */
-            int err = pthread_mutex_trylock( &stream->hostApi->mtx );
-            if( !err )
-            {
-                if( stream->doStart )   /* Could potentially change before obtaining the lock */
-                {
-                    stream->is_active = 1;
-                    stream->doStart = 0;
-                    PA_DEBUG(( "%s: Starting stream\n", __FUNCTION__ ));
-                    ASSERT_CALL( pthread_cond_signal( &stream->hostApi->cond ), 0 );
-                    stream->callbackResult = paContinue;
-                    stream->isSilenced = 0;
-                }
-
-                ASSERT_CALL( pthread_mutex_unlock( &stream->hostApi->mtx ), 0 );
-            }
-            else
-                assert( err == EBUSY );
-        }
-        else if( stream->doStop || stream->doAbort )    /* Should we stop/abort stream? */
-        {
-            if( stream->callbackResult == paContinue )     /* Ok, make it stop */
-            {
-                PA_DEBUG(( "%s: Stopping stream\n", __FUNCTION__ ));
-                stream->callbackResult = stream->doStop ? paComplete : paAbort;
-            }
-        }
-
-        if( stream->is_active )
-            ENSURE_PA( RealProcess( stream, frames ) );
-        /* If we have just entered inactive state, silence output */
-        if( !stream->is_active && !stream->isSilenced )
-        {
-            int i;
-
-            /* Silence buffer after entering inactive state */
-            PA_DEBUG(( "Silencing the output\n" ));
-            for( i = 0; i < stream->num_outgoing_connections; ++i )
-            {
-                jack_default_audio_sample_t *buffer = jack_port_get_buffer( stream->local_output_ports[i], frames );
-                memset( buffer, 0, sizeof (jack_default_audio_sample_t) * frames );
-            }
-
-            stream->isSilenced = 1;
-        }
-
-        if( stream->doStop || stream->doAbort )
-        {
-            /* See if RealProcess has acted on the request */
-            if( !stream->is_active )   /* Ok, signal to the main thread that we've carried out the operation */
-            {
-                /* If we can't obtain a lock, we'll try next time */
-                int err = pthread_mutex_trylock( &stream->hostApi->mtx );
-                if( !err )
-                {
-                    stream->doStop = stream->doAbort = 0;
-                    ASSERT_CALL( pthread_cond_signal( &stream->hostApi->cond ), 0 );
-                    ASSERT_CALL( pthread_mutex_unlock( &stream->hostApi->mtx ), 0 );
-                }
-                else
-                    assert( err == EBUSY );
-            }
-        }
+        ENSURE_PA( ProcessStream( stream, frames ) );
     }
 
     return 0;
@@ -1687,11 +1886,20 @@ error:
     return -1;
 }
 
+/* Process callback of a stream opened with PaJackStreamInfo::ownClient */
+static int JackStreamCallback( jack_nframes_t frames, void *userData )
+{
+    PaJackStream *stream = (PaJackStream *)userData;
+    assert( stream );
+
+    return ProcessStream( stream, frames ) == paNoError ? 0 : -1;
+}
+
 static PaError StartStream( PaStream *s )
 {
     PaError result = paNoError;
     PaJackStream *stream = (PaJackStream*)s;
-    int i;
+    int i, requestId;
 
     /* Ready the processor */
     PaUtil_ResetBufferProcessor( &stream->bufferProcessor );
@@ -1723,23 +1931,17 @@ static PaError StartStream( PaStream *s )
 
     /* Enable processing */
 
-    ASSERT_CALL( pthread_mutex_lock( &stream->hostApi->mtx ), 0 );
-    stream->doStart = 1;
+    requestId = NextStateRequestId( stream );
+    PaUtil_WriteMemoryBarrier();
+    stream->doStart = requestId;
 
     /* Wait for stream to be started */
-    result = WaitCondition( stream->hostApi );
-    /*
-    do
-    {
-        err = pthread_cond_timedwait( &stream->hostApi->cond, &stream->hostApi->mtx, &ts );
-    } while( !stream->is_active && !err );
-    */
+    result = WaitStreamState( stream, requestId );
     if( result != paNoError )   /* Something went wrong, call off the stream start */
     {
         stream->doStart = 0;
         stream->is_active = 0;  /* Cancel any processing */
     }
-    ASSERT_CALL( pthread_mutex_unlock( &stream->hostApi->mtx ), 0 );
 
     ENSURE_PA( result );
 
@@ -1753,21 +1955,20 @@ error:
 static PaError RealStop( PaJackStream *stream, int abort )
 {
     PaError result = paNoError;
-    int i;
+    int i, requestId;
 
     if( stream->isBlockingStream )
         BlockingWaitEmpty ( stream );
 
-    ASSERT_CALL( pthread_mutex_lock( &stream->hostApi->mtx ), 0 );
+    requestId = NextStateRequestId( stream );
     if( abort )
-        stream->doAbort = 1;
+        stream->doAbort = requestId;
     else
-        stream->doStop = 1;
+        stream->doStop = requestId;
 
-    /* Wait for stream to be stopped */
-    result = WaitCondition( stream->hostApi );
-    ASSERT_CALL( pthread_mutex_unlock( &stream->hostApi->mtx ), 0 );
-    ENSURE_PA( result );
+    /* Wait for stream to be stopped, nobody will tell us if JACK has gone away */
+    if( !stream->hostApi->jackIsDown && !stream->ownClientIsDown )
+        ENSURE_PA( WaitStreamState( stream, requestId ) );
 
     UNLESS( !stream->is_active, paInternalError );
 
@@ -1778,7 +1979,7 @@ error:
 
     /* Disconnect ports belonging to this stream */
 
-    if( !stream->hostApi->jackIsDown )  /* XXX: Well? */
+    if( !stream->hostApi->jackIsDown && !stream->ownClientIsDown )  /* XXX: Well? */
     {
         for( i = 0; i < stream->num_incoming_connections; i++ )
         {
@@ -1864,3 +2065,11 @@ PaError PaJack_GetClientName(const char** clientName)
 error:
     return result;
 }
+
+void PaJack_InitializeStreamInfo( PaJackStreamInfo *info )
+{
+    info->size = sizeof (PaJackStreamInfo);
+    info->hostApiType = paJACK;
+    info->version = 1;
+    info->ownClient = 0;
+}
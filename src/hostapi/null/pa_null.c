@@ -0,0 +1,1195 @@
+/*
+ * $Id$
+ * Portable Audio I/O Library null host API implementation
+ * virtual loopback devices driven by a simulated clock
+ *
+ * Based on the Open Source API proposed by Ross Bencina
+ * Copyright (c) 1999-2002 Ross Bencina, Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+/** @file
+ @ingroup hostapi_src
+
+ @brief Null host API, virtual devices that need no sound hardware.
+
+ Every stream runs a clock thread that wakes once per device period and moves
+ a period of audio through the buffer processor, so the whole stack can be
+ exercised, timed and benchmarked on headless build machines. The devices are
+ loopback cables: a full-duplex stream records its own output, which arrives
+ with inputBufferAdcTime equal to the outputBufferDacTime it was played at,
+ while an input-only stream records silence.
+
+ The devices and the clock are configured through environment variables read
+ by Pa_Initialize():
+
+ - PA_NULL_DEVICES: a ';' separated list of devices, each given as
+   "inputChannels,outputChannels,sampleRate,framesPerPeriod[,formats]" where
+   formats is a '+' separated list of float32, int32, int24, int16, int8 and
+   uint8, float32 if left out. For example
+   "2,2,48000,256,float32+int16;1,8,44100,64,int24". The default is a single
+   stereo float32 device with 256 frame periods at 48000 Hz. Streams may open
+   a device at any sample rate, the device's is only a default.
+ - PA_NULL_SPEED: how fast the simulated clock runs relative to real time,
+   1 by default. 0 runs the clock as fast as the CPU allows.
+ - PA_NULL_JITTER: the largest random delay, in microseconds, added to each
+   wake-up of a real-time clock. A wake-up late by a whole buffer is an xrun.
+ - PA_NULL_XRUN: drop every Nth period, which the stream sees as an output
+   underflow and input overflow. 0, the default, never drops.
+
+ The host API registers after all others, so it only becomes the default when
+ no real audio system has devices.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "pa_util.h"
+#include "pa_types.h"
+#include "pa_allocation.h"
+#include "pa_hostapi.h"
+#include "pa_stream.h"
+#include "pa_cpuload.h"
+#include "pa_process.h"
+#include "pa_converters.h"
+#include "pa_ringbuffer.h"
+#include "pa_trace.h"
+#include "pa_debugprint.h"
+
+#include "pa_unix_util.h"
+
+
+/* prototypes for functions declared in this file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+PaError PaNull_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex index );
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+static void Terminate( struct PaUtilHostApiRepresentation *hostApi );
+static PaError IsFormatSupported( struct PaUtilHostApiRepresentation *hostApi,
+                                  const PaStreamParameters *inputParameters,
+                                  const PaStreamParameters *outputParameters,
+                                  double sampleRate );
+static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
+                           PaStream** s,
+                           const PaStreamParameters *inputParameters,
+                           const PaStreamParameters *outputParameters,
+                           double sampleRate,
+                           unsigned long framesPerBuffer,
+                           PaStreamFlags streamFlags,
+                           PaStreamCallback *streamCallback,
+                           void *userData );
+static PaError CloseStream( PaStream* stream );
+static PaError StartStream( PaStream *stream );
+static PaError StopStream( PaStream *stream );
+static PaError AbortStream( PaStream *stream );
+static PaError IsStreamStopped( PaStream *s );
+static PaError IsStreamActive( PaStream *stream );
+static PaTime GetStreamTime( PaStream *stream );
+static double GetStreamCpuLoad( PaStream* stream );
+static PaError ReadStream( PaStream* stream, void *buffer, unsigned long frames );
+static PaError WriteStream( PaStream* stream, const void *buffer, unsigned long frames );
+static signed long GetStreamReadAvailable( PaStream* stream );
+static signed long GetStreamWriteAvailable( PaStream* stream );
+
+
+#define PA_NULL_SET_LAST_HOST_ERROR( errorCode, errorText ) \
+    PaUtil_SetLastHostErrorInfo( paInDevelopment, errorCode, errorText )
+
+#define PA_NULL_DEFAULT_DEVICES_ "2,2,48000,256,float32"
+#define PA_NULL_MAX_DEVICES_ 64
+#define PA_NULL_MAX_CHANNELS_ 256
+#define PA_NULL_MAX_PERIOD_FRAMES_ 65536
+#define PA_NULL_MIN_PERIODS_ 2
+#define PA_NULL_MAX_PERIODS_ 256
+
+static const struct
+{
+    const char *name;
+    PaSampleFormat format;
+}
+paNullFormatNames_[] =
+{
+    { "float32", paFloat32 },
+    { "int32", paInt32 },
+    { "int24", paInt24 },
+    { "int16", paInt16 },
+    { "int8", paInt8 },
+    { "uint8", paUInt8 }
+};
+
+/* PaNullDeviceInfo - a device as configured through PA_NULL_DEVICES */
+
+typedef struct
+{
+    PaDeviceInfo baseDeviceInfo;
+    unsigned long framesPerPeriod;
+    PaSampleFormat formats;
+}
+PaNullDeviceInfo;
+
+/* PaNullHostApiRepresentation - host api datastructure specific to this implementation */
+
+typedef struct
+{
+    PaUtilHostApiRepresentation inheritedHostApiRep;
+    PaUtilStreamInterface callbackStreamInterface;
+    PaUtilStreamInterface blockingStreamInterface;
+
+    PaUtilAllocationGroup *allocations;
+
+    double speed;
+    PaTime jitter;
+    unsigned long xrunInterval;
+}
+PaNullHostApiRepresentation;
+
+
+/* Parse one PA_NULL_DEVICES entry at *cursor, leaving *cursor past it. Returns 0 if it is malformed. */
+static int ParseDevice( const char **cursor, PaNullDeviceInfo *device )
+{
+    const char *p = *cursor;
+    char *end;
+    long inputChannels, outputChannels, framesPerPeriod;
+    double sampleRate;
+    size_t i, length;
+
+    inputChannels = strtol( p, &end, 10 );
+    if( *end != ',' )
+        return 0;
+    outputChannels = strtol( end + 1, &end, 10 );
+    if( *end != ',' )
+        return 0;
+    sampleRate = strtod( end + 1, &end );
+    if( *end != ',' )
+        return 0;
+    framesPerPeriod = strtol( end + 1, &end, 10 );
+    p = end;
+
+    if( inputChannels < 0 || inputChannels > PA_NULL_MAX_CHANNELS_ ||
+            outputChannels < 0 || outputChannels > PA_NULL_MAX_CHANNELS_ ||
+            inputChannels + outputChannels == 0 || sampleRate <= 0. ||
+            framesPerPeriod <= 0 || framesPerPeriod > PA_NULL_MAX_PERIOD_FRAMES_ )
+        return 0;
+
+    device->baseDeviceInfo.maxInputChannels = (int)inputChannels;
+    device->baseDeviceInfo.maxOutputChannels = (int)outputChannels;
+    device->baseDeviceInfo.defaultSampleRate = sampleRate;
+    device->framesPerPeriod = (unsigned long)framesPerPeriod;
+    device->formats = 0;
+
+    if( *p == ',' )
+    {
+        do
+        {
+            ++p;
+            length = strcspn( p, "+;" );
+            for( i = 0; i < sizeof (paNullFormatNames_) / sizeof (paNullFormatNames_[0]); ++i )
+            {
+                if( strlen( paNullFormatNames_[i].name ) == length &&
+                        !strncmp( p, paNullFormatNames_[i].name, length ) )
+                    break;
+            }
+            if( i == sizeof (paNullFormatNames_) / sizeof (paNullFormatNames_[0]) )
+                return 0;
+            device->formats |= paNullFormatNames_[i].format;
+            p += length;
+        }
+        while( *p == '+' );
+    }
+    else
+        device->formats = paFloat32;
+
+    if( *p == ';' )
+        ++p;
+    else if( *p != '\0' )
+        return 0;
+
+    *cursor = p;
+    return 1;
+}
+
+static PaError BuildDeviceList( PaNullHostApiRepresentation *nullHostApi, PaHostApiIndex hostApiIndex )
+{
+    PaError result = paNoError;
+    PaUtilHostApiRepresentation *commonApi = &nullHostApi->inheritedHostApiRep;
+    const char *spec = getenv( "PA_NULL_DEVICES" );
+    const char *cursor;
+    PaNullDeviceInfo *deviceInfoArray;
+    char *deviceName;
+    int i, deviceCount = 1;
+
+    if( !spec || !*spec )
+        spec = PA_NULL_DEFAULT_DEVICES_;
+    for( cursor = spec; *cursor; ++cursor )
+    {
+        if( *cursor == ';' && cursor[1] )
+            ++deviceCount;
+    }
+    if( deviceCount > PA_NULL_MAX_DEVICES_ )
+    {
+        PA_NULL_SET_LAST_HOST_ERROR( 0, "Too many devices in PA_NULL_DEVICES" );
+        result = paUnanticipatedHostError;
+        goto error;
+    }
+
+    PA_UNLESS( commonApi->deviceInfos = (PaDeviceInfo**)PaUtil_GroupAllocateZeroInitializedMemory(
+            nullHostApi->allocations, sizeof(PaDeviceInfo*) * deviceCount ), paInsufficientMemory );
+    /* allocate all device info structs in a contiguous block */
+    PA_UNLESS( deviceInfoArray = (PaNullDeviceInfo*)PaUtil_GroupAllocateZeroInitializedMemory(
+            nullHostApi->allocations, sizeof(PaNullDeviceInfo) * deviceCount ), paInsufficientMemory );
+
+    cursor = spec;
+    for( i = 0; i < deviceCount; ++i )
+    {
+        PaNullDeviceInfo *device = &deviceInfoArray[i];
+        PaDeviceInfo *baseDeviceInfo = &device->baseDeviceInfo;
+        PaTime periodTime;
+
+        if( !ParseDevice( &cursor, device ) )
+        {
+            PA_DEBUG(( "%s: Malformed PA_NULL_DEVICES entry at '%s'\n", __FUNCTION__, cursor ));
+            PA_NULL_SET_LAST_HOST_ERROR( i, "Malformed PA_NULL_DEVICES entry" );
+            result = paUnanticipatedHostError;
+            goto error;
+        }
+
+        PA_UNLESS( deviceName = (char*)PaUtil_GroupAllocateZeroInitializedMemory( nullHostApi->allocations, 32 ),
+                paInsufficientMemory );
+        snprintf( deviceName, 32, "Null %d", i );
+
+        periodTime = device->framesPerPeriod / baseDeviceInfo->defaultSampleRate;
+        baseDeviceInfo->structVersion = 2;
+        baseDeviceInfo->hostApi = hostApiIndex;
+        baseDeviceInfo->name = deviceName;
+        baseDeviceInfo->defaultLowInputLatency = baseDeviceInfo->maxInputChannels > 0 ? periodTime : 0.;
+        baseDeviceInfo->defaultHighInputLatency = baseDeviceInfo->maxInputChannels > 0 ? periodTime : 0.;
+        baseDeviceInfo->defaultLowOutputLatency = baseDeviceInfo->maxOutputChannels > 0 ?
+            PA_NULL_MIN_PERIODS_ * periodTime : 0.;
+        baseDeviceInfo->defaultHighOutputLatency = baseDeviceInfo->maxOutputChannels > 0 ?
+            4 * PA_NULL_MIN_PERIODS_ * periodTime : 0.;
+
+        if( commonApi->info.defaultInputDevice == paNoDevice && baseDeviceInfo->maxInputChannels > 0 )
+            commonApi->info.defaultInputDevice = i;
+        if( commonApi->info.defaultOutputDevice == paNoDevice && baseDeviceInfo->maxOutputChannels > 0 )
+            commonApi->info.defaultOutputDevice = i;
+
+        commonApi->deviceInfos[i] = baseDeviceInfo;
+        ++commonApi->info.deviceCount;
+    }
+
+error:
+    return result;
+}
+
+PaError PaNull_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex hostApiIndex )
+{
+    PaError result = paNoError;
+    PaNullHostApiRepresentation *nullHostApi;
+
+    PA_UNLESS( nullHostApi = (PaNullHostApiRepresentation*)PaUtil_AllocateZeroInitializedMemory(
+            sizeof(PaNullHostApiRepresentation) ), paInsufficientMemory );
+    PA_UNLESS( nullHostApi->allocations = PaUtil_CreateAllocationGroup(), paInsufficientMemory );
+
+    nullHostApi->speed = getenv( "PA_NULL_SPEED" ) ? atof( getenv( "PA_NULL_SPEED" ) ) : 1.;
+    if( nullHostApi->speed < 0. )
+        nullHostApi->speed = 0.;
+    if( getenv( "PA_NULL_JITTER" ) && atoi( getenv( "PA_NULL_JITTER" ) ) > 0 )
+        nullHostApi->jitter = atoi( getenv( "PA_NULL_JITTER" ) ) * 1e-6;
+    if( getenv( "PA_NULL_XRUN" ) && atoi( getenv( "PA_NULL_XRUN" ) ) > 0 )
+        nullHostApi->xrunInterval = (unsigned long)atoi( getenv( "PA_NULL_XRUN" ) );
+
+    *hostApi = &nullHostApi->inheritedHostApiRep;
+    (*hostApi)->info.structVersion = 1;
+    (*hostApi)->info.type = paInDevelopment;
+    (*hostApi)->info.name = "Null";
+    (*hostApi)->info.defaultInputDevice = paNoDevice;
+    (*hostApi)->info.defaultOutputDevice = paNoDevice;
+    (*hostApi)->info.deviceCount = 0;
+
+    PA_ENSURE( BuildDeviceList( nullHostApi, hostApiIndex ) );
+
+    (*hostApi)->Terminate = Terminate;
+    (*hostApi)->OpenStream = OpenStream;
+    (*hostApi)->IsFormatSupported = IsFormatSupported;
+
+    PaUtil_InitializeStreamInterface( &nullHostApi->callbackStreamInterface, CloseStream, StartStream,
+                                      StopStream, AbortStream, IsStreamStopped, IsStreamActive,
+                                      GetStreamTime, GetStreamCpuLoad,
+                                      PaUtil_DummyRead, PaUtil_DummyWrite,
+                                      PaUtil_DummyGetReadAvailable, PaUtil_DummyGetWriteAvailable );
+
+    PaUtil_InitializeStreamInterface( &nullHostApi->blockingStreamInterface, CloseStream, StartStream,
+                                      StopStream, AbortStream, IsStreamStopped, IsStreamActive,
+                                      GetStreamTime, PaUtil_DummyGetCpuLoad,
+                                      ReadStream, WriteStream, GetStreamReadAvailable, GetStreamWriteAvailable );
+
+    return result;
+
+error:
+    if( nullHostApi )
+    {
+        if( nullHostApi->allocations )
+        {
+            PaUtil_FreeAllAllocations( nullHostApi->allocations );
+            PaUtil_DestroyAllocationGroup( nullHostApi->allocations );
+        }
+
+        PaUtil_FreeMemory( nullHostApi );
+    }
+    return result;
+}
+
+
+static void Terminate( struct PaUtilHostApiRepresentation *hostApi )
+{
+    PaNullHostApiRepresentation *nullHostApi = (PaNullHostApiRepresentation*)hostApi;
+
+    if( nullHostApi->allocations )
+    {
+        PaUtil_FreeAllAllocations( nullHostApi->allocations );
+        PaUtil_DestroyAllocationGroup( nullHostApi->allocations );
+    }
+
+    PaUtil_FreeMemory( nullHostApi );
+}
+
+
+/* Check the parameters of one direction, this implementation doesn't use custom stream info */
+static PaError ValidateParameters( struct PaUtilHostApiRepresentation *hostApi,
+                                   const PaStreamParameters *parameters, int isInput )
+{
+    const PaDeviceInfo *deviceInfo;
+
+    if( parameters->sampleFormat & paCustomFormat )
+        return paSampleFormatNotSupported;
+    if( parameters->device == paUseHostApiSpecificDeviceSpecification )
+        return paInvalidDevice;
+    if( parameters->hostApiSpecificStreamInfo )
+        return paIncompatibleHostApiSpecificStreamInfo;
+
+    deviceInfo = hostApi->deviceInfos[ parameters->device ];
+    if( parameters->channelCount > ( isInput ? deviceInfo->maxInputChannels : deviceInfo->maxOutputChannels ) )
+        return paInvalidChannelCount;
+
+    return paNoError;
+}
+
+static PaError IsFormatSupported( struct PaUtilHostApiRepresentation *hostApi,
+                                  const PaStreamParameters *inputParameters,
+                                  const PaStreamParameters *outputParameters,
+                                  double sampleRate )
+{
+    PaError result;
+
+    if( inputParameters && ( result = ValidateParameters( hostApi, inputParameters, 1 ) ) != paNoError )
+        return result;
+    if( outputParameters && ( result = ValidateParameters( hostApi, outputParameters, 0 ) ) != paNoError )
+        return result;
+
+    /* the simulated clock runs at any rate */
+    if( sampleRate <= 0. )
+        return paInvalidSampleRate;
+
+    return paFormatIsSupported;
+}
+
+/* PaNullStream - a stream data structure specifically for this implementation */
+
+typedef struct PaNullStream
+{
+    PaUtilStreamRepresentation streamRepresentation;
+    PaUtilCpuLoadMeasurer cpuLoadMeasurer;
+    PaUtilBufferProcessor bufferProcessor;
+    PaUnixThread thread;
+
+    double sampleRate;
+    unsigned long framesPerPeriod;
+    unsigned long periodCount;          /* periods of output buffered ahead of the simulated DAC */
+    int inputChannelCount;
+    int outputChannelCount;
+    PaSampleFormat hostInputSampleFormat;
+    PaSampleFormat hostOutputSampleFormat;
+    unsigned long inputFrameBytes;
+    unsigned long outputFrameBytes;
+    void *inputBuffer;                  /* one period in host format */
+    void *outputBuffer;
+    unsigned char *loopback;            /* periodCount + 1 periods of output, full-duplex streams only */
+    PaUtilZeroer *inputZeroer;
+    PaUtilZeroer *outputZeroer;
+    PaStreamCallbackFlags xrunFlags;
+    PaStreamCallbackFlags pendingFlags; /* xruns not yet reported, only touched by the clock thread */
+
+    double speed;
+    PaTime jitter;
+    unsigned long xrunInterval;
+    PaUint32 random;
+
+    PaTime startTime;
+    unsigned long startPeriod;
+    volatile unsigned long period;      /* the next period the clock thread handles */
+    volatile int isActive;
+    int isStopped;
+    volatile int abortRequested;
+
+    /* blocking streams exchange host format periods with the clock thread through these */
+    PaUnixMutex mtx;
+    pthread_cond_t cond;
+    PaUtilRingBuffer inputRing;
+    PaUtilRingBuffer outputRing;
+    void *inputRingData;
+    void *outputRingData;
+    unsigned long ringFrames;           /* usable part of each ring, as large as the output buffering */
+    void **userBuffers;                 /* copy of the pointers passed for non-interleaved buffers */
+    int inputOverflowed;
+    int outputUnderflowed;
+    int outputPrimed;
+}
+PaNullStream;
+
+/* see pa_hostapi.h for a list of validity guarantees made about OpenStream parameters */
+
+static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
+                           PaStream** s,
+                           const PaStreamParameters *inputParameters,
+                           const PaStreamParameters *outputParameters,
+                           double sampleRate,
+                           unsigned long framesPerBuffer,
+                           PaStreamFlags streamFlags,
+                           PaStreamCallback *streamCallback,
+                           void *userData )
+{
+    PaError result = paNoError;
+    PaNullHostApiRepresentation *nullHostApi = (PaNullHostApiRepresentation*)hostApi;
+    PaNullStream *stream = 0;
+    const PaNullDeviceInfo *device;
+    int inputChannelCount = 0, outputChannelCount = 0;
+    PaSampleFormat inputSampleFormat = paFloat32, outputSampleFormat = paFloat32;
+    PaSampleFormat hostInputSampleFormat = paFloat32, hostOutputSampleFormat = paFloat32;
+    PaTime suggestedLatency = 0.;
+    unsigned long framesPerPeriod, periodCount, ringCapacity;
+    int bufferProcessorInitialized = 0, mtxInitialized = 0, condInitialized = 0;
+
+    if( inputParameters )
+        PA_ENSURE( ValidateParameters( hostApi, inputParameters, 1 ) );
+    if( outputParameters )
+        PA_ENSURE( ValidateParameters( hostApi, outputParameters, 0 ) );
+
+    /* validate platform specific flags */
+    if( (streamFlags & paPlatformSpecificFlags) != 0 )
+        return paInvalidFlag; /* unexpected platform specific flag */
+
+    /* the output device's period drives full-duplex streams */
+    if( outputParameters )
+    {
+        device = (const PaNullDeviceInfo*)hostApi->deviceInfos[ outputParameters->device ];
+        outputChannelCount = outputParameters->channelCount;
+        outputSampleFormat = outputParameters->sampleFormat;
+        hostOutputSampleFormat = PaUtil_SelectClosestAvailableFormat( device->formats, outputSampleFormat );
+        suggestedLatency = outputParameters->suggestedLatency;
+    }
+    else
+        device = (const PaNullDeviceInfo*)hostApi->deviceInfos[ inputParameters->device ];
+    framesPerPeriod = device->framesPerPeriod;
+
+    if( inputParameters )
+    {
+        inputChannelCount = inputParameters->channelCount;
+        inputSampleFormat = inputParameters->sampleFormat;
+        /* the loopback carries output samples untouched, so both sides share a host format */
+        hostInputSampleFormat = outputParameters ? hostOutputSampleFormat :
+            PaUtil_SelectClosestAvailableFormat( device->formats, inputSampleFormat );
+        suggestedLatency = PA_MAX( suggestedLatency, inputParameters->suggestedLatency );
+    }
+
+    periodCount = (unsigned long)( suggestedLatency * sampleRate / framesPerPeriod + .5 );
+    periodCount = PA_MIN( PA_MAX( periodCount, PA_NULL_MIN_PERIODS_ ), PA_NULL_MAX_PERIODS_ );
+
+    PA_UNLESS( stream = (PaNullStream*)PaUtil_AllocateZeroInitializedMemory( sizeof(PaNullStream) ),
+            paInsufficientMemory );
+
+    if( streamCallback )
+    {
+        PaUtil_InitializeStreamRepresentation( &stream->streamRepresentation,
+                                               &nullHostApi->callbackStreamInterface, streamCallback, userData );
+    }
+    else
+    {
+        PaUtil_InitializeStreamRepresentation( &stream->streamRepresentation,
+                                               &nullHostApi->blockingStreamInterface, streamCallback, userData );
+    }
+
+    PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, sampleRate );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
+
+    PA_ENSURE( PaUtil_InitializeBufferProcessor( &stream->bufferProcessor,
+              inputChannelCount, inputSampleFormat, hostInputSampleFormat,
+              outputChannelCount, outputSampleFormat, hostOutputSampleFormat,
+              sampleRate, streamFlags, framesPerBuffer,
+              framesPerPeriod, paUtilFixedHostBufferSize,
+              streamCallback, userData ) );
+    bufferProcessorInitialized = 1;
+
+    stream->sampleRate = sampleRate;
+    stream->framesPerPeriod = framesPerPeriod;
+    stream->periodCount = periodCount;
+    stream->inputChannelCount = inputChannelCount;
+    stream->outputChannelCount = outputChannelCount;
+    stream->hostInputSampleFormat = hostInputSampleFormat;
+    stream->hostOutputSampleFormat = hostOutputSampleFormat;
+    stream->speed = nullHostApi->speed;
+    stream->jitter = nullHostApi->jitter;
+    stream->xrunInterval = nullHostApi->xrunInterval;
+    stream->random = 0x9e3779b9;
+    stream->isStopped = 1;
+
+    if( inputParameters )
+    {
+        stream->inputFrameBytes = inputChannelCount * Pa_GetSampleSize( hostInputSampleFormat );
+        stream->inputZeroer = PaUtil_SelectZeroer( hostInputSampleFormat );
+        stream->xrunFlags |= paInputOverflow;
+        PA_UNLESS( stream->inputBuffer = PaUtil_AllocateZeroInitializedMemory(
+                framesPerPeriod * stream->inputFrameBytes ), paInsufficientMemory );
+    }
+    if( outputParameters )
+    {
+        stream->outputFrameBytes = outputChannelCount * Pa_GetSampleSize( hostOutputSampleFormat );
+        stream->outputZeroer = PaUtil_SelectZeroer( hostOutputSampleFormat );
+        stream->xrunFlags |= paOutputUnderflow;
+        PA_UNLESS( stream->outputBuffer = PaUtil_AllocateZeroInitializedMemory(
+                framesPerPeriod * stream->outputFrameBytes ), paInsufficientMemory );
+    }
+    if( inputParameters && outputParameters )
+    {
+        PA_UNLESS( stream->loopback = (unsigned char*)PaUtil_AllocateZeroInitializedMemory(
+                (periodCount + 1) * framesPerPeriod * stream->outputFrameBytes ), paInsufficientMemory );
+        stream->outputZeroer( stream->loopback, 1, (periodCount + 1) * framesPerPeriod * outputChannelCount );
+    }
+
+    if( !streamCallback )
+    {
+        PA_ENSURE( PaUnixMutex_Initialize( &stream->mtx ) );
+        mtxInitialized = 1;
+        PA_UNLESS( !pthread_cond_init( &stream->cond, NULL ), paInternalError );
+        condInitialized = 1;
+
+        stream->ringFrames = periodCount * framesPerPeriod;
+        for( ringCapacity = 1; ringCapacity < stream->ringFrames; ringCapacity <<= 1 )
+            ;
+        if( inputParameters )
+        {
+            PA_UNLESS( stream->inputRingData = PaUtil_AllocateZeroInitializedMemory(
+                    ringCapacity * stream->inputFrameBytes ), paInsufficientMemory );
+            PA_UNLESS( !PaUtil_InitializeRingBuffer( &stream->inputRing, stream->inputFrameBytes,
+                    ringCapacity, stream->inputRingData ), paInternalError );
+        }
+        if( outputParameters )
+        {
+            PA_UNLESS( stream->outputRingData = PaUtil_AllocateZeroInitializedMemory(
+                    ringCapacity * stream->outputFrameBytes ), paInsufficientMemory );
+            PA_UNLESS( !PaUtil_InitializeRingBuffer( &stream->outputRing, stream->outputFrameBytes,
+                    ringCapacity, stream->outputRingData ), paInternalError );
+        }
+        PA_UNLESS( stream->userBuffers = (void**)PaUtil_AllocateZeroInitializedMemory(
+                sizeof (void*) * PA_MAX( inputChannelCount, outputChannelCount ) ), paInsufficientMemory );
+    }
+
+    /* A sample played at outputBufferDacTime is recorded periodCount + 1 periods later, a period before
+       the callback it is delivered to, so the round trip adds up to the two latencies */
+    stream->streamRepresentation.streamInfo.inputLatency = inputParameters ?
+        (PaTime)( framesPerPeriod + PaUtil_GetBufferProcessorInputLatencyFrames( &stream->bufferProcessor ) ) /
+        sampleRate : 0.;
+    stream->streamRepresentation.streamInfo.outputLatency = outputParameters ?
+        (PaTime)( periodCount * framesPerPeriod + PaUtil_GetBufferProcessorOutputLatencyFrames( &stream->bufferProcessor ) ) /
+        sampleRate : 0.;
+    stream->streamRepresentation.streamInfo.sampleRate = sampleRate;
+
+    PA_DEBUG(( "%s: %lu periods of %lu frames at %g Hz\n", __FUNCTION__, periodCount, framesPerPeriod, sampleRate ));
+
+    *s = (PaStream*)stream;
+
+    return result;
+
+error:
+    if( stream )
+    {
+        if( bufferProcessorInitialized )
+            PaUtil_TerminateBufferProcessor( &stream->bufferProcessor );
+        if( condInitialized )
+            pthread_cond_destroy( &stream->cond );
+        if( mtxInitialized )
+            PaUnixMutex_Terminate( &stream->mtx );
+        PaUtil_FreeMemory( stream->inputBuffer );
+        PaUtil_FreeMemory( stream->outputBuffer );
+        PaUtil_FreeMemory( stream->loopback );
+        PaUtil_FreeMemory( stream->inputRingData );
+        PaUtil_FreeMemory( stream->outputRingData );
+        PaUtil_FreeMemory( stream->userBuffers );
+        PaUtil_FreeMemory( stream );
+    }
+
+    return result;
+}
+
+/* xorshift, a fraction in [0, 1) for jitter */
+static double NextRandom( PaNullStream *stream )
+{
+    stream->random ^= stream->random << 13;
+    stream->random ^= stream->random >> 17;
+    stream->random ^= stream->random << 5;
+    return stream->random / 4294967296.;
+}
+
+static PaTime GetPeriodTime( const PaNullStream *stream )
+{
+    return stream->framesPerPeriod / stream->sampleRate;
+}
+
+/* Sleep until the simulated clock reaches the current period. Returns how many periods the
+   thread has fallen behind once it is late by the whole output buffer, 0 otherwise. */
+static unsigned long WaitForPeriod( PaNullStream *stream )
+{
+    PaTime wallPeriodTime, deadline, now;
+    unsigned long due;
+    struct timespec req;
+
+    if( stream->speed <= 0. )
+        return 0;
+
+    wallPeriodTime = GetPeriodTime( stream ) / stream->speed;
+    deadline = stream->startTime + ( stream->period - stream->startPeriod ) * wallPeriodTime;
+    if( stream->jitter > 0. )
+        deadline += stream->jitter * NextRandom( stream );
+
+    now = PaUtil_GetTime();
+    if( deadline > now )
+    {
+        req.tv_sec = (time_t)( deadline - now );
+        req.tv_nsec = (long)( ( deadline - now - req.tv_sec ) * 1e9 );
+        nanosleep( &req, NULL );
+        now = PaUtil_GetTime();
+    }
+
+    due = stream->startPeriod + (unsigned long)( ( now - stream->startTime ) / wallPeriodTime );
+    return due >= stream->period + stream->periodCount ? due - stream->period : 0;
+}
+
+static unsigned char *GetLoopbackPeriod( PaNullStream *stream )
+{
+    return stream->loopback +
+        ( stream->period % ( stream->periodCount + 1 ) ) * stream->framesPerPeriod * stream->outputFrameBytes;
+}
+
+/* Record a period, from the loopback if there is one, or silence */
+static void FillInputPeriod( PaNullStream *stream )
+{
+    unsigned char *in = (unsigned char*)stream->inputBuffer;
+    const unsigned char *out;
+    unsigned long i, sampleBytes, copyBytes;
+    int channel;
+
+    if( !stream->loopback )
+    {
+        stream->inputZeroer( in, 1, stream->framesPerPeriod * stream->inputChannelCount );
+        return;
+    }
+
+    out = GetLoopbackPeriod( stream );
+    if( stream->inputChannelCount == stream->outputChannelCount )
+    {
+        memcpy( in, out, stream->framesPerPeriod * stream->inputFrameBytes );
+        return;
+    }
+
+    /* output channel n is wired to input channel n, spare input channels are silent */
+    sampleBytes = Pa_GetSampleSize( stream->hostInputSampleFormat );
+    copyBytes = PA_MIN( stream->inputChannelCount, stream->outputChannelCount ) * sampleBytes;
+    for( i = 0; i < stream->framesPerPeriod; ++i )
+        memcpy( in + i * stream->inputFrameBytes, out + i * stream->outputFrameBytes, copyBytes );
+    for( channel = stream->outputChannelCount; channel < stream->inputChannelCount; ++channel )
+        stream->inputZeroer( in + channel * sampleBytes, stream->inputChannelCount, stream->framesPerPeriod );
+}
+
+/* Play the period in outputBuffer, and move to the next one */
+static void EndPeriod( PaNullStream *stream )
+{
+    if( stream->loopback )
+        memcpy( GetLoopbackPeriod( stream ), stream->outputBuffer, stream->framesPerPeriod * stream->outputFrameBytes );
+    ++stream->period;
+}
+
+/* Let a period go by without the stream, the device plays silence and records nothing */
+static void SkipPeriod( PaNullStream *stream )
+{
+    if( stream->loopback )
+        stream->outputZeroer( GetLoopbackPeriod( stream ), 1, stream->framesPerPeriod * stream->outputChannelCount );
+    ++stream->period;
+}
+
+static void ProcessCallbackPeriod( PaNullStream *stream, int *callbackResult )
+{
+    PaStreamCallbackTimeInfo timeInfo;
+    PaTime periodTime = GetPeriodTime( stream );
+    unsigned long framesProcessed;
+
+    PaUtil_BeginCpuLoadMeasurement( &stream->cpuLoadMeasurer );
+
+    timeInfo.currentTime = stream->period * periodTime;
+    timeInfo.inputBufferAdcTime = timeInfo.currentTime - periodTime;
+    timeInfo.outputBufferDacTime = timeInfo.currentTime + stream->periodCount * periodTime;
+
+    if( stream->inputBuffer )
+        FillInputPeriod( stream );
+
+    PaUtil_BeginBufferProcessing( &stream->bufferProcessor, &timeInfo, stream->pendingFlags );
+    stream->pendingFlags = 0;
+
+    if( stream->inputBuffer )
+    {
+        PaUtil_SetInputFrameCount( &stream->bufferProcessor, 0 );
+        PaUtil_SetInterleavedInputChannels( &stream->bufferProcessor, 0, stream->inputBuffer, 0 );
+    }
+    if( stream->outputBuffer )
+    {
+        PaUtil_SetOutputFrameCount( &stream->bufferProcessor, 0 );
+        PaUtil_SetInterleavedOutputChannels( &stream->bufferProcessor, 0, stream->outputBuffer, 0 );
+    }
+
+    framesProcessed = PaUtil_EndBufferProcessing( &stream->bufferProcessor, callbackResult );
+
+    EndPeriod( stream );
+
+    PaUtil_EndCpuLoadMeasurement( &stream->cpuLoadMeasurer, framesProcessed );
+}
+
+static void ProcessBlockingPeriod( PaNullStream *stream )
+{
+    ring_buffer_size_t framesRead;
+
+    PaUnixMutex_Lock( &stream->mtx );
+
+    if( stream->inputBuffer )
+    {
+        FillInputPeriod( stream );
+        if( PaUtil_GetRingBufferReadAvailable( &stream->inputRing ) + stream->framesPerPeriod > stream->ringFrames )
+            stream->inputOverflowed = 1;
+        else
+            PaUtil_WriteRingBuffer( &stream->inputRing, stream->inputBuffer, stream->framesPerPeriod );
+    }
+    if( stream->outputBuffer )
+    {
+        framesRead = PaUtil_ReadRingBuffer( &stream->outputRing, stream->outputBuffer, stream->framesPerPeriod );
+        if( (unsigned long)framesRead < stream->framesPerPeriod )
+        {
+            stream->outputZeroer( (unsigned char*)stream->outputBuffer + framesRead * stream->outputFrameBytes, 1,
+                    ( stream->framesPerPeriod - framesRead ) * stream->outputChannelCount );
+            /* running dry before anything was written is just the stream starting */
+            if( stream->outputPrimed )
+                stream->outputUnderflowed = 1;
+        }
+    }
+
+    if( stream->pendingFlags & paInputOverflow )
+        stream->inputOverflowed = 1;
+    if( ( stream->pendingFlags & paOutputUnderflow ) && stream->outputPrimed )
+        stream->outputUnderflowed = 1;
+    stream->pendingFlags = 0;
+
+    EndPeriod( stream );
+
+    pthread_cond_broadcast( &stream->cond );
+    PaUnixMutex_Unlock( &stream->mtx );
+}
+
+static int IsOutputEmpty( PaNullStream *stream )
+{
+    if( !stream->outputBuffer )
+        return 1;
+    if( stream->bufferProcessor.streamCallback )
+        return PaUtil_IsBufferProcessorOutputEmpty( &stream->bufferProcessor );
+    return PaUtil_GetRingBufferReadAvailable( &stream->outputRing ) == 0;
+}
+
+/** The clock thread of a stream.
+ *
+ * Handles one period each time the simulated clock passes a period boundary. When stopped, or once the
+ * callback is done, the buffer processor or the blocking ring is emptied and the output buffer played
+ * out before the thread exits, unless the stream is aborted.
+ */
+static void *ClockThreadFunc( void *userData )
+{
+    PaError result = paNoError;
+    PaNullStream *stream = (PaNullStream*)userData;
+    int callbackResult = paContinue;
+    unsigned long missed, drainPeriods = 0;
+
+    PA_TRACE_REGISTER_NAMED_THREAD( "Null clock" );
+
+    PA_ENSURE( PaUnixThread_PrepareNotify( &stream->thread ) );
+    PA_ENSURE( PaUnixThread_NotifyParent( &stream->thread ) );
+
+    while( !stream->abortRequested )
+    {
+        if( callbackResult == paContinue && PaUnixThread_StopRequested( &stream->thread ) )
+            callbackResult = paComplete;
+
+        for( missed = WaitForPeriod( stream ); missed > 0; --missed )
+        {
+            SkipPeriod( stream );
+            stream->pendingFlags |= stream->xrunFlags;
+        }
+
+        if( drainPeriods > 0 )
+        {
+            SkipPeriod( stream );
+            if( --drainPeriods == 0 )
+                break;
+            continue;
+        }
+
+        if( stream->xrunInterval && stream->period % stream->xrunInterval == stream->xrunInterval - 1 )
+        {
+            SkipPeriod( stream );
+            stream->pendingFlags |= stream->xrunFlags;
+            continue;
+        }
+
+        if( stream->bufferProcessor.streamCallback )
+            ProcessCallbackPeriod( stream, &callbackResult );
+        else
+            ProcessBlockingPeriod( stream );
+
+        if( callbackResult == paAbort )
+            break;
+        if( callbackResult != paContinue && IsOutputEmpty( stream ) )
+        {
+            if( !stream->outputBuffer )
+                break;
+            drainPeriods = stream->periodCount;
+        }
+    }
+
+error:
+    PaUtil_ResetCpuLoadMeasurer( &stream->cpuLoadMeasurer );
+    if( !stream->bufferProcessor.streamCallback )
+    {
+        PaUnixMutex_Lock( &stream->mtx );
+        stream->isActive = 0;
+        pthread_cond_broadcast( &stream->cond );
+        PaUnixMutex_Unlock( &stream->mtx );
+    }
+    else
+        stream->isActive = 0;
+
+    if( stream->streamRepresentation.streamFinishedCallback )
+        stream->streamRepresentation.streamFinishedCallback( stream->streamRepresentation.userData );
+
+    PaUnixThreading_EXIT( result );
+}
+
+
+/*
+    When CloseStream() is called, the multi-api layer ensures that
+    the stream has already been stopped or aborted.
+*/
+static PaError CloseStream( PaStream* s )
+{
+    PaError result = paNoError;
+    PaNullStream *stream = (PaNullStream*)s;
+
+    if( !stream->bufferProcessor.streamCallback )
+    {
+        pthread_cond_destroy( &stream->cond );
+        PaUnixMutex_Terminate( &stream->mtx );
+    }
+
+    PaUtil_TerminateBufferProcessor( &stream->bufferProcessor );
+    PaUtil_TerminateStreamRepresentation( &stream->streamRepresentation );
+    PaUtil_FreeMemory( stream->inputBuffer );
+    PaUtil_FreeMemory( stream->outputBuffer );
+    PaUtil_FreeMemory( stream->loopback );
+    PaUtil_FreeMemory( stream->inputRingData );
+    PaUtil_FreeMemory( stream->outputRingData );
+    PaUtil_FreeMemory( stream->userBuffers );
+    PaUtil_FreeMemory( stream );
+
+    return result;
+}
+
+
+static PaError StartStream( PaStream *s )
+{
+    PaError result = paNoError;
+    PaNullStream *stream = (PaNullStream*)s;
+
+    PaUtil_ResetBufferProcessor( &stream->bufferProcessor );
+
+    if( !stream->bufferProcessor.streamCallback )
+    {
+        if( stream->inputBuffer )
+            PaUtil_FlushRingBuffer( &stream->inputRing );
+        if( stream->outputBuffer )
+            PaUtil_FlushRingBuffer( &stream->outputRing );
+        stream->inputOverflowed = stream->outputUnderflowed = stream->outputPrimed = 0;
+    }
+    if( stream->loopback )
+        stream->outputZeroer( stream->loopback, 1,
+                ( stream->periodCount + 1 ) * stream->framesPerPeriod * stream->outputChannelCount );
+
+    /* stream time carries on from where the last run left it */
+    stream->startPeriod = stream->period;
+    stream->startTime = PaUtil_GetTime();
+    stream->pendingFlags = 0;
+    stream->abortRequested = 0;
+    stream->isActive = 1;
+    stream->isStopped = 0;
+
+    PA_ENSURE( PaUnixThread_New( &stream->thread, &ClockThreadFunc, stream, 1., 0, NULL ) );
+
+    return result;
+
+error:
+    stream->isActive = 0;
+    stream->isStopped = 1;
+    return result;
+}
+
+
+static PaError RealStop( PaNullStream *stream, int abort )
+{
+    PaError result = paNoError, threadResult = paNoError;
+
+    if( abort )
+        stream->abortRequested = 1;
+    PA_ENSURE( PaUnixThread_Terminate( &stream->thread, 1, &threadResult ) );
+    result = threadResult;
+
+error:
+    stream->isActive = 0;
+    stream->isStopped = 1;
+    return result;
+}
+
+
+static PaError StopStream( PaStream *s )
+{
+    return RealStop( (PaNullStream*)s, 0 );
+}
+
+
+static PaError AbortStream( PaStream *s )
+{
+    return RealStop( (PaNullStream*)s, 1 );
+}
+
+
+static PaError IsStreamStopped( PaStream *s )
+{
+    PaNullStream *stream = (PaNullStream*)s;
+
+    return stream->isStopped;
+}
+
+
+static PaError IsStreamActive( PaStream *s )
+{
+    PaNullStream *stream = (PaNullStream*)s;
+
+    return stream->isActive;
+}
+
+
+/* A real-time clock is read between periods, an unthrottled one only moves a period at a time */
+static PaTime GetStreamTime( PaStream *s )
+{
+    PaNullStream *stream = (PaNullStream*)s;
+
+    if( stream->isActive && stream->speed > 0. )
+        return stream->startPeriod * GetPeriodTime( stream ) + ( PaUtil_GetTime() - stream->startTime ) * stream->speed;
+    return stream->period * GetPeriodTime( stream );
+}
+
+
+static double GetStreamCpuLoad( PaStream* s )
+{
+    PaNullStream *stream = (PaNullStream*)s;
+
+    return PaUtil_GetCpuLoad( &stream->cpuLoadMeasurer );
+}
+
+
+/*
+    As separate stream interfaces are used for blocking and callback
+    streams, the following functions can be guaranteed to only be called
+    for blocking streams.
+*/
+
+static PaError ReadStream( PaStream* s,
+                           void *buffer,
+                           unsigned long frames )
+{
+    PaError result = paNoError;
+    PaNullStream *stream = (PaNullStream*)s;
+    PaUtilBufferProcessor *bp = &stream->bufferProcessor;
+    void *userBuffer = buffer;
+    void *data[2];
+    ring_buffer_size_t size[2], framesAvailable;
+    int i;
+
+    if( !bp->userInputIsInterleaved )
+    {
+        userBuffer = stream->userBuffers;
+        memcpy( userBuffer, buffer, sizeof (void*) * stream->inputChannelCount );
+    }
+
+    PaUnixMutex_Lock( &stream->mtx );
+    while( frames > 0 )
+    {
+        while( ( framesAvailable = PaUtil_GetRingBufferReadAvailable( &stream->inputRing ) ) == 0 )
+        {
+            if( !stream->isActive )
+            {
+                result = paStreamIsStopped;
+                goto unlock;
+            }
+            pthread_cond_wait( &stream->cond, &stream->mtx.mtx );
+        }
+
+        framesAvailable = PaUtil_GetRingBufferReadRegions( &stream->inputRing,
+                (ring_buffer_size_t)PA_MIN( (unsigned long)framesAvailable, frames ),
+                &data[0], &size[0], &data[1], &size[1] );
+        for( i = 0; i < 2 && size[i] > 0; ++i )
+        {
+            PaUtil_SetInputFrameCount( bp, size[i] );
+            PaUtil_SetInterleavedInputChannels( bp, 0, data[i], stream->inputChannelCount );
+            PaUtil_CopyInput( bp, &userBuffer, size[i] );
+        }
+        PaUtil_AdvanceRingBufferReadIndex( &stream->inputRing, framesAvailable );
+        frames -= framesAvailable;
+    }
+
+    if( stream->inputOverflowed )
+    {
+        stream->inputOverflowed = 0;
+        result = paInputOverflowed;
+    }
+
+unlock:
+    PaUnixMutex_Unlock( &stream->mtx );
+    return result;
+}
+
+
+static PaError WriteStream( PaStream* s,
+                            const void *buffer,
+                            unsigned long frames )
+{
+    PaError result = paNoError;
+    PaNullStream *stream = (PaNullStream*)s;
+    PaUtilBufferProcessor *bp = &stream->bufferProcessor;
+    const void *userBuffer = buffer;
+    void *data[2];
+    ring_buffer_size_t size[2], framesAvailable;
+    int i;
+
+    if( !bp->userOutputIsInterleaved )
+    {
+        userBuffer = stream->userBuffers;
+        memcpy( stream->userBuffers, buffer, sizeof (void*) * stream->outputChannelCount );
+    }
+
+    PaUnixMutex_Lock( &stream->mtx );
+    while( frames > 0 )
+    {
+        while( ( framesAvailable = (ring_buffer_size_t)stream->ringFrames -
+                    PaUtil_GetRingBufferReadAvailable( &stream->outputRing ) ) <= 0 )
+        {
+            if( !stream->isActive )
+            {
+                result = paStreamIsStopped;
+                goto unlock;
+            }
+            pthread_cond_wait( &stream->cond, &stream->mtx.mtx );
+        }
+
+        framesAvailable = PaUtil_GetRingBufferWriteRegions( &stream->outputRing,
+                (ring_buffer_size_t)PA_MIN( (unsigned long)framesAvailable, frames ),
+                &data[0], &size[0], &data[1], &size[1] );
+        for( i = 0; i < 2 && size[i] > 0; ++i )
+        {
+            PaUtil_SetOutputFrameCount( bp, size[i] );
+            PaUtil_SetInterleavedOutputChannels( bp, 0, data[i], stream->outputChannelCount );
+            PaUtil_CopyOutput( bp, &userBuffer, size[i] );
+        }
+        PaUtil_AdvanceRingBufferWriteIndex( &stream->outputRing, framesAvailable );
+        frames -= framesAvailable;
+        stream->outputPrimed = 1;
+    }
+
+    if( stream->outputUnderflowed )
+    {
+        stream->outputUnderflowed = 0;
+        result = paOutputUnderflowed;
+    }
+
+unlock:
+    PaUnixMutex_Unlock( &stream->mtx );
+    return result;
+}
+
+
+static signed long GetStreamReadAvailable( PaStream* s )
+{
+    PaNullStream *stream = (PaNullStream*)s;
+
+    return PaUtil_GetRingBufferReadAvailable( &stream->inputRing );
+}
+
+
+static signed long GetStreamWriteAvailable( PaStream* s )
+{
+    PaNullStream *stream = (PaNullStream*)s;
+
+    return (signed long)stream->ringFrames - PaUtil_GetRingBufferReadAvailable( &stream->outputRing );
+}
@@ -45,6 +45,12 @@
 /**
  @file
  @ingroup hostapi_src
+
+ Setting the PA_OSS_MMAP environment variable to 1 before Pa_Initialize() makes callback streams map the
+ DMA buffers of their devices instead of moving audio with read() and write(). The device positions are
+ then tracked with SNDCTL_DSP_GETIPTR and SNDCTL_DSP_GETOPTR, and the buffer processor converts straight
+ from and into the mapped buffers. Devices that can't be mapped are used through read() and write() as usual.
+ Output is written ahead of the device only as far as the requested latency, and xruns are reported to the callback.
 */
 
 #include <stdio.h>
@@ -60,6 +66,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/poll.h>
+#include <sys/mman.h>
 #include <limits.h>
 #include <semaphore.h>
 
@@ -89,6 +96,7 @@
 #include "pa_process.h"
 #include "pa_unix_util.h"
 #include "pa_debugprint.h"
+#include "pa_trace.h"
 
 static int sysErr_;
 static pthread_t mainThread_;
@@ -136,6 +144,7 @@ typedef struct
     PaUtilAllocationGroup *allocations;
 
     PaHostApiIndex hostApiIndex;
+    int useMmap;    /* Map the devices of callback streams, see PA_OSS_MMAP */
 }
 PaOSSHostApiRepresentation;
 
@@ -157,6 +166,18 @@ typedef struct
     double latency;
     unsigned long hostFrames, numBufs;
     void **userBuffers; /* For non-interleaved blocking */
+
+    /* In mmap mode, the mapped DMA buffer and the frame in it where the next host buffer is read or written */
+    void *mmapBuffer;
+    size_t mmapBytes;
+    unsigned long mmapFrames, mmapPos;
+    int mmapResync;     /* Take mmapPos from the device position, after (re)triggering */
+    /* Frame counts since the device was triggered, only their differences are meaningful: the frames read or
+     * written by us, and the start of the host buffer the device is at. Also that host buffer's position in the
+     * mapped buffer, and the device's byte count the last time it was looked at */
+    unsigned long mmapDone, mmapDevice, mmapDevicePos;
+    unsigned int mmapDeviceBytes;
+    unsigned long mmapWriteAhead;   /* Playback: frames kept written ahead of the host buffer being played */
 } PaOssStreamComponent;
 
 /** Implementation specific representation of a PaStream.
@@ -186,6 +207,7 @@ typedef struct PaOssStream
 
     int callbackMode;
     volatile int callbackStop, callbackAbort;
+    int mmapped;    /* Audio goes through the mapped DMA buffers of the devices */
 
     PaOssStreamComponent *capture, *playback;
     unsigned long pollTimeout;
@@ -247,6 +269,8 @@ PaError PaOSS_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex
             paInsufficientMemory );
     PA_UNLESS( ossHostApi->allocations = PaUtil_CreateAllocationGroup(), paInsufficientMemory );
     ossHostApi->hostApiIndex = hostApiIndex;
+    if( getenv( "PA_OSS_MMAP" ) && atoi( getenv( "PA_OSS_MMAP" ) ) )
+        ossHostApi->useMmap = 1;
 
     /* Initialize host API structure */
     *hostApi = &ossHostApi->inheritedHostApiRep;
@@ -773,6 +797,8 @@ static void PaOssStreamComponent_Terminate( PaOssStreamComponent *component )
 {
     assert( component );
 
+    if( component->mmapBuffer )
+        munmap( component->mmapBuffer, component->mmapBytes );
     if( component->fd >= 0 )
         close( component->fd );
     if( component->buffer )
@@ -804,10 +830,11 @@ error:
 
 /** Open input and output devices.
  *
+ * @param readable: Open an output only device for reading too if possible, which mapping it requires.
  * @param idev: Returned input device file descriptor.
  * @param odev: Returned output device file descriptor.
  */
-static PaError OpenDevices( const char *idevName, const char *odevName, int *idev, int *odev )
+static PaError OpenDevices( const char *idevName, const char *odevName, int readable, int *idev, int *odev )
 {
     PaError result = paNoError;
     int flags = O_NONBLOCK, duplex = 0;
@@ -835,7 +862,10 @@ static PaError OpenDevices( const char *idevName, const char *odevName, int *ide
     {
         if( !idevName )
         {
-            ENSURE_( *odev = open( odevName, flags ), paDeviceUnavailable );
+            if( readable )
+                *odev = open( odevName, O_NONBLOCK | O_RDWR );
+            if( *odev < 0 )
+                ENSURE_( *odev = open( odevName, flags ), paDeviceUnavailable );
             PA_ENSURE( ModifyBlocking( *odev, 1 ) ); /* Blocking */
         }
         else
@@ -874,7 +904,7 @@ static PaError PaOssStream_Initialize( PaOssStream *stream, const PaStreamParame
         idevName = hostApi->deviceInfos[inputParameters->device]->name;
     if( outputParameters )
         odevName = hostApi->deviceInfos[outputParameters->device]->name;
-    PA_ENSURE( OpenDevices( idevName, odevName, &idev, &odev ) );
+    PA_ENSURE( OpenDevices( idevName, odevName, callback != NULL && ossApi->useMmap, &idev, &odev ) );
     if( inputParameters )
     {
         PA_UNLESS( stream->capture = PaUtil_AllocateZeroInitializedMemory( sizeof (PaOssStreamComponent) ), paInsufficientMemory );
@@ -1119,13 +1149,156 @@ error:
     return result;
 }
 
+/** Map the DMA buffer of a configured component for mmap mode.
+ *
+ * @return Nonzero if mapped, zero if the device can't be mapped, in which case it's used through read()/write().
+ */
+static int PaOssStreamComponent_Map( PaOssStreamComponent *component, StreamMode streamMode, double sampleRate )
+{
+    int caps = 0;
+    audio_buf_info bufInfo;
+    void *buffer;
+    size_t bytes;
+
+    /* We need the trigger to start the device on an initialized buffer */
+    if( ioctl( component->fd, SNDCTL_DSP_GETCAPS, &caps ) < 0 || !(caps & DSP_CAP_MMAP) || !(caps & DSP_CAP_TRIGGER) )
+    {
+        PA_DEBUG(( "%s: %s doesn't support mmap\n", __FUNCTION__, component->devName ));
+        return 0;
+    }
+    if( ioctl( component->fd, streamMode == StreamMode_In ? SNDCTL_DSP_GETISPACE : SNDCTL_DSP_GETOSPACE, &bufInfo ) < 0 )
+        return 0;
+
+    /* Positions are tracked in whole host buffers */
+    bytes = (size_t)bufInfo.fragstotal * bufInfo.fragsize;
+    if( (unsigned long)bufInfo.fragsize != component->hostFrames * PaOssStreamComponent_FrameSize( component ) )
+        return 0;
+
+    buffer = mmap( NULL, bytes, streamMode == StreamMode_In ? PROT_READ : PROT_WRITE, MAP_SHARED, component->fd, 0 );
+    if( buffer == MAP_FAILED )
+    {
+        PA_DEBUG(( "%s: Failed to map %s: %s\n", __FUNCTION__, component->devName, strerror( errno ) ));
+        return 0;
+    }
+
+    component->mmapBuffer = buffer;
+    component->mmapBytes = bytes;
+    component->mmapFrames = bytes / PaOssStreamComponent_FrameSize( component );
+    component->mmapPos = 0;
+
+    /* Output is only written as far ahead as the requested latency, beyond the host buffer being played, rather
+     * than a whole lap of the mapped buffer */
+    component->mmapWriteAhead = ((unsigned long)ceil( component->latency * sampleRate / component->hostFrames ) + 1) *
+        component->hostFrames;
+    component->mmapWriteAhead = PA_MIN( PA_MAX( component->mmapWriteAhead, 2 * component->hostFrames ),
+            component->mmapFrames );
+    return 1;
+}
+
+static void PaOssStreamComponent_Unmap( PaOssStreamComponent *component )
+{
+    if( component->mmapBuffer )
+        munmap( component->mmapBuffer, component->mmapBytes );
+    component->mmapBuffer = NULL;
+}
+
+/** Account for frames read from or written to the mapped buffer of a component. */
+static void PaOssStreamComponent_MappedAdvance( PaOssStreamComponent *component, unsigned long frames )
+{
+    component->mmapPos = (component->mmapPos + frames) % component->mmapFrames;
+    component->mmapDone += frames;
+}
+
+/** Get the frames that can be read from or written to the mapped buffer of a component.
+ *
+ * The host buffer the device is at is still being recorded or played. For capture the frames up to it hold new
+ * frames. For playback the frames past it are filled up to mmapWriteAhead.
+ *
+ * The device position only tells where in the mapped buffer the device is, not how many times it went around,
+ * so an xrun is detected by the byte and block counts having gone through the whole buffer since the last look,
+ * or by the device having caught up with us. The component is then resynchronized with the device.
+ * @param xrun Set if the device has overwritten unread input or played output that hadn't been written.
+ */
+static PaError PaOssStreamComponent_MappedAvailable( PaOssStreamComponent *component, StreamMode streamMode,
+        unsigned long *frames, int *xrun )
+{
+    PaError result = paNoError;
+    count_info info;
+    unsigned long devicePos;
+    unsigned int deviceBytes;
+    long ahead;
+
+    *xrun = 0;
+    ENSURE_( ioctl( component->fd, streamMode == StreamMode_In ? SNDCTL_DSP_GETIPTR : SNDCTL_DSP_GETOPTR, &info ),
+            paUnanticipatedHostError );
+    devicePos = (unsigned long)info.ptr / PaOssStreamComponent_FrameSize( component ) % component->mmapFrames;
+    devicePos -= devicePos % component->hostFrames;
+    deviceBytes = (unsigned int)info.bytes;
+
+    if( component->mmapResync )
+    {
+        component->mmapDevice = component->mmapDone = 0;
+        component->mmapResync = 0;
+        goto resync;
+    }
+
+    component->mmapDevice += (devicePos + component->mmapFrames - component->mmapDevicePos) % component->mmapFrames;
+    component->mmapDevicePos = devicePos;
+    if( deviceBytes - component->mmapDeviceBytes >= component->mmapBytes ||
+            (unsigned long)info.blocks >= component->mmapFrames / component->hostFrames )
+    {
+        *xrun = 1;
+        goto resync;
+    }
+    component->mmapDeviceBytes = deviceBytes;
+
+    if( streamMode == StreamMode_In )
+    {
+        *frames = component->mmapDevice - component->mmapDone;
+        if( *frames < component->mmapFrames )
+            goto end;
+    }
+    else
+    {
+        ahead = (long)(component->mmapDone - component->mmapDevice);
+        if( ahead > 0 )
+        {
+            *frames = (unsigned long)ahead < component->mmapWriteAhead ? component->mmapWriteAhead - ahead : 0;
+            goto end;
+        }
+    }
+    *xrun = 1;
+
+resync:
+    /* Input starts at the host buffer being recorded, output right after the one being played */
+    component->mmapDevicePos = devicePos;
+    component->mmapDeviceBytes = deviceBytes;
+    component->mmapDone = component->mmapDevice;
+    component->mmapPos = devicePos;
+    if( streamMode == StreamMode_Out )
+        PaOssStreamComponent_MappedAdvance( component, component->hostFrames );
+    *frames = streamMode == StreamMode_Out ? component->mmapWriteAhead - component->hostFrames : 0;
+
+end:
+error:
+    return result;
+}
+
+/** The host buffer to hand to the buffer processor, in the mapped buffer in mmap mode. */
+static void *PaOssStreamComponent_HostBuffer( PaOssStreamComponent *component )
+{
+    if( component->mmapBuffer )
+        return (char *)component->mmapBuffer + component->mmapPos * PaOssStreamComponent_FrameSize( component );
+    return component->buffer;
+}
+
 /** Configure the stream according to input/output parameters.
  *
  * Aspect StreamChannels: The minimum number of channels supported by the device may exceed that requested by
  * the user, if so we'll record the actual number of host channels and adapt later.
  */
 static PaError PaOssStream_Configure( PaOssStream *stream, double sampleRate, unsigned long framesPerBuffer,
-        double *inputLatency, double *outputLatency )
+        int useMmap, double *inputLatency, double *outputLatency )
 {
     PaError result = paNoError;
     int duplex = stream->capture && stream->playback;
@@ -1166,6 +1339,26 @@ static PaError PaOssStream_Configure( PaOssStream *stream, double sampleRate, un
         framesPerHostBuffer = stream->playback->hostFrames;
 
     stream->framesPerHostBuffer = framesPerHostBuffer;
+
+    /* Use mmap mode only if every direction can be mapped */
+    if( useMmap )
+    {
+        stream->mmapped = (!stream->capture || PaOssStreamComponent_Map( stream->capture, StreamMode_In, sampleRate )) &&
+            (!stream->playback || PaOssStreamComponent_Map( stream->playback, StreamMode_Out, sampleRate ));
+        if( !stream->mmapped )
+        {
+            if( stream->capture )
+                PaOssStreamComponent_Unmap( stream->capture );
+            if( stream->playback )
+                PaOssStreamComponent_Unmap( stream->playback );
+        }
+        PA_DEBUG(( "%s: mmap mode %s\n", __FUNCTION__, stream->mmapped ? "on" : "off" ));
+
+        /* The frames written ahead of the host buffer being played */
+        if( stream->mmapped && stream->playback )
+            *outputLatency = (stream->playback->mmapWriteAhead - stream->playback->hostFrames) / sampleRate;
+    }
+
     stream->pollTimeout = (int) ceil( 1e6 * framesPerHostBuffer / sampleRate );    /* Period in usecs, rounded up */
 
     stream->sampleRate = stream->streamRepresentation.streamInfo.sampleRate = sampleRate;
@@ -1256,9 +1449,11 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     PA_UNLESS( stream = (PaOssStream*)PaUtil_AllocateZeroInitializedMemory( sizeof(PaOssStream) ), paInsufficientMemory );
     PA_ENSURE( PaOssStream_Initialize( stream, inputParameters, outputParameters, streamCallback, userData, streamFlags, ossHostApi ) );
 
-    PA_ENSURE( PaOssStream_Configure( stream, sampleRate, framesPerBuffer, &inLatency, &outLatency ) );
+    PA_ENSURE( PaOssStream_Configure( stream, sampleRate, framesPerBuffer, streamCallback != NULL && ossHostApi->useMmap,
+                &inLatency, &outLatency ) );
 
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, sampleRate );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
     if( inputParameters )
     {
@@ -1462,6 +1657,70 @@ error:
     return result;
 }
 
+/** Wait for frames in mmap mode.
+ *
+ * A mapped device need not signal readiness through select(), so we look at the device positions every quarter of
+ * a host buffer until there is at least a host buffer to process. The frames are aligned like in
+ * PaOssStream_WaitForFrames.
+ * @param cbFlags paInputOverflow and paOutputUnderflow are added for the xruns detected meanwhile.
+ */
+static PaError PaOssStream_WaitForMappedFrames( PaOssStream *stream, unsigned long *frames,
+        PaStreamCallbackFlags *cbFlags )
+{
+    PaError result = paNoError;
+    unsigned long captureAvail, playbackAvail, commonAvail;
+    int xrun;
+    struct timeval selectTimeval = {0, 0};
+
+    while( 1 )
+    {
+#ifdef PTHREAD_CANCELED
+        pthread_testcancel();
+#else
+        /* avoid indefinite waiting on thread not supporting cancellation */
+        if( stream->callbackStop || stream->callbackAbort )
+        {
+            PA_DEBUG(( "Cancelling PaOssStream_WaitForMappedFrames\n" ));
+            (*frames) = 0;
+            return paNoError;
+        }
+#endif
+        captureAvail = playbackAvail = ULONG_MAX;
+        if( stream->capture )
+        {
+            PA_ENSURE( PaOssStreamComponent_MappedAvailable( stream->capture, StreamMode_In, &captureAvail, &xrun ) );
+            if( xrun )
+            {
+                PA_DEBUG(( "%s: Input overflow\n", __FUNCTION__ ));
+                *cbFlags |= paInputOverflow;
+            }
+        }
+        if( stream->playback )
+        {
+            PA_ENSURE( PaOssStreamComponent_MappedAvailable( stream->playback, StreamMode_Out, &playbackAvail, &xrun ) );
+            if( xrun )
+            {
+                PA_DEBUG(( "%s: Output underflow\n", __FUNCTION__ ));
+                *cbFlags |= paOutputUnderflow;
+            }
+        }
+
+        commonAvail = PA_MIN( captureAvail, playbackAvail );
+        commonAvail -= commonAvail % stream->framesPerHostBuffer;
+        if( commonAvail > 0 )
+            break;
+
+        /* select may modify the timeout parameter */
+        selectTimeval.tv_usec = stream->pollTimeout / 4;
+        select( 0, NULL, NULL, NULL, &selectTimeval );
+    }
+
+    *frames = commonAvail;
+
+error:
+    return result;
+}
+
 /** Prepare stream for capture/playback.
  *
  * In order to synchronize capture and playback properly we use the SETTRIGGER command.
@@ -1480,7 +1739,19 @@ static PaError PaOssStream_Prepare( PaOssStream *stream )
     if( stream->capture )
         ENSURE_( ioctl( stream->capture->fd, SNDCTL_DSP_SETTRIGGER, &enableBits ), paUnanticipatedHostError );
 
-    if( stream->playback )
+    if( stream->mmapped )
+    {
+        /* The device starts on a silent buffer, which is filled as it is played. Positions are picked up anew
+         * since the device may or may not have rewound */
+        if( stream->playback )
+        {
+            memset( stream->playback->mmapBuffer, 0, stream->playback->mmapBytes );
+            stream->playback->mmapResync = 1;
+        }
+        if( stream->capture )
+            stream->capture->mmapResync = 1;
+    }
+    else if( stream->playback )
     {
         size_t bufSz = PaOssStreamComponent_BufferSize( stream->playback );
         memset( stream->playback->buffer, 0, bufSz );
@@ -1522,6 +1793,43 @@ error:
     return result;
 }
 
+/** Stop audio processing in mmap mode.
+ *
+ * The device would loop over the mapped buffer forever, so we silence what hasn't been written ahead and wait for
+ * the rest to play, unless aborting, before we stop it with SNDCTL_DSP_SETTRIGGER. The next start triggers it again.
+ */
+static PaError PaOssStream_StopMapped( PaOssStream *stream, int abort )
+{
+    PaError result = paNoError;
+    int enableBits = 0;
+
+    if( stream->playback && !abort )
+    {
+        PaOssStreamComponent *component = stream->playback;
+        unsigned int frameSize = PaOssStreamComponent_FrameSize( component );
+        unsigned long writable, ahead, silent, head;
+        int xrun;
+
+        PA_ENSURE( PaOssStreamComponent_MappedAvailable( component, StreamMode_Out, &writable, &xrun ) );
+        ahead = component->mmapDone - component->mmapDevice;
+        silent = component->mmapFrames - ahead;
+        head = PA_MIN( silent, component->mmapFrames - component->mmapPos );
+        memset( PaOssStreamComponent_HostBuffer( component ), 0, head * frameSize );
+        memset( component->mmapBuffer, 0, (silent - head) * frameSize );
+
+        Pa_Sleep( (long)ceil( 1000. * ahead / stream->sampleRate ) );
+    }
+
+    if( stream->capture )
+        ENSURE_( ioctl( stream->capture->fd, SNDCTL_DSP_SETTRIGGER, &enableBits ), paUnanticipatedHostError );
+    if( stream->playback && !stream->sharedDevice )
+        ENSURE_( ioctl( stream->playback->fd, SNDCTL_DSP_SETTRIGGER, &enableBits ), paUnanticipatedHostError );
+    stream->triggered = 0;
+
+error:
+    return result;
+}
+
 /** Stop audio processing
  *
  */
@@ -1529,6 +1837,9 @@ static PaError PaOssStream_Stop( PaOssStream *stream, int abort )
 {
     PaError result = paNoError;
 
+    if( stream->mmapped )
+        return PaOssStream_StopMapped( stream, abort );
+
     /* Looks like the only safe way to stop audio without reopening the device is SNDCTL_DSP_POST.
      * Also disable capture/playback till the stream is started again.
      */
@@ -1577,6 +1888,7 @@ static void OnExit( void *data )
 
     stream->callbackAbort = 0;      /* Clear state */
     stream->isActive = 0;
+    PaUtil_UnregisterTraceThread();
 }
 
 static PaError SetUpBuffers( PaOssStream *stream, unsigned long framesAvail )
@@ -1585,14 +1897,14 @@ static PaError SetUpBuffers( PaOssStream *stream, unsigned long framesAvail )
 
     if( stream->capture )
     {
-        PaUtil_SetInterleavedInputChannels( &stream->bufferProcessor, 0, stream->capture->buffer,
-                stream->capture->hostChannelCount );
+        PaUtil_SetInterleavedInputChannels( &stream->bufferProcessor, 0,
+                PaOssStreamComponent_HostBuffer( stream->capture ), stream->capture->hostChannelCount );
         PaUtil_SetInputFrameCount( &stream->bufferProcessor, framesAvail );
     }
     if( stream->playback )
     {
-        PaUtil_SetInterleavedOutputChannels( &stream->bufferProcessor, 0, stream->playback->buffer,
-                stream->playback->hostChannelCount );
+        PaUtil_SetInterleavedOutputChannels( &stream->bufferProcessor, 0,
+                PaOssStreamComponent_HostBuffer( stream->playback ), stream->playback->hostChannelCount );
         PaUtil_SetOutputFrameCount( &stream->bufferProcessor, framesAvail );
     }
 
@@ -1626,6 +1938,7 @@ static void *PaOSS_AudioThreadProc( void *userData )
     assert( stream );
 
     pthread_cleanup_push( &OnExit, stream );    /* Execute OnExit when exiting */
+    PA_TRACE_REGISTER_NAMED_THREAD( "OSS callback" );
 
     /* The first time the stream is started we use SNDCTL_DSP_TRIGGER to accurately start capture and
      * playback in sync, when the stream is restarted after being stopped we simply start by reading/
@@ -1668,7 +1981,14 @@ static void *PaOSS_AudioThreadProc( void *userData )
         if( !initiateProcessing )
         {
             /* Wait on available frames */
-            PA_ENSURE( PaOssStream_WaitForFrames( stream, &framesAvail ) );
+            if( stream->mmapped )
+            {
+                PA_ENSURE( PaOssStream_WaitForMappedFrames( stream, &framesAvail, &cbFlags ) );
+            }
+            else
+            {
+                PA_ENSURE( PaOssStream_WaitForFrames( stream, &framesAvail ) );
+            }
             assert( framesAvail % stream->framesPerHostBuffer == 0 );
         }
         else
@@ -1697,8 +2017,16 @@ static void *PaOSS_AudioThreadProc( void *userData )
 #endif
             PaUtil_BeginCpuLoadMeasurement( &stream->cpuLoadMeasurer );
 
-            /* Read data */
-            if ( stream->capture )
+            /* Read data, in mmap mode the buffer processor reads and writes the mapped buffers directly, as far
+             * as they go before wrapping around */
+            if( stream->mmapped )
+            {
+                if( stream->capture )
+                    frames = PA_MIN( frames, stream->capture->mmapFrames - stream->capture->mmapPos );
+                if( stream->playback )
+                    frames = PA_MIN( frames, stream->playback->mmapFrames - stream->playback->mmapPos );
+            }
+            else if ( stream->capture )
             {
                 PA_ENSURE( PaOssStreamComponent_Read( stream->capture, &frames ) );
                 if( frames < framesAvail )
@@ -1729,14 +2057,21 @@ static void *PaOSS_AudioThreadProc( void *userData )
             PaUtil_BeginBufferProcessing( &stream->bufferProcessor, &timeInfo,
                     cbFlags );
             cbFlags = 0;
-            PA_ENSURE( SetUpBuffers( stream, framesAvail ) );
+            PA_ENSURE( SetUpBuffers( stream, frames ) );
 
             framesProcessed = PaUtil_EndBufferProcessing( &stream->bufferProcessor,
                     &callbackResult );
-            assert( framesProcessed == framesAvail );
+            assert( framesProcessed == frames );
             PaUtil_EndCpuLoadMeasurement( &stream->cpuLoadMeasurer, framesProcessed );
 
-            if ( stream->playback )
+            if( stream->mmapped )
+            {
+                if( stream->capture )
+                    PaOssStreamComponent_MappedAdvance( stream->capture, framesProcessed );
+                if( stream->playback )
+                    PaOssStreamComponent_MappedAdvance( stream->playback, framesProcessed );
+            }
+            else if ( stream->playback )
             {
                 frames = framesAvail;
 
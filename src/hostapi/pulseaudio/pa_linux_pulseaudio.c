@@ -53,9 +53,13 @@
 
 #include "pa_linux_pulseaudio_cb_internal.h"
 #include "pa_linux_pulseaudio_block_internal.h"
+#include "pa_trace.h"
+#include "pa_memorybarrier.h"
+#include "pa_atomic.h"
 
 /* PulseAudio headers */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <pulse/pulseaudio.h>
@@ -137,6 +141,106 @@ int PaPulseAudio_CheckConnection( PaPulseAudio_HostApiRepresentation * ptr )
     return retCode;
 }
 
+/* Shard contexts only have to wake up whoever waits for them */
+static void _PaPulseAudio_ShardContextStateCb( pa_context * c,
+                                               void *userdata )
+{
+    PaPulseAudio_Shard *shard = (PaPulseAudio_Shard *) userdata;
+    pa_threaded_mainloop_signal( shard->mainloop, 0 );
+}
+
+/* Runs once in the mainloop thread as it starts, before any stream callback. The thread
+   lives as long as the host API, its trace ring is freed along with the other ones */
+static void _PaPulseAudio_RegisterTraceThread( pa_mainloop_api * api,
+                                               void *userdata )
+{
+    PA_TRACE_REGISTER_NAMED_THREAD( "PulseAudio mainloop" );
+}
+
+static void _PaPulseAudio_FreeShard( PaPulseAudio_Shard * shard )
+{
+    if( shard->mainloop )
+    {
+        pa_threaded_mainloop_stop( shard->mainloop );
+    }
+
+    if( shard->context )
+    {
+        pa_context_disconnect( shard->context );
+        pa_context_unref( shard->context );
+        shard->context = NULL;
+    }
+
+    if( shard->mainloop )
+    {
+        pa_threaded_mainloop_free( shard->mainloop );
+        shard->mainloop = NULL;
+    }
+}
+
+/* Start mainloop thread for shard and connect it to server */
+static PaError _PaPulseAudio_ConnectShard( PaPulseAudio_Shard * shard )
+{
+    pa_context_state_t state = PA_CONTEXT_UNCONNECTED;
+
+    memset( shard, 0x00, sizeof(PaPulseAudio_Shard) );
+
+    shard->mainloop = pa_threaded_mainloop_new();
+
+    if( !shard->mainloop )
+    {
+        goto error;
+    }
+
+    shard->context = pa_context_new( pa_threaded_mainloop_get_api( shard->mainloop ),
+                                     __progname );
+
+    if( !shard->context )
+    {
+        goto error;
+    }
+
+    pa_context_set_state_callback( shard->context,
+                                   _PaPulseAudio_ShardContextStateCb,
+                                   shard );
+
+    pa_mainloop_api_once( pa_threaded_mainloop_get_api( shard->mainloop ),
+                          _PaPulseAudio_RegisterTraceThread, NULL );
+
+    if( pa_threaded_mainloop_start( shard->mainloop ) < 0 )
+    {
+        goto error;
+    }
+
+    PaPulseAudio_Lock( shard->mainloop );
+
+    if( pa_context_connect( shard->context, NULL, 0, NULL ) >= 0 )
+    {
+        state = pa_context_get_state( shard->context );
+
+        while( state != PA_CONTEXT_READY && PA_CONTEXT_IS_GOOD( state ) )
+        {
+            pa_threaded_mainloop_wait( shard->mainloop );
+            state = pa_context_get_state( shard->context );
+        }
+    }
+
+    PaPulseAudio_UnLock( shard->mainloop );
+
+    if( state != PA_CONTEXT_READY )
+    {
+        goto error;
+    }
+
+    return paNoError;
+
+    error:
+    PA_DEBUG( ("Portaudio %s: Can't connect shard to server\n",
+               __FUNCTION__) );
+    _PaPulseAudio_FreeShard( shard );
+    return paUnanticipatedHostError;
+}
+
 /* Create HostAPI presensentation */
 PaPulseAudio_HostApiRepresentation *PaPulseAudio_New( void )
 {
@@ -186,6 +290,8 @@ PaPulseAudio_HostApiRepresentation *PaPulseAudio_New( void )
                                    ptr );
 
 
+    pa_mainloop_api_once( ptr->mainloopApi, _PaPulseAudio_RegisterTraceThread, NULL );
+
     if( pa_threaded_mainloop_start( ptr->mainloop ) < 0 )
     {
         PA_PULSEAUDIO_SET_LAST_HOST_ERROR( 0,
@@ -205,6 +311,7 @@ PaPulseAudio_HostApiRepresentation *PaPulseAudio_New( void )
 /* Free HostAPI */
 void PaPulseAudio_Free( PaPulseAudio_HostApiRepresentation * ptr )
 {
+    int i;
 
     /* Sanity check if ptr if NULL don't go anywhere or
      * it will SIGSEGV
@@ -216,6 +323,12 @@ void PaPulseAudio_Free( PaPulseAudio_HostApiRepresentation * ptr )
         return;
     }
 
+    /* First shard is freed below as host API mainloop and context */
+    for( i = 1; i < ptr->shardCount; i++ )
+    {
+        _PaPulseAudio_FreeShard( &ptr->shards[i] );
+    }
+
     if( ptr->mainloop )
     {
         pa_threaded_mainloop_stop( ptr->mainloop );
@@ -527,6 +640,151 @@ void PaPulseAudio_StreamStateCb( pa_stream * s,
     }
 }
 
+/* Report buffering PulseAudio has actually granted as stream latency.
+ * The latencies are published under the mainloop lock, each with
+ * a single store, as Pa_GetStreamInfo() readers don't take it.
+ */
+void PaPulseAudio_UpdateStreamLatency( PaPulseAudio_Stream *stream )
+{
+    PaStreamInfo *streamInfo = &stream->streamRepresentation.streamInfo;
+    const pa_buffer_attr *pulseaudioBufferAttr = NULL;
+    PaTime inputLatency, outputLatency;
+
+    PaPulseAudio_Lock( stream->mainloop );
+
+    inputLatency = streamInfo->inputLatency;
+    outputLatency = streamInfo->outputLatency;
+
+    if( stream->outputStream &&
+        pa_stream_get_state( stream->outputStream ) == PA_STREAM_READY &&
+        (pulseaudioBufferAttr = pa_stream_get_buffer_attr( stream->outputStream )) )
+    {
+        outputLatency =
+            (PaTime) PaUtil_GetBufferProcessorOutputLatencyFrames( &stream->bufferProcessor ) /
+            streamInfo->sampleRate +
+            (PaTime) pa_bytes_to_usec( pulseaudioBufferAttr->tlength, &stream->outputSampleSpec ) / 1e6;
+    }
+
+    if( stream->inputStream &&
+        pa_stream_get_state( stream->inputStream ) == PA_STREAM_READY &&
+        (pulseaudioBufferAttr = pa_stream_get_buffer_attr( stream->inputStream )) )
+    {
+        inputLatency =
+            (PaTime) PaUtil_GetBufferProcessorInputLatencyFrames( &stream->bufferProcessor ) /
+            streamInfo->sampleRate +
+            (PaTime) pa_bytes_to_usec( pulseaudioBufferAttr->fragsize, &stream->inputSampleSpec ) / 1e6;
+    }
+
+    PaUtil_WriteMemoryBarrier();
+    streamInfo->outputLatency = outputLatency;
+    streamInfo->inputLatency = inputLatency;
+
+    PaPulseAudio_UnLock( stream->mainloop );
+}
+
+static void _PaPulseAudio_BufferAttrCb( pa_stream *s,
+                                        int success,
+                                        void *userdata )
+{
+    PaPulseAudio_Stream *stream = (PaPulseAudio_Stream *) userdata;
+
+    if( success )
+    {
+        PaPulseAudio_UpdateStreamLatency( stream );
+    }
+}
+
+/* Scale buffering of one direction (tlength for playback, fragsize
+ * for record) by factor and keep it within adaptive bounds.
+ *
+ * Must be called from mainloop thread or with mainloop locked.
+ */
+static void _PaPulseAudio_AdaptLatency( PaPulseAudio_Stream *stream,
+                                        pa_stream *s,
+                                        const pa_sample_spec *sampleSpec,
+                                        pa_buffer_attr *bufferAttr,
+                                        double factor )
+{
+    const pa_buffer_attr *pulseaudioBufferAttr = NULL;
+    pa_operation *pulseaudioOperation = NULL;
+    uint32_t *bufferLength = NULL;
+    PaTime latency;
+    size_t bytes;
+
+    if( !stream->adaptiveLatency ||
+        !s ||
+        pa_stream_get_state( s ) != PA_STREAM_READY ||
+        !(pulseaudioBufferAttr = pa_stream_get_buffer_attr( s )) )
+    {
+        return;
+    }
+
+    *bufferAttr = *pulseaudioBufferAttr;
+    bufferLength = ( s == stream->outputStream ) ? &bufferAttr->tlength : &bufferAttr->fragsize;
+
+    latency = PaPulseAudio_ClampAdaptiveLatency( stream,
+                  (PaTime) pa_bytes_to_usec( *bufferLength, sampleSpec ) / 1e6 * factor );
+    bytes = pa_usec_to_bytes( (pa_usec_t) (latency * 1e6), sampleSpec );
+
+    if( bytes == *bufferLength )
+    {
+        return;
+    }
+
+    *bufferLength = (uint32_t) bytes;
+
+    if( s == stream->outputStream )
+    {
+        /* Ask for more data when quarter of buffer has been played
+         * and let server choose prebuffering for new tlength
+         */
+        bufferAttr->minreq = (uint32_t) pa_usec_to_bytes( (pa_usec_t) (latency * 1e6 / 4),
+                                                          sampleSpec );
+        bufferAttr->prebuf = (uint32_t) -1;
+    }
+
+    PA_DEBUG( ("Portaudio %s: buffering changed to %f seconds\n",
+               __FUNCTION__,
+               latency) );
+
+    pulseaudioOperation = pa_stream_set_buffer_attr( s,
+                                                     bufferAttr,
+                                                     _PaPulseAudio_BufferAttrCb,
+                                                     stream );
+    if( pulseaudioOperation )
+    {
+        pa_operation_unref( pulseaudioOperation );
+    }
+}
+
+/* Grow after underflow or overflow, at most once per grow interval
+ * so one burst of them does not run latency straight to maximum
+ */
+static void _PaPulseAudio_GrowLatency( PaPulseAudio_Stream *stream,
+                                       pa_stream *s,
+                                       const pa_sample_spec *sampleSpec,
+                                       pa_buffer_attr *bufferAttr,
+                                       PaTime *adaptTime )
+{
+    PaTime now;
+
+    if( !stream->adaptiveLatency )
+    {
+        return;
+    }
+
+    now = PaUtil_GetTime();
+    if( now - *adaptTime >= PA_PULSEAUDIO_ADAPTIVE_GROW_INTERVAL )
+    {
+        _PaPulseAudio_AdaptLatency( stream,
+                                    s,
+                                    sampleSpec,
+                                    bufferAttr,
+                                    PA_PULSEAUDIO_ADAPTIVE_GROW );
+        *adaptTime = now;
+    }
+}
+
 /* If stream is underflowed then this callback is called
  * one needs to enable debug to make use os this
  *
@@ -553,10 +811,112 @@ void PaPulseAudio_StreamUnderflowCb( pa_stream *s,
                pa_stream_get_device_name(s),
                pulseaudioOutputSampleSpec->tlength) );
 
+    _PaPulseAudio_GrowLatency( stream,
+                               s,
+                               &stream->outputSampleSpec,
+                               &stream->outputBufferAttr,
+                               &stream->outputAdaptTime );
+
     pa_threaded_mainloop_signal( stream->mainloop,
                                  0 );
 }
 
+/* Record counterpart of PaPulseAudio_StreamUnderflowCb(). Input was
+ * not read in time and PulseAudio had to drop some of it.
+ */
+void PaPulseAudio_StreamOverflowCb( pa_stream *s,
+                                    void *userdata )
+{
+    PaPulseAudio_Stream *stream = (PaPulseAudio_Stream *) userdata;
+
+    if( !s )
+    {
+        PA_DEBUG( ("Portaudio %s: Invalid stream",
+                   __FUNCTION__) );
+        return;
+    }
+
+    stream->inputOverflows++;
+    PA_DEBUG( ("Portaudio %s: PulseAudio '%s' stream has overflowed\n",
+               __FUNCTION__,
+               pa_stream_get_device_name(s)) );
+
+    _PaPulseAudio_GrowLatency( stream,
+                               s,
+                               &stream->inputSampleSpec,
+                               &stream->inputBufferAttr,
+                               &stream->inputAdaptTime );
+
+    pa_threaded_mainloop_signal( stream->mainloop,
+                                 0 );
+}
+
+PaTime PaPulseAudio_ClampAdaptiveLatency( PaPulseAudio_Stream *stream,
+                                          PaTime latency )
+{
+    if( !stream->adaptiveLatency )
+    {
+        return latency;
+    }
+
+    if( latency < stream->adaptiveMinLatency )
+    {
+        latency = stream->adaptiveMinLatency;
+    }
+    if( latency > stream->adaptiveMaxLatency )
+    {
+        latency = stream->adaptiveMaxLatency;
+    }
+
+    return latency;
+}
+
+void PaPulseAudio_AdaptiveLatencyTick( PaPulseAudio_Stream *stream )
+{
+    const pa_timing_info *pulseaudioTimingInfo = NULL;
+    PaTime now;
+
+    if( !stream->adaptiveLatency )
+    {
+        return;
+    }
+
+    now = PaUtil_GetTime();
+
+    /* Output shrinks only when PulseAudio has played whole interval
+     * worth of audio since the last underflow
+     */
+    if( stream->outputStream &&
+        now - stream->outputAdaptTime >= PA_PULSEAUDIO_ADAPTIVE_SHRINK_INTERVAL )
+    {
+        pulseaudioTimingInfo = pa_stream_get_timing_info( stream->outputStream );
+
+        if( pulseaudioTimingInfo &&
+            pulseaudioTimingInfo->since_underrun >=
+            (int64_t) pa_usec_to_bytes( (pa_usec_t) (PA_PULSEAUDIO_ADAPTIVE_SHRINK_INTERVAL * 1e6),
+                                        &stream->outputSampleSpec ) )
+        {
+            _PaPulseAudio_AdaptLatency( stream,
+                                        stream->outputStream,
+                                        &stream->outputSampleSpec,
+                                        &stream->outputBufferAttr,
+                                        PA_PULSEAUDIO_ADAPTIVE_SHRINK );
+        }
+        stream->outputAdaptTime = now;
+    }
+
+    if( stream->inputStream &&
+        now - stream->inputAdaptTime >= PA_PULSEAUDIO_ADAPTIVE_SHRINK_INTERVAL )
+    {
+        _PaPulseAudio_AdaptLatency( stream,
+                                    stream->inputStream,
+                                    &stream->inputSampleSpec,
+                                    &stream->inputBufferAttr,
+                                    PA_PULSEAUDIO_ADAPTIVE_SHRINK );
+        stream->inputAdaptTime = now;
+    }
+}
+
 /* Initialize HostAPI */
 PaError PaPulseAudio_Initialize( PaUtilHostApiRepresentation ** hostApi,
                                  PaHostApiIndex hostApiIndex )
@@ -566,6 +926,7 @@ PaError PaPulseAudio_Initialize( PaUtilHostApiRepresentation ** hostApi,
     int deviceCount;
     int ret = 0;
     int lockTaken = 0;
+    int shardCount = 1;
     PaPulseAudio_HostApiRepresentation *pulseaudioHostApi = NULL;
     PaDeviceInfo *deviceInfoArray = NULL;
 
@@ -652,7 +1013,7 @@ PaError PaPulseAudio_Initialize( PaUtilHostApiRepresentation ** hostApi,
     PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
     lockTaken = 0;
 
-    PaPulseAudio_ReleaseOperation( pulseaudioHostApi,
+    PaPulseAudio_ReleaseOperation( pulseaudioHostApi->mainloop,
                                    &pulseaudioOperation );
 
     PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
@@ -705,7 +1066,7 @@ PaError PaPulseAudio_Initialize( PaUtilHostApiRepresentation ** hostApi,
     PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
     lockTaken = 0;
 
-    PaPulseAudio_ReleaseOperation( pulseaudioHostApi,
+    PaPulseAudio_ReleaseOperation( pulseaudioHostApi->mainloop,
                                    &pulseaudioOperation );
 
     PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
@@ -720,7 +1081,7 @@ PaError PaPulseAudio_Initialize( PaUtilHostApiRepresentation ** hostApi,
     PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
     lockTaken = 0;
 
-    PaPulseAudio_ReleaseOperation( pulseaudioHostApi,
+    PaPulseAudio_ReleaseOperation( pulseaudioHostApi->mainloop,
                                    &pulseaudioOperation );
 
     PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
@@ -785,6 +1146,32 @@ PaError PaPulseAudio_Initialize( PaUtilHostApiRepresentation ** hostApi,
 
     PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
     lockTaken = 0;
+
+    /* PA_PULSEAUDIO_SHARDS=N spreads streams over N mainloop threads,
+     * each with its own connection, so that many streams don't all
+     * serialize on one mainloop lock. Shards that fail to connect
+     * are left out.
+     */
+    pulseaudioHostApi->shards[0].mainloop = pulseaudioHostApi->mainloop;
+    pulseaudioHostApi->shards[0].context = pulseaudioHostApi->context;
+    pulseaudioHostApi->shardCount = 1;
+
+    if( getenv( "PA_PULSEAUDIO_SHARDS" ) )
+    {
+        shardCount = atoi( getenv( "PA_PULSEAUDIO_SHARDS" ) );
+
+        if( shardCount > PA_PULSEAUDIO_MAX_SHARDS )
+        {
+            shardCount = PA_PULSEAUDIO_MAX_SHARDS;
+        }
+    }
+
+    while( pulseaudioHostApi->shardCount < shardCount &&
+           _PaPulseAudio_ConnectShard( &pulseaudioHostApi->shards[pulseaudioHostApi->shardCount] ) == paNoError )
+    {
+        pulseaudioHostApi->shardCount++;
+    }
+
     return result;
 
     error:
@@ -958,9 +1345,12 @@ PaError PaPulseAudio_ConvertPortaudioFormatToPaPulseAudio_( PaSampleFormat porta
 }
 
 
-/* Allocate buffer. */
+/* Allocate buffer. If lockMemory is set the buffer is locked into
+ * physical memory, *locked tells whether that succeeded. */
 PaError PaPulseAudio_BlockingInitRingBuffer( PaUtilRingBuffer * rbuf,
-                                             int size )
+                                             int size,
+                                             int lockMemory,
+                                             int *locked )
 {
     char *ringbufferBuffer = (char *) malloc( size );
     PaError ret = paNoError;
@@ -992,9 +1382,34 @@ PaError PaPulseAudio_BlockingInitRingBuffer( PaUtilRingBuffer * rbuf,
         return paNotInitialized;
     }
 
+    *locked = 0;
+    if( lockMemory && PaUtil_LockMemory( ringbufferBuffer, size ) == paNoError )
+    {
+        *locked = 1;
+    }
+
     return paNoError;
 }
 
+
+/* Free buffer allocated by PaPulseAudio_BlockingInitRingBuffer. */
+void PaPulseAudio_BlockingFreeRingBuffer( PaUtilRingBuffer * rbuf,
+                                          int locked )
+{
+    if( rbuf->buffer == NULL )
+    {
+        return;
+    }
+
+    if( locked )
+    {
+        PaUtil_UnlockMemory( rbuf->buffer, rbuf->bufferSize );
+    }
+
+    free( rbuf->buffer );
+    rbuf->buffer = NULL;
+}
+
 /* see pa_hostapi.h for a list of validity guarantees made about OpenStream parameters */
 
 PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
@@ -1010,7 +1425,9 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     PaError result = paNoError;
     PaPulseAudio_HostApiRepresentation *pulseaudioHostApi =
         (PaPulseAudio_HostApiRepresentation *) hostApi;
+    PaPulseAudio_Shard *pulseaudioShard = &pulseaudioHostApi->shards[0];
     PaPulseAudio_Stream *stream = NULL;
+    int i;
     unsigned long framesPerHostBuffer = framesPerBuffer;        /* these may not be equivalent for all implementations */
     int inputChannelCount,
      outputChannelCount;
@@ -1033,7 +1450,21 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
         framesPerBuffer = PAPULSEAUDIO_FRAMESPERBUFFERUNSPEC;
     }
 
-    PaPulseAudio_Lock(pulseaudioHostApi->mainloop);
+    /* Stream goes to shard with least streams. Counts may change under
+     * us while choosing, which only makes the balance a little off,
+     * but the shard is claimed straight away so that streams opened
+     * at the same time don't all pile onto it.
+     */
+    for( i = 1; i < pulseaudioHostApi->shardCount; i++ )
+    {
+        if( pulseaudioHostApi->shards[i].streamCount < pulseaudioShard->streamCount )
+        {
+            pulseaudioShard = &pulseaudioHostApi->shards[i];
+        }
+    }
+    PaUtil_AtomicAddLong( &pulseaudioShard->streamCount, 1 );
+
+    PaPulseAudio_Lock( pulseaudioShard->mainloop );
     stream =
         (PaPulseAudio_Stream *) PaUtil_AllocateZeroInitializedMemory( sizeof( PaPulseAudio_Stream ) );
 
@@ -1129,7 +1560,7 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
         }
 
         stream->inputStream =
-            pa_stream_new( pulseaudioHostApi->context,
+            pa_stream_new( pulseaudioShard->context,
                            stream->inputStreamName,
                            &stream->inputSampleSpec,
                            NULL );
@@ -1142,6 +1573,9 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
             pa_stream_set_started_callback( stream->inputStream,
                                             PaPulseAudio_StreamStartedCb,
                                             stream );
+            pa_stream_set_overflow_callback( stream->inputStream,
+                                             PaPulseAudio_StreamOverflowCb,
+                                             stream );
         }
         else
         {
@@ -1161,16 +1595,33 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
             stream->suggestedLatencyUSecs = 0;
         }
 
-        /*
-         * This is too much as most of the time there is not much
-         * stuff in buffer but it's enough if we are doing blocked
-         * and reading is somewhat slower than callback
-         */
-        result = PaPulseAudio_BlockingInitRingBuffer( &stream->inputRing,
-                                                      (65536 * 4) );
-        if( result != paNoError )
+        if( streamCallback )
         {
-            goto openstream_error;
+            /* Callback reads input in place so only a frame split between
+             * fragments needs to be stored
+             */
+            stream->inputScratch = PaUtil_AllocateZeroInitializedMemory( stream->inputFrameSize );
+            if( !stream->inputScratch )
+            {
+                result = paInsufficientMemory;
+                goto openstream_error;
+            }
+        }
+        else
+        {
+            /*
+             * This is too much as most of the time there is not much
+             * stuff in buffer but it's enough if we are doing blocked
+             * and reading is somewhat slower than callback
+             */
+            result = PaPulseAudio_BlockingInitRingBuffer( &stream->inputRing,
+                                                          (65536 * 4),
+                                                          (streamFlags & paLockMemory) != 0,
+                                                          &stream->inputRingLocked );
+            if( result != paNoError )
+            {
+                goto openstream_error;
+            }
         }
 
     }
@@ -1219,6 +1670,13 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
         stream->outputFrameSize =
             Pa_GetSampleSize( outputSampleFormat ) * outputChannelCount;
 
+        stream->outputScratch = PaUtil_AllocateZeroInitializedMemory( stream->outputFrameSize );
+        if( !stream->outputScratch )
+        {
+            result = paInsufficientMemory;
+            goto openstream_error;
+        }
+
         result = PaPulseAudio_ConvertPortaudioFormatToPaPulseAudio_(
             hostOutputSampleFormat,
             &stream->outputSampleSpec );
@@ -1241,7 +1699,7 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
         }
 
         stream->outputStream =
-            pa_stream_new( pulseaudioHostApi->context,
+            pa_stream_new( pulseaudioShard->context,
                            stream->outputStreamName,
                            &stream->outputSampleSpec,
                            NULL );
@@ -1296,8 +1754,9 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     }
 
     stream->hostapi = pulseaudioHostApi;
-    stream->context = pulseaudioHostApi->context;
-    stream->mainloop = pulseaudioHostApi->mainloop;
+    stream->shard = pulseaudioShard;
+    stream->context = pulseaudioShard->context;
+    stream->mainloop = pulseaudioShard->mainloop;
 
     if( streamCallback )
     {
@@ -1317,6 +1776,7 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer,
                                       sampleRate
                                     );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
     /* we assume a fixed host buffer size in this example, but the buffer processor
      * can also support bounded and unknown host buffer sizes by passing
@@ -1361,13 +1821,19 @@ PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     *s = (PaStream *) stream;
 
     openstream_end:
-    PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
+    PaPulseAudio_UnLock( pulseaudioShard->mainloop );
     return result;
 
     openstream_error:
 
+    PaUtil_AtomicAddLong( &pulseaudioShard->streamCount, -1 );
+
     if( stream )
     {
+        PaPulseAudio_BlockingFreeRingBuffer( &stream->inputRing,
+                                             stream->inputRingLocked );
+        PaUtil_FreeMemory( stream->inputScratch );
+        PaUtil_FreeMemory( stream->outputScratch );
         PaUtil_FreeMemory( stream->inputStreamName );
         PaUtil_FreeMemory( stream->outputStreamName );
         PaUtil_FreeMemory( stream );
@@ -1393,10 +1859,9 @@ PaError IsStreamActive( PaStream * s )
 PaTime GetStreamTime( PaStream * s )
 {
     PaPulseAudio_Stream *stream = (PaPulseAudio_Stream *) s;
-    PaPulseAudio_HostApiRepresentation *pulseaudioHostApi = stream->hostapi;
     PaStreamCallbackTimeInfo timeInfo = { 0, 0, 0 };
 
-    PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
+    PaPulseAudio_Lock( stream->mainloop );
 
     if( stream->outputStream )
     {
@@ -1404,6 +1869,7 @@ PaTime GetStreamTime( PaStream * s )
                                          &timeInfo,
                                          0 ) == -PA_ERR_NODATA )
         {
+            PaPulseAudio_UnLock( stream->mainloop );
             return 0;
         }
     }
@@ -1414,11 +1880,12 @@ PaTime GetStreamTime( PaStream * s )
                                          &timeInfo,
                                          1 )  == -PA_ERR_NODATA )
         {
+            PaPulseAudio_UnLock( stream->mainloop );
             return 0;
         }
     }
 
-    PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
+    PaPulseAudio_UnLock( stream->mainloop );
     return timeInfo.currentTime;
 }
 
@@ -1466,7 +1933,7 @@ PaError PaPulseAudio_RenameSource( PaStream *s, const char *streamName )
     op = pa_stream_set_name( stream->inputStream, streamName, RenameStreamCb, stream );
     PaPulseAudio_UnLock( stream->mainloop );
 
-    PaPulseAudio_ReleaseOperation( stream->hostapi,
+    PaPulseAudio_ReleaseOperation( stream->mainloop,
                                    &op );
 
     return result;
@@ -1500,8 +1967,47 @@ PaError PaPulseAudio_RenameSink( PaStream *s, const char *streamName )
     PaPulseAudio_UnLock( stream->mainloop );
 
     /* Wait for completion. */
-    PaPulseAudio_ReleaseOperation( stream->hostapi,
+    PaPulseAudio_ReleaseOperation( stream->mainloop,
                                    &op );
 
     return result;
 }
+
+PaError PaPulseAudio_SetAdaptiveLatency( PaStream *s,
+                                         PaTime minLatency,
+                                         PaTime maxLatency )
+{
+    PaPulseAudio_Stream *stream = (PaPulseAudio_Stream *) s;
+
+    if( stream == NULL )
+    {
+        return paBadStreamPtr;
+    }
+
+    if( minLatency < 0. || maxLatency < minLatency )
+    {
+        return paInvalidFlag;
+    }
+
+    PaPulseAudio_Lock( stream->mainloop );
+
+    stream->adaptiveLatency = ( maxLatency > 0. );
+    stream->adaptiveMinLatency = minLatency;
+    stream->adaptiveMaxLatency = maxLatency;
+
+    /* Running stream is brought within new bounds straight away */
+    _PaPulseAudio_AdaptLatency( stream,
+                                stream->outputStream,
+                                &stream->outputSampleSpec,
+                                &stream->outputBufferAttr,
+                                1. );
+    _PaPulseAudio_AdaptLatency( stream,
+                                stream->inputStream,
+                                &stream->inputSampleSpec,
+                                &stream->inputBufferAttr,
+                                1. );
+
+    PaPulseAudio_UnLock( stream->mainloop );
+
+    return paNoError;
+}
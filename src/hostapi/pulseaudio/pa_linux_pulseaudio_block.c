@@ -50,7 +50,6 @@
 */
 
 #include "pa_linux_pulseaudio_block_internal.h"
-#include <unistd.h>
 
 /*
     As separate stream interfaces are used for blocking and callback
@@ -58,40 +57,53 @@
     for blocking streams.
 */
 
+/* PA_PULSEAUDIO_IS_ERROR() returns so it can't be used while holding
+ * the mainloop lock. Wrap it so callers can unlock before they bail out.
+ */
+static PaError _PaPulseAudio_CheckBlockingStream( PaPulseAudio_Stream *stream )
+{
+    PA_PULSEAUDIO_IS_ERROR( stream, paStreamIsStopped )
+
+    return paNoError;
+}
+
 PaError PaPulseAudio_ReadStreamBlock( PaStream * s,
                                       void *buffer,
                                       unsigned long frames )
 {
     PaPulseAudio_Stream *pulseaudioStream = (PaPulseAudio_Stream *) s;
-    PaPulseAudio_HostApiRepresentation *pulseaudioHostApi =
-        pulseaudioStream->hostapi;
-    PaError ret = 0;
+    PaError ret = paNoError;
     uint8_t *readableBuffer = (uint8_t *) buffer;
     long bufferLeftToRead = (frames * pulseaudioStream->inputFrameSize);
 
+    /* Record callback fills the ring buffer and signals the mainloop
+     * after every fragment so we can sleep on it with the lock held
+     * instead of polling.
+     */
+    PaPulseAudio_Lock( pulseaudioStream->mainloop );
+
     while( bufferLeftToRead > 0 )
     {
-        PA_PULSEAUDIO_IS_ERROR( pulseaudioStream, paStreamIsStopped )
+        ret = _PaPulseAudio_CheckBlockingStream( pulseaudioStream );
+        if( ret != paNoError )
+        {
+            break;
+        }
 
-        PaPulseAudio_Lock( pulseaudioStream->mainloop );
         long l_read = PaUtil_ReadRingBuffer( &pulseaudioStream->inputRing, readableBuffer,
                                              bufferLeftToRead );
         readableBuffer += l_read;
         bufferLeftToRead -= l_read;
-        if( bufferLeftToRead > 0 )
-            pa_threaded_mainloop_wait( pulseaudioStream->mainloop );
-
-        PaPulseAudio_UnLock( pulseaudioStream->mainloop );
 
         if( bufferLeftToRead > 0 )
         {
-            /* Sleep small amount of time not burn CPU
-            * we block anyway so this is bearable
-            */
-            usleep(100);
+            pa_threaded_mainloop_wait( pulseaudioStream->mainloop );
         }
     }
-    return paNoError;
+
+    PaPulseAudio_UnLock( pulseaudioStream->mainloop );
+
+    return ret;
 }
 
 
@@ -100,86 +112,102 @@ PaError PaPulseAudio_WriteStreamBlock( PaStream * s,
                                        unsigned long frames )
 {
     PaPulseAudio_Stream *pulseaudioStream = (PaPulseAudio_Stream *) s;
-    int ret = 0;
+    PaError ret = paNoError;
     size_t pulseaudioWritable = 0;
-    uint8_t *writableBuffer = (uint8_t *) buffer;
-    long bufferLeftToWrite = (frames * pulseaudioStream->outputFrameSize);
+    void *pulseaudioBuffer = NULL;
+    const uint8_t *writableBuffer = (const uint8_t *) buffer;
+    size_t bufferLeftToWrite = (frames * pulseaudioStream->outputFrameSize);
     pa_operation *pulseaudioOperation = NULL;
+    PaTime now;
 
     PaUtil_BeginCpuLoadMeasurement( &pulseaudioStream->cpuLoadMeasurer );
 
-    while( bufferLeftToWrite > 0)
+    /* Whole write happens under one lock. When PulseAudio buffer is
+     * full we wait for playback callback to signal that there is room
+     * again. Every round fills all the room there is with one
+     * pa_stream_begin_write() and pa_stream_write() pair.
+     */
+    PaPulseAudio_Lock( pulseaudioStream->mainloop );
+
+    while( bufferLeftToWrite > 0 )
     {
-        PA_PULSEAUDIO_IS_ERROR( pulseaudioStream, paStreamIsStopped )
+        ret = _PaPulseAudio_CheckBlockingStream( pulseaudioStream );
+        if( ret != paNoError )
+        {
+            break;
+        }
 
-        PaPulseAudio_Lock( pulseaudioStream->mainloop );
         pulseaudioWritable = pa_stream_writable_size( pulseaudioStream->outputStream );
-        PaPulseAudio_UnLock( pulseaudioStream->mainloop );
 
-        if( pulseaudioWritable > 0 )
+        if( pulseaudioWritable == (size_t) -1 )
         {
-            if( bufferLeftToWrite < pulseaudioWritable )
-            {
-                pulseaudioWritable = bufferLeftToWrite;
-            }
-            PaPulseAudio_Lock( pulseaudioStream->mainloop );
-            ret = pa_stream_write( pulseaudioStream->outputStream,
-                                     writableBuffer,
-                                     pulseaudioWritable,
-                                     NULL,
-                                     0,
-                                     PA_SEEK_RELATIVE );
-
-            pulseaudioOperation = pa_stream_update_timing_info( pulseaudioStream->outputStream,
-                                                                NULL,
-                                                                NULL );
-            PaPulseAudio_UnLock( pulseaudioStream->mainloop );
-
-            ret = 0;
-
-            if( pulseaudioOperation == NULL )
-            {
-                return paInsufficientMemory;
-            }
-
-            while( pa_operation_get_state( pulseaudioOperation ) == PA_OPERATION_RUNNING )
-            {
-                ret ++;
-                PA_PULSEAUDIO_IS_ERROR( pulseaudioStream, paStreamIsStopped )
-
-                /* As this shouldn never happen it's error if it does */
-                if( ret >= 10000 )
-                {
-                    return paStreamIsStopped;
-                }
-
-                usleep(100);
-            }
-
-            PaPulseAudio_Lock( pulseaudioStream->mainloop );
+            ret = paStreamIsStopped;
+            break;
+        }
 
-            pa_operation_unref( pulseaudioOperation );
-            pulseaudioOperation = NULL;
+        if( pulseaudioWritable == 0 )
+        {
+            pa_threaded_mainloop_wait( pulseaudioStream->mainloop );
+            continue;
+        }
 
-            PaPulseAudio_UnLock( pulseaudioStream->mainloop );
+        if( pulseaudioWritable > bufferLeftToWrite )
+        {
+            pulseaudioWritable = bufferLeftToWrite;
+        }
 
-            writableBuffer += pulseaudioWritable;
-            bufferLeftToWrite -= pulseaudioWritable;
+        /* PulseAudio may hand out smaller buffer than was asked for */
+        if( pa_stream_begin_write( pulseaudioStream->outputStream,
+                                   &pulseaudioBuffer,
+                                   &pulseaudioWritable ) ||
+            pulseaudioBuffer == NULL )
+        {
+            ret = paInsufficientMemory;
+            break;
         }
 
-        if( bufferLeftToWrite > 0 )
+        memcpy( pulseaudioBuffer, writableBuffer, pulseaudioWritable );
+
+        if( pa_stream_write( pulseaudioStream->outputStream,
+                             pulseaudioBuffer,
+                             pulseaudioWritable,
+                             NULL,
+                             0,
+                             PA_SEEK_RELATIVE ) )
         {
-            /* Sleep small amount of time not burn CPU
-            * we block anyway so this is bearable
-            */
-            usleep(100);
+            pa_stream_cancel_write( pulseaudioStream->outputStream );
+            ret = paUnanticipatedHostError;
+            break;
         }
 
+        writableBuffer += pulseaudioWritable;
+        bufferLeftToWrite -= pulseaudioWritable;
     }
+
+    /* Interpolated timing keeps stream time running between updates
+     * so there is no need to ask for new timing info on every write.
+     * Nobody waits for the answer either.
+     */
+    now = PaUtil_GetTime();
+    if( ret == paNoError &&
+        now - pulseaudioStream->timingUpdateTime >= PA_PULSEAUDIO_TIMING_UPDATE_INTERVAL )
+    {
+        pulseaudioOperation = pa_stream_update_timing_info( pulseaudioStream->outputStream,
+                                                            NULL,
+                                                            NULL );
+        if( pulseaudioOperation )
+        {
+            pa_operation_unref( pulseaudioOperation );
+            pulseaudioStream->timingUpdateTime = now;
+        }
+    }
+
+    PaPulseAudio_UnLock( pulseaudioStream->mainloop );
+
     PaUtil_EndCpuLoadMeasurement( &pulseaudioStream->cpuLoadMeasurer,
                                   frames );
 
-    return paNoError;
+    return ret;
 }
 
 
@@ -59,6 +59,7 @@
 
 #include "pa_unix_util.h"
 #include "pa_ringbuffer.h"
+#include "pa_atomic.h"
 
 #include "pa_linux_pulseaudio_cb_internal.h"
 
@@ -106,7 +107,7 @@ int PaPulseAudio_updateTimeInfo( pa_stream * s,
 }
 
 /* Release pa_operation always same way */
-void PaPulseAudio_ReleaseOperation(PaPulseAudio_HostApiRepresentation *hostapi,
+void PaPulseAudio_ReleaseOperation(pa_threaded_mainloop *mainloop,
                                   pa_operation **operation)
 {
     unsigned int waitOperation = 1000;
@@ -120,20 +121,20 @@ void PaPulseAudio_ReleaseOperation(PaPulseAudio_HostApiRepresentation *hostapi,
     while( waitOperation > 0 )
     {
 
-        PaPulseAudio_Lock( hostapi->mainloop );
+        PaPulseAudio_Lock( mainloop );
         localOperationState = pa_operation_get_state( localOperation );
 
         if( localOperationState == PA_OPERATION_RUNNING )
         {
-            pa_threaded_mainloop_wait( hostapi->mainloop );
+            pa_threaded_mainloop_wait( mainloop );
         }
         else
         {
             // Result is DONE or CANCEL
-            PaPulseAudio_UnLock( hostapi->mainloop );
+            PaPulseAudio_UnLock( mainloop );
             break;
         }
-        PaPulseAudio_UnLock( hostapi->mainloop );
+        PaPulseAudio_UnLock( mainloop );
 
         waitOperation --;
     }
@@ -145,10 +146,10 @@ void PaPulseAudio_ReleaseOperation(PaPulseAudio_HostApiRepresentation *hostapi,
         __FUNCTION__, localOperationState ) );
     }
 
-    PaPulseAudio_Lock( hostapi->mainloop );
+    PaPulseAudio_Lock( mainloop );
     pa_operation_unref( localOperation );
     operation = NULL;
-    PaPulseAudio_UnLock( hostapi->mainloop );
+    PaPulseAudio_UnLock( mainloop );
 }
 
 
@@ -185,18 +186,16 @@ void _PaPulseAudio_WriteRingBuffer( PaUtilRingBuffer *ringbuffer,
                                     size_t length )
 {
     /*
-     * If there is not enough room. Read from ringbuffer to make
-     * sure that if not full and audio will just underrun
-     *
-     * If you try to read too much and there is no room then this
-     * will fail. But I don't know how to get into that?
+     * If there is not enough room, drop the oldest audio
+     * from the ringbuffer so the reader just misses some
+     * audio rather than the newest
      */
     if( PaUtil_GetRingBufferWriteAvailable( ringbuffer ) < length )
     {
-        uint8_t tmpBuffer[ PULSEAUDIO_BUFFER_SIZE ];
-        PaUtil_ReadRingBuffer( ringbuffer,
-                               tmpBuffer,
-                               length );
+        ring_buffer_size_t readAvailable = PaUtil_GetRingBufferReadAvailable( ringbuffer );
+
+        PaUtil_AdvanceRingBufferReadIndex( ringbuffer,
+                                           length < readAvailable ? length : readAvailable );
     }
 
     PaUtil_WriteRingBuffer( ringbuffer,
@@ -213,7 +212,7 @@ void _PaPulseAudio_Read( PaPulseAudio_Stream *stream,
     /*
      * Idea behind this is that we fill ringbuffer with data
      * that comes from input device. When it's available
-     * we'll fill it to callback or blocking reading
+     * we'll fill it to blocking reading
      */
     if( pa_stream_peek( stream->inputStream,
                         &pulseaudioData,
@@ -221,228 +220,270 @@ void _PaPulseAudio_Read( PaPulseAudio_Stream *stream,
     {
         PA_DEBUG( ("Portaudio %s: Can't read audio!\n",
                   __FUNCTION__) );
+        return;
     }
-    else
+
+    /* NULL with length means hole in the stream */
+    if( pulseaudioData )
     {
         _PaPulseAudio_WriteRingBuffer( &stream->inputRing, pulseaudioData, length );
     }
 
-    pa_stream_drop( stream->inputStream );
+    if( length )
+    {
+        pa_stream_drop( stream->inputStream );
+    }
 
     pulseaudioData = NULL;
 
 }
 
-static int _PaPulseAudio_ProcessAudio(PaPulseAudio_Stream *stream,
-                                      size_t length)
+/* Run buffer processor over frames that live in PulseAudio's own memory */
+static int _PaPulseAudio_ProcessFrames( PaPulseAudio_Stream *stream,
+                                        const void *input,
+                                        void *output,
+                                        unsigned long frames )
 {
-    uint8_t pulseaudioSampleBuffer[PULSEAUDIO_BUFFER_SIZE];
-    size_t hostFramesPerBuffer = stream->bufferProcessor.framesPerHostBuffer;
-    size_t pulseaudioOutputBytes = 0;
-    size_t pulseaudioInputBytes = 0;
-    size_t hostFrameCount = 0;
-    int isOutputCb = 0;
-    int isInputCb = 0;
-    PaStreamCallbackTimeInfo timeInfo;
+    PaStreamCallbackTimeInfo timeInfo = { 0, 0, 0 };
+    unsigned long framesProcessed = 0;
     int ret = paContinue;
-    void *bufferData = NULL;
-    size_t pulseaudioOutputWritten = 0;
 
-    /* If there is no specified per host buffer then
-     * just generate one or but correct one in place
-     */
-    if( hostFramesPerBuffer == paFramesPerBufferUnspecified )
+    if( stream->outputStream )
     {
-        if( !stream->framesPerHostCallback )
-        {
-            /* This just good enough and most
-             * Pulseaudio server and ALSA can handle it
-             *
-             * We should never get here but this is ultimate
-             * backup.
-             */
-            hostFramesPerBuffer = PAPULSEAUDIO_FRAMESPERBUFFERUNSPEC;
-
-            stream->framesPerHostCallback = hostFramesPerBuffer;
-        }
-        else
-        {
-            hostFramesPerBuffer = stream->framesPerHostCallback;
-        }
+        PaPulseAudio_updateTimeInfo( stream->outputStream,
+                                     &timeInfo,
+                                     0 );
     }
 
-    if( stream->outputStream )
+    if( stream->inputStream )
     {
-        /* Calculate how many bytes goes to one frame */
-        pulseaudioInputBytes = pulseaudioOutputBytes = (hostFramesPerBuffer * stream->outputFrameSize);
-
-        if( stream->bufferProcessor.streamCallback )
-        {
-            isOutputCb = 1;
-        }
+        PaPulseAudio_updateTimeInfo( stream->inputStream,
+                                     &timeInfo,
+                                     1 );
     }
 
-    /* If we just want to have input but not output (Not Duplex)
-     * Use this calculation
-     */
-    if( stream->inputStream )
+    PaUtil_BeginCpuLoadMeasurement( &stream->cpuLoadMeasurer );
+
+    PaUtil_BeginBufferProcessing( &stream->bufferProcessor,
+                                  &timeInfo,
+                                  0 );
+
+    if( input )
     {
-        pulseaudioInputBytes = pulseaudioOutputBytes = (hostFramesPerBuffer * stream->inputFrameSize);
+        /* Buffer processor only reads from input so peeked memory is fine */
+        PaUtil_SetInterleavedInputChannels( &stream->bufferProcessor,
+                                            0,
+                                            (void *) input,
+                                            stream->inputChannelCount );
 
-        if( stream->bufferProcessor.streamCallback )
-        {
-            isInputCb = 1;
-        }
+        PaUtil_SetInputFrameCount( &stream->bufferProcessor,
+                                   frames );
     }
 
-    /* If we have input which is mono and
-     * output which is stereo. We have to copy
-     * mono to monomono which is stereo.
-     * Then just read half and copy
-     */
-    if( isOutputCb &&
-        stream->outputSampleSpec.channels == 2 &&
-        stream->inputSampleSpec.channels == 1)
+    if( output )
     {
-        pulseaudioInputBytes /= 2;
+        PaUtil_SetInterleavedOutputChannels( &stream->bufferProcessor,
+                                             0,
+                                             output,
+                                             stream->outputChannelCount );
+
+        PaUtil_SetOutputFrameCount( &stream->bufferProcessor,
+                                    frames );
     }
 
-    if( !stream->isActive && stream->pulseaudioIsActive && stream->outputStream)
+    framesProcessed = PaUtil_EndBufferProcessing( &stream->bufferProcessor,
+                                                  &ret );
+
+    PaUtil_EndCpuLoadMeasurement( &stream->cpuLoadMeasurer,
+                                  framesProcessed );
+
+    return ret;
+}
+
+/* Write silence for frames when there is nothing to play but
+ * PulseAudio still wants something */
+static void _PaPulseAudio_WriteSilence( PaPulseAudio_Stream *stream,
+                                        size_t frames )
+{
+    while( frames > 0 )
     {
-        bufferData = pulseaudioSampleBuffer;
-        memset( bufferData, 0x00, length);
+        void *bufferData = NULL;
+        size_t bytes = frames * stream->outputFrameSize;
+
+        if( pa_stream_begin_write( stream->outputStream, &bufferData, &bytes ) || !bufferData )
+        {
+            return;
+        }
 
+        bytes = (bytes / stream->outputFrameSize) * stream->outputFrameSize;
+        if( !bytes )
+        {
+            pa_stream_cancel_write( stream->outputStream );
+            bufferData = stream->outputScratch;
+            bytes = stream->outputFrameSize;
+        }
+
+        memset( bufferData, 0x00, bytes );
         pa_stream_write( stream->outputStream,
                          bufferData,
-                         length,
+                         bytes,
                          NULL,
                          0,
                          PA_SEEK_RELATIVE );
 
+        frames -= bytes / stream->outputFrameSize;
+    }
+}
+
+/* Process frames of input from PulseAudio memory or if there is no input
+ * stream same amount of frames of output. Output is rendered straight to
+ * memory got from pa_stream_begin_write() which can be less than asked
+ * so this is done in pieces.
+ */
+static int _PaPulseAudio_ProcessAudio( PaPulseAudio_Stream *stream,
+                                       const uint8_t *input,
+                                       size_t frames )
+{
+    int ret = paContinue;
+
+    if( !stream->isActive )
+    {
+        if( stream->pulseaudioIsActive && stream->outputStream )
+        {
+            _PaPulseAudio_WriteSilence( stream, frames );
+        }
+
         return paContinue;
     }
 
+    /*
+     * If everything fail like stream vanish or mainloop
+     * is in error state try to handle error
+     */
+    PA_PULSEAUDIO_IS_ERROR( stream, paStreamIsStopped )
 
-    while(1)
+    if( !stream->outputStream )
     {
-        /*
-         * If everything fail like stream vanish or mainloop
-         * is in error state try to handle error
-         */
-        PA_PULSEAUDIO_IS_ERROR( stream, paStreamIsStopped )
+        return _PaPulseAudio_ProcessFrames( stream, input, NULL, frames );
+    }
 
-        /* There is only Record stream so
-         * see if we have enough stuff to feed record stream
-         * If not then bail out.
-         */
-        if( isInputCb &&
-            PaUtil_GetRingBufferReadAvailable(&stream->inputRing) < pulseaudioInputBytes )
+    /* When doing Portaudio Duplex one has to write and read same amount of data
+     * if not done that way Portaudio will go boo boo and nothing works.
+     * So every piece of output comes with same amount of input
+     */
+    while( frames > 0 )
+    {
+        void *bufferData = NULL;
+        size_t bytes = frames * stream->outputFrameSize;
+        size_t pieceFrames = 0;
+
+        if( pa_stream_begin_write( stream->outputStream, &bufferData, &bytes ) || !bufferData )
         {
-            if(isOutputCb && (pulseaudioOutputWritten < length) && !stream->missedBytes)
-            {
-                stream->missedBytes = length - pulseaudioOutputWritten;
-            }
-            else
-            {
-                stream->missedBytes = 0;
-            }
-            break;
+            PA_DEBUG( ("Portaudio %s: Can't get memory to write audio!\n",
+                      __FUNCTION__) );
+            return paNotInitialized;
         }
-        else if( pulseaudioOutputWritten >= length)
+
+        pieceFrames = bytes / stream->outputFrameSize;
+
+        /* Less than frame is useless so use scratch and make
+         * PulseAudio to copy it */
+        if( !pieceFrames )
         {
-            stream->missedBytes = 0;
-            break;
+            pa_stream_cancel_write( stream->outputStream );
+            bufferData = stream->outputScratch;
+            pieceFrames = 1;
         }
 
-        if(  stream->outputStream )
+        ret = _PaPulseAudio_ProcessFrames( stream, input, bufferData, pieceFrames );
+
+        if( pa_stream_write( stream->outputStream,
+                             bufferData,
+                             pieceFrames * stream->outputFrameSize,
+                             NULL,
+                             0,
+                             PA_SEEK_RELATIVE ) )
         {
-            PaPulseAudio_updateTimeInfo( stream->outputStream,
-                                         &timeInfo,
-                                         0 );
+            PA_DEBUG( ("Portaudio %s: Can't write audio!\n",
+                      __FUNCTION__) );
         }
 
-        if(  stream->inputStream )
+        /* Callback is done, don't ask it for the rest of the frames */
+        if( ret != paContinue )
         {
-            PaPulseAudio_updateTimeInfo( stream->inputStream,
-                                         &timeInfo,
-                                         1 );
+            break;
         }
 
-        PaUtil_BeginCpuLoadMeasurement( &stream->cpuLoadMeasurer );
-
-        /* When doing Portaudio Duplex one has to write and read same amount of data
-         * if not done that way Portaudio will go boo boo and nothing works.
-         * This is why this is done as it's done
-         *
-         * Pulseaudio does not care and this is something that needs small adjusting
-         */
-        PaUtil_BeginBufferProcessing( &stream->bufferProcessor,
-                                      &timeInfo,
-                                      0 );
-
-        /* Read of ther is something to read */
-        if( isInputCb )
+        if( input )
         {
-            PaUtil_ReadRingBuffer( &stream->inputRing,
-                                   pulseaudioSampleBuffer,
-                                   pulseaudioInputBytes);
-
-            PaUtil_SetInterleavedInputChannels( &stream->bufferProcessor,
-                                                0,
-                                                pulseaudioSampleBuffer,
-                                                stream->inputSampleSpec.channels );
-
-            PaUtil_SetInputFrameCount( &stream->bufferProcessor,
-                                       hostFramesPerBuffer );
+            input += pieceFrames * stream->inputFrameSize;
         }
+        frames -= pieceFrames;
+    }
 
-        if( isOutputCb )
-        {
+    return ret;
+}
 
-            size_t tmpSize = pulseaudioOutputBytes;
+/* Process every input fragment that is available in place from
+ * pa_stream_peek(). Only a frame split between two fragments is
+ * gathered to scratch buffer.
+ */
+static void _PaPulseAudio_ProcessInput( PaPulseAudio_Stream *stream )
+{
+    const void *pulseaudioData = NULL;
+    const uint8_t *fragment = NULL;
+    size_t length = 0;
+    size_t frames = 0;
+    size_t head = 0;
+    int ret = paContinue;
 
-            /* Allocate memory to make it faster to output stuff */
-            pa_stream_begin_write( stream->outputStream, &bufferData, &tmpSize );
+    while( !pa_stream_peek( stream->inputStream,
+                            &pulseaudioData,
+                            &length ) && length > 0 )
+    {
+        fragment = (const uint8_t *) pulseaudioData;
 
-            /* If bufferData is NULL then output is not ready
-             * and we have to wait for it
-             */
-            if(!bufferData)
+        /* NULL with length means hole in the stream, just skip it.
+         * Once callback is done rest of the input is dropped */
+        if( fragment && ret == paContinue )
+        {
+            if( stream->inputScratchBytes )
             {
-                return paNotInitialized;
-            }
+                head = stream->inputFrameSize - stream->inputScratchBytes;
+                if( head > length )
+                {
+                    head = length;
+                }
 
-            PaUtil_SetInterleavedOutputChannels( &stream->bufferProcessor,
-                                                 0,
-                                                 bufferData,
-                                                 stream->outputChannelCount );
+                memcpy( stream->inputScratch + stream->inputScratchBytes, fragment, head );
+                stream->inputScratchBytes += head;
+                fragment += head;
+                length -= head;
 
-            PaUtil_SetOutputFrameCount( &stream->bufferProcessor,
-                                        hostFramesPerBuffer );
+                if( stream->inputScratchBytes == stream->inputFrameSize )
+                {
+                    ret = _PaPulseAudio_ProcessAudio( stream, stream->inputScratch, 1 );
+                    stream->inputScratchBytes = 0;
+                }
+            }
 
-            if( pa_stream_write( stream->outputStream,
-                                 bufferData,
-                                 pulseaudioOutputBytes,
-                                 NULL,
-                                 0,
-                                 PA_SEEK_RELATIVE ) )
+            frames = length / stream->inputFrameSize;
+            if( frames && ret == paContinue )
             {
-                PA_DEBUG( ("Portaudio %s: Can't write audio!\n",
-                          __FUNCTION__) );
+                ret = _PaPulseAudio_ProcessAudio( stream, fragment, frames );
             }
 
-            pulseaudioOutputWritten += pulseaudioOutputBytes;
+            /* Keep the start of the frame that continues in the next fragment */
+            length -= frames * stream->inputFrameSize;
+            if( length && ret == paContinue )
+            {
+                memcpy( stream->inputScratch, fragment + frames * stream->inputFrameSize, length );
+                stream->inputScratchBytes = length;
+            }
         }
 
-        hostFrameCount =
-            PaUtil_EndBufferProcessing( &stream->bufferProcessor,
-                                        &ret );
-
-        PaUtil_EndCpuLoadMeasurement( &stream->cpuLoadMeasurer,
-                                      hostFrameCount );
+        pa_stream_drop( stream->inputStream );
     }
-
-    return ret;
 }
 
 void PaPulseAudio_StreamRecordCb( pa_stream * s,
@@ -451,17 +492,21 @@ void PaPulseAudio_StreamRecordCb( pa_stream * s,
 {
     PaPulseAudio_Stream *pulseaudioStream = (PaPulseAudio_Stream *) userdata;
 
-    _PaPulseAudio_Read( pulseaudioStream, length );
-
-    /* Let's handle when output happens if Duplex
+    /* Callback streams process input (and output if Duplex) in place.
      *
      * Also there is no callback there is no meaning to continue
      * as we have blocking reading
      */
     if( pulseaudioStream->bufferProcessor.streamCallback )
     {
-        _PaPulseAudio_ProcessAudio( pulseaudioStream, length );
+        _PaPulseAudio_ProcessInput( pulseaudioStream );
     }
+    else
+    {
+        _PaPulseAudio_Read( pulseaudioStream, length );
+    }
+
+    PaPulseAudio_AdaptiveLatencyTick( pulseaudioStream );
 
     pa_threaded_mainloop_signal( pulseaudioStream->mainloop,
                                  0 );
@@ -475,9 +520,13 @@ void PaPulseAudio_StreamPlaybackCb( pa_stream * s,
 
     if( pulseaudioStream->bufferProcessor.streamCallback )
     {
-        _PaPulseAudio_ProcessAudio( pulseaudioStream, length );
+        _PaPulseAudio_ProcessAudio( pulseaudioStream,
+                                    NULL,
+                                    length / pulseaudioStream->outputFrameSize );
     }
 
+    PaPulseAudio_AdaptiveLatencyTick( pulseaudioStream );
+
     pa_threaded_mainloop_signal( pulseaudioStream->mainloop,
                                  0 );
 }
@@ -524,7 +573,6 @@ PaError PaPulseAudio_CloseStreamCb( PaStream * s )
 {
     PaError result = paNoError;
     PaPulseAudio_Stream *stream = (PaPulseAudio_Stream *) s;
-    PaPulseAudio_HostApiRepresentation *pulseaudioHostApi = stream->hostapi;
     pa_operation *pulseaudioOperation = NULL;
     int waitLoop = 0;
     int pulseaudioError = 0;
@@ -546,7 +594,7 @@ PaError PaPulseAudio_CloseStreamCb( PaStream * s )
                                               stream );
         PaPulseAudio_UnLock( stream->mainloop );
 
-        PaPulseAudio_ReleaseOperation( pulseaudioHostApi,
+        PaPulseAudio_ReleaseOperation( stream->mainloop,
                                        &pulseaudioOperation );
 
         PaPulseAudio_Lock(stream->mainloop);
@@ -566,7 +614,7 @@ PaError PaPulseAudio_CloseStreamCb( PaStream * s )
                                               stream );
         PaPulseAudio_UnLock( stream->mainloop );
 
-        PaPulseAudio_ReleaseOperation( pulseaudioHostApi,
+        PaPulseAudio_ReleaseOperation( stream->mainloop,
                                        &pulseaudioOperation );
 
         PaPulseAudio_Lock( stream->mainloop );
@@ -612,9 +660,16 @@ PaError PaPulseAudio_CloseStreamCb( PaStream * s )
         usleep(10000);
     }
 
+    PaUtil_AtomicAddLong( &stream->shard->streamCount, -1 );
+
     PaUtil_TerminateBufferProcessor( &stream->bufferProcessor );
     PaUtil_TerminateStreamRepresentation( &stream->streamRepresentation );
 
+    PaPulseAudio_BlockingFreeRingBuffer( &stream->inputRing,
+                                         stream->inputRingLocked );
+
+    PaUtil_FreeMemory( stream->inputScratch );
+    PaUtil_FreeMemory( stream->outputScratch );
     PaUtil_FreeMemory( stream->inputStreamName );
     PaUtil_FreeMemory( stream->outputStreamName );
     PaUtil_FreeMemory( stream );
@@ -681,12 +736,21 @@ PaError PaPulseAudio_StartStreamCb( PaStream * s )
     stream->isStopped = 1;
     stream->pulseaudioIsActive = 1;
     stream->pulseaudioIsStopped = 0;
-    stream->missedBytes = 0;
+    stream->inputScratchBytes = 0;
+    stream->timingUpdateTime = 0.;
+    stream->outputAdaptTime = stream->inputAdaptTime = PaUtil_GetTime();
+
+    /* Adaptive mode starts from suggested latency but within its bounds */
+    if( stream->adaptiveLatency )
+    {
+        pulseaudioReqFrameSize = (unsigned int)
+            (PaPulseAudio_ClampAdaptiveLatency( stream, pulseaudioReqFrameSize / 1e6 ) * 1e6);
+    }
 
     /* Ready the processor */
     PaUtil_ResetBufferProcessor( &stream->bufferProcessor );
 
-    PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
+    PaPulseAudio_Lock( stream->mainloop );
     /* Adjust latencies if that is wanted
      * https://www.freedesktop.org/wiki/Software/PulseAudio/Documentation/Developer/Clients/LatencyControl/
      *
@@ -709,7 +773,8 @@ PaError PaPulseAudio_StartStreamCb( PaStream * s )
     stream->inputBufferAttr.minreq = (uint32_t)-1;
 
     stream->outputUnderflows = 0;
-    PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
+    stream->inputOverflows = 0;
+    PaPulseAudio_UnLock( stream->mainloop );
 
     pa_stream_flags_t pulseaudioStreamFlags = PA_STREAM_INTERPOLATE_TIMING |
                                  PA_STREAM_AUTO_TIMING_UPDATE |
@@ -753,7 +818,7 @@ PaError PaPulseAudio_StartStreamCb( PaStream * s )
 
         if ( result == paNoError )
         {
-            PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
+            PaPulseAudio_Lock( stream->mainloop );
             /* Zero means success */
             if( pa_stream_connect_record( stream->inputStream,
                                           pulseaudioName,
@@ -762,13 +827,13 @@ PaError PaPulseAudio_StartStreamCb( PaStream * s )
             {
                 PA_DEBUG( ("Portaudio %s: Can't read audio!\n",
                           __FUNCTION__) );
-                PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
+                PaPulseAudio_UnLock( stream->mainloop );
 
                 goto startstreamcb_error;
             }
-            PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
+            PaPulseAudio_UnLock( stream->mainloop );
 
-            if( _PaPulseAudio_WaitStreamState( pulseaudioHostApi->mainloop, stream->inputStream ) != paNoError )
+            if( _PaPulseAudio_WaitStreamState( stream->mainloop, stream->inputStream ) != paNoError )
             {
                 goto startstreamcb_error;
             }
@@ -795,14 +860,14 @@ PaError PaPulseAudio_StartStreamCb( PaStream * s )
         if( pa_stream_get_state( stream->outputStream ) == PA_STREAM_READY
             && pa_stream_is_corked( stream->outputStream ) )
         {
-            PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
+            PaPulseAudio_Lock( stream->mainloop );
             pulseaudioOperation = pa_stream_cork( stream->outputStream,
                                             0,
                                             PaPulseAudio_CorkSuccessCb,
                                             stream );
-            PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
+            PaPulseAudio_UnLock( stream->mainloop );
 
-            PaPulseAudio_ReleaseOperation( pulseaudioHostApi,
+            PaPulseAudio_ReleaseOperation( stream->mainloop,
                                            &pulseaudioOperation );
         }
         else
@@ -833,13 +898,16 @@ PaError PaPulseAudio_StartStreamCb( PaStream * s )
 
             if(result == paNoError)
             {
-                PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
+                PaPulseAudio_Lock( stream->mainloop );
 
                 /* This is only needed when making non duplex
                  * as when duplexing then input should feed
-                 * output and we don't need playback callback
+                 * output and we don't need playback callback.
+                 * Blocking streams always need it as it wakes up
+                 * writer waiting for space in PulseAudio buffer
                  */
-                if( !stream->inputStream )
+                if( !stream->inputStream ||
+                    !stream->bufferProcessor.streamCallback )
                 {
                     pa_stream_set_write_callback( stream->outputStream,
                                                   PaPulseAudio_StreamPlaybackCb,
@@ -855,12 +923,12 @@ PaError PaPulseAudio_StartStreamCb( PaStream * s )
                 {
                     PA_DEBUG( ("Portaudio %s: Can't write audio!\n",
                               __FUNCTION__) );
-                    PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
+                    PaPulseAudio_UnLock( stream->mainloop );
                     goto startstreamcb_error;
                 }
-                PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
+                PaPulseAudio_UnLock( stream->mainloop );
 
-                if( _PaPulseAudio_WaitStreamState( pulseaudioHostApi->mainloop, stream->outputStream ) != paNoError )
+                if( _PaPulseAudio_WaitStreamState( stream->mainloop, stream->outputStream ) != paNoError )
                 {
                     goto startstreamcb_error;
                 }
@@ -888,6 +956,11 @@ PaError PaPulseAudio_StartStreamCb( PaStream * s )
     stream->isActive = 1;
     stream->isStopped = 0;
 
+    if( stream->adaptiveLatency )
+    {
+        PaPulseAudio_UpdateStreamLatency( stream );
+    }
+
     /* Start callback here after we can be
      * sure that everything is correct
      */
@@ -923,10 +996,9 @@ static PaError RequestStop( PaPulseAudio_Stream * stream,
                      int abort )
 {
     PaError ret = paNoError;
-    PaPulseAudio_HostApiRepresentation *pulseaudioHostApi = stream->hostapi;
     pa_operation *pulseaudioOperation = NULL;
 
-    PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
+    PaPulseAudio_Lock( stream->mainloop );
 
     /* Wait for stream to be stopped */
     stream->isActive = 0;
@@ -934,8 +1006,6 @@ static PaError RequestStop( PaPulseAudio_Stream * stream,
     stream->pulseaudioIsActive = 0;
     stream->pulseaudioIsStopped = 1;
 
-    stream->missedBytes = 0;
-
     /* Test if there is something that we can play */
     if( stream->outputStream
         && pa_stream_get_state( stream->outputStream ) == PA_STREAM_READY
@@ -947,14 +1017,14 @@ static PaError RequestStop( PaPulseAudio_Stream * stream,
                                               PaPulseAudio_CorkSuccessCb,
                                               stream );
 
-        PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
-        PaPulseAudio_ReleaseOperation( pulseaudioHostApi,
+        PaPulseAudio_UnLock( stream->mainloop );
+        PaPulseAudio_ReleaseOperation( stream->mainloop,
                                        &pulseaudioOperation );
-        PaPulseAudio_Lock( pulseaudioHostApi->mainloop );
+        PaPulseAudio_Lock( stream->mainloop );
     }
 
     requeststop_error:
-    PaPulseAudio_UnLock( pulseaudioHostApi->mainloop );
+    PaPulseAudio_UnLock( stream->mainloop );
     stream->isActive = 0;
     stream->isStopped = 1;
     stream->pulseaudioIsActive = 0;
@@ -79,11 +79,32 @@ extern "C"
 /* Just some value that Pulseaudio can handle */
 #define PAPULSEAUDIO_FRAMESPERBUFFERUNSPEC 32
 
-/* Assuming of 2 seconds of 44100 Hz sample rate with FLOAT (4 bytes) and stereo channels (2 channels).
-   You should have pretty good size buffer with this. If output/intput doesn't happens in 2 second we
-   have more trouble than this buffer.
-   @todo change this to something more sophisticated */
-#define PULSEAUDIO_BUFFER_SIZE (96100 * 4 * 2)
+/* Blocking writes ask PulseAudio for fresh timing info at most this often (seconds) */
+#define PA_PULSEAUDIO_TIMING_UPDATE_INTERVAL 0.020
+
+/* Adaptive latency, see PaPulseAudio_SetAdaptiveLatency(). Buffering grows
+ * by GROW after an underflow (overflow for input), at most once per
+ * GROW_INTERVAL seconds, and shrinks by SHRINK after SHRINK_INTERVAL seconds
+ * without one.
+ */
+#define PA_PULSEAUDIO_ADAPTIVE_GROW 1.5
+#define PA_PULSEAUDIO_ADAPTIVE_GROW_INTERVAL 0.250
+#define PA_PULSEAUDIO_ADAPTIVE_SHRINK 0.8
+#define PA_PULSEAUDIO_ADAPTIVE_SHRINK_INTERVAL 10.0
+
+/* Upper limit for PA_PULSEAUDIO_SHARDS */
+#define PA_PULSEAUDIO_MAX_SHARDS 16
+
+/* Mainloop thread with its own server connection. Every stream lives
+ * on one shard and takes only that shard's lock.
+ */
+typedef struct
+{
+    pa_threaded_mainloop *mainloop;
+    pa_context *context;
+    volatile long streamCount;  /* only changed with PaUtil_AtomicAddLong() */
+}
+PaPulseAudio_Shard;
 
 typedef struct
 {
@@ -104,6 +125,12 @@ typedef struct
     pa_context *context;
     int deviceCount;
     pa_time_event *timeEvent;
+
+    /* First shard is mainloop and context above, rest are
+     * created when PA_PULSEAUDIO_SHARDS asks for them
+     */
+    PaPulseAudio_Shard shards[PA_PULSEAUDIO_MAX_SHARDS];
+    int shardCount;
 }
 PaPulseAudio_HostApiRepresentation;
 
@@ -115,6 +142,7 @@ typedef struct PaPulseAudio_Stream
     PaUtilCpuLoadMeasurer cpuLoadMeasurer;
     PaUtilBufferProcessor bufferProcessor;
     PaPulseAudio_HostApiRepresentation *hostapi;
+    PaPulseAudio_Shard *shard;
 
     unsigned long framesPerHostCallback;
     pa_threaded_mainloop *mainloop;
@@ -127,6 +155,7 @@ typedef struct PaPulseAudio_Stream
     pa_buffer_attr inputBufferAttr;
     unsigned int suggestedLatencyUSecs;
     int outputUnderflows;
+    int inputOverflows;
     int outputChannelCount;
     int inputChannelCount;
 
@@ -141,9 +170,27 @@ typedef struct PaPulseAudio_Stream
     char *outputStreamName;
     char *inputStreamName;
 
+    /* Input of blocking streams, callback streams process it straight from pa_stream_peek() */
     PaUtilRingBuffer inputRing;
+    int inputRingLocked;
+
+    /* Callback streams: a frame of input split between two fragments, and a frame of
+     * output for when PulseAudio hands out less than a frame to write to */
+    uint8_t *inputScratch;
+    size_t inputScratchBytes;
+    uint8_t *outputScratch;
 
-    size_t missedBytes;
+    /* Blocking streams: when the last timing info update was requested */
+    PaTime timingUpdateTime;
+
+    /* Adaptive latency bounds in seconds and when buffering of
+     * each direction was last changed or found too small
+     */
+    int adaptiveLatency;
+    PaTime adaptiveMinLatency;
+    PaTime adaptiveMaxLatency;
+    PaTime outputAdaptTime;
+    PaTime inputAdaptTime;
 
     /* Used in communication between threads
      *
@@ -200,7 +247,7 @@ PaPulseAudio_Stream;
         return paStreamIsStopped; \
     }
 
-void PaPulseAudio_ReleaseOperation(PaPulseAudio_HostApiRepresentation *hostapi,
+void PaPulseAudio_ReleaseOperation(pa_threaded_mainloop *mainloop,
                                   pa_operation **pulseaudioOperation);
 
 void PaPulseAudio_Lock( pa_threaded_mainloop *mainloop );
@@ -239,6 +286,13 @@ void PaPulseAudio_Free( PaPulseAudio_HostApiRepresentation * ptr );
 
 int PaPulseAudio_CheckConnection( PaPulseAudio_HostApiRepresentation * ptr );
 
+PaError PaPulseAudio_BlockingInitRingBuffer( PaUtilRingBuffer * rbuf,
+                                             int size,
+                                             int lockMemory,
+                                             int *locked );
+void PaPulseAudio_BlockingFreeRingBuffer( PaUtilRingBuffer * rbuf,
+                                          int locked );
+
 void PaPulseAudio_CheckContextStateCb( pa_context * c,
                                        void *userdata );
 void PaPulseAudio_ServerInfoCb( pa_context *c,
@@ -264,6 +318,16 @@ void PaPulseAudio_StreamStartedCb( pa_stream * s,
 void PaPulseAudio_StreamUnderflowCb( pa_stream * s,
                                      void *userdata );
 
+void PaPulseAudio_StreamOverflowCb( pa_stream * s,
+                                    void *userdata );
+
+PaTime PaPulseAudio_ClampAdaptiveLatency( PaPulseAudio_Stream * stream,
+                                          PaTime latency );
+
+void PaPulseAudio_AdaptiveLatencyTick( PaPulseAudio_Stream * stream );
+
+void PaPulseAudio_UpdateStreamLatency( PaPulseAudio_Stream * stream );
+
 PaError PaPulseAudio_ConvertPortaudioFormatToPaPulseAudio_( PaSampleFormat portaudiosf,
                                                             pa_sample_spec * pulseaudiosf
 );
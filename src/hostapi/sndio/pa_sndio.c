@@ -29,6 +29,7 @@
 #include "pa_hostapi.h"
 #include "pa_process.h"
 #include "pa_stream.h"
+#include "pa_trace.h"
 #include "pa_util.h"
 
 /*
@@ -44,8 +45,8 @@ typedef struct PaSndioStream
     int stopped; /* stop requested or not started */
     int active; /* thread is running */
     unsigned long long realpos; /* frame number h/w is processing */
-    char *rbuf, *wbuf; /* bounce buffers for conversions */
-    unsigned long long rpos, wpos; /* bytes read/written */
+    char *rbuf, *wbuf; /* host buffers, unless the user's are used directly */
+    unsigned long long rpos, wpos; /* frames read/written */
     pthread_t thread; /* thread of the callback interface */
 } PaSndioStream;
 
@@ -160,66 +161,95 @@ static int sndioGetFmt( struct sio_par *par, PaSampleFormat *fmt )
 }
 
 /*
- * I/O loop for callback interface
+ * read the given number of frames, return true on success
+ */
+static int sndioRead( PaSndioStream *sndioStream, void *data, unsigned long frames )
+{
+    size_t n, todo = (size_t)frames * sndioStream->par.rchan * sndioStream->par.bps;
+
+    while( todo > 0 )
+    {
+        n = sio_read( sndioStream->hdl, data, todo );
+        if( n == 0 )
+            return 0;
+        data = (char *)data + n;
+        todo -= n;
+    }
+    sndioStream->rpos += frames;
+    return 1;
+}
+
+/*
+ * write the given number of frames, return true on success
+ */
+static int sndioWrite( PaSndioStream *sndioStream, const void *data, unsigned long frames )
+{
+    size_t n, todo = (size_t)frames * sndioStream->par.pchan * sndioStream->par.bps;
+
+    while( todo > 0 )
+    {
+        n = sio_write( sndioStream->hdl, data, todo );
+        if( n == 0 )
+            return 0;
+        data = (const char *)data + n;
+        todo -= n;
+    }
+    sndioStream->wpos += frames;
+    return 1;
+}
+
+/*
+ * I/O loop for callback interface: blocks go straight between the
+ * device and the host buffers the buffer processor works on, which
+ * hands them to the callback as they are if no conversion is needed
  */
 static void *sndioThread( void *arg )
 {
     PaSndioStream *sndioStream = (PaSndioStream *)arg;
-    PaStreamCallbackTimeInfo timeInfo;
-    unsigned char *data;
-    unsigned todo, rblksz, wblksz;
+    PaStreamCallbackTimeInfo timeInfo = { 0, 0, 0 };
+    double rate = sndioStream->par.rate;
+    unsigned round = sndioStream->par.round;
     int n, result;
 
-    rblksz = sndioStream->par.round * sndioStream->par.rchan * sndioStream->par.bps;
-    wblksz = sndioStream->par.round * sndioStream->par.pchan * sndioStream->par.bps;
-
-    PA_DEBUG( ( "sndioThread: mode = %x, round = %u, rblksz = %u, wblksz = %u\n", sndioStream->mode,
-                sndioStream->par.round, rblksz, wblksz ) );
+    PA_DEBUG( ( "sndioThread: mode = %x, round = %u\n", sndioStream->mode, round ) );
+    PA_TRACE_REGISTER_NAMED_THREAD( "sndio callback" );
 
     while( !sndioStream->stopped )
     {
         if( sndioStream->mode & SIO_REC )
         {
-            todo = rblksz;
-            data = sndioStream->rbuf;
-            while( todo > 0 )
+            if( !sndioRead( sndioStream, sndioStream->rbuf, round ) )
             {
-                n = sio_read( sndioStream->hdl, data, todo );
-                if( n == 0 )
-                {
-                    PA_DEBUG( ( "sndioThread: sio_read failed\n" ) );
-                    goto failed;
-                }
-                todo -= n;
-                data += n;
+                PA_DEBUG( ( "sndioThread: sio_read failed\n" ) );
+                goto failed;
             }
-            sndioStream->rpos += sndioStream->par.round;
-            timeInfo.inputBufferAdcTime = (double)sndioStream->realpos / sndioStream->par.rate;
+            /* the block just read started at frame rpos - round */
+            timeInfo.inputBufferAdcTime = (double)( sndioStream->rpos - round ) / rate;
         }
         if( sndioStream->mode & SIO_PLAY )
         {
-            timeInfo.outputBufferDacTime =
-                (double)( sndioStream->realpos + sndioStream->par.bufsz ) / sndioStream->par.rate;
+            /* everything written so far is played before this block */
+            timeInfo.outputBufferDacTime = (double)sndioStream->wpos / rate;
         }
-        timeInfo.currentTime = sndioStream->realpos / (double)sndioStream->par.rate;
+        timeInfo.currentTime = sndioStream->realpos / rate;
         PaUtil_BeginBufferProcessing( &sndioStream->bufferProcessor, &timeInfo, 0 );
         if( sndioStream->mode & SIO_PLAY )
         {
-            PaUtil_SetOutputFrameCount( &sndioStream->bufferProcessor, sndioStream->par.round );
+            PaUtil_SetOutputFrameCount( &sndioStream->bufferProcessor, round );
             PaUtil_SetInterleavedOutputChannels( &sndioStream->bufferProcessor, 0, sndioStream->wbuf,
                                                  sndioStream->par.pchan );
         }
         if( sndioStream->mode & SIO_REC )
         {
-            PaUtil_SetInputFrameCount( &sndioStream->bufferProcessor, sndioStream->par.round );
+            PaUtil_SetInputFrameCount( &sndioStream->bufferProcessor, round );
             PaUtil_SetInterleavedInputChannels( &sndioStream->bufferProcessor, 0, sndioStream->rbuf,
                                                 sndioStream->par.rchan );
         }
         result = paContinue;
         n = PaUtil_EndBufferProcessing( &sndioStream->bufferProcessor, &result );
-        if( n != sndioStream->par.round )
+        if( (unsigned)n != round )
         {
-            PA_DEBUG( ( "sndioThread: %d < %u frames, result = %d\n", n, sndioStream->par.round, result ) );
+            PA_DEBUG( ( "sndioThread: %d < %u frames, result = %d\n", n, round, result ) );
         }
         if( result != paContinue )
         {
@@ -227,17 +257,16 @@ static void *sndioThread( void *arg )
         }
         if( sndioStream->mode & SIO_PLAY )
         {
-            n = sio_write( sndioStream->hdl, sndioStream->wbuf, wblksz );
-            if( n < wblksz )
+            if( !sndioWrite( sndioStream, sndioStream->wbuf, round ) )
             {
                 PA_DEBUG( ( "sndioThread: sio_write failed\n" ) );
                 goto failed;
             }
-            sndioStream->wpos += sndioStream->par.round;
         }
     }
 failed:
     sndioStream->active = 0;
+    PaUtil_UnregisterTraceThread();
     PA_DEBUG( ( "sndioThread: done\n" ) );
     return NULL;
 }
@@ -365,6 +394,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi, PaStream
         sio_close( hdl );
         return paInsufficientMemory;
     }
+    sio_onmove( hdl, sndioOnMove, sndioStream );
     PaUtil_InitializeStreamRepresentation( &sndioStream->base,
                                            streamCallback ? &sndioHostApi->callback : &sndioHostApi->blocking,
                                            streamCallback, userData );
@@ -405,7 +435,15 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi, PaStream
             return paInsufficientMemory;
         }
     }
-    sndioStream->base.streamInfo.inputLatency = 0;
+    /*
+     * a recorded block is read once complete, a played one after the
+     * whole buffer, see the time info in sndioThread
+     */
+    sndioStream->base.streamInfo.inputLatency =
+        ( mode & SIO_REC )
+            ? (double)( par.round + PaUtil_GetBufferProcessorInputLatencyFrames( &sndioStream->bufferProcessor ) ) /
+                  (double)par.rate
+            : 0;
     sndioStream->base.streamInfo.outputLatency =
         ( mode & SIO_PLAY )
             ? (double)( par.bufsz + PaUtil_GetBufferProcessorOutputLatencyFrames( &sndioStream->bufferProcessor ) ) /
@@ -425,32 +463,26 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi, PaStream
 static PaError BlockingReadStream( PaStream *paStream, void *data, unsigned long numFrames )
 {
     PaSndioStream *sndioStream = (PaSndioStream *)paStream;
-    unsigned n, res, todo;
-    void *buf;
+    PaUtilBufferProcessor *bp = &sndioStream->bufferProcessor;
+    unsigned n, res;
+
+    /* read straight into the user buffer if there's nothing to convert */
+    if( bp->userInputSampleFormatIsEqualToHost && bp->userInputIsInterleaved )
+        return sndioRead( sndioStream, data, numFrames ) ? paNoError : paUnanticipatedHostError;
 
     while( numFrames > 0 )
     {
         n = sndioStream->par.round;
         if( n > numFrames )
             n = numFrames;
-        buf = sndioStream->rbuf;
-        todo = n * sndioStream->par.rchan * sndioStream->par.bps;
-        while( todo > 0 )
-        {
-            res = sio_read( sndioStream->hdl, buf, todo );
-            if( res == 0 )
-                return paUnanticipatedHostError;
-            buf = (char *)buf + res;
-            todo -= res;
-        }
-        sndioStream->rpos += n;
-        PaUtil_SetInputFrameCount( &sndioStream->bufferProcessor, n );
-        PaUtil_SetInterleavedInputChannels( &sndioStream->bufferProcessor, 0, sndioStream->rbuf,
-                                            sndioStream->par.rchan );
-        res = PaUtil_CopyInput( &sndioStream->bufferProcessor, &data, n );
+        if( !sndioRead( sndioStream, sndioStream->rbuf, n ) )
+            return paUnanticipatedHostError;
+        PaUtil_SetInputFrameCount( bp, n );
+        PaUtil_SetInterleavedInputChannels( bp, 0, sndioStream->rbuf, sndioStream->par.rchan );
+        res = PaUtil_CopyInput( bp, &data, n );
         if( res != n )
         {
-            PA_DEBUG( ( "BlockingReadStream: copyInput: %u != %u\n" ) );
+            PA_DEBUG( ( "BlockingReadStream: copyInput: %u != %u\n", res, n ) );
             return paUnanticipatedHostError;
         }
         numFrames -= n;
@@ -461,26 +493,28 @@ static PaError BlockingReadStream( PaStream *paStream, void *data, unsigned long
 static PaError BlockingWriteStream( PaStream *paStream, const void *data, unsigned long numFrames )
 {
     PaSndioStream *sndioStream = (PaSndioStream *)paStream;
+    PaUtilBufferProcessor *bp = &sndioStream->bufferProcessor;
     unsigned n, res;
 
+    /* write straight from the user buffer if there's nothing to convert */
+    if( bp->userOutputSampleFormatIsEqualToHost && bp->userOutputIsInterleaved )
+        return sndioWrite( sndioStream, data, numFrames ) ? paNoError : paUnanticipatedHostError;
+
     while( numFrames > 0 )
     {
         n = sndioStream->par.round;
         if( n > numFrames )
             n = numFrames;
-        PaUtil_SetOutputFrameCount( &sndioStream->bufferProcessor, n );
-        PaUtil_SetInterleavedOutputChannels( &sndioStream->bufferProcessor, 0, sndioStream->wbuf,
-                                             sndioStream->par.pchan );
-        res = PaUtil_CopyOutput( &sndioStream->bufferProcessor, &data, n );
+        PaUtil_SetOutputFrameCount( bp, n );
+        PaUtil_SetInterleavedOutputChannels( bp, 0, sndioStream->wbuf, sndioStream->par.pchan );
+        res = PaUtil_CopyOutput( bp, &data, n );
         if( res != n )
         {
-            PA_DEBUG( ( "BlockingWriteStream: copyOutput: %u != %u\n" ) );
+            PA_DEBUG( ( "BlockingWriteStream: copyOutput: %u != %u\n", res, n ) );
             return paUnanticipatedHostError;
         }
-        res = sio_write( sndioStream->hdl, sndioStream->wbuf, n * sndioStream->par.pchan * sndioStream->par.bps );
-        if( res == 0 )
+        if( !sndioWrite( sndioStream, sndioStream->wbuf, n ) )
             return paUnanticipatedHostError;
-        sndioStream->wpos += n;
         numFrames -= n;
     }
     return paNoError;
@@ -544,7 +578,7 @@ static PaError BlockingWaitEmpty( PaStream *paStream )
 static PaError StartStream( PaStream *paStream )
 {
     PaSndioStream *sndioStream = (PaSndioStream *)paStream;
-    unsigned primes, wblksz;
+    unsigned primes;
     int err;
 
     PA_DEBUG( ( "StartStream: s=%d, a=%d\n", sndioStream->stopped, sndioStream->active ) );
@@ -568,10 +602,12 @@ static PaError StartStream( PaStream *paStream )
      */
     if( sndioStream->mode & SIO_PLAY )
     {
-        wblksz = sndioStream->par.round * sndioStream->par.pchan * sndioStream->par.bps;
-        memset( sndioStream->wbuf, 0, wblksz );
+        memset( sndioStream->wbuf, 0, sndioStream->par.round * sndioStream->par.pchan * sndioStream->par.bps );
         for( primes = sndioStream->par.bufsz / sndioStream->par.round; primes > 0; primes-- )
-            sndioStream->wpos += sio_write( sndioStream->hdl, sndioStream->wbuf, wblksz );
+        {
+            if( !sndioWrite( sndioStream, sndioStream->wbuf, sndioStream->par.round ) )
+                return paUnanticipatedHostError;
+        }
     }
     if( sndioStream->base.streamCallback )
     {
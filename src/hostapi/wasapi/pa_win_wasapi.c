@@ -109,6 +109,7 @@
 #include "pa_process.h"
 #include "pa_debugprint.h"
 #include "pa_ringbuffer.h"
+#include "pa_trace.h"
 #include "pa_win_version.h"
 #include "pa_win_coinitialize.h"
 #include "pa_win_wasapi.h"
@@ -4132,6 +4133,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
 
     // Initialize CPU measurer
     PaUtil_InitializeCpuLoadMeasurer(&stream->cpuLoadMeasurer, sampleRate);
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
     if (outputParameters && inputParameters)
     {
@@ -5947,6 +5949,9 @@ PA_THREAD_FUNC ProcThreadEvent(void *param)
     // Boost thread priority
     PaWasapi_ThreadPriorityBoost((void **)&stream->hAvTask, stream->nThreadPriority);
 
+    // Trace events of this thread, before processing starts
+    PA_TRACE_REGISTER_NAMED_THREAD("WASAPI processing");
+
     // Create events
     if (stream->event[S_OUTPUT] == NULL)
     {
@@ -6080,6 +6085,9 @@ thread_end:
     // Release unmarshaled COM pointers
     FinishComPointers(stream, threadComInitialized);
 
+    // Release trace ring
+    PaUtil_UnregisterTraceThread();
+
     // Notify: stream inactive
     stream->isActive = FALSE;
 
@@ -6239,6 +6247,9 @@ PA_THREAD_FUNC ProcThreadPoll(void *param)
     // Boost thread priority
     PaWasapi_ThreadPriorityBoost((void **)&stream->hAvTask, stream->nThreadPriority);
 
+    // Trace events of this thread, before processing starts
+    PA_TRACE_REGISTER_NAMED_THREAD("WASAPI processing");
+
     // Signal: stream active (reconfirm)
     stream->isActive = TRUE;
 
@@ -6557,6 +6568,9 @@ thread_end:
     // Release unmarshaled COM pointers
     FinishComPointers(stream, threadComInitialized);
 
+    // Release trace ring
+    PaUtil_UnregisterTraceThread();
+
     // Notify: state inactive
     stream->isActive = FALSE;
 
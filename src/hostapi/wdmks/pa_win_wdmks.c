@@ -110,7 +110,7 @@ of a device for the duration of active stream using those devices
 /* The PA_HP_TRACE macro is used in RT parts, so it can be switched off without affecting
 the rest of the debug tracing */
 #if 1
-#define PA_HP_TRACE(x)  PaUtil_AddHighSpeedLogMessage x ;
+#define PA_HP_TRACE(x)  PA_TRACE_EVENT x ;
 #else
 #define PA_HP_TRACE(x)
 #endif
@@ -389,10 +389,6 @@ struct __PaWinWdmStream
     PaUtilCpuLoadMeasurer       cpuLoadMeasurer;
     PaUtilBufferProcessor       bufferProcessor;
 
-#if PA_TRACE_REALTIME_EVENTS
-    LogHandle                   hLog;
-#endif
-
     PaUtilAllocationGroup*      allocGroup;
     PaWinWdmIOInfo              capture;
     PaWinWdmIOInfo              render;
@@ -4439,6 +4435,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     }
 
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, sampleRate );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
     /* Instantiate the input pin if necessary */
     if(userInputChannels > 0)
@@ -5702,7 +5699,7 @@ static PaError PaDoProcessing(PaProcessThreadInfo* pInfo)
     {
         unsigned processFullDuplex = pInfo->stream->capture.pPin && pInfo->stream->render.pPin && (!pInfo->priming);
 
-        PA_HP_TRACE((pInfo->stream->hLog, "DoProcessing: InputFrames=%u", inputFramesAvailable));
+        PA_HP_TRACE(("DoProcessing: InputFrames=%lu", inputFramesAvailable, 0, 0, 0));
 
         PaUtil_BeginCpuLoadMeasurement( &pInfo->stream->cpuLoadMeasurer );
 
@@ -5775,7 +5772,7 @@ static PaError PaDoProcessing(PaProcessThreadInfo* pInfo)
             /* If we have full-duplex, this is at startup, so mark no-input! */
             if (pInfo->stream->userOutputChannels>0 && pInfo->stream->userInputChannels>0)
             {
-                PA_HP_TRACE((pInfo->stream->hLog, "Input startup, marking no input."));
+                PA_HP_TRACE(("Input startup, marking no input.", 0, 0, 0, 0));
                 PaUtil_SetNoInput(&pInfo->stream->bufferProcessor);
             }
         }
@@ -5800,7 +5797,7 @@ static PaError PaDoProcessing(PaProcessThreadInfo* pInfo)
             framesProcessed = PaUtil_EndBufferProcessing(&pInfo->stream->bufferProcessor, &pInfo->cbResult);
         }
 
-        PA_HP_TRACE((pInfo->stream->hLog, "Frames processed: %u %s", framesProcessed, (pInfo->priming ? "(priming)":"")));
+        PA_HP_TRACE(("Frames processed: %lu priming=%ld", framesProcessed, pInfo->priming, 0, 0));
 
         if( doChannelCopy )
         {
@@ -5836,7 +5833,7 @@ static PaError PaDoProcessing(PaProcessThreadInfo* pInfo)
                 result = pInfo->stream->render.pPin->fnSubmitHandler(pInfo, pInfo->renderTail);
                 if (result != paNoError)
                 {
-                    PA_HP_TRACE((pInfo->stream->hLog, "Capture submit handler failed with result %d", result));
+                    PA_HP_TRACE(("Capture submit handler failed with result %ld", result, 0, 0, 0));
                     return result;
                 }
             }
@@ -5846,7 +5843,7 @@ static PaError PaDoProcessing(PaProcessThreadInfo* pInfo)
                 /* We start the pins here to allow "prime time" */
                 if ((result = StartPins(pInfo)) == paNoError)
                 {
-                    PA_HP_TRACE((pInfo->stream->hLog, "Starting pins!"));
+                    PA_HP_TRACE(("Starting pins!", 0, 0, 0, 0));
                     pInfo->pinsStarted = 1;
                 }
             }
@@ -5947,12 +5944,7 @@ PA_THREAD_FUNC ProcessingThread(void* pParam)
         goto error;
     }
 
-    /* Init high speed logger */
-    if (PaUtil_InitializeHighSpeedLog(&info.stream->hLog, 1000000) != paNoError)
-    {
-        PA_DEBUG(("Failed to init high speed logger!\n"));
-        goto error;
-    }
+    PA_TRACE_REGISTER_NAMED_THREAD("WDM-KS processing");
 
     /* Heighten priority here */
     hAVRT = BumpThreadPriority();
@@ -6038,7 +6030,7 @@ PA_THREAD_FUNC ProcessingThread(void* pParam)
             {
                 if (PaUtil_GetRingBufferWriteAvailable(&info.stream->ringBuffer) == 0)
                 {
-                    PA_HP_TRACE((info.stream->hLog, "!!!!! Input overflow !!!!!"));
+                    PA_HP_TRACE(("!!!!! Input overflow !!!!!", 0, 0, 0, 0));
                     info.underover |= paInputOverflow;
                 }
             }
@@ -6046,7 +6038,7 @@ PA_THREAD_FUNC ProcessingThread(void* pParam)
             {
                 if (!info.priming && info.renderHead - info.renderTail > 1)
                 {
-                    PA_HP_TRACE((info.stream->hLog, "!!!!! Output underflow !!!!!"));
+                    PA_HP_TRACE(("!!!!! Output underflow !!!!!", 0, 0, 0, 0));
                     info.underover |= paOutputUnderflow;
                 }
             }
@@ -6073,7 +6065,7 @@ PA_THREAD_FUNC ProcessingThread(void* pParam)
         if (wait == WAIT_IO_COMPLETION)
         {
             /* Waitable timer has fired! */
-            PA_HP_TRACE((info.stream->hLog, "WAIT_IO_COMPLETION"));
+            PA_HP_TRACE(("WAIT_IO_COMPLETION", 0, 0, 0, 0));
             continue;
         }
 
@@ -6095,7 +6087,7 @@ PA_THREAD_FUNC ProcessingThread(void* pParam)
                         result = info.stream->capture.pPin->fnSubmitHandler(&info, info.captureTail);
                         if (result != paNoError)
                         {
-                            PA_HP_TRACE((info.stream->hLog, "Capture submit handler failed with result %d", result));
+                            PA_HP_TRACE(("Capture submit handler failed with result %ld", result, 0, 0, 0));
                             break;
                         }
                     }
@@ -6117,7 +6109,7 @@ PA_THREAD_FUNC ProcessingThread(void* pParam)
             else
             {
                 assert(info.stream->streamAbort);
-                PA_HP_TRACE((info.stream->hLog, "Stream abort!"));
+                PA_HP_TRACE(("Stream abort!", 0, 0, 0, 0));
                 continue;
             }
         }
@@ -6128,25 +6120,25 @@ PA_THREAD_FUNC ProcessingThread(void* pParam)
             result = PaDoProcessing(&info);
             if (result != paNoError)
             {
-                PA_HP_TRACE((info.stream->hLog, "PaDoProcessing failed!"));
+                PA_HP_TRACE(("PaDoProcessing failed!", 0, 0, 0, 0));
                 break;
             }
         }
 
         if(info.stream->streamStop && info.cbResult != paComplete)
         {
-            PA_HP_TRACE((info.stream->hLog, "Stream stop! pending=%d",info.pending));
+            PA_HP_TRACE(("Stream stop! pending=%ld", info.pending, 0, 0, 0));
             info.cbResult = paComplete; /* Stop, but play remaining buffers */
         }
 
         if(info.pending<=0)
         {
-            PA_HP_TRACE((info.stream->hLog, "pending==0 finished..."));
+            PA_HP_TRACE(("pending==0 finished...", 0, 0, 0, 0));
             break;
         }
         if((!info.stream->render.pPin)&&(info.cbResult!=paContinue))
         {
-            PA_HP_TRACE((info.stream->hLog, "record only cbResult=%d...",info.cbResult));
+            PA_HP_TRACE(("record only cbResult=%ld...", info.cbResult, 0, 0, 0));
             break;
         }
     }
@@ -6184,15 +6176,7 @@ bailout:
         PaUtil_FreeMemory(handleArray);
     }
 
-#if PA_TRACE_REALTIME_EVENTS
-    if (info.stream->hLog)
-    {
-        PA_DEBUG(("Dumping highspeed trace...\n"));
-        PaUtil_DumpHighSpeedLog(info.stream->hLog, "hp_trace.log");
-        PaUtil_DiscardHighSpeedLog(info.stream->hLog);
-        info.stream->hLog = 0;
-    }
-#endif
+    PaUtil_UnregisterTraceThread();
     info.stream->streamActive = 0;
 
     if((!info.stream->streamStop)&&(!info.stream->streamAbort))
@@ -6512,7 +6496,7 @@ static PaError PaPinCaptureEventHandler_WaveCyclic(PaProcessThreadInfo* pInfo, u
 
     if (packet->Header.DataUsed == 0)
     {
-        PA_HP_TRACE((pInfo->stream->hLog, ">>> Capture bogus event (no data): idx=%u", eventIndex));
+        PA_HP_TRACE((">>> Capture bogus event (no data): idx=%lu", eventIndex, 0, 0, 0));
 
         /* Bogus event, reset! This is to handle the behavior of this USB mic: http://shop.xtz.se/measurement-system/microphone-to-dirac-live-room-correction-suite
            on startup of streaming, where it erroneously sets the event without the corresponding buffer being filled (DataUsed == 0) */
@@ -6526,7 +6510,7 @@ static PaError PaPinCaptureEventHandler_WaveCyclic(PaProcessThreadInfo* pInfo, u
 
         frameCount = PaUtil_WriteRingBuffer(&pInfo->stream->ringBuffer, packet->Header.Data, pInfo->stream->capture.framesPerBuffer);
 
-        PA_HP_TRACE((pInfo->stream->hLog, ">>> Capture event: idx=%u (frames=%u)", eventIndex, frameCount));
+        PA_HP_TRACE((">>> Capture event: idx=%lu (frames=%lu)", eventIndex, frameCount, 0, 0));
         ++pInfo->captureHead;
     }
 
@@ -6540,7 +6524,7 @@ static PaError PaPinCaptureSubmitHandler_WaveCyclic(PaProcessThreadInfo* pInfo,
     DATAPACKET* packet = pInfo->capturePackets[pInfo->captureTail & cPacketsArrayMask].packet;
     pInfo->capturePackets[pInfo->captureTail & cPacketsArrayMask].packet = 0;
     assert(packet != 0);
-    PA_HP_TRACE((pInfo->stream->hLog, "Capture submit: %u", eventIndex));
+    PA_HP_TRACE(("Capture submit: %lu", eventIndex, 0, 0, 0));
     packet->Header.DataUsed = 0; /* Reset for reuse */
     packet->Header.OptionsFlags = 0; /* Reset for reuse. Required for e.g. Focusrite Scarlett 2i4 (1st Gen) see #310 */
     ResetEvent(packet->Signal.hEvent);
@@ -6554,7 +6538,7 @@ static PaError PaPinRenderEventHandler_WaveCyclic(PaProcessThreadInfo* pInfo, un
     assert( eventIndex < pInfo->stream->render.noOfPackets );
 
     pInfo->renderPackets[pInfo->renderHead & cPacketsArrayMask].packet = pInfo->stream->render.packets + eventIndex;
-    PA_HP_TRACE((pInfo->stream->hLog, "<<< Render event : idx=%u head=%u", eventIndex, pInfo->renderHead));
+    PA_HP_TRACE(("<<< Render event : idx=%lu head=%lu", eventIndex, pInfo->renderHead, 0, 0));
     ++pInfo->renderHead;
     --pInfo->pending;
     return paNoError;
@@ -6567,7 +6551,7 @@ static PaError PaPinRenderSubmitHandler_WaveCyclic(PaProcessThreadInfo* pInfo, u
     pInfo->renderPackets[pInfo->renderTail & cPacketsArrayMask].packet = 0;
     assert(packet != 0);
 
-    PA_HP_TRACE((pInfo->stream->hLog, "Render submit : %u idx=%u", pInfo->renderTail, (unsigned)(packet - pInfo->stream->render.packets)));
+    PA_HP_TRACE(("Render submit : %lu idx=%lu", pInfo->renderTail, (packet - pInfo->stream->render.packets), 0, 0));
     ResetEvent(packet->Signal.hEvent);
     result = PinWrite(pInfo->stream->render.pPin->handle, packet);
     /* Reset event, just in case we have an analogous situation to capture (see PaPinCaptureSubmitHandler_WaveCyclic) */
@@ -6627,7 +6611,7 @@ static PaError PaPinCaptureEventHandler_WaveRTEvent(PaProcessThreadInfo* pInfo,
         }
     }
 
-    PA_HP_TRACE((pInfo->stream->hLog, "Capture event (WaveRT): idx=%u head=%u (pos = %4.1lf%%, frames=%u)", realInBuf, pInfo->captureHead, (pos * 100.0 / pCapture->hostBufferSize), frameCount));
+    PA_HP_TRACE(("Capture event (WaveRT): idx=%lu head=%lu (pos = %ld%%, frames=%lu)", realInBuf, pInfo->captureHead, (long)(pos * 100.0 / pCapture->hostBufferSize), frameCount));
 
     ++pInfo->captureHead;
     --pInfo->pending;
@@ -6666,7 +6650,7 @@ static PaError PaPinCaptureEventHandler_WaveRTPolled(PaProcessThreadInfo* pInfo,
 
         pCapture->lastPosition = (pCapture->lastPosition + frameCount * pCapture->bytesPerFrame) % pCapture->hostBufferSize;
 
-        PA_HP_TRACE((pInfo->stream->hLog, "Capture event (WaveRTPolled): pos = %4.1lf%%, framesRead=%u", (pos * 100.0 / pCapture->hostBufferSize), frameCount));
+        PA_HP_TRACE(("Capture event (WaveRTPolled): pos = %ld%%, framesRead=%lu", (long)(pos * 100.0 / pCapture->hostBufferSize), frameCount, 0, 0));
         ++pInfo->captureHead;
         --pInfo->pending;
     }
@@ -6715,7 +6699,7 @@ static PaError PaPinRenderEventHandler_WaveRTEvent(PaProcessThreadInfo* pInfo, u
     ioPacket->startByte = realOutBuf * halfOutputBuffer;
     ioPacket->lengthBytes = halfOutputBuffer;
 
-    PA_HP_TRACE((pInfo->stream->hLog, "Render event (WaveRT) : idx=%u head=%u (pos = %4.1lf%%)", realOutBuf, pInfo->renderHead, (pos * 100.0 / pRender->hostBufferSize) ));
+    PA_HP_TRACE(("Render event (WaveRT) : idx=%lu head=%lu (pos = %ld%%)", realOutBuf, pInfo->renderHead, (long)(pos * 100.0 / pRender->hostBufferSize), 0));
 
     ++pInfo->renderHead;
     --pInfo->pending;
@@ -6764,7 +6748,7 @@ static PaError PaPinRenderEventHandler_WaveRTPolled(PaProcessThreadInfo* pInfo,
             ioPacket->lengthBytes = halfOutputBuffer;
             ++pInfo->renderHead;
             --pInfo->pending;
-            PA_HP_TRACE((pInfo->stream->hLog, "Render event (WaveRTPolled) : idx=%u head=%u (pos = %4.1lf%%, cnt=%u)", realOutBuf, pInfo->renderHead, (pos * 100.0 / pRender->hostBufferSize), pRender->pollCntr));
+            PA_HP_TRACE(("Render event (WaveRTPolled) : idx=%lu head=%lu (pos = %ld%%, cnt=%lu)", realOutBuf, pInfo->renderHead, (long)(pos * 100.0 / pRender->hostBufferSize), pRender->pollCntr));
             pRender->pollCntr = 0;
         }
     }
@@ -6777,14 +6761,14 @@ static PaError PaPinRenderSubmitHandler_WaveRTEvent(PaProcessThreadInfo* pInfo,
     pInfo->renderPackets[pInfo->renderTail & cPacketsArrayMask].packet = 0;
     /* Call barrier (if needed) */
     pin->fnMemBarrier();
-    PA_HP_TRACE((pInfo->stream->hLog, "Render submit (WaveRT) : submit=%u", pInfo->renderTail));
+    PA_HP_TRACE(("Render submit (WaveRT) : submit=%lu", pInfo->renderTail, 0, 0, 0));
     ++pInfo->pending;
     if (pInfo->priming)
     {
         --pInfo->priming;
         if (pInfo->priming)
         {
-            PA_HP_TRACE((pInfo->stream->hLog, "Setting WaveRT event for priming (2)"));
+            PA_HP_TRACE(("Setting WaveRT event for priming (2)", 0, 0, 0, 0));
             SetEvent(pInfo->stream->render.events[0]);
         }
     }
@@ -6797,14 +6781,14 @@ static PaError PaPinRenderSubmitHandler_WaveRTPolled(PaProcessThreadInfo* pInfo,
     pInfo->renderPackets[pInfo->renderTail & cPacketsArrayMask].packet = 0;
     /* Call barrier (if needed) */
     pin->fnMemBarrier();
-    PA_HP_TRACE((pInfo->stream->hLog, "Render submit (WaveRTPolled) : submit=%u", pInfo->renderTail));
+    PA_HP_TRACE(("Render submit (WaveRTPolled) : submit=%lu", pInfo->renderTail, 0, 0, 0));
     ++pInfo->pending;
     if (pInfo->priming)
     {
         --pInfo->priming;
         if (pInfo->priming)
         {
-            PA_HP_TRACE((pInfo->stream->hLog, "Setting WaveRT event for priming (2)"));
+            PA_HP_TRACE(("Setting WaveRT event for priming (2)", 0, 0, 0, 0));
             SetEvent(pInfo->stream->render.events[0]);
         }
     }
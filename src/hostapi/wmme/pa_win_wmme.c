@@ -2475,6 +2475,7 @@ static PaError OpenStream( struct PaUtilHostApiRepresentation *hostApi,
     streamRepresentationIsInitialized = 1;
 
     PaUtil_InitializeCpuLoadMeasurer( &stream->cpuLoadMeasurer, sampleRate );
+    stream->streamRepresentation.cpuLoadMeasurer = &stream->cpuLoadMeasurer;
 
 
     if( inputParameters && outputParameters ) /* full duplex */
@@ -2831,6 +2832,8 @@ PA_THREAD_FUNC ProcessingThreadProc( void *pArg )
 
     statusFlags = 0; /** @todo support paInputUnderflow, paOutputOverflow and paNeverDropInput */
 
+    PA_TRACE_REGISTER_NAMED_THREAD( "MME processing" );
+
     /* loop until something causes us to stop */
     do{
         /* wait for MME to signal that a buffer is available, or for
@@ -3187,6 +3190,7 @@ PA_THREAD_FUNC ProcessingThreadProc( void *pArg )
 
     PaUtil_ResetCpuLoadMeasurer( &stream->cpuLoadMeasurer );
 
+    PaUtil_UnregisterTraceThread();
     return result;
 }
 
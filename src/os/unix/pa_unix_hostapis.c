@@ -54,6 +54,7 @@ PaError PaSGI_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex
 PaError PaAsiHpi_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex index );
 PaError PaMacCore_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex index );
 PaError PaSkeleton_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex index );
+PaError PaNull_Initialize( PaUtilHostApiRepresentation **hostApi, PaHostApiIndex index );
 
 /** Note that on Linux, ALSA is placed before OSS so that the former is preferred over the latter.
  */
@@ -118,5 +119,9 @@ PaUtilHostApiInitializer *paHostApiInitializers[] =
         PaSkeleton_Initialize,
 #endif
 
+#if PA_USE_NULL
+        PaNull_Initialize,
+#endif
+
         0   /* NULL terminated array */
     };
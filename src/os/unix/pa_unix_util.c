@@ -41,16 +41,31 @@
  @ingroup unix_src
 */
 
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#define _GNU_SOURCE /* for cpu_set_t and pthread_setaffinity_np */
+#endif
+
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <assert.h>
 #include <string.h> /* For memset */
 #include <math.h>
 #include <errno.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#endif
+
 #if defined(__APPLE__) && !defined(HAVE_MACH_ABSOLUTE_TIME)
 #define HAVE_MACH_ABSOLUTE_TIME
 #endif
@@ -58,9 +73,20 @@
 #include <mach/mach_time.h>
 #endif
 
+/* The TSC clock source needs an x86-64 compiler with 128 bit arithmetic for
+   the tick to nanosecond conversion */
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_RAW) \
+        && defined(__x86_64__) && defined(__GNUC__) && defined(__SIZEOF_INT128__)
+#define PA_HAVE_TSC_CLOCK_
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
 #include "pa_util.h"
 #include "pa_unix_util.h"
 #include "pa_debugprint.h"
+#include "pa_atomic.h"
+#include "pa_memorybarrier.h"
 
 /*
    Track memory allocations to avoid leaks.
@@ -109,6 +135,185 @@ int PaUtil_CountCurrentlyAllocatedBlocks( void )
 }
 
 
+/*
+   Memory locking.
+ */
+
+/* regions at least this large are advised to use transparent huge pages */
+#define PA_HUGE_PAGE_THRESHOLD_  (2 * 1024 * 1024)
+
+static volatile long lockedBytes_ = 0;
+
+/* A page locked with mlock() is unlocked by a single munlock(), however many times it was locked. Locked
+   regions may share pages, so the regions are remembered and a page is only unlocked along with the last
+   region covering it. */
+typedef struct PaUnixLockedRegion
+{
+    size_t first, last;     /* page aligned */
+} PaUnixLockedRegion;
+
+static pthread_mutex_t lockedRegionsMutex_ = PTHREAD_MUTEX_INITIALIZER;
+static PaUnixLockedRegion *lockedRegions_ = NULL;
+static unsigned long lockedRegionCount_ = 0, lockedRegionCapacity_ = 0;
+
+static size_t GetPageSize( void )
+{
+    long pageSize = sysconf( _SC_PAGESIZE );
+    return pageSize > 0 ? (size_t)pageSize : 4096;
+}
+
+/* mlock() and madvise() work on whole pages, the region is rounded outwards to those */
+static void GetPageRange( void *address, unsigned long size, size_t pageSize, size_t *first, size_t *last )
+{
+    *first = (size_t)address & ~(pageSize - 1);
+    *last = ((size_t)address + size + pageSize - 1) & ~(pageSize - 1);
+}
+
+/* Called with lockedRegionsMutex_ held */
+static int IsPageLocked( size_t page )
+{
+    unsigned long i;
+
+    for( i = 0; i < lockedRegionCount_; ++i )
+    {
+        if( page >= lockedRegions_[i].first && page < lockedRegions_[i].last )
+            return 1;
+    }
+    return 0;
+}
+
+/* The number of bytes in the pages of [first, last) which no remembered region covers.
+   Called with lockedRegionsMutex_ held */
+static size_t CountUnlockedBytes( size_t first, size_t last, size_t pageSize )
+{
+    size_t page, count = 0;
+
+    for( page = first; page < last; page += pageSize )
+    {
+        if( !IsPageLocked( page ) )
+            count += pageSize;
+    }
+    return count;
+}
+
+
+PaError PaUtil_LockMemory( void *address, unsigned long size )
+{
+    size_t pageSize = GetPageSize();
+    size_t first, last, newlyLocked;
+    volatile char *page;
+
+    if( !address || size == 0 )
+        return paNoError;
+
+    GetPageRange( address, size, pageSize, &first, &last );
+
+#ifdef MADV_HUGEPAGE
+    if( size >= PA_HUGE_PAGE_THRESHOLD_ )
+        madvise( (void*)first, last - first, MADV_HUGEPAGE ); /* advisory, failure is harmless */
+#endif
+
+    pthread_mutex_lock( &lockedRegionsMutex_ );
+    if( lockedRegionCount_ == lockedRegionCapacity_ )
+    {
+        unsigned long capacity = lockedRegionCapacity_ ? 2 * lockedRegionCapacity_ : 16;
+        PaUnixLockedRegion *regions = (PaUnixLockedRegion*)realloc( lockedRegions_, capacity * sizeof (PaUnixLockedRegion) );
+
+        if( !regions )
+        {
+            pthread_mutex_unlock( &lockedRegionsMutex_ );
+            goto prefault;
+        }
+        lockedRegions_ = regions;
+        lockedRegionCapacity_ = capacity;
+    }
+
+    if( mlock( (void*)first, last - first ) == 0 )
+    {
+        /* mlock() faults in the pages itself */
+        newlyLocked = CountUnlockedBytes( first, last, pageSize );
+        lockedRegions_[lockedRegionCount_].first = first;
+        lockedRegions_[lockedRegionCount_].last = last;
+        ++lockedRegionCount_;
+        PaUtil_AtomicAddLong( &lockedBytes_, (long)newlyLocked );
+        pthread_mutex_unlock( &lockedRegionsMutex_ );
+        return paNoError;
+    }
+    pthread_mutex_unlock( &lockedRegionsMutex_ );
+
+    PA_DEBUG(( "%s: mlock of %lu bytes failed: %s\n", __FUNCTION__, size, strerror( errno ) ));
+
+prefault:
+    /* fall back to prefaulting. write to each page so that copy-on-write
+        zero pages are replaced by real ones */
+    for( page = (volatile char*)address; page < (volatile char*)address + size; page += pageSize )
+        *page = *page;
+    page = (volatile char*)address + size - 1;
+    *page = *page;
+
+    return paInsufficientMemory;
+}
+
+
+void PaUtil_UnlockMemory( void *address, unsigned long size )
+{
+    size_t pageSize = GetPageSize();
+    size_t first, last, page, runStart = 0, unlocked = 0;
+    unsigned long i;
+
+    if( !address || size == 0 )
+        return;
+
+    GetPageRange( address, size, pageSize, &first, &last );
+
+    pthread_mutex_lock( &lockedRegionsMutex_ );
+    for( i = lockedRegionCount_; i > 0; --i )
+    {
+        if( lockedRegions_[i - 1].first == first && lockedRegions_[i - 1].last == last )
+            break;
+    }
+    if( i == 0 )
+    {
+        /* never locked, or locking failed */
+        pthread_mutex_unlock( &lockedRegionsMutex_ );
+        return;
+    }
+    lockedRegions_[i - 1] = lockedRegions_[--lockedRegionCount_];
+
+    /* Unlock the runs of pages which no other region covers */
+    for( page = first; page <= last; page += pageSize )
+    {
+        if( page < last && !IsPageLocked( page ) )
+        {
+            if( !runStart )
+                runStart = page;
+            continue;
+        }
+        if( runStart )
+        {
+            munlock( (void*)runStart, page - runStart );
+            unlocked += page - runStart;
+            runStart = 0;
+        }
+    }
+    PaUtil_AtomicAddLong( &lockedBytes_, -(long)unlocked );
+
+    if( lockedRegionCount_ == 0 )
+    {
+        free( lockedRegions_ );
+        lockedRegions_ = NULL;
+        lockedRegionCapacity_ = 0;
+    }
+    pthread_mutex_unlock( &lockedRegionsMutex_ );
+}
+
+
+unsigned long PaUtil_GetLockedMemoryByteCount( void )
+{
+    return (unsigned long)lockedBytes_;
+}
+
+
 void Pa_Sleep( long msec )
 {
 #ifdef HAVE_NANOSLEEP
@@ -145,16 +350,163 @@ void Pa_Sleep( long msec )
 
 /* Scaler to convert the result of mach_absolute_time to seconds */
 static double machSecondsConversionScaler_ = 0.0;
+static mach_timebase_info_data_t machTimebase_ = { 1, 1 };
+#endif
+
+static PaUnixClockSource clockSource_ = paUnixClockMonotonic;
+
+#ifdef HAVE_CLOCK_GETTIME
+#if defined(CLOCK_MONOTONIC)
+static clockid_t clockId_ = CLOCK_MONOTONIC;
+#else
+static clockid_t clockId_ = CLOCK_REALTIME;
+#endif
+#endif
+
+#ifdef PA_HAVE_TSC_CLOCK_
+/* Values of tscState_ */
+#define PA_TSC_PENDING_         (0)
+#define PA_TSC_CALIBRATING_     (1)
+#define PA_TSC_READY_           (2)
+#define PA_TSC_FAILED_          (3)
+
+/* The TSC is calibrated lazily, see CalibrateTsc */
+#define PA_TSC_CALIBRATION_NSEC_    (10000000)
+
+static volatile long tscState_ = PA_TSC_FAILED_;
+static PaUint64 tscStartTicks_;
+static PaInt64 tscStartNanoseconds_;
+static PaUint64 tscBase_;
+static PaInt64 tscBaseNanoseconds_;
+static PaInt64 tscNanosecondsPerTick_; /* 32.32 fixed point */
+
+static PaInt64 TimespecToNanoseconds( const struct timespec *tp )
+{
+    return (PaInt64)tp->tv_sec * 1000000000 + tp->tv_nsec;
+}
+
+/* Start calibrating the TSC. It is only used if the CPU reports it as
+   invariant, that is running at a constant rate in all power states and
+   synchronized between cores. */
+static int StartTscCalibration( void )
+{
+    unsigned int eax, ebx, ecx, edx;
+    struct timespec start;
+
+    if( !__get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx ) || !(edx & (1 << 8)) )
+        return 0;
+
+    clock_gettime( CLOCK_MONOTONIC_RAW, &start );
+    tscStartTicks_ = __rdtsc();
+    tscStartNanoseconds_ = TimespecToNanoseconds( &start );
+    tscState_ = PA_TSC_PENDING_;
+    return 1;
+}
+
+/* Measure the TSC frequency against CLOCK_MONOTONIC_RAW since
+   StartTscCalibration, rather than sleeping while PortAudio is initialized.
+   Until at least 10 msec have passed, PaUtil_GetNanoseconds reads
+   CLOCK_MONOTONIC_RAW, which the TSC is then anchored to. The first thread to
+   find that enough time has passed calibrates, others carry on reading the
+   clock meanwhile. */
+static void CalibrateTsc( PaInt64 now )
+{
+    struct timespec end;
+    PaUint64 endTicks;
+    PaInt64 elapsed;
+
+    if( now - tscStartNanoseconds_ < PA_TSC_CALIBRATION_NSEC_ ||
+            !PaUtil_AtomicCompareAndSwapLong( &tscState_, PA_TSC_PENDING_, PA_TSC_CALIBRATING_ ) )
+        return;
+
+    /* Read the TSC first, so that it can't lag behind the clock that was read by other threads */
+    endTicks = __rdtsc();
+    clock_gettime( CLOCK_MONOTONIC_RAW, &end );
+
+    elapsed = TimespecToNanoseconds( &end ) - tscStartNanoseconds_;
+    if( endTicks <= tscStartTicks_ || elapsed <= 0 )
+    {
+        PA_DEBUG(( "%s: Failed calibrating the TSC, staying with CLOCK_MONOTONIC_RAW\n", __FUNCTION__ ));
+        tscState_ = PA_TSC_FAILED_;
+        return;
+    }
+
+    tscNanosecondsPerTick_ = (PaInt64)( ((unsigned __int128)elapsed << 32) / (endTicks - tscStartTicks_) );
+    tscBase_ = endTicks;
+    tscBaseNanoseconds_ = TimespecToNanoseconds( &end );
+    PA_DEBUG(( "%s: TSC runs at %.3f MHz\n", __FUNCTION__, (endTicks - tscStartTicks_) * 1e3 / elapsed ));
+    PaUtil_WriteMemoryBarrier();
+    tscState_ = PA_TSC_READY_;
+}
+#endif /* PA_HAVE_TSC_CLOCK_ */
+
+
+PaError PaUnix_SetClockSource( PaUnixClockSource source )
+{
+    switch( source )
+    {
+    case paUnixClockMonotonic:
+#ifdef HAVE_CLOCK_GETTIME
+#if defined(CLOCK_MONOTONIC)
+        clockId_ = CLOCK_MONOTONIC;
+#else
+        clockId_ = CLOCK_REALTIME;
 #endif
+#endif
+        break;
+    case paUnixClockMonotonicRaw:
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_RAW)
+        clockId_ = CLOCK_MONOTONIC_RAW;
+        break;
+#else
+        return paDeviceUnavailable;
+#endif
+    case paUnixClockTsc:
+#ifdef PA_HAVE_TSC_CLOCK_
+        if( !StartTscCalibration() )
+            return paDeviceUnavailable;
+        clockId_ = CLOCK_MONOTONIC_RAW;
+        break;
+#else
+        return paDeviceUnavailable;
+#endif
+    default:
+        return paDeviceUnavailable;
+    }
+
+    clockSource_ = source;
+    return paNoError;
+}
+
+
+PaUnixClockSource PaUnix_GetClockSource( void )
+{
+    return clockSource_;
+}
+
 
 void PaUtil_InitializeClock( void )
 {
+    const char *source = getenv( "PA_CLOCK_SOURCE" );
+
 #ifdef HAVE_MACH_ABSOLUTE_TIME
     mach_timebase_info_data_t info;
     kern_return_t err = mach_timebase_info( &info );
     if( err == 0  )
+    {
         machSecondsConversionScaler_ = 1e-9 * (double) info.numer / (double) info.denom;
+        machTimebase_ = info;
+    }
 #endif
+
+    if( source && strcmp( source, "raw" ) == 0 )
+        PaUnix_SetClockSource( paUnixClockMonotonicRaw );
+    else if( source && strcmp( source, "tsc" ) == 0 )
+        PaUnix_SetClockSource( paUnixClockTsc );
+    else
+        PaUnix_SetClockSource( paUnixClockMonotonic );
+
+    PA_DEBUG(( "%s: using clock source %d\n", __FUNCTION__, clockSource_ ));
 }
 
 
@@ -177,6 +529,44 @@ PaTime PaUtil_GetTime( void )
 #endif
 }
 
+
+PaInt64 PaUtil_GetNanoseconds( void )
+{
+#ifdef HAVE_MACH_ABSOLUTE_TIME
+    return (PaInt64)( mach_absolute_time() * machTimebase_.numer / machTimebase_.denom );
+#elif defined(HAVE_CLOCK_GETTIME)
+    struct timespec tp;
+#ifdef PA_HAVE_TSC_CLOCK_
+    PaInt64 now;
+
+    if( clockSource_ == paUnixClockTsc )
+    {
+        if( tscState_ == PA_TSC_READY_ )
+        {
+            PaUtil_ReadMemoryBarrier();
+            return tscBaseNanoseconds_ +
+                (PaInt64)( ( (__int128)(PaInt64)(__rdtsc() - tscBase_) * tscNanosecondsPerTick_ ) >> 32 );
+        }
+
+        /* Not calibrated yet, clockId_ is CLOCK_MONOTONIC_RAW */
+        clock_gettime( clockId_, &tp );
+        now = TimespecToNanoseconds( &tp );
+        if( tscState_ == PA_TSC_PENDING_ )
+            CalibrateTsc( now );
+        return now;
+    }
+#endif
+    clock_gettime( clockId_, &tp );
+    return (PaInt64)tp.tv_sec * 1000000000 + tp.tv_nsec;
+#else
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return (PaInt64)tv.tv_sec * 1000000000 + (PaInt64)tv.tv_usec * 1000;
+#endif
+}
+
+static void SetThreadAffinity( pthread_t thread, const PaUnixCpuSet* cpuAffinity, PaUnixCpuSet* effective );
+
 PaError PaUtil_InitializeThreading( PaUtilThreading *threading )
 {
     (void) paUtilErr_;
@@ -190,6 +580,7 @@ void PaUtil_TerminateThreading( PaUtilThreading *threading )
 PaError PaUtil_StartThreading( PaUtilThreading *threading, void *(*threadRoutine)(void *), void *data )
 {
     pthread_create( &threading->callbackThread, NULL, threadRoutine, data );
+    SetThreadAffinity( threading->callbackThread, NULL, NULL );
     return paNoError;
 }
 
@@ -244,12 +635,257 @@ pthread_t paUnixMainThread = 0;
 pthread_t paUnixMainThread = 0;
 #endif
 
+#define PA_CPU_SET_BITS_    (8 * sizeof (unsigned long))
+
+void PaUnixCpuSet_Add( PaUnixCpuSet* set, unsigned long cpu )
+{
+    assert( cpu < PA_UNIX_MAX_CPUS );
+    set->mask[ cpu / PA_CPU_SET_BITS_ ] |= 1UL << (cpu % PA_CPU_SET_BITS_);
+}
+
+int PaUnixCpuSet_Contains( const PaUnixCpuSet* set, unsigned long cpu )
+{
+    if( cpu >= PA_UNIX_MAX_CPUS )
+        return 0;
+    return (set->mask[ cpu / PA_CPU_SET_BITS_ ] >> (cpu % PA_CPU_SET_BITS_)) & 1;
+}
+
+PaError PaUnixCpuSet_Parse( PaUnixCpuSet* set, const char* cpuList )
+{
+    PaError result = paNoError;
+    const char *p = cpuList;
+    char *end;
+    unsigned long first, last, cpu;
+
+    memset( set, 0, sizeof (PaUnixCpuSet) );
+    if( !p )
+        return paNoError;
+
+    while( *p )
+    {
+        PA_UNLESS( isdigit( (unsigned char)*p ), paIncompatibleHostApiSpecificStreamInfo );
+        first = last = strtoul( p, &end, 10 );
+        p = end;
+        if( *p == '-' )
+        {
+            ++p;
+            PA_UNLESS( isdigit( (unsigned char)*p ), paIncompatibleHostApiSpecificStreamInfo );
+            last = strtoul( p, &end, 10 );
+            p = end;
+        }
+        PA_UNLESS( first <= last && last < PA_UNIX_MAX_CPUS, paIncompatibleHostApiSpecificStreamInfo );
+
+        for( cpu = first; cpu <= last; ++cpu )
+            PaUnixCpuSet_Add( set, cpu );
+
+        if( *p == ',' )
+        {
+            ++p;
+            PA_UNLESS( *p, paIncompatibleHostApiSpecificStreamInfo );
+        }
+        else
+            PA_UNLESS( !*p, paIncompatibleHostApiSpecificStreamInfo );
+    }
+
+error:
+    return result;
+}
+
+void PaUnixCpuSet_Format( const PaUnixCpuSet* set, char* cpuList, unsigned long size )
+{
+    unsigned long cpu = 0, last, length = 0;
+    int written;
+
+    if( size == 0 )
+        return;
+    cpuList[0] = 0;
+
+    while( cpu < PA_UNIX_MAX_CPUS )
+    {
+        if( !PaUnixCpuSet_Contains( set, cpu ) )
+        {
+            ++cpu;
+            continue;
+        }
+
+        last = cpu;
+        while( last + 1 < PA_UNIX_MAX_CPUS && PaUnixCpuSet_Contains( set, last + 1 ) )
+            ++last;
+
+        if( last == cpu )
+            written = snprintf( cpuList + length, size - length, "%s%lu", length ? "," : "", cpu );
+        else
+            written = snprintf( cpuList + length, size - length, "%s%lu-%lu", length ? "," : "", cpu, last );
+        if( written < 0 || (unsigned long)written >= size - length )
+        {
+            /* Drop the entry that didn't fit */
+            cpuList[length] = 0;
+            return;
+        }
+        length += written;
+        cpu = last + 1;
+    }
+}
+
+int PaUnixCpuSet_IsEmpty( const PaUnixCpuSet* set )
+{
+    size_t i;
+    for( i = 0; i < sizeof (set->mask) / sizeof (set->mask[0]); ++i )
+    {
+        if( set->mask[i] )
+            return 0;
+    }
+    return 1;
+}
+
+static PaUnixCpuSet defaultCpuAffinity_;
+static pthread_once_t defaultCpuAffinityOnce_ = PTHREAD_ONCE_INIT;
+
+static void InitializeDefaultCpuAffinity( void )
+{
+    const char *cpuList = getenv( "PA_CPU_AFFINITY" );
+
+    if( cpuList && PaUnixCpuSet_Parse( &defaultCpuAffinity_, cpuList ) != paNoError )
+    {
+        PA_DEBUG(( "%s: Ignoring malformed PA_CPU_AFFINITY '%s'\n", __FUNCTION__, cpuList ));
+        memset( &defaultCpuAffinity_, 0, sizeof (PaUnixCpuSet) );
+    }
+}
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+static void ToCpuSet( const PaUnixCpuSet* set, cpu_set_t* cpus )
+{
+    unsigned long cpu;
+
+    CPU_ZERO( cpus );
+    for( cpu = 0; cpu < PA_UNIX_MAX_CPUS && cpu < CPU_SETSIZE; ++cpu )
+    {
+        if( PaUnixCpuSet_Contains( set, cpu ) )
+            CPU_SET( cpu, cpus );
+    }
+}
+
+static void FromCpuSet( const cpu_set_t* cpus, PaUnixCpuSet* set )
+{
+    unsigned long cpu;
+
+    memset( set, 0, sizeof (PaUnixCpuSet) );
+    for( cpu = 0; cpu < PA_UNIX_MAX_CPUS && cpu < CPU_SETSIZE; ++cpu )
+    {
+        if( CPU_ISSET( cpu, cpus ) )
+            PaUnixCpuSet_Add( set, cpu );
+    }
+}
+#endif
+
+/* Pin thread to the CPUs in cpuAffinity, or to the default CPUs if it is NULL, and store the CPUs the
+   thread may actually run on in effective. An empty set leaves the affinity unchanged. Like
+   BoostPriority, failing to pin the thread is not an error, effective tells the caller where it ended up. */
+static void SetThreadAffinity( pthread_t thread, const PaUnixCpuSet* cpuAffinity, PaUnixCpuSet* effective )
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    cpu_set_t cpus;
+    int err;
+
+    pthread_once( &defaultCpuAffinityOnce_, InitializeDefaultCpuAffinity );
+    if( !cpuAffinity )
+        cpuAffinity = &defaultCpuAffinity_;
+
+    if( !PaUnixCpuSet_IsEmpty( cpuAffinity ) )
+    {
+        ToCpuSet( cpuAffinity, &cpus );
+        if( (err = pthread_setaffinity_np( thread, sizeof (cpu_set_t), &cpus )) != 0 )
+            PA_DEBUG(( "%s: Failed setting CPU affinity: %s\n", __FUNCTION__, strerror( err ) ));
+    }
+
+    if( effective && pthread_getaffinity_np( thread, sizeof (cpu_set_t), &cpus ) == 0 )
+        FromCpuSet( &cpus, effective );
+#else
+    (void) thread;
+    (void) cpuAffinity;
+    (void) effective;
+#endif
+}
+
+/* Have the thread created on the CPUs it is to be pinned to, rather than moved there once it runs. Returns
+   whether the affinity was set on attr. SetThreadAffinity still pins the thread where this isn't supported. */
+static int SetThreadAttrAffinity( pthread_attr_t* attr, const PaUnixCpuSet* cpuAffinity )
+{
+#if defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP) && defined(HAVE_PTHREAD_SETAFFINITY_NP)
+    cpu_set_t cpus;
+    int err;
+
+    pthread_once( &defaultCpuAffinityOnce_, InitializeDefaultCpuAffinity );
+    if( !cpuAffinity )
+        cpuAffinity = &defaultCpuAffinity_;
+    if( PaUnixCpuSet_IsEmpty( cpuAffinity ) )
+        return 0;
+
+    ToCpuSet( cpuAffinity, &cpus );
+    if( (err = pthread_attr_setaffinity_np( attr, sizeof (cpu_set_t), &cpus )) != 0 )
+    {
+        PA_DEBUG(( "%s: Failed setting CPU affinity: %s\n", __FUNCTION__, strerror( err ) ));
+        return 0;
+    }
+    return 1;
+#else
+    (void) attr;
+    (void) cpuAffinity;
+    return 0;
+#endif
+}
+
 PaError PaUnixThreading_Initialize( void )
 {
     paUnixMainThread = pthread_self();
+    pthread_once( &defaultCpuAffinityOnce_, InitializeDefaultCpuAffinity );
     return paNoError;
 }
 
+PaError PaUnixThreading_SetDefaultCpuAffinity( const PaUnixCpuSet* cpuAffinity )
+{
+    pthread_once( &defaultCpuAffinityOnce_, InitializeDefaultCpuAffinity );
+#ifndef HAVE_PTHREAD_SETAFFINITY_NP
+    if( !PaUnixCpuSet_IsEmpty( cpuAffinity ) )
+        return paDeviceUnavailable;
+#endif
+    defaultCpuAffinity_ = *cpuAffinity;
+    return paNoError;
+}
+
+void PaUnixThreading_GetDefaultCpuAffinity( PaUnixCpuSet* cpuAffinity )
+{
+    pthread_once( &defaultCpuAffinityOnce_, InitializeDefaultCpuAffinity );
+    *cpuAffinity = defaultCpuAffinity_;
+}
+
+void PaUnixThreading_GetAvailableCpus( PaUnixCpuSet* cpus )
+{
+    long cpu, count;
+
+    PaUnixThreading_GetDefaultCpuAffinity( cpus );
+    if( !PaUnixCpuSet_IsEmpty( cpus ) )
+        return;
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    {
+        cpu_set_t processCpus;
+        if( sched_getaffinity( 0, sizeof (cpu_set_t), &processCpus ) == 0 )
+        {
+            FromCpuSet( &processCpus, cpus );
+            if( !PaUnixCpuSet_IsEmpty( cpus ) )
+                return;
+        }
+    }
+#endif
+
+    count = sysconf( _SC_NPROCESSORS_ONLN );
+    if( count < 1 )
+        count = 1;
+    for( cpu = 0; cpu < count && cpu < PA_UNIX_MAX_CPUS; ++cpu )
+        PaUnixCpuSet_Add( cpus, cpu );
+}
+
 static PaError BoostPriority( PaUnixThread* self )
 {
     PaError result = paNoError;
@@ -274,12 +910,12 @@ error:
 }
 
 PaError PaUnixThread_New( PaUnixThread* self, void* (*threadFunc)( void* ), void* threadArg, PaTime waitForChild,
-        int rtSched )
+        int rtSched, const PaUnixCpuSet* cpuAffinity )
 {
     PaError result = paNoError;
     pthread_attr_t attr;
     pthread_condattr_t cattr;
-    int started = 0;
+    int started = 0, attrInitialized = 0;
 
     memset( self, 0, sizeof (PaUnixThread) );
     PaUnixMutex_Initialize( &self->mtx );
@@ -310,50 +946,38 @@ PaError PaUnixThread_New( PaUnixThread* self, void* (*threadFunc)( void* ), void
 #endif
 
     PA_UNLESS( !pthread_attr_init( &attr ), paInternalError );
+    attrInitialized = 1;
     /* Priority relative to other processes */
     PA_UNLESS( !pthread_attr_setscope( &attr, PTHREAD_SCOPE_SYSTEM ), paInternalError );
 
-    PA_UNLESS( !pthread_create( &self->thread, &attr, threadFunc, threadArg ), paInternalError );
-    started = 1;
-
-    if( rtSched )
+    if( SetThreadAttrAffinity( &attr, cpuAffinity ) )
     {
-#if 0
-        if( self->useWatchdog )
+        if( pthread_create( &self->thread, &attr, threadFunc, threadArg ) == 0 )
+            started = 1;
+        else
         {
-            int err;
-            struct sched_param wdSpm = { 0 };
-            /* Launch watchdog, watchdog sets callback thread priority */
-            int prio = PA_MIN( self->rtPrio + 4, sched_get_priority_max( SCHED_FIFO ) );
-            wdSpm.sched_priority = prio;
-
+            /* Likely CPUs the process may not run on, start the thread anywhere and leave it to
+               SetThreadAffinity */
+            PA_DEBUG(( "%s: Failed creating thread on its CPUs\n", __FUNCTION__ ));
+            pthread_attr_destroy( &attr );
+            attrInitialized = 0;
             PA_UNLESS( !pthread_attr_init( &attr ), paInternalError );
-            PA_UNLESS( !pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED ), paInternalError );
+            attrInitialized = 1;
             PA_UNLESS( !pthread_attr_setscope( &attr, PTHREAD_SCOPE_SYSTEM ), paInternalError );
-            PA_UNLESS( !pthread_attr_setschedpolicy( &attr, SCHED_FIFO ), paInternalError );
-            PA_UNLESS( !pthread_attr_setschedparam( &attr, &wdSpm ), paInternalError );
-            if( (err = pthread_create( &self->watchdogThread, &attr, &WatchdogFunc, self )) )
-            {
-                PA_UNLESS( err == EPERM, paInternalError );
-                /* Permission error, go on without realtime privileges */
-                PA_DEBUG(( "Failed bumping priority\n" ));
-            }
-            else
-            {
-                int policy;
-                self->watchdogRunning = 1;
-                PA_ENSURE_SYSTEM( pthread_getschedparam( self->watchdogThread, &policy, &wdSpm ), 0 );
-                /* Check if priority is right, policy could potentially differ from SCHED_FIFO (but that's alright) */
-                if( wdSpm.sched_priority != prio )
-                {
-                    PA_DEBUG(( "Watchdog priority not set correctly (%d)\n", wdSpm.sched_priority ));
-                    PA_ENSURE( paInternalError );
-                }
-            }
         }
-        else
-#endif
-            PA_ENSURE( BoostPriority( self ) );
+    }
+    if( !started )
+    {
+        PA_UNLESS( !pthread_create( &self->thread, &attr, threadFunc, threadArg ), paInternalError );
+        started = 1;
+    }
+
+    /* Either way, this reads back the CPUs the thread may actually run on */
+    SetThreadAffinity( self->thread, cpuAffinity, &self->cpuAffinity );
+
+    if( rtSched )
+    {
+        PA_ENSURE( BoostPriority( self ) );
 
         {
             int policy;
@@ -405,6 +1029,8 @@ PaError PaUnixThread_New( PaUnixThread* self, void* (*threadFunc)( void* ), void
     }
 
 end:
+    if( attrInitialized )
+        pthread_attr_destroy( &attr );
     return result;
 error:
     if( started )
@@ -424,23 +1050,8 @@ PaError PaUnixThread_Terminate( PaUnixThread* self, int wait, PaError* exitResul
     {
         *exitResult = paNoError;
     }
-#if 0
-    if( watchdogExitResult )
-        *watchdogExitResult = paNoError;
-
-    if( th->watchdogRunning )
-    {
-        pthread_cancel( th->watchdogThread );
-        PA_ENSURE_SYSTEM( pthread_join( th->watchdogThread, &pret ), 0 );
-
-        if( pret && pret != PTHREAD_CANCELED )
-        {
-            if( watchdogExitResult )
-                *watchdogExitResult = *(PaError *) pret;
-            free( pret );
-        }
-    }
-#endif
+    /* The supervisor must not touch the thread once it has been joined */
+    PaUnixThread_StopWatchdog( self );
 
     /* Only kill the thread if it isn't in the process of stopping (flushing adaptation buffers) */
     /* TODO: Make join time out */
@@ -471,12 +1082,118 @@ PaError PaUnixThread_Terminate( PaUnixThread* self, int wait, PaError* exitResul
     }
 
 error:
+    /* The thread has unlocked its stack on the way out, see UnlockStack */
+    assert( !self->lockedStack || result != paNoError );
+
     PA_ASSERT_CALL( PaUnixMutex_Terminate( &self->mtx ), paNoError );
     PA_ASSERT_CALL( pthread_cond_destroy( &self->cond ), 0 );
 
     return result;
 }
 
+#if defined(__linux__) && defined(SYS_sched_setattr)
+#define PA_HAVE_SCHED_DEADLINE_
+
+#define PA_SCHED_FLAG_RESET_ON_FORK_    (0x01)
+
+/* struct sched_attr of the kernel, which older C libraries don't declare */
+typedef struct PaUnixSchedAttr
+{
+    PaUint32 size;
+    PaUint32 schedPolicy;
+    PaUint64 schedFlags;
+    PaInt32 schedNice;
+    PaUint32 schedPriority;
+    PaUint64 schedRuntime;
+    PaUint64 schedDeadline;
+    PaUint64 schedPeriod;
+} PaUnixSchedAttr;
+#endif
+
+PaError PaUnixThread_SetDeadlineScheduling( PaUnixThread* self, PaInt64 runtime, PaInt64 deadline, PaInt64 period )
+{
+#ifdef PA_HAVE_SCHED_DEADLINE_
+    PaUnixSchedAttr attr;
+
+    assert( self );
+    assert( runtime >= 1024 && runtime <= deadline && deadline <= period );
+
+    memset( &attr, 0, sizeof (attr) );
+    attr.size = sizeof (attr);
+    attr.schedPolicy = SCHED_DEADLINE;
+    attr.schedFlags = PA_SCHED_FLAG_RESET_ON_FORK_;
+    attr.schedRuntime = runtime;
+    attr.schedDeadline = deadline;
+    attr.schedPeriod = period;
+
+    if( syscall( SYS_sched_setattr, 0, &attr, 0 ) != 0 )
+    {
+        /* EBUSY when admission control rejects the bandwidth, EPERM without privileges or with a restricted
+           CPU affinity */
+        PA_DEBUG(( "%s: Failed setting SCHED_DEADLINE: %s\n", __FUNCTION__, strerror( errno ) ));
+        return paDeviceUnavailable;
+    }
+
+    PA_DEBUG(( "%s: Running under SCHED_DEADLINE, runtime %lld of %lld nsec\n", __FUNCTION__,
+                (long long)runtime, (long long)period ));
+    self->deadlineScheduling = 1;
+    return paNoError;
+#else
+    (void) self;
+    (void) runtime;
+    (void) deadline;
+    (void) period;
+    return paDeviceUnavailable;
+#endif
+}
+
+/* The C library keeps the stacks of joined threads for reuse, so a locked stack must be unlocked by the thread
+   itself before it exits. The destructor of this key runs in the exiting thread, whether it returns, exits or
+   is canceled */
+static pthread_key_t lockedStackKey_;
+static pthread_once_t lockedStackKeyOnce_ = PTHREAD_ONCE_INIT;
+static int lockedStackKeyCreated_ = 0;
+
+static void UnlockStack( void *data )
+{
+    PaUnixThread *self = (PaUnixThread *)data;
+
+    PaUtil_UnlockMemory( self->lockedStack, self->lockedStackSize );
+    self->lockedStack = NULL;
+}
+
+static void CreateLockedStackKey( void )
+{
+    lockedStackKeyCreated_ = pthread_key_create( &lockedStackKey_, &UnlockStack ) == 0;
+}
+
+PaError PaUnixThread_LockStack( PaUnixThread* self, unsigned long size )
+{
+    PaError result = paNoError;
+    char marker;
+    /* the stack grows downwards on all supported platforms, leave some room for this frame */
+    char *top = &marker - 256;
+
+    PA_UNLESS( !self->lockedStack, paInternalError );
+    pthread_once( &lockedStackKeyOnce_, CreateLockedStackKey );
+    PA_UNLESS( lockedStackKeyCreated_, paInternalError );
+
+    result = PaUtil_LockMemory( top - size, size );
+    if( result == paNoError )
+    {
+        self->lockedStack = top - size;
+        self->lockedStackSize = size;
+        if( pthread_setspecific( lockedStackKey_, self ) != 0 )
+        {
+            UnlockStack( self );
+            result = paInternalError;
+        }
+    }
+
+error:
+    return result;
+}
+
 PaError PaUnixThread_PrepareNotify( PaUnixThread* self )
 {
     PaError result = paNoError;
@@ -565,162 +1282,342 @@ error:
 }
 
 
-#if 0
-static void OnWatchdogExit( void *userData )
-{
-    PaAlsaThreading *th = (PaAlsaThreading *) userData;
-    struct sched_param spm = { 0 };
-    assert( th );
-
-    PA_ASSERT_CALL( pthread_setschedparam( th->callbackThread, SCHED_OTHER, &spm ), 0 );    /* Lower before exiting */
-    PA_DEBUG(( "Watchdog exiting\n" ));
-}
+/* Watchdog */
 
-static void *WatchdogFunc( void *userData )
-{
-    PaError result = paNoError, *pres = NULL;
-    int err;
-    PaAlsaThreading *th = (PaAlsaThreading *) userData;
-    unsigned intervalMsec = 500;
-    const PaTime maxSeconds = 3.;   /* Max seconds between callbacks */
-    PaTime timeThen = PaUtil_GetTime(), timeNow, timeElapsed, cpuTimeThen, cpuTimeNow, cpuTimeElapsed;
-    double cpuLoad, avgCpuLoad = 0.;
-    int throttled = 0;
+#if defined(__linux__) && defined(HAVE_CLOCK_GETTIME)
+#define PA_HAVE_WATCHDOG_
+#endif
 
-    assert( th );
+#define PA_WATCHDOG_CHECK_PERIODS_      (2)         /* periods of the fastest thread between checks */
+#define PA_WATCHDOG_MIN_INTERVAL_       (2000000)   /* nanoseconds */
+#define PA_WATCHDOG_MAX_INTERVAL_       (100000000)
+#define PA_WATCHDOG_THROTTLE_LOAD_      (0.95)      /* CPU fraction of a runaway thread */
+#define PA_WATCHDOG_THROTTLE_CHECKS_    (2)         /* consecutive overloaded checks before throttling */
+#define PA_WATCHDOG_UNTHROTTLE_LOAD_    (0.8)
+#define PA_WATCHDOG_STALL_LOAD_         (0.05)
 
-    /* Execute OnWatchdogExit when exiting */
-    pthread_cleanup_push( &OnWatchdogExit, th );
+static pthread_mutex_t watchdogMutex_ = PTHREAD_MUTEX_INITIALIZER;
 
-    /* Boost priority of callback thread */
-    PA_ENSURE( result = BoostPriority( th ) );
-    if( !result )
-    {
-        /* Boost failed, might as well exit */
-        pthread_exit( NULL );
-    }
+#ifdef PA_HAVE_WATCHDOG_
 
-    cpuTimeThen = th->callbackCpuTime;
-    {
-        int policy;
-        struct sched_param spm = { 0 };
-        pthread_getschedparam( pthread_self(), &policy, &spm );
-        PA_DEBUG(( "%s: Watchdog priority is %d\n", __FUNCTION__, spm.sched_priority ));
-    }
+typedef struct PaUnixWatchdogSupervisor
+{
+    pthread_t thread;
+    int timerFd;
+    int wakeFd;
+    int stopRequested;
+} PaUnixWatchdogSupervisor;
+
+/* Protected by watchdogMutex_ */
+static PaUnixWatchdog *watchdogs_ = NULL;
+static PaUnixWatchdogSupervisor *supervisor_ = NULL;
+static PaInt64 watchdogInterval_ = 0;
+
+static PaInt64 ReadClock( clockid_t clockId )
+{
+    struct timespec ts;
 
-    while( 1 )
-    {
-        double lowpassCoeff = 0.9, lowpassCoeff1 = 0.99999 - lowpassCoeff;
+    if( clock_gettime( clockId, &ts ) != 0 )
+        return -1;
+    return (PaInt64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-        /* Test before and after in case whatever underlying sleep call isn't interrupted by pthread_cancel */
-        pthread_testcancel();
-        Pa_Sleep( intervalMsec );
-        pthread_testcancel();
+/* Arm the supervisor's timer for the fastest watched thread */
+static void ArmWatchdogTimer( void )
+{
+    struct itimerspec spec;
+    PaInt64 interval = PA_WATCHDOG_MAX_INTERVAL_;
+    PaUnixWatchdog *watchdog;
+
+    for( watchdog = watchdogs_; watchdog; watchdog = watchdog->next )
+        interval = PA_MIN( interval, watchdog->period * PA_WATCHDOG_CHECK_PERIODS_ );
+    interval = PA_MAX( interval, PA_WATCHDOG_MIN_INTERVAL_ );
+    if( interval == watchdogInterval_ )
+        return;
+
+    watchdogInterval_ = interval;
+    spec.it_interval.tv_sec = (time_t)( interval / 1000000000 );
+    spec.it_interval.tv_nsec = (long)( interval % 1000000000 );
+    spec.it_value = spec.it_interval;
+    if( timerfd_settime( supervisor_->timerFd, 0, &spec, NULL ) != 0 )
+        PA_DEBUG(( "%s: Failed arming the watchdog timer: %s\n", __FUNCTION__, strerror( errno ) ));
+}
 
-        if( PaUtil_GetTime() - th->callbackTime > maxSeconds )
+static void CheckWatchdog( PaUnixWatchdog *watchdog, PaInt64 now )
+{
+    PaInt64 cpuTime = ReadClock( watchdog->cpuClock );
+    unsigned long progress = watchdog->progress, xrunCount = watchdog->xrunCount;
+    int progressed = progress != watchdog->lastProgress;
+    int xrun = xrunCount != watchdog->lastXrunCount;
+    PaUnixWatchdogStatistics *statistics = &watchdog->statistics;
+    double cpuFraction;
+    int policy;
+    struct sched_param spm;
+
+    if( cpuTime < 0 || now <= watchdog->lastCheckTime )
+        return;
+
+    cpuFraction = (double)( cpuTime - watchdog->lastCpuTime ) / (double)( now - watchdog->lastCheckTime );
+    watchdog->lastCheckTime = now;
+    watchdog->lastCpuTime = cpuTime;
+    watchdog->lastProgress = progress;
+    watchdog->lastXrunCount = xrunCount;
+
+    statistics->cpuFraction = cpuFraction;
+    if( cpuFraction > statistics->maximumCpuFraction )
+        statistics->maximumCpuFraction = cpuFraction;
+
+    /* A thread that neither runs nor makes progress is blocked, for instance on a device that went away */
+    if( !progressed && cpuFraction < PA_WATCHDOG_STALL_LOAD_ )
+    {
+        if( !watchdog->stalled )
         {
-            PA_DEBUG(( "Watchdog: Terminating callback thread\n" ));
-            /* Tell thread to terminate */
-            err = pthread_kill( th->callbackThread, SIGKILL );
-            pthread_exit( NULL );
+            PA_DEBUG(( "%s: Thread stalled\n", __FUNCTION__ ));
+            watchdog->stalled = 1;
+            ++statistics->stallCount;
         }
+    }
+    else
+        watchdog->stalled = 0;
 
-        PA_DEBUG(( "%s: PortAudio reports CPU load: %g\n", __FUNCTION__, PaUtil_GetCpuLoad( th->cpuLoadMeasurer ) ));
-
-        /* Check if we should throttle, or unthrottle :P */
-        cpuTimeNow = th->callbackCpuTime;
-        cpuTimeElapsed = cpuTimeNow - cpuTimeThen;
-        cpuTimeThen = cpuTimeNow;
-
-        timeNow = PaUtil_GetTime();
-        timeElapsed = timeNow - timeThen;
-        timeThen = timeNow;
-        cpuLoad = cpuTimeElapsed / timeElapsed;
-        avgCpuLoad = avgCpuLoad * lowpassCoeff + cpuLoad * lowpassCoeff1;
-        /*
-        if( throttled )
-            PA_DEBUG(( "Watchdog: CPU load: %g, %g\n", avgCpuLoad, cpuTimeElapsed ));
-            */
-        if( PaUtil_GetCpuLoad( th->cpuLoadMeasurer ) > .925 )
+    if( !statistics->throttled )
+    {
+        /* A thread that is busy but keeps up with its device is left alone */
+        if( cpuFraction >= PA_WATCHDOG_THROTTLE_LOAD_ && ( !progressed || xrun ) )
+            ++watchdog->overloadedChecks;
+        else
+            watchdog->overloadedChecks = 0;
+
+        if( watchdog->overloadedChecks >= PA_WATCHDOG_THROTTLE_CHECKS_ &&
+                pthread_getschedparam( watchdog->thread, &policy, &spm ) == 0 &&
+                ( policy == SCHED_FIFO || policy == SCHED_RR ) )
         {
-            static int policy;
-            static struct sched_param spm = { 0 };
-            static const struct sched_param defaultSpm = { 0 };
-            PA_DEBUG(( "%s: Throttling audio thread, priority %d\n", __FUNCTION__, spm.sched_priority ));
+            struct sched_param defaultSpm = { 0 };
 
-            pthread_getschedparam( th->callbackThread, &policy, &spm );
-            if( !pthread_setschedparam( th->callbackThread, SCHED_OTHER, &defaultSpm ) )
+            if( pthread_setschedparam( watchdog->thread, SCHED_OTHER, &defaultSpm ) == 0 )
             {
-                throttled = 1;
+                PA_DEBUG(( "%s: Throttling thread using %g of a CPU\n", __FUNCTION__, cpuFraction ));
+                watchdog->throttledPolicy = policy;
+                watchdog->throttledParam = spm;
+                statistics->throttled = 1;
+                ++statistics->throttleCount;
             }
             else
-                PA_DEBUG(( "Watchdog: Couldn't lower priority of audio thread: %s\n", strerror( errno ) ));
+                PA_DEBUG(( "%s: Couldn't lower priority of thread: %s\n", __FUNCTION__, strerror( errno ) ));
+        }
+    }
+    else if( progressed && cpuFraction < PA_WATCHDOG_UNTHROTTLE_LOAD_ )
+    {
+        /* Sharing the CPU under SCHED_OTHER can keep a runaway thread below the threshold, so the thread
+           must also be making progress again */
+        if( pthread_setschedparam( watchdog->thread, watchdog->throttledPolicy, &watchdog->throttledParam ) == 0 )
+        {
+            PA_DEBUG(( "%s: Unthrottling thread\n", __FUNCTION__ ));
+            statistics->throttled = 0;
+            watchdog->overloadedChecks = 0;
+        }
+    }
+}
 
-            /* Give other processes a go, before raising priority again */
-            PA_DEBUG(( "%s: Watchdog sleeping for %lu msecs before unthrottling\n", __FUNCTION__, th->throttledSleepTime ));
-            Pa_Sleep( th->throttledSleepTime );
+static void *WatchdogSupervisorFunc( void *userData )
+{
+    PaUnixWatchdogSupervisor *self = (PaUnixWatchdogSupervisor *)userData;
+    struct pollfd pfds[2];
+    PaUint64 expirations;
+    PaUnixWatchdog *watchdog;
+    PaInt64 now;
 
-            /* Reset callback priority */
-            if( pthread_setschedparam( th->callbackThread, SCHED_FIFO, &spm ) != 0 )
-            {
-                PA_DEBUG(( "%s: Couldn't raise priority of audio thread: %s\n", __FUNCTION__, strerror( errno ) ));
-            }
+    pfds[0].fd = self->timerFd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = self->wakeFd;
+    pfds[1].events = POLLIN;
 
-            if( PaUtil_GetCpuLoad( th->cpuLoadMeasurer ) >= .99 )
-                intervalMsec = 50;
-            else
-                intervalMsec = 100;
+    while( 1 )
+    {
+        if( poll( pfds, 2, -1 ) < 0 && errno != EINTR )
+            break;
+        if( ( pfds[0].revents & POLLIN ) && read( self->timerFd, &expirations, sizeof (expirations) ) < 0 )
+            PA_DEBUG(( "%s: Failed reading the watchdog timer: %s\n", __FUNCTION__, strerror( errno ) ));
 
-            /*
-            lowpassCoeff = .97;
-            lowpassCoeff1 = .99999 - lowpassCoeff;
-            */
-        }
-        else if( throttled && avgCpuLoad < .8 )
+        pthread_mutex_lock( &watchdogMutex_ );
+        if( self->stopRequested )
         {
-            intervalMsec = 500;
-            throttled = 0;
-
-            /*
-            lowpassCoeff = .9;
-            lowpassCoeff1 = .99999 - lowpassCoeff;
-            */
+            pthread_mutex_unlock( &watchdogMutex_ );
+            break;
         }
+        now = ReadClock( CLOCK_MONOTONIC );
+        for( watchdog = watchdogs_; watchdog; watchdog = watchdog->next )
+            CheckWatchdog( watchdog, now );
+        pthread_mutex_unlock( &watchdogMutex_ );
+    }
+
+    return NULL;
+}
+
+static void FreeWatchdogSupervisor( PaUnixWatchdogSupervisor *supervisor )
+{
+    if( supervisor->timerFd >= 0 )
+        close( supervisor->timerFd );
+    if( supervisor->wakeFd >= 0 )
+        close( supervisor->wakeFd );
+    PaUtil_FreeMemory( supervisor );
+}
+
+/* Called with watchdogMutex_ held */
+static PaError StartWatchdogSupervisor( void )
+{
+    PaError result = paNoError;
+    PaUnixWatchdogSupervisor *supervisor;
+    pthread_attr_t attr;
+    struct sched_param spm = { 0 };
+    int err;
+
+    PA_UNLESS( supervisor = (PaUnixWatchdogSupervisor *)PaUtil_AllocateZeroInitializedMemory(
+                sizeof (PaUnixWatchdogSupervisor) ), paInsufficientMemory );
+    supervisor->wakeFd = -1;
+    supervisor->timerFd = timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC );
+    PA_UNLESS( supervisor->timerFd >= 0, paInternalError );
+    supervisor->wakeFd = eventfd( 0, EFD_CLOEXEC );
+    PA_UNLESS( supervisor->wakeFd >= 0, paInternalError );
+
+    /* Run above the watched threads, so that a runaway thread can't starve the supervisor */
+    spm.sched_priority = sched_get_priority_max( SCHED_FIFO );
+    PA_UNLESS( !pthread_attr_init( &attr ), paInternalError );
+    pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+    pthread_attr_setschedpolicy( &attr, SCHED_FIFO );
+    pthread_attr_setschedparam( &attr, &spm );
+    err = pthread_create( &supervisor->thread, &attr, &WatchdogSupervisorFunc, supervisor );
+    pthread_attr_destroy( &attr );
+    if( err == EPERM )
+    {
+        /* Permission error, go on without realtime privileges */
+        PA_DEBUG(( "%s: Failed bumping priority of the watchdog\n", __FUNCTION__ ));
+        err = pthread_create( &supervisor->thread, NULL, &WatchdogSupervisorFunc, supervisor );
     }
+    PA_UNLESS( !err, paInternalError );
 
-    pthread_cleanup_pop( 1 );   /* Execute cleanup on exit */
+    supervisor_ = supervisor;
+    watchdogInterval_ = 0;
 
+end:
+    return result;
 error:
-    /* Shouldn't get here in the normal case */
+    if( supervisor )
+        FreeWatchdogSupervisor( supervisor );
+    goto end;
+}
 
-    /* Pass on error code */
-    pres = malloc( sizeof (PaError) );
-    *pres = result;
+#endif /* PA_HAVE_WATCHDOG_ */
+
+PaError PaUnixThread_StartWatchdog( PaUnixThread* self, PaInt64 period )
+{
+#ifdef PA_HAVE_WATCHDOG_
+    PaError result = paNoError;
+    PaUnixWatchdog *watchdog = &self->watchdog;
+    int locked = 0;
 
-    pthread_exit( pres );
+    assert( !watchdog->registered && period > 0 );
+
+    memset( watchdog, 0, sizeof (PaUnixWatchdog) );
+    watchdog->thread = pthread_self();
+    PA_ENSURE_SYSTEM( pthread_getcpuclockid( watchdog->thread, &watchdog->cpuClock ), 0 );
+    watchdog->period = period;
+    watchdog->lastCheckTime = ReadClock( CLOCK_MONOTONIC );
+    watchdog->lastCpuTime = ReadClock( watchdog->cpuClock );
+
+    PA_ENSURE_SYSTEM( pthread_mutex_lock( &watchdogMutex_ ), 0 );
+    locked = 1;
+    if( !supervisor_ )
+        PA_ENSURE( StartWatchdogSupervisor() );
+
+    watchdog->next = watchdogs_;
+    watchdogs_ = watchdog;
+    watchdog->registered = 1;
+    ArmWatchdogTimer();
+
+error:
+    if( locked )
+        pthread_mutex_unlock( &watchdogMutex_ );
+    return result;
+#else
+    (void) self;
+    (void) period;
+    return paDeviceUnavailable;
+#endif
 }
 
-static void CallbackUpdate( PaAlsaThreading *th )
+void PaUnixThread_SetWatchdogPeriod( PaUnixThread* self, PaInt64 period )
 {
-    th->callbackTime = PaUtil_GetTime();
-    th->callbackCpuTime = PaUtil_GetCpuLoad( th->cpuLoadMeasurer );
+#ifdef PA_HAVE_WATCHDOG_
+    PaUnixWatchdog *watchdog = &self->watchdog;
+
+    assert( period > 0 );
+
+    pthread_mutex_lock( &watchdogMutex_ );
+    if( watchdog->registered )
+    {
+        watchdog->period = period;
+        ArmWatchdogTimer();
+    }
+    pthread_mutex_unlock( &watchdogMutex_ );
+#else
+    (void) self;
+    (void) period;
+#endif
 }
 
-/*
-static void *CanaryFunc( void *userData )
+void PaUnixThread_StopWatchdog( PaUnixThread* self )
 {
-    const unsigned intervalMsec = 1000;
-    PaUtilThreading *th = (PaUtilThreading *) userData;
+#ifdef PA_HAVE_WATCHDOG_
+    PaUnixWatchdog *watchdog = &self->watchdog, **link;
+    PaUnixWatchdogSupervisor *supervisor = NULL;
+    PaUint64 one = 1;
 
-    while( 1 )
+    pthread_mutex_lock( &watchdogMutex_ );
+    if( !watchdog->registered )
+    {
+        pthread_mutex_unlock( &watchdogMutex_ );
+        return;
+    }
+
+    for( link = &watchdogs_; *link != watchdog; link = &(*link)->next )
+        ;
+    *link = watchdog->next;
+    watchdog->registered = 0;
+
+    if( !watchdogs_ )
     {
-        th->canaryTime = PaUtil_GetTime();
+        /* Last one out stops the supervisor */
+        supervisor = supervisor_;
+        supervisor_ = NULL;
+        supervisor->stopRequested = 1;
+    }
+    else
+        ArmWatchdogTimer();
+    pthread_mutex_unlock( &watchdogMutex_ );
 
-        pthread_testcancel();
-        Pa_Sleep( intervalMsec );
+    if( supervisor )
+    {
+        if( write( supervisor->wakeFd, &one, sizeof (one) ) < 0 )
+            PA_DEBUG(( "%s: Failed waking the watchdog: %s\n", __FUNCTION__, strerror( errno ) ));
+        pthread_join( supervisor->thread, NULL );
+        FreeWatchdogSupervisor( supervisor );
     }
+#else
+    (void) self;
+#endif
+}
 
-    pthread_exit( NULL );
+void PaUnixThread_NotifyWatchdog( PaUnixThread* self, int xrun )
+{
+    ++self->watchdog.progress;
+    if( xrun )
+        ++self->watchdog.xrunCount;
+}
+
+void PaUnixThread_GetWatchdogStatistics( PaUnixThread* self, PaUnixWatchdogStatistics* statistics )
+{
+    pthread_mutex_lock( &watchdogMutex_ );
+    *statistics = self->watchdog.statistics;
+    pthread_mutex_unlock( &watchdogMutex_ );
 }
-*/
-#endif
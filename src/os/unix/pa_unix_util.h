@@ -49,13 +49,20 @@
 #include "pa_cpuload.h"
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif /* __cplusplus */
 
+/* The deadline policy of Linux, which older C libraries don't define, see PaUnixThread_SetDeadlineScheduling */
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE  (6)
+#endif
+
 #define PA_MIN(x,y) ( (x) < (y) ? (x) : (y) )
 #define PA_MAX(x,y) ( (x) > (y) ? (x) : (y) )
 
@@ -143,6 +150,74 @@ PaError PaUnixMutex_Terminate( PaUnixMutex* self );
 PaError PaUnixMutex_Lock( PaUnixMutex* self );
 PaError PaUnixMutex_Unlock( PaUnixMutex* self );
 
+/** The largest number of CPUs a PaUnixCpuSet can hold. */
+#define PA_UNIX_MAX_CPUS    (1024)
+
+/** A set of CPUs that a thread may run on.
+ *
+ * Written as a CPU list in the format used by taskset -c and the isolcpus kernel parameter, for
+ * example "2-3,6". An empty set means that the thread may run on any CPU.
+ */
+typedef struct PaUnixCpuSet
+{
+    unsigned long mask[ PA_UNIX_MAX_CPUS / (8 * sizeof (unsigned long)) ];
+} PaUnixCpuSet;
+
+/** Parse a CPU list such as "0,2-3" into set. NULL or an empty string give an empty set.
+ * @return: paIncompatibleHostApiSpecificStreamInfo if cpuList is malformed or names a CPU beyond
+ * PA_UNIX_MAX_CPUS.
+ */
+PaError PaUnixCpuSet_Parse( PaUnixCpuSet* set, const char* cpuList );
+
+/** Format set as a CPU list into a buffer of size bytes, truncating the list if it doesn't fit.
+ */
+void PaUnixCpuSet_Format( const PaUnixCpuSet* set, char* cpuList, unsigned long size );
+
+/** Is set empty? */
+int PaUnixCpuSet_IsEmpty( const PaUnixCpuSet* set );
+
+/** Add cpu, which must be less than PA_UNIX_MAX_CPUS, to set. */
+void PaUnixCpuSet_Add( PaUnixCpuSet* set, unsigned long cpu );
+
+/** Does set contain cpu? */
+int PaUnixCpuSet_Contains( const PaUnixCpuSet* set, unsigned long cpu );
+
+/** Counters of the decisions taken by the watchdog about a thread.
+ * @see PaUnixThread_StartWatchdog
+ */
+typedef struct PaUnixWatchdogStatistics
+{
+    unsigned long throttleCount;    /**< times the thread was demoted to SCHED_OTHER */
+    unsigned long stallCount;       /**< times the thread stopped making progress while not using the CPU */
+    int throttled;                  /**< is the thread currently demoted? */
+    double cpuFraction;             /**< fraction of a CPU used by the thread over the last check interval */
+    double maximumCpuFraction;
+} PaUnixWatchdogStatistics;
+
+/** Watchdog state of a PaUnixThread. progress and xrunCount are written by the watched thread, the rest by
+ * the supervisor thread.
+ */
+typedef struct PaUnixWatchdog
+{
+    struct PaUnixWatchdog *next;
+    pthread_t thread;
+    clockid_t cpuClock;
+    PaInt64 period;                 /**< nanoseconds */
+    volatile unsigned long progress;
+    volatile unsigned long xrunCount;
+    int registered;
+
+    PaInt64 lastCheckTime;
+    PaInt64 lastCpuTime;
+    unsigned long lastProgress;
+    unsigned long lastXrunCount;
+    int overloadedChecks;
+    int stalled;
+    int throttledPolicy;            /**< scheduling to restore when unthrottling */
+    struct sched_param throttledParam;
+    PaUnixWatchdogStatistics statistics;
+} PaUnixWatchdog;
+
 typedef struct
 {
     pthread_t thread;
@@ -153,12 +228,35 @@ typedef struct
     pthread_cond_t cond;
     PaUtilClockId condClockId;
     volatile sig_atomic_t stopRequest;
+    void *lockedStack;                  /**< region locked by PaUnixThread_LockStack */
+    unsigned long lockedStackSize;
+    PaUnixCpuSet cpuAffinity;           /**< CPUs the thread actually runs on, empty if unknown */
+    int deadlineScheduling;             /**< set once the thread runs under SCHED_DEADLINE */
+    PaUnixWatchdog watchdog;
 } PaUnixThread;
 
 /** Initialize global threading state.
+ *
+ * The default CPU affinity is taken from the PA_CPU_AFFINITY environment variable, if set.
  */
 PaError PaUnixThreading_Initialize( void );
 
+/** Set the CPUs that audio threads run on unless a stream specifies otherwise.
+ *
+ * Applies to threads created by PaUnixThread_New and PaUtil_StartThreading after the call. An empty
+ * set removes the restriction.
+ * @return: paDeviceUnavailable if thread affinity isn't supported on this system.
+ */
+PaError PaUnixThreading_SetDefaultCpuAffinity( const PaUnixCpuSet* cpuAffinity );
+
+/** Get the default CPU affinity of audio threads. */
+void PaUnixThreading_GetDefaultCpuAffinity( PaUnixCpuSet* cpuAffinity );
+
+/** Get the CPUs that audio threads may run on: the default CPU affinity if one is set, else the CPUs
+ * the process may run on.
+ */
+void PaUnixThreading_GetAvailableCpus( PaUnixCpuSet* cpus );
+
 /** Perish, passing on eventual error code.
  *
  * A thin wrapper around pthread_exit, will automatically pass on any error code to the joining thread.
@@ -188,10 +286,13 @@ PaError PaUnixThreading_Initialize( void );
  * @param waitForChild: If not 0, wait for child thread to call PaUnixThread_NotifyParent. Less than 0 means
  * wait for ever, greater than 0 wait for the specified time.
  * @param rtSched: Enable realtime scheduling?
+ * @param cpuAffinity: The CPUs the thread may run on, or NULL to use the default set with
+ * PaUnixThreading_SetDefaultCpuAffinity. The thread is created with this affinity, and the affinity it
+ * actually got is stored in self->cpuAffinity.
  * @return: If timed out waiting on child, paTimedOut.
  */
 PaError PaUnixThread_New( PaUnixThread* self, void* (*threadFunc)( void* ), void* threadArg, PaTime waitForChild,
-        int rtSched );
+        int rtSched, const PaUnixCpuSet* cpuAffinity );
 
 /** Terminate thread.
  *
@@ -218,6 +319,86 @@ PaError PaUnixThread_NotifyParent( PaUnixThread* self );
  */
 int PaUnixThread_StopRequested( PaUnixThread* self );
 
+/** Lock and prefault the calling thread's stack.
+ *
+ * Must be called from the thread itself, early on, so that the size bytes below the current stack
+ * frame are resident before real-time work starts. The region is unlocked by the thread itself when it exits,
+ * since the stack may be reused for another thread once it has been joined.
+ * @param size: The number of bytes of stack to lock, must be less than the thread's stack size.
+ * @return: paInsufficientMemory if the stack couldn't be locked, it is still prefaulted.
+ */
+PaError PaUnixThread_LockStack( PaUnixThread* self, unsigned long size );
+
+/** Switch the calling thread to the SCHED_DEADLINE policy.
+ *
+ * Must be called from the thread itself. The kernel admits the thread only if the total bandwidth
+ * (runtime / period) of deadline threads fits on the CPUs, and only if the thread's CPU affinity
+ * spans its whole root domain, so callers should be prepared for this to fail. The thread is throttled
+ * once it has used runtime nanoseconds in a period, until the start of the next period.
+ * @param runtime: The CPU time budget per period in nanoseconds, at least 1024.
+ * @param deadline: The relative deadline in nanoseconds, between runtime and period.
+ * @param period: The period in nanoseconds.
+ * @return: paDeviceUnavailable if the kernel doesn't support SCHED_DEADLINE or refused to admit the
+ * thread, in which case its scheduling is unchanged.
+ */
+PaError PaUnixThread_SetDeadlineScheduling( PaUnixThread* self, PaInt64 runtime, PaInt64 deadline, PaInt64 period );
+
+/** Put the calling thread under the watchdog.
+ *
+ * A single supervisor thread, running at the highest SCHED_FIFO priority, checks all watched threads every
+ * two periods of the fastest one. It reads their CPU time from the per-thread CPU clocks rather than relying
+ * on the threads themselves. A real-time thread that uses nearly all of a CPU over two consecutive checks
+ * while not making progress or while its stream keeps running into xruns is demoted to SCHED_OTHER, so that a
+ * misbehaving callback can't lock up the system. It gets its priority back once it makes progress again with a lower CPU use.
+ * Threads under SCHED_DEADLINE are left alone since the kernel enforces their runtime budget.
+ *
+ * The supervisor is started with the first watched thread and stops with the last one.
+ * @param period: The time between the thread's periods of work in nanoseconds.
+ * @return: paDeviceUnavailable if the watchdog isn't supported on this system.
+ */
+PaError PaUnixThread_StartWatchdog( PaUnixThread* self, PaInt64 period );
+
+/** Remove the thread from the watchdog, if it was started. Called by PaUnixThread_Terminate if the thread
+ * didn't do so itself.
+ */
+void PaUnixThread_StopWatchdog( PaUnixThread* self );
+
+/** Change the period at which a watched thread is checked, re-arming the supervisor's timer. Keeps the
+ * thread's counters and its throttled state. Does nothing if the watchdog hasn't been started for the thread.
+ */
+void PaUnixThread_SetWatchdogPeriod( PaUnixThread* self, PaInt64 period );
+
+/** Tell the watchdog that the thread completed a period of work.
+ * @param xrun: Did the period end in an xrun?
+ */
+void PaUnixThread_NotifyWatchdog( PaUnixThread* self, int xrun );
+
+/** Read the watchdog counters of a thread. May be called from any thread. */
+void PaUnixThread_GetWatchdogStatistics( PaUnixThread* self, PaUnixWatchdogStatistics* statistics );
+
+/** Sources for PaUtil_GetNanoseconds. */
+typedef enum PaUnixClockSource
+{
+    paUnixClockMonotonic = 0, /**< CLOCK_MONOTONIC, the default */
+    paUnixClockMonotonicRaw,  /**< CLOCK_MONOTONIC_RAW, not slewed by NTP */
+    paUnixClockTsc            /**< the invariant x86 time stamp counter, calibrated against CLOCK_MONOTONIC_RAW
+                                   once 10 msec have passed, that clock is read until then */
+} PaUnixClockSource;
+
+/** Select the source used by PaUtil_GetNanoseconds.
+ *
+ * The initial source is taken from the PA_CLOCK_SOURCE environment variable ("monotonic", "raw" or
+ * "tsc") when PortAudio is initialized. PaUtil_GetTime always uses CLOCK_MONOTONIC so that its
+ * timestamps stay comparable with those of the host APIs. Not thread safe, call it while no streams
+ * are running.
+ * @return: paDeviceUnavailable if the source isn't supported on this system, in which case the
+ * current source is kept.
+ */
+PaError PaUnix_SetClockSource( PaUnixClockSource source );
+
+/** Get the source used by PaUtil_GetNanoseconds. */
+PaUnixClockSource PaUnix_GetClockSource( void );
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -44,6 +44,7 @@
 */
 
 #include <windows.h>
+#include <stdlib.h> /* for realloc() */
 
 #if defined(WINAPI_FAMILY) && (WINAPI_FAMILY == WINAPI_FAMILY_APP)
     #include <sys/timeb.h> /* for _ftime_s() */
@@ -99,6 +100,181 @@ int PaUtil_CountCurrentlyAllocatedBlocks( void )
 }
 
 
+/*
+   Memory locking.
+ */
+
+static volatile LONG lockedBytes_ = 0;
+
+/* VirtualLock() keeps no count, a page is unlocked by a single VirtualUnlock(), however many times it was
+   locked. Locked regions may share pages, so the regions are remembered and a page is only unlocked along
+   with the last region covering it. */
+typedef struct PaWinLockedRegion
+{
+    SIZE_T first, last;     /* page aligned */
+} PaWinLockedRegion;
+
+/* there is no static initializer for a CRITICAL_SECTION, locking memory is rare enough for a spin lock */
+static volatile LONG lockedRegionsLock_ = 0;
+static PaWinLockedRegion *lockedRegions_ = NULL;
+static unsigned long lockedRegionCount_ = 0, lockedRegionCapacity_ = 0;
+
+static void LockRegions( void )
+{
+    while( InterlockedCompareExchange( &lockedRegionsLock_, 1, 0 ) != 0 )
+        Sleep( 0 );
+}
+
+static void UnlockRegions( void )
+{
+    InterlockedExchange( &lockedRegionsLock_, 0 );
+}
+
+/* VirtualLock() works on whole pages, the region is rounded outwards to those */
+static void GetPageRange( void *address, unsigned long size, DWORD pageSize, SIZE_T *first, SIZE_T *last )
+{
+    *first = (SIZE_T)address & ~((SIZE_T)pageSize - 1);
+    *last = ((SIZE_T)address + size + pageSize - 1) & ~((SIZE_T)pageSize - 1);
+}
+
+/* Called with the regions locked */
+static int IsPageLocked( SIZE_T page )
+{
+    unsigned long i;
+
+    for( i = 0; i < lockedRegionCount_; ++i )
+    {
+        if( page >= lockedRegions_[i].first && page < lockedRegions_[i].last )
+            return 1;
+    }
+    return 0;
+}
+
+/* The number of bytes in the pages of [first, last) which no remembered region covers.
+   Called with the regions locked */
+static SIZE_T CountUnlockedBytes( SIZE_T first, SIZE_T last, DWORD pageSize )
+{
+    SIZE_T page, count = 0;
+
+    for( page = first; page < last; page += pageSize )
+    {
+        if( !IsPageLocked( page ) )
+            count += pageSize;
+    }
+    return count;
+}
+
+PaError PaUtil_LockMemory( void *address, unsigned long size )
+{
+    SYSTEM_INFO systemInfo;
+    SIZE_T first, last, newlyLocked;
+    volatile char *page;
+
+    if( !address || size == 0 )
+        return paNoError;
+
+    GetSystemInfo( &systemInfo );
+    GetPageRange( address, size, systemInfo.dwPageSize, &first, &last );
+
+    LockRegions();
+    if( lockedRegionCount_ == lockedRegionCapacity_ )
+    {
+        unsigned long capacity = lockedRegionCapacity_ ? 2 * lockedRegionCapacity_ : 16;
+        PaWinLockedRegion *regions = (PaWinLockedRegion*)realloc( lockedRegions_, capacity * sizeof (PaWinLockedRegion) );
+
+        if( !regions )
+        {
+            UnlockRegions();
+            goto prefault;
+        }
+        lockedRegions_ = regions;
+        lockedRegionCapacity_ = capacity;
+    }
+
+    /* VirtualLock() faults in the pages itself */
+    if( VirtualLock( (LPVOID)first, last - first ) )
+    {
+        newlyLocked = CountUnlockedBytes( first, last, systemInfo.dwPageSize );
+        lockedRegions_[lockedRegionCount_].first = first;
+        lockedRegions_[lockedRegionCount_].last = last;
+        ++lockedRegionCount_;
+        InterlockedExchangeAdd( &lockedBytes_, (LONG)newlyLocked );
+        UnlockRegions();
+        return paNoError;
+    }
+    UnlockRegions();
+
+prefault:
+    /* the working set is probably too small, fall back to prefaulting */
+    for( page = (volatile char*)address; page < (volatile char*)address + size; page += systemInfo.dwPageSize )
+        *page = *page;
+    page = (volatile char*)address + size - 1;
+    *page = *page;
+
+    return paInsufficientMemory;
+}
+
+
+void PaUtil_UnlockMemory( void *address, unsigned long size )
+{
+    SYSTEM_INFO systemInfo;
+    SIZE_T first, last, page, runStart = 0, unlocked = 0;
+    unsigned long i;
+
+    if( !address || size == 0 )
+        return;
+
+    GetSystemInfo( &systemInfo );
+    GetPageRange( address, size, systemInfo.dwPageSize, &first, &last );
+
+    LockRegions();
+    for( i = lockedRegionCount_; i > 0; --i )
+    {
+        if( lockedRegions_[i - 1].first == first && lockedRegions_[i - 1].last == last )
+            break;
+    }
+    if( i == 0 )
+    {
+        /* never locked, or locking failed */
+        UnlockRegions();
+        return;
+    }
+    lockedRegions_[i - 1] = lockedRegions_[--lockedRegionCount_];
+
+    /* Unlock the runs of pages which no other region covers */
+    for( page = first; page <= last; page += systemInfo.dwPageSize )
+    {
+        if( page < last && !IsPageLocked( page ) )
+        {
+            if( !runStart )
+                runStart = page;
+            continue;
+        }
+        if( runStart )
+        {
+            VirtualUnlock( (LPVOID)runStart, page - runStart );
+            unlocked += page - runStart;
+            runStart = 0;
+        }
+    }
+    InterlockedExchangeAdd( &lockedBytes_, -(LONG)unlocked );
+
+    if( lockedRegionCount_ == 0 )
+    {
+        free( lockedRegions_ );
+        lockedRegions_ = NULL;
+        lockedRegionCapacity_ = 0;
+    }
+    UnlockRegions();
+}
+
+
+unsigned long PaUtil_GetLockedMemoryByteCount( void )
+{
+    return (unsigned long)lockedBytes_;
+}
+
+
 void Pa_Sleep( long msec )
 {
     Sleep( msec );
@@ -106,6 +282,7 @@ void Pa_Sleep( long msec )
 
 static int usePerformanceCounter_;
 static double secondsPerTick_;
+static LONGLONG ticksPerSecond_;
 
 void PaUtil_InitializeClock( void )
 {
@@ -115,6 +292,7 @@ void PaUtil_InitializeClock( void )
     {
         usePerformanceCounter_ = 1;
         secondsPerTick_ = 1.0 / (double)ticksPerSecond.QuadPart;
+        ticksPerSecond_ = ticksPerSecond.QuadPart;
     }
     else
     {
@@ -159,6 +337,32 @@ double PaUtil_GetTime( void )
     }
 }
 
+
+PaInt64 PaUtil_GetNanoseconds( void )
+{
+    LARGE_INTEGER time;
+
+    if( usePerformanceCounter_ )
+    {
+        /* split the conversion so that ticks * 1e9 can't overflow */
+        QueryPerformanceCounter( &time );
+        return (time.QuadPart / ticksPerSecond_) * 1000000000
+                + (time.QuadPart % ticksPerSecond_) * 1000000000 / ticksPerSecond_;
+    }
+    else
+    {
+#ifndef UNDER_CE
+    #if defined(WINAPI_FAMILY) && (WINAPI_FAMILY == WINAPI_FAMILY_APP)
+        return (PaInt64)GetTickCount64() * 1000000;
+    #else
+        return (PaInt64)timeGetTime() * 1000000;
+    #endif
+#else
+        return (PaInt64)GetTickCount() * 1000000;
+#endif
+    }
+}
+
 void PaWinUtil_SetLastSystemErrorInfo( PaHostApiTypeId hostApiType, long winError )
 {
     wchar_t wide_msg[1024]; //PA_LAST_HOST_ERROR_TEXT_LENGTH_
@@ -0,0 +1,203 @@
+/** @file patest_allocation.c
+    @ingroup test_src
+    @brief Tests the allocation group functions in pa_allocation.c
+
+    Checks alignment, zero initialization, free list reuse, bulk free, memory
+    locking and the memory usage counters, then times repeated create/allocate/destroy cycles
+    such as those performed when streams are opened and closed.
+*/
+/*
+ * $Id: $
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2008 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+#include <stdio.h>
+#include <stddef.h>
+
+#include "portaudio.h"
+#include "pa_allocation.h"
+#include "pa_util.h"
+
+#define CYCLE_COUNT     (20000)
+
+static int failures_ = 0;
+
+#define CHECK( expr ) \
+    do { if( !(expr) ){ printf( "FAILED line %d: %s\n", __LINE__, #expr ); ++failures_; } } while(0)
+
+
+static int IsZero( const char *p, long size )
+{
+    long i;
+    for( i=0; i < size; ++i )
+        if( p[i] != 0 )
+            return 0;
+    return 1;
+}
+
+
+static void TestAllocationGroup( void )
+{
+    PaUtilAllocationGroup *group;
+    PaUtilAllocationGroupStatistics stats;
+    char *a, *b, *c;
+    long alignment;
+
+    group = PaUtil_CreateAllocationGroup();
+    CHECK( group != 0 );
+    if( !group )
+        return;
+
+    /* free list reuse and re-zeroing */
+    a = (char*)PaUtil_GroupAllocateZeroInitializedMemory( group, 100 );
+    CHECK( a != 0 && IsZero( a, 100 ) );
+    a[0] = a[99] = 1;
+    PaUtil_GroupFreeMemory( group, a );
+    b = (char*)PaUtil_GroupAllocateZeroInitializedMemory( group, 100 );
+    CHECK( b == a );
+    CHECK( IsZero( b, 100 ) );
+
+    /* alignment */
+    for( alignment = 1; alignment <= 4096; alignment *= 2 )
+    {
+        c = (char*)PaUtil_GroupAllocateAlignedZeroInitializedMemory( group, 1000, alignment );
+        CHECK( c != 0 && ((size_t)c % (size_t)alignment) == 0 );
+        CHECK( c != 0 && IsZero( c, 1000 ) );
+    }
+    CHECK( PaUtil_GroupAllocateAlignedZeroInitializedMemory( group, 10, 3 ) == 0 );
+
+    /* an aligned block is found in its arena, and its space reused */
+    c = (char*)PaUtil_GroupAllocateAlignedZeroInitializedMemory( group, 100, 256 );
+    CHECK( c != 0 );
+    PaUtil_GroupFreeMemory( group, c );
+    CHECK( (char*)PaUtil_GroupAllocateAlignedZeroInitializedMemory( group, 100, 256 ) == c );
+
+    /* large blocks bypass the arenas */
+    c = (char*)PaUtil_GroupAllocateAlignedZeroInitializedMemory( group, 1024 * 1024, 64 );
+    CHECK( c != 0 && ((size_t)c % 64) == 0 );
+    PaUtil_GetAllocationGroupStatistics( group, &stats );
+    CHECK( stats.largeBlockCount == 1 );
+    CHECK( stats.blockCount == 3 + 13 );
+    CHECK( stats.bytesRequested == 2 * 100 + 13 * 1000 + 1024 * 1024 );
+    CHECK( stats.bytesInUse >= stats.bytesRequested );
+    CHECK( stats.bytesReserved >= stats.bytesInUse );
+    PaUtil_GroupFreeMemory( group, c );
+    PaUtil_GetAllocationGroupStatistics( group, &stats );
+    CHECK( stats.largeBlockCount == 0 );
+
+    /* bulk free */
+    PaUtil_FreeAllAllocations( group );
+    PaUtil_GetAllocationGroupStatistics( group, &stats );
+    CHECK( stats.blockCount == 0 && stats.bytesInUse == 0 && stats.bytesRequested == 0 );
+    CHECK( stats.arenaCount <= 1 );
+    CHECK( stats.peakBytesInUse > 1024 * 1024 );
+
+    PaUtil_DestroyAllocationGroup( group );
+}
+
+
+static void TestLockedAllocationGroup( void )
+{
+    PaUtilAllocationGroup *group;
+    PaUtilAllocationGroupStatistics stats;
+    PaError lockResult;
+    char *a, *b;
+
+    group = PaUtil_CreateAllocationGroup();
+    CHECK( group != 0 );
+    if( !group )
+        return;
+
+    a = (char*)PaUtil_GroupAllocateZeroInitializedMemory( group, 4096 );
+    lockResult = PaUtil_LockAllocationGroupMemory( group );
+    b = (char*)PaUtil_GroupAllocateAlignedZeroInitializedMemory( group, 256 * 1024, 64 );
+    CHECK( a != 0 && b != 0 );
+
+    PaUtil_GetAllocationGroupStatistics( group, &stats );
+    printf( "locking %s, %lu bytes locked\n", lockResult == paNoError ? "succeeded" : "failed (resource limit?)",
+            stats.bytesLocked );
+    if( lockResult == paNoError )
+    {
+        CHECK( stats.bytesLocked >= 256 * 1024 );
+        /* the locked regions are rounded to whole pages */
+        CHECK( PaUtil_GetLockedMemoryByteCount() >= stats.bytesLocked );
+    }
+
+    PaUtil_FreeAllAllocations( group );
+    PaUtil_DestroyAllocationGroup( group );
+    CHECK( PaUtil_GetLockedMemoryByteCount() == 0 );
+}
+
+
+static void TimeCycles( void )
+{
+    PaTime start, end;
+    int i, j;
+
+    start = PaUtil_GetTime();
+    for( i=0; i < CYCLE_COUNT; ++i )
+    {
+        PaUtilAllocationGroup *group = PaUtil_CreateAllocationGroup();
+        if( !group )
+        {
+            ++failures_;
+            return;
+        }
+        for( j=0; j < 16; ++j )
+            PaUtil_GroupAllocateAlignedZeroInitializedMemory( group, 64 << (j % 8), 64 );
+        PaUtil_FreeAllAllocations( group );
+        PaUtil_DestroyAllocationGroup( group );
+    }
+    end = PaUtil_GetTime();
+
+    printf( "%d create/allocate/destroy cycles: %.3f usec per cycle\n",
+            CYCLE_COUNT, (end - start) * 1e6 / CYCLE_COUNT );
+}
+
+
+int main( void );
+int main( void )
+{
+    PaUtil_InitializeClock();
+
+    TestAllocationGroup();
+    TestLockedAllocationGroup();
+    TimeCycles();
+
+    PaUtil_ReleaseAllocationArenaCache();
+
+    printf( "%s\n", failures_ ? "FAILED" : "PASSED" );
+    return failures_ ? 1 : 0;
+}
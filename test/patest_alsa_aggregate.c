@@ -0,0 +1,220 @@
+/** @file patest_alsa_aggregate.c
+    @ingroup test_src
+    @brief Record from several ALSA devices as one aggregate stream.
+
+    Opens the default input device along with the ALSA devices given on the
+    command line, as one callback stream with the channels of all devices, and
+    prints the estimated rate ratio of each further device and the peak level of
+    each device's channels once a second.
+
+    Usage: patest_alsa_aggregate device:channels [device:channels ...]
+    For example: patest_alsa_aggregate hw:2:8 hw:3:8
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "portaudio.h"
+#include "pa_linux_alsa.h"
+
+#define SAMPLE_RATE     (48000)
+#define NUM_SECONDS     (10)
+#define MAX_DEVICES     (16)
+#define MAX_CHANNELS    (256)
+
+typedef struct
+{
+    int channelCount;
+    float peaks[MAX_CHANNELS];
+    unsigned long overflowCount;
+}
+paTestData;
+
+static int recordCallback( const void *inputBuffer, void *outputBuffer,
+                           unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           PaStreamCallbackFlags statusFlags,
+                           void *userData )
+{
+    paTestData *data = (paTestData*)userData;
+    const float *in = (const float*)inputBuffer;
+    unsigned long i;
+    int c;
+
+    (void) outputBuffer;
+    (void) timeInfo;
+
+    for( i=0; i<framesPerBuffer; i++ )
+    {
+        for( c=0; c<data->channelCount; c++ )
+        {
+            float value = fabsf( *in++ );
+            if( value > data->peaks[c] )
+                data->peaks[c] = value;
+        }
+    }
+    if( statusFlags & paInputOverflow )
+        ++data->overflowCount;
+    return paContinue;
+}
+
+int main( int argc, char **argv );
+int main( int argc, char **argv )
+{
+    PaStreamParameters inputParameters;
+    PaAlsaStreamInfo streamInfo;
+    PaAlsaAggregateDevice devices[MAX_DEVICES];
+    char names[MAX_DEVICES][64];
+    PaStream *stream = NULL;
+    static paTestData data;
+    int deviceCount = argc - 1, firstChannel, i, c, second;
+    PaError err;
+
+    if( deviceCount < 1 || deviceCount > MAX_DEVICES )
+    {
+        fprintf( stderr, "Usage: %s device:channels [device:channels ...]\n", argv[0] );
+        return 1;
+    }
+
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+
+    inputParameters.device = Pa_GetDefaultInputDevice();
+    if( inputParameters.device == paNoDevice ||
+            Pa_GetHostApiInfo( Pa_GetDeviceInfo( inputParameters.device )->hostApi )->type != paALSA )
+    {
+        fprintf( stderr, "Error: The default input device is not an ALSA device.\n" );
+        err = paInvalidDevice;
+        goto error;
+    }
+    data.channelCount = Pa_GetDeviceInfo( inputParameters.device )->maxInputChannels;
+    if( data.channelCount > 2 )
+        data.channelCount = 2;
+
+    /* Each argument names a device and the number of channels to take from it, separated by the last colon */
+    for( i = 0; i < deviceCount; i++ )
+    {
+        char *colon;
+        strncpy( names[i], argv[i + 1], sizeof (names[i]) - 1 );
+        names[i][sizeof (names[i]) - 1] = '\0';
+        colon = strrchr( names[i], ':' );
+        if( !colon || atoi( colon + 1 ) < 1 )
+        {
+            fprintf( stderr, "Error: Expected device:channels, got %s\n", argv[i + 1] );
+            err = paInvalidChannelCount;
+            goto error;
+        }
+        *colon = '\0';
+        devices[i].deviceString = names[i];
+        devices[i].channelCount = atoi( colon + 1 );
+        data.channelCount += devices[i].channelCount;
+    }
+    if( data.channelCount > MAX_CHANNELS )
+    {
+        err = paInvalidChannelCount;
+        goto error;
+    }
+
+    PaAlsa_InitializeStreamInfoVersion( &streamInfo, 3 );
+    streamInfo.aggregateDevices = devices;
+    streamInfo.aggregateDeviceCount = deviceCount;
+
+    inputParameters.channelCount = data.channelCount;
+    inputParameters.sampleFormat = paFloat32;
+    inputParameters.suggestedLatency = Pa_GetDeviceInfo( inputParameters.device )->defaultLowInputLatency;
+    inputParameters.hostApiSpecificStreamInfo = &streamInfo;
+
+    err = Pa_OpenStream( &stream, &inputParameters, NULL, SAMPLE_RATE, paFramesPerBufferUnspecified,
+                         paClipOff, recordCallback, &data );
+    if( err != paNoError ) goto error;
+
+    printf( "Recording %d channels, input latency %.3f seconds\n", data.channelCount,
+            Pa_GetStreamInfo( stream )->inputLatency );
+    err = Pa_StartStream( stream );
+    if( err != paNoError ) goto error;
+
+    for( second = 0; second < NUM_SECONDS; second++ )
+    {
+        Pa_Sleep( 1000 );
+
+        firstChannel = data.channelCount;
+        for( i = 0; i < deviceCount; i++ )
+            firstChannel -= devices[i].channelCount;
+        printf( "%2d s: default peak", second + 1 );
+        for( c = 0; c < firstChannel; c++ )
+            printf( " %.3f", data.peaks[c] );
+        for( i = 0; i < deviceCount; i++ )
+        {
+            double ratio = 0.;
+            float peak = 0.f;
+            PaAlsa_GetStreamAggregateRatio( stream, 1, i, &ratio );
+            for( c = 0; c < devices[i].channelCount; c++ )
+            {
+                if( data.peaks[firstChannel + c] > peak )
+                    peak = data.peaks[firstChannel + c];
+            }
+            firstChannel += devices[i].channelCount;
+            printf( ", %s ratio %.6f peak %.3f", devices[i].deviceString, ratio, peak );
+        }
+        printf( ", overflows %lu\n", data.overflowCount );
+        fflush( stdout );
+        memset( data.peaks, 0, sizeof (data.peaks) );
+    }
+
+    err = Pa_StopStream( stream );
+    if( err != paNoError ) goto error;
+    err = Pa_CloseStream( stream );
+    stream = NULL;
+    if( err != paNoError ) goto error;
+
+    Pa_Terminate();
+    printf( "Test finished.\n" );
+    return 0;
+
+error:
+    if( stream )
+        Pa_CloseStream( stream );
+    Pa_Terminate();
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return 1;
+}
@@ -0,0 +1,124 @@
+/** @file patest_alsa_streaminfo.c
+    @ingroup test_src
+    @brief Check that initializing an old PaAlsaStreamInfo doesn't write past its end.
+
+    Applications built against the version 1 header allocate a PaAlsaStreamInfo
+    that ends after deviceString. Initializes one in a guarded buffer with
+    PaAlsa_InitializeStreamInfo and checks that the bytes after it are untouched,
+    then does the same for each version passed to PaAlsa_InitializeStreamInfoVersion.
+    Needs no sound hardware.
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "portaudio.h"
+#include "pa_linux_alsa.h"
+
+#define GUARD_BYTE (0xA5)
+
+typedef union
+{
+    PaAlsaStreamInfo info;
+    unsigned char bytes[sizeof (PaAlsaStreamInfo) + 64];
+}
+GuardedStreamInfo;
+
+/* Returns 1 if any byte from the given offset on was written */
+static int isOverrun( const GuardedStreamInfo *guarded, size_t offset )
+{
+    size_t i;
+
+    for( i = offset; i < sizeof (guarded->bytes); ++i )
+    {
+        if( guarded->bytes[i] != GUARD_BYTE )
+        {
+            printf( "byte %lu after the end of the structure was written\n", (unsigned long)( i - offset ) );
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int checkVersion( unsigned long version, size_t size )
+{
+    GuardedStreamInfo guarded;
+    PaError err;
+    int failed;
+
+    memset( guarded.bytes, GUARD_BYTE, sizeof (guarded.bytes) );
+    if( version == 0 )
+    {
+        PaAlsa_InitializeStreamInfo( &guarded.info );
+        version = 1;
+        err = paNoError;
+    }
+    else
+        err = PaAlsa_InitializeStreamInfoVersion( &guarded.info, version );
+
+    failed = err != paNoError || isOverrun( &guarded, size ) ||
+        guarded.info.size != size || guarded.info.version != version ||
+        guarded.info.hostApiType != paALSA || guarded.info.deviceString != NULL;
+    printf( "version %lu: size %lu, %s\n", version, (unsigned long)size, failed ? "FAILED" : "ok" );
+    return failed;
+}
+
+int main( void );
+int main( void )
+{
+    PaAlsaStreamInfo info;
+    int failed = 0;
+
+    failed |= checkVersion( 0, offsetof( PaAlsaStreamInfo, cpuAffinity ) );
+    failed |= checkVersion( 1, offsetof( PaAlsaStreamInfo, cpuAffinity ) );
+    failed |= checkVersion( 2, offsetof( PaAlsaStreamInfo, aggregateDevices ) );
+    failed |= checkVersion( 3, sizeof (PaAlsaStreamInfo) );
+
+    if( PaAlsa_InitializeStreamInfoVersion( &info, 4 ) != paIncompatibleHostApiSpecificStreamInfo )
+    {
+        printf( "version 4 was accepted\n" );
+        failed = 1;
+    }
+
+    printf( failed ? "FAILED\n" : "PASSED\n" );
+    return failed;
+}
@@ -0,0 +1,202 @@
+/** @file patest_alsa_tsched.c
+    @ingroup test_src
+    @brief Compare timer-based scheduling of ALSA streams with period-based configurations.
+
+    Plays a quiet sine wave on the default output device with the same suggested
+    latency once for each of a few PaAlsa_SetNumPeriods settings and once with
+    PaAlsa_SetTimerScheduling, and prints the callbacks and context switches per
+    second, the output underflows and the CPU load of each configuration.
+
+    Usage: patest_alsa_tsched [latency in seconds] [seconds per configuration]
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/resource.h>
+
+#include "portaudio.h"
+#include "pa_linux_alsa.h"
+
+#define LATENCY         (0.5)
+#define NUM_SECONDS     (10)
+#define FREQUENCY       (440.0)
+#define AMPLITUDE       (0.1)
+#ifndef M_PI
+#define M_PI            (3.14159265)
+#endif
+
+typedef struct
+{
+    double phase;
+    double phaseIncrement;
+    unsigned long callbackCount;
+    unsigned long underflowCount;
+}
+paTestData;
+
+static int patestCallback( const void *inputBuffer, void *outputBuffer,
+                           unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           PaStreamCallbackFlags statusFlags,
+                           void *userData )
+{
+    paTestData *data = (paTestData*)userData;
+    float *out = (float*)outputBuffer;
+    unsigned long i;
+
+    (void) inputBuffer;
+    (void) timeInfo;
+
+    for( i=0; i<framesPerBuffer; i++ )
+    {
+        float sample = (float)( AMPLITUDE * sin( data->phase ) );
+        *out++ = sample;
+        *out++ = sample;
+        data->phase += data->phaseIncrement;
+        if( data->phase >= 2.0 * M_PI )
+            data->phase -= 2.0 * M_PI;
+    }
+
+    ++data->callbackCount;
+    if( statusFlags & paOutputUnderflow )
+        ++data->underflowCount;
+    return paContinue;
+}
+
+static long ContextSwitches( const struct rusage *usage )
+{
+    return usage->ru_nvcsw + usage->ru_nivcsw;
+}
+
+/* Play for the given time with the current ALSA settings and print a line of results */
+static PaError RunConfiguration( const char *name, PaDeviceIndex device, double latency, int seconds )
+{
+    PaStreamParameters outputParameters;
+    PaStream *stream;
+    paTestData data = { 0., 0., 0, 0 };
+    struct rusage before, after;
+    double sampleRate = Pa_GetDeviceInfo( device )->defaultSampleRate, cpuLoad;
+    PaError err;
+
+    outputParameters.device = device;
+    outputParameters.channelCount = 2;
+    outputParameters.sampleFormat = paFloat32;
+    outputParameters.suggestedLatency = latency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+    data.phaseIncrement = 2.0 * M_PI * FREQUENCY / sampleRate;
+
+    err = Pa_OpenStream( &stream, NULL, &outputParameters, sampleRate, paFramesPerBufferUnspecified,
+                         paClipOff, patestCallback, &data );
+    if( err != paNoError )
+        return err;
+
+    getrusage( RUSAGE_SELF, &before );
+    err = Pa_StartStream( stream );
+    if( err != paNoError )
+    {
+        Pa_CloseStream( stream );
+        return err;
+    }
+    Pa_Sleep( seconds * 1000 );
+    cpuLoad = Pa_GetStreamCpuLoad( stream );
+    getrusage( RUSAGE_SELF, &after );
+
+    printf( "%-20s %8.3f %12.1f %12.1f %10lu %8.4f\n", name, Pa_GetStreamInfo( stream )->outputLatency,
+            (double)data.callbackCount / seconds, (double)( ContextSwitches( &after ) - ContextSwitches( &before ) ) / seconds,
+            data.underflowCount, cpuLoad );
+    fflush( stdout );
+
+    err = Pa_StopStream( stream );
+    Pa_CloseStream( stream );
+    return err;
+}
+
+int main( int argc, char **argv );
+int main( int argc, char **argv )
+{
+    static const int numPeriods[] = { 2, 4, 8 };
+    double latency = argc > 1 ? atof( argv[1] ) : LATENCY;
+    int seconds = argc > 2 ? atoi( argv[2] ) : NUM_SECONDS;
+    PaDeviceIndex device;
+    char name[32];
+    PaError err;
+    int i;
+
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+
+    device = Pa_GetDefaultOutputDevice();
+    if( device == paNoDevice || Pa_GetHostApiInfo( Pa_GetDeviceInfo( device )->hostApi )->type != paALSA )
+    {
+        fprintf( stderr, "Error: The default output device is not an ALSA device.\n" );
+        err = paInvalidDevice;
+        goto error;
+    }
+
+    printf( "Suggested latency %.3f seconds, %d seconds per configuration on %s\n", latency, seconds,
+            Pa_GetDeviceInfo( device )->name );
+    printf( "%-20s %8s %12s %12s %10s %8s\n", "configuration", "latency", "callbacks/s", "switches/s",
+            "underflows", "cpu load" );
+
+    PaAlsa_SetTimerScheduling( 0 );
+    for( i = 0; i < (int)( sizeof (numPeriods) / sizeof (numPeriods[0]) ); ++i )
+    {
+        PaAlsa_SetNumPeriods( numPeriods[i] );
+        snprintf( name, sizeof (name), "%d periods", numPeriods[i] );
+        err = RunConfiguration( name, device, latency, seconds );
+        if( err != paNoError ) goto error;
+    }
+
+    PaAlsa_SetNumPeriods( 4 );
+    PaAlsa_SetTimerScheduling( 1 );
+    err = RunConfiguration( "timer scheduling", device, latency, seconds );
+    if( err != paNoError ) goto error;
+
+    Pa_Terminate();
+    printf( "Test finished.\n" );
+    return 0;
+
+error:
+    Pa_Terminate();
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return 1;
+}
@@ -0,0 +1,171 @@
+/** @file patest_begin_commit.c
+    @ingroup test_src
+    @brief Play a sine wave by writing straight into the stream's buffer with Pa_BeginWriteStream and Pa_CommitWriteStream.
+
+    The stream is opened with 16 bit samples, which most devices take as they are, so that host APIs which support it
+    hand out their own buffers. Pass -n to use non-interleaved buffers.
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "portaudio.h"
+
+#define NUM_SECONDS         (3)
+#define SAMPLE_RATE         (44100)
+#define FRAMES_PER_BUFFER   (256)
+#define NUM_CHANNELS        (2)
+#define NUM_PREFILL_BUFFERS (3)
+
+#ifndef M_PI
+#define M_PI  (3.14159265)
+#endif
+
+
+static void FillSine( void *buffer, unsigned long frames, int nonInterleaved, double *phase )
+{
+    unsigned long i;
+    int c;
+
+    for( i = 0; i < frames; ++i )
+    {
+        short sample = (short)( 8000. * sin( *phase ) );
+        *phase += 2. * M_PI * 440. / SAMPLE_RATE;
+        for( c = 0; c < NUM_CHANNELS; ++c )
+        {
+            if( nonInterleaved )
+                ((short **)buffer)[c][i] = sample;
+            else
+                ((short *)buffer)[i * NUM_CHANNELS + c] = sample;
+        }
+    }
+}
+
+int main( int argc, char **argv );
+int main( int argc, char **argv )
+{
+    PaStreamParameters outputParameters;
+    PaStream *stream;
+    PaError err;
+    int nonInterleaved = argc > 1 && !strcmp( argv[1], "-n" );
+    int i;
+    unsigned long framesLeft = NUM_SECONDS * SAMPLE_RATE, commitCount = 0, frames;
+    double phase = 0.;
+    void *buffer;
+
+    printf( "PortAudio Test: write a sine wave with Pa_BeginWriteStream, %s.\n",
+            nonInterleaved ? "non-interleaved" : "interleaved" );
+
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+
+    outputParameters.device = Pa_GetDefaultOutputDevice();
+    if( outputParameters.device == paNoDevice )
+    {
+        fprintf( stderr, "Error: No default output device.\n" );
+        goto error;
+    }
+    outputParameters.channelCount = NUM_CHANNELS;
+    outputParameters.sampleFormat = paInt16 | ( nonInterleaved ? paNonInterleaved : 0 );
+    outputParameters.suggestedLatency = Pa_GetDeviceInfo( outputParameters.device )->defaultHighOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    err = Pa_OpenStream( &stream, NULL, &outputParameters, SAMPLE_RATE, FRAMES_PER_BUFFER, paClipOff, NULL, NULL );
+    if( err != paNoError ) goto error;
+
+    /* Nothing to commit yet */
+    if( Pa_CommitWriteStream( stream, 1 ) != paBadBufferPtr )
+    {
+        fprintf( stderr, "Pa_CommitWriteStream without Pa_BeginWriteStream should fail.\n" );
+        err = paInternalError;
+        goto error;
+    }
+
+    /* Prefill the first buffers while the stream is stopped, they are written once the stream is started */
+    for( i = 0; i < NUM_PREFILL_BUFFERS; ++i )
+    {
+        frames = FRAMES_PER_BUFFER;
+        err = Pa_BeginWriteStream( stream, &buffer, &frames );
+        if( err != paNoError ) goto error;
+        FillSine( buffer, frames, nonInterleaved, &phase );
+        err = Pa_CommitWriteStream( stream, frames );
+        if( err != paNoError ) goto error;
+        framesLeft -= frames;
+        ++commitCount;
+    }
+
+    err = Pa_StartStream( stream );
+    if( err != paNoError ) goto error;
+
+    while( framesLeft > 0 )
+    {
+        frames = framesLeft < FRAMES_PER_BUFFER ? framesLeft : FRAMES_PER_BUFFER;
+        err = Pa_BeginWriteStream( stream, &buffer, &frames );
+        if( err == paOutputUnderflowed )
+            printf( "Output underflowed.\n" );
+        else if( err != paNoError )
+            goto error;
+
+        FillSine( buffer, frames, nonInterleaved, &phase );
+
+        err = Pa_CommitWriteStream( stream, frames );
+        if( err != paNoError && err != paOutputUnderflowed ) goto error;
+        framesLeft -= frames;
+        ++commitCount;
+    }
+    printf( "Wrote %d seconds in %lu commits.\n", NUM_SECONDS, commitCount );
+
+    err = Pa_StopStream( stream );
+    if( err != paNoError ) goto error;
+
+    err = Pa_CloseStream( stream );
+    if( err != paNoError ) goto error;
+
+    Pa_Terminate();
+    printf( "Test finished.\n" );
+    return err;
+
+error:
+    Pa_Terminate();
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return err;
+}
@@ -0,0 +1,122 @@
+/** @file patest_clock.c
+    @ingroup test_src
+    @brief Measures the cost of PaUtil_GetTime and PaUtil_GetNanoseconds
+
+    Checks that each clock source supported by PaUnix_SetClockSource is
+    monotonic and agrees with PaUtil_GetTime over a short sleep, and prints the
+    average cost of a call for each source.
+*/
+/*
+ * $Id: $
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2008 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+#include <stdio.h>
+
+#include "portaudio.h"
+#include "pa_util.h"
+#include "pa_unix_util.h"
+
+#define CALL_COUNT      (1000000)
+#define SLEEP_MSEC      (100)
+
+static int failures_ = 0;
+
+#define CHECK( expr ) \
+    do { if( !(expr) ){ printf( "FAILED line %d: %s\n", __LINE__, #expr ); ++failures_; } } while(0)
+
+
+static void TestSource( PaUnixClockSource source, const char *name )
+{
+    PaInt64 previous, now, elapsed;
+    PaTime start, seconds;
+    long i, backwards = 0;
+
+    /* selecting a source mustn't wait for it to be calibrated */
+    start = PaUtil_GetTime();
+    if( PaUnix_SetClockSource( source ) != paNoError )
+    {
+        printf( "%-10s not supported\n", name );
+        return;
+    }
+    CHECK( PaUtil_GetTime() - start < .002 );
+    CHECK( PaUnix_GetClockSource() == source );
+
+    previous = PaUtil_GetNanoseconds();
+    start = PaUtil_GetTime();
+    for( i=0; i < CALL_COUNT; ++i )
+    {
+        now = PaUtil_GetNanoseconds();
+        if( now < previous )
+            ++backwards;
+        previous = now;
+    }
+    seconds = PaUtil_GetTime() - start;
+    CHECK( backwards == 0 );
+    printf( "%-10s PaUtil_GetNanoseconds: %5.1f nsec per call\n", name, seconds * 1e9 / CALL_COUNT );
+
+    /* the interval measured by both clocks should agree to within a millisecond */
+    start = PaUtil_GetTime();
+    previous = PaUtil_GetNanoseconds();
+    Pa_Sleep( SLEEP_MSEC );
+    elapsed = PaUtil_GetNanoseconds() - previous;
+    seconds = PaUtil_GetTime() - start;
+    CHECK( PA_NANOSECONDS_TO_PATIME( elapsed ) > seconds - .001 );
+    CHECK( PA_NANOSECONDS_TO_PATIME( elapsed ) < seconds + .001 );
+}
+
+
+int main( void );
+int main( void )
+{
+    PaTime start, now = 0.;
+    long i;
+
+    PaUtil_InitializeClock();
+
+    start = PaUtil_GetTime();
+    for( i=0; i < CALL_COUNT; ++i )
+        now += PaUtil_GetTime();
+    printf( "%-10s PaUtil_GetTime:        %5.1f nsec per call\n", "",
+            (PaUtil_GetTime() - start) * 1e9 / CALL_COUNT );
+
+    TestSource( paUnixClockMonotonic, "monotonic" );
+    TestSource( paUnixClockMonotonicRaw, "raw" );
+    TestSource( paUnixClockTsc, "tsc" );
+    CHECK( PaUnix_SetClockSource( paUnixClockMonotonic ) == paNoError );
+
+    printf( failures_ ? "FAILED\n" : "PASSED\n" );
+    return failures_ ? 1 : 0;
+}
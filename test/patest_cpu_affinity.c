@@ -0,0 +1,176 @@
+/** @file patest_cpu_affinity.c
+    @ingroup test_src
+    @brief Tests CPU lists and the CPU affinity of threads created by PaUnixThread_New
+
+    Parses and formats CPU lists, then pins a thread to the first CPU available
+    to the process and checks that the affinity reported back matches.
+*/
+/*
+ * $Id: $
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2008 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+#define _GNU_SOURCE /* for sched_getcpu */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sched.h>
+
+#include "portaudio.h"
+#include "pa_util.h"
+#include "pa_unix_util.h"
+
+static int failures_ = 0;
+
+#define CHECK( expr ) \
+    do { if( !(expr) ){ printf( "FAILED line %d: %s\n", __LINE__, #expr ); ++failures_; } } while(0)
+
+
+/* Parse cpuList and format it back, return the formatted list */
+static const char *RoundTrip( const char *cpuList )
+{
+    static char formatted[256];
+    PaUnixCpuSet set;
+
+    if( PaUnixCpuSet_Parse( &set, cpuList ) != paNoError )
+        return "error";
+    PaUnixCpuSet_Format( &set, formatted, sizeof (formatted) );
+    return formatted;
+}
+
+
+static int startCpu_ = -1;   /* the CPU a thread started out on */
+
+static void *ThreadFunc( void *userData )
+{
+    PaUnixThread *thread = (PaUnixThread *)userData;
+
+#ifdef __GLIBC__
+    startCpu_ = sched_getcpu();
+#endif
+    while( !PaUnixThread_StopRequested( thread ) )
+        Pa_Sleep( 1 );
+    return NULL;
+}
+
+
+int main( void );
+int main( void )
+{
+    PaUnixThread thread;
+    PaUnixCpuSet set;
+    char cpuList[16], first[16];
+
+    PaUtil_InitializeClock();
+    PaUnixThreading_Initialize();
+
+    CHECK( strcmp( RoundTrip( NULL ), "" ) == 0 );
+    CHECK( strcmp( RoundTrip( "" ), "" ) == 0 );
+    CHECK( strcmp( RoundTrip( "3" ), "3" ) == 0 );
+    CHECK( strcmp( RoundTrip( "2-3,6" ), "2-3,6" ) == 0 );
+    CHECK( strcmp( RoundTrip( "6,0,1,2,5-4" ), "error" ) == 0 );
+    CHECK( strcmp( RoundTrip( "6,0,1,2,4-5" ), "0-2,4-6" ) == 0 );
+    CHECK( strcmp( RoundTrip( "1023" ), "1023" ) == 0 );
+    CHECK( strcmp( RoundTrip( "1024" ), "error" ) == 0 );
+    CHECK( strcmp( RoundTrip( "1," ), "error" ) == 0 );
+    CHECK( strcmp( RoundTrip( "1-" ), "error" ) == 0 );
+    CHECK( strcmp( RoundTrip( "a" ), "error" ) == 0 );
+
+    /* entries which don't fit are dropped */
+    CHECK( PaUnixCpuSet_Parse( &set, "0-3,10,200-300" ) == paNoError );
+    PaUnixCpuSet_Format( &set, cpuList, 8 );
+    CHECK( strcmp( cpuList, "0-3,10" ) == 0 );
+    CHECK( !PaUnixCpuSet_IsEmpty( &set ) );
+    CHECK( PaUnixCpuSet_Contains( &set, 250 ) );
+    CHECK( !PaUnixCpuSet_Contains( &set, 5 ) );
+    CHECK( !PaUnixCpuSet_Contains( &set, PA_UNIX_MAX_CPUS ) );
+    PaUnixCpuSet_Add( &set, 4 );
+    PaUnixCpuSet_Format( &set, cpuList, 8 );
+    CHECK( strcmp( cpuList, "0-4,10" ) == 0 );
+
+    /* some CPU is always available */
+    PaUnixThreading_GetAvailableCpus( &set );
+    CHECK( !PaUnixCpuSet_IsEmpty( &set ) );
+
+    /* without an affinity the thread may run on any CPU available to the process */
+    CHECK( PaUnixThread_New( &thread, ThreadFunc, &thread, 0., 0, NULL ) == paNoError );
+    PaUnixCpuSet_Format( &thread.cpuAffinity, cpuList, sizeof (cpuList) );
+    CHECK( PaUnixThread_Terminate( &thread, 1, NULL ) == paNoError );
+    if( PaUnixCpuSet_IsEmpty( &thread.cpuAffinity ) )
+    {
+        printf( "thread affinity not supported\n" );
+    }
+    else
+    {
+        printf( "process CPUs: %s\n", cpuList );
+
+        /* pin a thread to the first of them */
+        sscanf( cpuList, "%15[0-9]", first );
+        CHECK( PaUnixCpuSet_Parse( &set, first ) == paNoError );
+        startCpu_ = -1;
+        CHECK( PaUnixThread_New( &thread, ThreadFunc, &thread, 0., 0, &set ) == paNoError );
+        PaUnixCpuSet_Format( &thread.cpuAffinity, cpuList, sizeof (cpuList) );
+        CHECK( PaUnixThread_Terminate( &thread, 1, NULL ) == paNoError );
+        CHECK( strcmp( cpuList, first ) == 0 );
+#ifdef __GLIBC__
+        /* created there, rather than moved there once running */
+        CHECK( startCpu_ == atoi( first ) );
+#endif
+
+        /* a CPU the process can't run on doesn't keep the thread from starting */
+        memset( &set, 0, sizeof (set) );
+        PaUnixCpuSet_Add( &set, PA_UNIX_MAX_CPUS - 1 );
+        CHECK( PaUnixThread_New( &thread, ThreadFunc, &thread, 0., 0, &set ) == paNoError );
+        CHECK( PaUnixThread_Terminate( &thread, 1, NULL ) == paNoError );
+        CHECK( PaUnixCpuSet_Parse( &set, first ) == paNoError );
+
+        /* and through the default affinity */
+        CHECK( PaUnixThreading_SetDefaultCpuAffinity( &set ) == paNoError );
+        CHECK( PaUnixThread_New( &thread, ThreadFunc, &thread, 0., 0, NULL ) == paNoError );
+        PaUnixCpuSet_Format( &thread.cpuAffinity, cpuList, sizeof (cpuList) );
+        CHECK( PaUnixThread_Terminate( &thread, 1, NULL ) == paNoError );
+        CHECK( strcmp( cpuList, first ) == 0 );
+        printf( "pinned thread CPUs: %s\n", cpuList );
+
+        /* which then limits the available CPUs */
+        PaUnixThreading_GetAvailableCpus( &set );
+        PaUnixCpuSet_Format( &set, cpuList, sizeof (cpuList) );
+        CHECK( strcmp( cpuList, first ) == 0 );
+    }
+
+    printf( failures_ ? "FAILED\n" : "PASSED\n" );
+    return failures_ ? 1 : 0;
+}
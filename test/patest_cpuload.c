@@ -0,0 +1,128 @@
+/** @file patest_cpuload.c
+    @ingroup test_src
+    @brief Tests the callback load histogram in pa_cpuload.c
+
+    Drives a CPU load measurer with busy waits of known duration and checks the
+    callback count, deadline miss count, maximum and percentiles reported by
+    PaUtil_GetCpuLoadStatistics.
+*/
+/*
+ * $Id: $
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2008 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+#include <stdio.h>
+
+#include "portaudio.h"
+#include "pa_cpuload.h"
+#include "pa_util.h"
+
+#define SAMPLE_RATE         (10000)
+#define FRAMES_PER_BUFFER   (20)    /* 2 msec period */
+#define CALLBACK_COUNT      (1000)
+#define SLOW_INTERVAL       (100)   /* every SLOW_INTERVAL'th buffer misses its deadline */
+
+static int failures_ = 0;
+
+#define CHECK( expr ) \
+    do { if( !(expr) ){ printf( "FAILED line %d: %s\n", __LINE__, #expr ); ++failures_; } } while(0)
+
+
+static void BusyWait( double seconds )
+{
+    double end = PaUtil_GetTime() + seconds;
+    while( PaUtil_GetTime() < end )
+        ;
+}
+
+
+int main( void );
+int main( void )
+{
+    PaUtilCpuLoadMeasurer measurer;
+    PaStreamStatistics statistics;
+    double period = (double)FRAMES_PER_BUFFER / SAMPLE_RATE;
+    unsigned long sum = 0;
+    int i;
+
+    PaUtil_InitializeClock();
+    PaUtil_InitializeCpuLoadMeasurer( &measurer, SAMPLE_RATE );
+
+    PaUtil_GetCpuLoadStatistics( &measurer, &statistics );
+    CHECK( statistics.callbackCount == 0 );
+    CHECK( statistics.maximumLoad == 0. );
+    CHECK( statistics.load999thPercentile == 0. );
+
+    for( i=0; i < CALLBACK_COUNT; ++i )
+    {
+        PaUtil_BeginCpuLoadMeasurement( &measurer );
+        BusyWait( ( (i % SLOW_INTERVAL) == SLOW_INTERVAL - 1 ) ? period * 1.5 : period * .25 );
+        PaUtil_EndCpuLoadMeasurement( &measurer, FRAMES_PER_BUFFER );
+    }
+
+    /* empty buffers are not measured */
+    PaUtil_BeginCpuLoadMeasurement( &measurer );
+    PaUtil_EndCpuLoadMeasurement( &measurer, 0 );
+
+    PaUtil_GetCpuLoadStatistics( &measurer, &statistics );
+
+    printf( "%lu callbacks, %lu missed deadlines, average %f, max %f, 99%% %f, 99.9%% %f\n",
+            statistics.callbackCount, statistics.deadlineMissCount, statistics.averageLoad,
+            statistics.maximumLoad, statistics.load99thPercentile, statistics.load999thPercentile );
+
+    for( i=0; i < paLoadHistogramBinCount; ++i )
+        sum += statistics.loadHistogram[i];
+
+    CHECK( statistics.callbackCount == CALLBACK_COUNT );
+    CHECK( sum == CALLBACK_COUNT );
+    /* timing is only checked loosely, the busy waits can be preempted */
+    CHECK( statistics.deadlineMissCount >= CALLBACK_COUNT / SLOW_INTERVAL );
+    CHECK( statistics.maximumLoad >= 1.5 );
+    CHECK( statistics.load999thPercentile >= 1.5 - paLoadHistogramBinWidth );
+    CHECK( statistics.load999thPercentile <= statistics.maximumLoad );
+    CHECK( statistics.load99thPercentile >= .25 );
+    CHECK( statistics.load99thPercentile <= statistics.load999thPercentile );
+    CHECK( statistics.averageLoad > 0. );
+    CHECK( statistics.averageLoad == PaUtil_GetCpuLoad( &measurer ) );
+
+    /* resetting clears the average but keeps the histogram */
+    PaUtil_ResetCpuLoadMeasurer( &measurer );
+    PaUtil_GetCpuLoadStatistics( &measurer, &statistics );
+    CHECK( statistics.averageLoad == 0. );
+    CHECK( statistics.callbackCount == CALLBACK_COUNT );
+
+    printf( failures_ ? "FAILED\n" : "PASSED\n" );
+    return failures_ ? 1 : 0;
+}
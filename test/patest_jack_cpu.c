@@ -0,0 +1,184 @@
+/** @file patest_jack_cpu.c
+    @ingroup test_src
+    @brief Measure the time a JACK callback stream takes per JACK cycle.
+
+    Runs an output stream on the default JACK device with a callback that does next
+    to nothing, once with paFloat32 | paNonInterleaved buffers of one JACK period,
+    which the callback gets straight from the JACK ports, and once with interleaved
+    paFloat32 and with an odd buffer size, both of which go through copies. Prints the
+    average time PortAudio spends per cycle, taken from Pa_GetStreamCpuLoad().
+
+    Run it against a JACK server with the dummy backend, for example:
+
+        jackd -d dummy -r 48000 -p 256 -P 8 &
+        patest_jack_cpu 256
+
+    Usage: patest_jack_cpu [JACK period in frames] [seconds per stream]
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "portaudio.h"
+
+#define NUM_SECONDS     (5)
+#define MAX_CHANNELS    (8)
+#define JACK_PERIOD     (256)
+
+static int patestCallback( const void *inputBuffer, void *outputBuffer,
+                           unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           PaStreamCallbackFlags statusFlags,
+                           void *userData )
+{
+    const PaStreamParameters *parameters = (const PaStreamParameters*)userData;
+    int i;
+
+    (void) inputBuffer;
+    (void) timeInfo;
+    (void) statusFlags;
+
+    if( parameters->sampleFormat & paNonInterleaved )
+    {
+        for( i = 0; i < parameters->channelCount; ++i )
+            memset( ((float**)outputBuffer)[i], 0, framesPerBuffer * sizeof (float) );
+    }
+    else
+        memset( outputBuffer, 0, framesPerBuffer * parameters->channelCount * sizeof (float) );
+
+    return paContinue;
+}
+
+/* Run a stream for the given time and print the time spent per JACK cycle */
+static PaError RunStream( const char *name, PaStreamParameters *parameters, unsigned long framesPerBuffer,
+                          unsigned long jackPeriod, int seconds )
+{
+    PaStream *stream;
+    double sampleRate, load = 0.;
+    int i;
+    PaError err;
+
+    sampleRate = Pa_GetDeviceInfo( parameters->device )->defaultSampleRate;
+    err = Pa_OpenStream( &stream, NULL, parameters, sampleRate, framesPerBuffer, paClipOff,
+                         patestCallback, parameters );
+    if( err != paNoError )
+        return err;
+
+    err = Pa_StartStream( stream );
+    if( err != paNoError )
+    {
+        Pa_CloseStream( stream );
+        return err;
+    }
+    /* Average the load over the run, it is already smoothed over a few cycles */
+    for( i = 0; i < seconds * 10; ++i )
+    {
+        Pa_Sleep( 100 );
+        load += Pa_GetStreamCpuLoad( stream );
+    }
+    load /= seconds * 10;
+    err = Pa_StopStream( stream );
+    Pa_CloseStream( stream );
+
+    printf( "%-28s %10lu %14.2f\n", name, framesPerBuffer, load * jackPeriod / sampleRate * 1e6 );
+    fflush( stdout );
+    return err;
+}
+
+int main( int argc, char **argv );
+int main( int argc, char **argv )
+{
+    unsigned long jackPeriod = argc > 1 ? strtoul( argv[1], NULL, 10 ) : JACK_PERIOD;
+    int seconds = argc > 2 ? atoi( argv[2] ) : NUM_SECONDS;
+    PaStreamParameters outputParameters;
+    PaHostApiIndex hostApi;
+    PaError err;
+
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+
+    hostApi = Pa_HostApiTypeIdToHostApiIndex( paJACK );
+    if( hostApi < 0 )
+    {
+        fprintf( stderr, "Error: JACK is not available, is the server running?\n" );
+        err = hostApi;
+        goto error;
+    }
+
+    outputParameters.device = Pa_GetHostApiInfo( hostApi )->defaultOutputDevice;
+    if( outputParameters.device == paNoDevice )
+    {
+        fprintf( stderr, "Error: No JACK output device.\n" );
+        err = paInvalidDevice;
+        goto error;
+    }
+    outputParameters.channelCount = Pa_GetDeviceInfo( outputParameters.device )->maxOutputChannels;
+    if( outputParameters.channelCount > MAX_CHANNELS )
+        outputParameters.channelCount = MAX_CHANNELS;
+    outputParameters.suggestedLatency = Pa_GetDeviceInfo( outputParameters.device )->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    printf( "%d channels, %d seconds per stream\n", outputParameters.channelCount, seconds );
+    printf( "%-28s %10s %14s\n", "buffers", "frames", "usec/cycle" );
+
+    outputParameters.sampleFormat = paFloat32 | paNonInterleaved;
+    err = RunStream( "non-interleaved, one period", &outputParameters, jackPeriod, jackPeriod, seconds );
+    if( err != paNoError ) goto error;
+
+    outputParameters.sampleFormat = paFloat32;
+    err = RunStream( "interleaved, one period", &outputParameters, jackPeriod, jackPeriod, seconds );
+    if( err != paNoError ) goto error;
+
+    outputParameters.sampleFormat = paFloat32 | paNonInterleaved;
+    err = RunStream( "non-interleaved, odd size", &outputParameters, jackPeriod - 1, jackPeriod, seconds );
+    if( err != paNoError ) goto error;
+
+    Pa_Terminate();
+    printf( "Test finished.\n" );
+    return 0;
+
+error:
+    Pa_Terminate();
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return err;
+}
@@ -0,0 +1,190 @@
+/** @file patest_jack_many_streams.c
+    @ingroup test_src
+    @brief Start and stop many JACK streams at once.
+
+    Opens NUM_STREAMS output streams on the default JACK device, starts them all,
+    checks that every one of them gets its callback called and then stops and closes
+    them again. Prints how long opening, starting, stopping and closing took, which
+    shows whether the JACK process thread picks up queued streams promptly.
+
+    Run it against a JACK server with the dummy backend so that no sound card is
+    needed, for example:
+
+        jackd -d dummy -r 48000 -p 256 &
+        patest_jack_many_streams
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "portaudio.h"
+
+#define NUM_STREAMS     (100)
+#define NUM_CHANNELS    (1)
+#define SAMPLE_RATE     (48000)
+#define RUN_MSEC        (500)
+
+typedef struct
+{
+    volatile unsigned long frameCount;
+}
+paTestData;
+
+static int patestCallback( const void *inputBuffer, void *outputBuffer,
+                           unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           PaStreamCallbackFlags statusFlags,
+                           void *userData )
+{
+    paTestData *data = (paTestData*)userData;
+
+    (void) inputBuffer;
+    (void) timeInfo;
+    (void) statusFlags;
+
+    memset( outputBuffer, 0, framesPerBuffer * NUM_CHANNELS * sizeof (float) );
+    data->frameCount += framesPerBuffer;
+    return paContinue;
+}
+
+static double Now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static PaStream *streams_[NUM_STREAMS];
+static paTestData data_[NUM_STREAMS];
+
+int main( void );
+int main( void )
+{
+    PaStreamParameters outputParameters;
+    PaHostApiIndex hostApi;
+    double start;
+    int i, opened = 0, started = 0, silent = 0;
+    PaError err;
+
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+
+    hostApi = Pa_HostApiTypeIdToHostApiIndex( paJACK );
+    if( hostApi < 0 )
+    {
+        fprintf( stderr, "Error: JACK is not available, is the server running?\n" );
+        err = hostApi;
+        goto error;
+    }
+
+    outputParameters.device = Pa_GetHostApiInfo( hostApi )->defaultOutputDevice;
+    if( outputParameters.device == paNoDevice )
+    {
+        fprintf( stderr, "Error: No JACK output device.\n" );
+        err = paInvalidDevice;
+        goto error;
+    }
+    outputParameters.channelCount = NUM_CHANNELS;
+    outputParameters.sampleFormat = paFloat32;
+    outputParameters.suggestedLatency = Pa_GetDeviceInfo( outputParameters.device )->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    start = Now();
+    for( opened = 0; opened < NUM_STREAMS; ++opened )
+    {
+        err = Pa_OpenStream( &streams_[opened], NULL, &outputParameters, SAMPLE_RATE,
+                             paFramesPerBufferUnspecified, paClipOff, patestCallback, &data_[opened] );
+        if( err != paNoError ) goto error;
+    }
+    printf( "opened  %d streams in %8.3f ms\n", NUM_STREAMS, (Now() - start) * 1000. );
+
+    start = Now();
+    for( started = 0; started < NUM_STREAMS; ++started )
+    {
+        err = Pa_StartStream( streams_[started] );
+        if( err != paNoError ) goto error;
+    }
+    printf( "started %d streams in %8.3f ms\n", NUM_STREAMS, (Now() - start) * 1000. );
+
+    Pa_Sleep( RUN_MSEC );
+
+    start = Now();
+    for( i = 0; i < NUM_STREAMS; ++i )
+    {
+        err = Pa_StopStream( streams_[i] );
+        if( err != paNoError ) goto error;
+    }
+    started = 0;
+    printf( "stopped %d streams in %8.3f ms\n", NUM_STREAMS, (Now() - start) * 1000. );
+
+    for( i = 0; i < NUM_STREAMS; ++i )
+    {
+        if( data_[i].frameCount == 0 )
+            ++silent;
+    }
+
+    start = Now();
+    while( opened > 0 )
+    {
+        err = Pa_CloseStream( streams_[--opened] );
+        if( err != paNoError ) goto error;
+    }
+    printf( "closed  %d streams in %8.3f ms\n", NUM_STREAMS, (Now() - start) * 1000. );
+
+    Pa_Terminate();
+
+    if( silent )
+        printf( "%d streams never had their callback called\n", silent );
+    printf( silent ? "FAILED\n" : "PASSED\n" );
+    return silent ? 1 : 0;
+
+error:
+    for( i = 0; i < started; ++i )
+        Pa_AbortStream( streams_[i] );
+    for( i = 0; i < opened; ++i )
+        Pa_CloseStream( streams_[i] );
+    Pa_Terminate();
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return err;
+}
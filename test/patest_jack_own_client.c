@@ -0,0 +1,197 @@
+/** @file patest_jack_own_client.c
+    @ingroup test_src
+    @brief Run heavy JACK streams on clients of their own.
+
+    Opens NUM_STREAMS output streams on the default JACK device whose callbacks each
+    spend LOAD of a JACK period busy. Together they need more than one period, so when
+    they share PortAudio's JACK client, which runs them one after the other, JACK
+    reports xruns. Opened with PaJackStreamInfo::ownClient, each stream gets a JACK
+    client of its own, and jackd2 runs them in parallel on a machine with at least
+    NUM_STREAMS cores. Prints the xruns seen by the callbacks for both cases.
+
+    Run it against jackd2 with the dummy backend, for example:
+
+        jackd -d dummy -r 48000 -p 256 &
+        patest_jack_own_client
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "portaudio.h"
+#include "pa_jack.h"
+
+#define NUM_STREAMS     (4)
+#define NUM_CHANNELS    (1)
+#define SAMPLE_RATE     (48000)
+#define LOAD            (0.4)
+#define RUN_MSEC        (3000)
+
+typedef struct
+{
+    volatile unsigned long callbackCount;
+    volatile unsigned long xrunCount;
+}
+paTestData;
+
+static double Now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int patestCallback( const void *inputBuffer, void *outputBuffer,
+                           unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           PaStreamCallbackFlags statusFlags,
+                           void *userData )
+{
+    paTestData *data = (paTestData*)userData;
+    double end = Now() + LOAD * framesPerBuffer / SAMPLE_RATE;
+
+    (void) inputBuffer;
+    (void) timeInfo;
+
+    memset( outputBuffer, 0, framesPerBuffer * NUM_CHANNELS * sizeof (float) );
+    while( Now() < end )
+        ;
+
+    if( statusFlags & paOutputUnderflow )
+        ++data->xrunCount;
+    ++data->callbackCount;
+    return paContinue;
+}
+
+static PaStream *streams_[NUM_STREAMS];
+static paTestData data_[NUM_STREAMS];
+
+/* Run all streams for RUN_MSEC and print how many xruns their callbacks were told about */
+static PaError RunStreams( const char *name, PaStreamParameters *outputParameters )
+{
+    int i, opened = 0, started = 0;
+    unsigned long callbacks = 0, xruns = 0;
+    PaError err = paNoError;
+
+    memset( data_, 0, sizeof (data_) );
+    for( opened = 0; opened < NUM_STREAMS; ++opened )
+    {
+        err = Pa_OpenStream( &streams_[opened], NULL, outputParameters, SAMPLE_RATE,
+                             paFramesPerBufferUnspecified, paClipOff, patestCallback, &data_[opened] );
+        if( err != paNoError ) goto done;
+    }
+    for( started = 0; started < NUM_STREAMS; ++started )
+    {
+        err = Pa_StartStream( streams_[started] );
+        if( err != paNoError ) goto done;
+    }
+
+    Pa_Sleep( RUN_MSEC );
+
+    for( i = 0; i < NUM_STREAMS; ++i )
+    {
+        callbacks += data_[i].callbackCount;
+        xruns += data_[i].xrunCount;
+    }
+    printf( "%-12s %10lu callbacks %8lu xruns\n", name, callbacks, xruns );
+
+done:
+    while( started > 0 )
+        Pa_StopStream( streams_[--started] );
+    while( opened > 0 )
+        Pa_CloseStream( streams_[--opened] );
+    return err;
+}
+
+int main( void );
+int main( void )
+{
+    PaStreamParameters outputParameters;
+    PaJackStreamInfo streamInfo;
+    PaHostApiIndex hostApi;
+    PaError err;
+
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+
+    hostApi = Pa_HostApiTypeIdToHostApiIndex( paJACK );
+    if( hostApi < 0 )
+    {
+        fprintf( stderr, "Error: JACK is not available, is the server running?\n" );
+        err = hostApi;
+        goto error;
+    }
+
+    outputParameters.device = Pa_GetHostApiInfo( hostApi )->defaultOutputDevice;
+    if( outputParameters.device == paNoDevice )
+    {
+        fprintf( stderr, "Error: No JACK output device.\n" );
+        err = paInvalidDevice;
+        goto error;
+    }
+    outputParameters.channelCount = NUM_CHANNELS;
+    outputParameters.sampleFormat = paFloat32;
+    outputParameters.suggestedLatency = Pa_GetDeviceInfo( outputParameters.device )->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    printf( "%d streams, each busy for %.0f%% of a period\n", NUM_STREAMS, LOAD * 100. );
+
+    err = RunStreams( "shared", &outputParameters );
+    if( err != paNoError ) goto error;
+
+    PaJack_InitializeStreamInfo( &streamInfo );
+    streamInfo.ownClient = 1;
+    outputParameters.hostApiSpecificStreamInfo = &streamInfo;
+    err = RunStreams( "own clients", &outputParameters );
+    if( err != paNoError ) goto error;
+
+    Pa_Terminate();
+    printf( "Test finished.\n" );
+    return 0;
+
+error:
+    Pa_Terminate();
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return err;
+}
@@ -0,0 +1,346 @@
+/** @file patest_null_loopback.c
+    @ingroup test_src
+    @brief Check the null host API's loopback, timestamps, injected xruns and clock.
+
+    Needs no sound hardware. Sends an impulse through the loopback of a full-duplex
+    stream on an unthrottled clock, checking that it is recorded after the sum of
+    the reported input and output latencies, with an inputBufferAdcTime equal to
+    the outputBufferDacTime it was played at. This is done with callbacks of one
+    device period and of an odd size, which goes through the buffer processor's
+    adaption. Then drops every XRUN_INTERVAL th period and counts the xruns the
+    callback is told about, runs the clock ten times faster than real time, and
+    sends a ramp through the loopback of a blocking paInt16 stream, checking that
+    it comes back intact.
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "portaudio.h"
+
+#define NULL_DEVICES      "2,2,48000,256,float32;2,2,44100,64,int16"
+#define SAMPLE_RATE       (48000)
+#define PERIOD_FRAMES     (256)
+#define ODD_FRAMES        (100)
+#define IMPULSE_FRAME     (1000)
+#define NUM_CALLBACKS     (400)
+#define XRUN_INTERVAL     (10)
+#define SPEED             (10)
+#define BLOCKING_RATE     (44100)
+#define BLOCKING_FRAMES   (441)
+#define BLOCKING_BLOCKS   (100)
+
+typedef struct
+{
+    unsigned long framesIn;
+    unsigned long framesOut;
+    unsigned long callbackCount;
+    unsigned long xrunCount;
+    int impulseSent;
+    int impulseDetected;
+    unsigned long detectedFrame;
+    double impulseDacTime;
+    double detectedAdcTime;
+}
+paTestData;
+
+static int loopbackCallback( const void *inputBuffer, void *outputBuffer,
+                             unsigned long framesPerBuffer,
+                             const PaStreamCallbackTimeInfo* timeInfo,
+                             PaStreamCallbackFlags statusFlags,
+                             void *userData )
+{
+    paTestData *data = (paTestData*)userData;
+    const float *in = (const float*)inputBuffer;
+    float *out = (float*)outputBuffer;
+    unsigned long i;
+
+    if( ( statusFlags & ( paInputOverflow | paOutputUnderflow ) ) == ( paInputOverflow | paOutputUnderflow ) )
+        ++data->xrunCount;
+
+    for( i = 0; i < framesPerBuffer && !data->impulseDetected; ++i )
+    {
+        if( in[2 * i] > .5f )
+        {
+            data->impulseDetected = 1;
+            data->detectedFrame = data->framesIn + i;
+            data->detectedAdcTime = timeInfo->inputBufferAdcTime + (double)i / SAMPLE_RATE;
+        }
+    }
+
+    memset( out, 0, framesPerBuffer * 2 * sizeof (float) );
+    if( !data->impulseSent && data->framesOut + framesPerBuffer > IMPULSE_FRAME )
+    {
+        i = IMPULSE_FRAME - data->framesOut;
+        out[2 * i] = 1.f;
+        data->impulseSent = 1;
+        data->impulseDacTime = timeInfo->outputBufferDacTime + (double)i / SAMPLE_RATE;
+    }
+
+    data->framesIn += framesPerBuffer;
+    data->framesOut += framesPerBuffer;
+    return ++data->callbackCount < NUM_CALLBACKS ? paContinue : paComplete;
+}
+
+static PaError runLoopback( PaDeviceIndex device, unsigned long framesPerBuffer, paTestData *data, double *latency )
+{
+    PaStreamParameters parameters;
+    PaStream *stream;
+    PaError err;
+
+    parameters.device = device;
+    parameters.channelCount = 2;
+    parameters.sampleFormat = paFloat32;
+    parameters.suggestedLatency = Pa_GetDeviceInfo( device )->defaultLowOutputLatency;
+    parameters.hostApiSpecificStreamInfo = NULL;
+
+    memset( data, 0, sizeof (*data) );
+    err = Pa_OpenStream( &stream, &parameters, &parameters, SAMPLE_RATE, framesPerBuffer, paClipOff,
+                         loopbackCallback, data );
+    if( err != paNoError )
+        return err;
+    *latency = Pa_GetStreamInfo( stream )->inputLatency + Pa_GetStreamInfo( stream )->outputLatency;
+    err = Pa_StartStream( stream );
+    if( err == paNoError )
+    {
+        while( Pa_IsStreamActive( stream ) == 1 )
+            Pa_Sleep( 1 );
+        err = Pa_StopStream( stream );
+    }
+    Pa_CloseStream( stream );
+    return err;
+}
+
+static int checkLoopback( const char *name, const paTestData *data, double latency )
+{
+    long delay = (long)data->detectedFrame - IMPULSE_FRAME;
+
+    printf( "%s: impulse back after %ld frames, latency %ld frames, adc - dac time %g s, %lu callbacks\n",
+            name, delay, (long)( latency * SAMPLE_RATE + .5 ), data->detectedAdcTime - data->impulseDacTime,
+            data->callbackCount );
+    return !data->impulseDetected || data->xrunCount ||
+        labs( delay - (long)( latency * SAMPLE_RATE + .5 ) ) > 0 ||
+        fabs( data->detectedAdcTime - data->impulseDacTime ) > .5 / SAMPLE_RATE;
+}
+
+static int countingCallback( const void *inputBuffer, void *outputBuffer,
+                             unsigned long framesPerBuffer,
+                             const PaStreamCallbackTimeInfo* timeInfo,
+                             PaStreamCallbackFlags statusFlags,
+                             void *userData )
+{
+    (void) inputBuffer;
+    (void) timeInfo;
+    (void) statusFlags;
+
+    memset( outputBuffer, 0, framesPerBuffer * 2 * sizeof (float) );
+    *(unsigned long*)userData += framesPerBuffer;
+    return paContinue;
+}
+
+static short ramp_[BLOCKING_BLOCKS * BLOCKING_FRAMES * 2];
+static short recorded_[BLOCKING_BLOCKS * BLOCKING_FRAMES * 2];
+
+/* Play a ramp through the loopback of a blocking stream, returns how many frames of it came back in order */
+static PaError runBlocking( PaDeviceIndex device, unsigned long *framesMatched )
+{
+    PaStreamParameters parameters;
+    PaStream *stream;
+    unsigned long i, written, prefill;
+    short expected = 0;
+    PaError err;
+
+    for( i = 0; i < BLOCKING_BLOCKS * BLOCKING_FRAMES; ++i )
+        ramp_[2 * i] = ramp_[2 * i + 1] = (short)( i % 30000 + 1 );
+
+    parameters.device = device;
+    parameters.channelCount = 2;
+    parameters.sampleFormat = paInt16;
+    parameters.suggestedLatency = .5;
+    parameters.hostApiSpecificStreamInfo = NULL;
+
+    err = Pa_OpenStream( &stream, &parameters, &parameters, BLOCKING_RATE, paFramesPerBufferUnspecified, paClipOff,
+                         NULL, NULL );
+    if( err != paNoError )
+        return err;
+    err = Pa_StartStream( stream );
+    if( err != paNoError )
+        goto done;
+
+    /* keep half the buffer queued, so the output doesn't run dry while waiting for input */
+    prefill = (unsigned long)Pa_GetStreamWriteAvailable( stream ) / 2;
+    prefill -= prefill % BLOCKING_FRAMES;
+    err = Pa_WriteStream( stream, ramp_, prefill );
+    written = prefill;
+    for( i = 0; i < BLOCKING_BLOCKS && err == paNoError; ++i )
+    {
+        if( written < BLOCKING_BLOCKS * BLOCKING_FRAMES )
+        {
+            err = Pa_WriteStream( stream, ramp_ + 2 * written, BLOCKING_FRAMES );
+            written += BLOCKING_FRAMES;
+        }
+        if( err == paNoError )
+            err = Pa_ReadStream( stream, recorded_ + 2 * i * BLOCKING_FRAMES, BLOCKING_FRAMES );
+    }
+    if( err == paNoError )
+        err = Pa_StopStream( stream );
+
+    *framesMatched = 0;
+    for( i = 0; i < BLOCKING_BLOCKS * BLOCKING_FRAMES; ++i )
+    {
+        if( !expected && !recorded_[2 * i] )
+            continue;
+        if( recorded_[2 * i] != expected + 1 || recorded_[2 * i + 1] != expected + 1 )
+            break;
+        expected = (short)( ( expected + 1 ) % 30000 );
+        ++*framesMatched;
+    }
+    if( i < BLOCKING_BLOCKS * BLOCKING_FRAMES )
+        *framesMatched = 0;
+
+done:
+    Pa_CloseStream( stream );
+    return err;
+}
+
+static PaDeviceIndex getNullDevice( int index )
+{
+    PaHostApiIndex hostApi = Pa_HostApiTypeIdToHostApiIndex( paInDevelopment );
+
+    if( hostApi < 0 || strcmp( Pa_GetHostApiInfo( hostApi )->name, "Null" ) )
+    {
+        fprintf( stderr, "Error: the null host API is not available.\n" );
+        return paHostApiNotFound;
+    }
+    return Pa_HostApiDeviceIndexToDeviceIndex( hostApi, index );
+}
+
+int main( void );
+int main( void )
+{
+    PaStreamParameters outputParameters;
+    PaStream *stream = NULL;
+    PaDeviceIndex device;
+    paTestData data;
+    double latency, seconds;
+    unsigned long frames = 0, framesMatched;
+    int failed = 0;
+    PaError err;
+
+    setenv( "PA_NULL_DEVICES", NULL_DEVICES, 1 );
+    setenv( "PA_NULL_SPEED", "0", 1 );
+    unsetenv( "PA_NULL_JITTER" );
+    unsetenv( "PA_NULL_XRUN" );
+
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+    device = getNullDevice( 0 );
+    if( device < 0 ) { err = device; goto error; }
+
+    err = runLoopback( device, PERIOD_FRAMES, &data, &latency );
+    if( err != paNoError ) goto error;
+    failed |= checkLoopback( "one period", &data, latency );
+
+    err = runLoopback( device, ODD_FRAMES, &data, &latency );
+    if( err != paNoError ) goto error;
+    failed |= checkLoopback( "odd size", &data, latency );
+    Pa_Terminate();
+
+    /* Injected xruns */
+    setenv( "PA_NULL_XRUN", "10", 1 );
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+    err = runLoopback( getNullDevice( 0 ), PERIOD_FRAMES, &data, &latency );
+    if( err != paNoError ) goto error;
+    printf( "xruns: %lu in %lu callbacks, dropping every %d periods\n", data.xrunCount, data.callbackCount,
+            XRUN_INTERVAL );
+    if( labs( (long)data.xrunCount - (long)( data.callbackCount / ( XRUN_INTERVAL - 1 ) ) ) > 1 )
+        failed = 1;
+    Pa_Terminate();
+    unsetenv( "PA_NULL_XRUN" );
+
+    /* Real-time clock, sped up */
+    setenv( "PA_NULL_SPEED", "10", 1 );
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+    device = getNullDevice( 0 );
+    outputParameters.device = device;
+    outputParameters.channelCount = 2;
+    outputParameters.sampleFormat = paFloat32;
+    outputParameters.suggestedLatency = Pa_GetDeviceInfo( device )->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+    err = Pa_OpenStream( &stream, NULL, &outputParameters, SAMPLE_RATE, PERIOD_FRAMES, paClipOff,
+                         countingCallback, &frames );
+    if( err != paNoError ) goto error;
+    err = Pa_StartStream( stream );
+    if( err != paNoError ) goto error;
+    Pa_Sleep( 500 );
+    seconds = Pa_GetStreamTime( stream );
+    err = Pa_StopStream( stream );
+    if( err != paNoError ) goto error;
+    Pa_CloseStream( stream );
+    stream = NULL;
+    printf( "clock: %lu frames, stream time %.2f s in 0.5 s at %dx\n", frames, seconds, SPEED );
+    if( frames < .5 * SPEED * .5 * SAMPLE_RATE || frames > 1.5 * SPEED * .5 * SAMPLE_RATE ||
+            seconds < .5 * SPEED * .5 || seconds > 1.5 * SPEED * .5 )
+        failed = 1;
+
+    err = runBlocking( getNullDevice( 1 ), &framesMatched );
+    if( err != paNoError ) goto error;
+    printf( "blocking: %lu frames of the ramp came back in order\n", framesMatched );
+    if( framesMatched < BLOCKING_BLOCKS * BLOCKING_FRAMES / 2 )
+        failed = 1;
+
+    Pa_Terminate();
+    printf( failed ? "FAILED\n" : "PASSED\n" );
+    return failed;
+
+error:
+    if( stream )
+        Pa_CloseStream( stream );
+    Pa_Terminate();
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return err;
+}
@@ -0,0 +1,186 @@
+/** @file patest_oss_mmap.c
+    @ingroup test_src
+    @brief Play a sine wave on the default OSS device with and without mmap mode.
+
+    Plays NUM_SECONDS of sine once through read()/write() and once with PA_OSS_MMAP set,
+    in which case the callback renders straight into the mapped DMA buffer. For both it
+    checks that the callback kept up with the device clock and prints the CPU load.
+
+    Needs an OSS device, on Linux a user-space emulation will do, for example:
+
+        osspd &
+        patest_oss_mmap
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "portaudio.h"
+
+#define NUM_SECONDS       (3)
+#define NUM_CHANNELS      (2)
+#define SAMPLE_RATE       (48000)
+#define FRAMES_PER_BUFFER (256)
+#define TABLE_SIZE        (200)
+#ifndef M_PI
+#define M_PI  (3.14159265)
+#endif
+
+typedef struct
+{
+    float sine[TABLE_SIZE];
+    int phase;
+    volatile unsigned long frameCount;
+}
+paTestData;
+
+static int patestCallback( const void *inputBuffer, void *outputBuffer,
+                           unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           PaStreamCallbackFlags statusFlags,
+                           void *userData )
+{
+    paTestData *data = (paTestData*)userData;
+    float *out = (float*)outputBuffer;
+    unsigned long i;
+    int j;
+
+    (void) inputBuffer;
+    (void) timeInfo;
+    (void) statusFlags;
+
+    for( i = 0; i < framesPerBuffer; i++ )
+    {
+        for( j = 0; j < NUM_CHANNELS; j++ )
+            *out++ = data->sine[data->phase];
+        if( ++data->phase >= TABLE_SIZE )
+            data->phase = 0;
+    }
+    data->frameCount += framesPerBuffer;
+    return paContinue;
+}
+
+static double Now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Play with PA_OSS_MMAP set to mmap, return nonzero in *failed if the callback fell behind */
+static PaError PlaySine( paTestData *data, const char *mmap, int *failed )
+{
+    PaStreamParameters outputParameters;
+    PaStream *stream = NULL;
+    PaHostApiIndex hostApi;
+    double start, elapsed, load;
+    PaError err;
+
+    setenv( "PA_OSS_MMAP", mmap, 1 );
+    err = Pa_Initialize();
+    if( err != paNoError ) return err;
+
+    hostApi = Pa_HostApiTypeIdToHostApiIndex( paOSS );
+    if( hostApi < 0 || Pa_GetHostApiInfo( hostApi )->defaultOutputDevice == paNoDevice )
+    {
+        fprintf( stderr, "Error: No OSS output device.\n" );
+        err = paInvalidDevice;
+        goto done;
+    }
+    outputParameters.device = Pa_GetHostApiInfo( hostApi )->defaultOutputDevice;
+    outputParameters.channelCount = NUM_CHANNELS;
+    outputParameters.sampleFormat = paFloat32;
+    outputParameters.suggestedLatency = Pa_GetDeviceInfo( outputParameters.device )->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    data->frameCount = 0;
+    err = Pa_OpenStream( &stream, NULL, &outputParameters, SAMPLE_RATE, FRAMES_PER_BUFFER, paClipOff,
+                         patestCallback, data );
+    if( err != paNoError ) goto done;
+
+    start = Now();
+    err = Pa_StartStream( stream );
+    if( err != paNoError ) goto done;
+    Pa_Sleep( NUM_SECONDS * 1000 );
+    load = Pa_GetStreamCpuLoad( stream );
+    elapsed = Now() - start;
+    err = Pa_StopStream( stream );
+    if( err != paNoError ) goto done;
+
+    /* The device buffer takes some frames ahead of time, but the callback must not fall behind */
+    if( data->frameCount < 0.9 * elapsed * SAMPLE_RATE )
+        *failed = 1;
+    printf( "PA_OSS_MMAP=%s: %lu frames in %.2f s, cpu load %.4f\n", mmap, data->frameCount, elapsed, load );
+
+done:
+    if( stream )
+        Pa_CloseStream( stream );
+    Pa_Terminate();
+    return err;
+}
+
+int main( void );
+int main( void )
+{
+    paTestData data;
+    int i, failed = 0;
+    PaError err;
+
+    for( i = 0; i < TABLE_SIZE; i++ )
+        data.sine[i] = (float) (0.2 * sin( ((double)i / (double)TABLE_SIZE) * M_PI * 2. ));
+    data.phase = 0;
+
+    err = PlaySine( &data, "0", &failed );
+    if( err != paNoError ) goto error;
+    err = PlaySine( &data, "1", &failed );
+    if( err != paNoError ) goto error;
+
+    printf( failed ? "FAILED\n" : "PASSED\n" );
+    return failed;
+
+error:
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return err;
+}
@@ -0,0 +1,200 @@
+/** @file patest_pulseaudio_cpu.c
+    @ingroup test_src
+    @brief Measure the CPU time PulseAudio callback streams take per second of audio.
+
+    Runs an output, an input and a full duplex callback stream on the default
+    PulseAudio devices in turn, with a callback that does next to nothing, and
+    prints the CPU time used by the process per second of audio processed. Run it
+    before and after a change to the PulseAudio host API to compare the cost of
+    its data path.
+
+    Usage: patest_pulseaudio_cpu [seconds per stream] [frames per buffer]
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "portaudio.h"
+
+#define NUM_SECONDS     (10)
+#define NUM_CHANNELS    (2)
+#define SAMPLE_RATE     (48000)
+
+typedef struct
+{
+    unsigned long frameCount;
+    unsigned long statusCount;
+}
+paTestData;
+
+static int patestCallback( const void *inputBuffer, void *outputBuffer,
+                           unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           PaStreamCallbackFlags statusFlags,
+                           void *userData )
+{
+    paTestData *data = (paTestData*)userData;
+
+    (void) timeInfo;
+
+    /* Touch the samples the way a real client would, but cheaply */
+    if( outputBuffer )
+    {
+        if( inputBuffer )
+            memcpy( outputBuffer, inputBuffer, framesPerBuffer * NUM_CHANNELS * sizeof (float) );
+        else
+            memset( outputBuffer, 0, framesPerBuffer * NUM_CHANNELS * sizeof (float) );
+    }
+
+    data->frameCount += framesPerBuffer;
+    if( statusFlags )
+        ++data->statusCount;
+    return paContinue;
+}
+
+static double CpuSeconds( void )
+{
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+/* Run a stream for the given time and print a line of results */
+static PaError RunStream( const char *name, PaDeviceIndex inputDevice, PaDeviceIndex outputDevice, int seconds,
+                          unsigned long framesPerBuffer )
+{
+    PaStreamParameters inputParameters, outputParameters;
+    PaStream *stream;
+    paTestData data = { 0, 0 };
+    double cpuSeconds, audioSeconds;
+    PaError err;
+
+    inputParameters.device = inputDevice;
+    inputParameters.channelCount = NUM_CHANNELS;
+    inputParameters.sampleFormat = paFloat32;
+    inputParameters.suggestedLatency = inputDevice != paNoDevice ?
+            Pa_GetDeviceInfo( inputDevice )->defaultLowInputLatency : 0.;
+    inputParameters.hostApiSpecificStreamInfo = NULL;
+    outputParameters.device = outputDevice;
+    outputParameters.channelCount = NUM_CHANNELS;
+    outputParameters.sampleFormat = paFloat32;
+    outputParameters.suggestedLatency = outputDevice != paNoDevice ?
+            Pa_GetDeviceInfo( outputDevice )->defaultLowOutputLatency : 0.;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    err = Pa_OpenStream( &stream, inputDevice != paNoDevice ? &inputParameters : NULL,
+                         outputDevice != paNoDevice ? &outputParameters : NULL, SAMPLE_RATE, framesPerBuffer,
+                         paClipOff, patestCallback, &data );
+    if( err != paNoError )
+        return err;
+
+    cpuSeconds = CpuSeconds();
+    err = Pa_StartStream( stream );
+    if( err != paNoError )
+    {
+        Pa_CloseStream( stream );
+        return err;
+    }
+    Pa_Sleep( seconds * 1000 );
+    err = Pa_StopStream( stream );
+    cpuSeconds = CpuSeconds() - cpuSeconds;
+    Pa_CloseStream( stream );
+
+    audioSeconds = (double)data.frameCount / SAMPLE_RATE;
+    printf( "%-12s %12.2f %16.3f %10lu\n", name, audioSeconds,
+            audioSeconds > 0. ? cpuSeconds * 1000. / audioSeconds : 0., data.statusCount );
+    fflush( stdout );
+    return err;
+}
+
+int main( int argc, char **argv );
+int main( int argc, char **argv )
+{
+    int seconds = argc > 1 ? atoi( argv[1] ) : NUM_SECONDS;
+    unsigned long framesPerBuffer = argc > 2 ? strtoul( argv[2], NULL, 10 ) : paFramesPerBufferUnspecified;
+    PaHostApiIndex hostApi;
+    PaDeviceIndex inputDevice, outputDevice;
+    PaError err;
+
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+
+    hostApi = Pa_HostApiTypeIdToHostApiIndex( paPulseAudio );
+    if( hostApi < 0 )
+    {
+        fprintf( stderr, "Error: PulseAudio is not available.\n" );
+        err = hostApi;
+        goto error;
+    }
+    inputDevice = Pa_GetHostApiInfo( hostApi )->defaultInputDevice;
+    outputDevice = Pa_GetHostApiInfo( hostApi )->defaultOutputDevice;
+
+    printf( "%d seconds per stream, %lu frames per buffer\n", seconds, framesPerBuffer );
+    printf( "%-12s %12s %16s %10s\n", "stream", "audio s", "cpu ms/audio s", "xruns" );
+
+    if( outputDevice != paNoDevice )
+    {
+        err = RunStream( "output", paNoDevice, outputDevice, seconds, framesPerBuffer );
+        if( err != paNoError ) goto error;
+    }
+    if( inputDevice != paNoDevice )
+    {
+        err = RunStream( "input", inputDevice, paNoDevice, seconds, framesPerBuffer );
+        if( err != paNoError ) goto error;
+    }
+    if( inputDevice != paNoDevice && outputDevice != paNoDevice )
+    {
+        err = RunStream( "full duplex", inputDevice, outputDevice, seconds, framesPerBuffer );
+        if( err != paNoError ) goto error;
+    }
+
+    Pa_Terminate();
+    printf( "Test finished.\n" );
+    return 0;
+
+error:
+    Pa_Terminate();
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return err;
+}
@@ -0,0 +1,176 @@
+/** @file patest_sndio_latency.c
+    @ingroup test_src
+    @brief Check the latency sndio streams report against their positions.
+
+    Writes NUM_SECONDS of silence to the default sndio device with a blocking paInt16
+    stream, whose samples go straight from the user buffer to the device, checking
+    that the stream time advances and that the space reported by
+    Pa_GetStreamWriteAvailable() stays within the device buffer. Then runs a callback
+    stream and compares the output latency seen by the callback, outputBufferDacTime
+    minus currentTime, with the one in Pa_GetStreamInfo().
+
+    Needs sndiod running, for example on Linux:
+
+        sndiod -f default &
+        patest_sndio_latency
+*/
+/*
+ * $Id$
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2000 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "portaudio.h"
+
+#define NUM_SECONDS       (2)
+#define NUM_CHANNELS      (2)
+#define SAMPLE_RATE       (48000)
+#define FRAMES_PER_BUFFER (480)
+
+typedef struct
+{
+    double latencySum;
+    unsigned long callbackCount;
+}
+paTestData;
+
+static int patestCallback( const void *inputBuffer, void *outputBuffer,
+                           unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           PaStreamCallbackFlags statusFlags,
+                           void *userData )
+{
+    paTestData *data = (paTestData*)userData;
+
+    (void) inputBuffer;
+    (void) statusFlags;
+
+    memset( outputBuffer, 0, framesPerBuffer * NUM_CHANNELS * sizeof (short) );
+    data->latencySum += timeInfo->outputBufferDacTime - timeInfo->currentTime;
+    ++data->callbackCount;
+    return paContinue;
+}
+
+static short buffer_[FRAMES_PER_BUFFER * NUM_CHANNELS];
+
+int main( void );
+int main( void )
+{
+    PaStreamParameters outputParameters;
+    PaStream *stream = NULL;
+    PaHostApiIndex hostApi;
+    paTestData data = { 0., 0 };
+    signed long available, maxAvailable = 0;
+    double reported, measured;
+    int i, failed = 0;
+    PaError err;
+
+    err = Pa_Initialize();
+    if( err != paNoError ) goto error;
+
+    hostApi = Pa_HostApiTypeIdToHostApiIndex( paSndio );
+    if( hostApi < 0 )
+    {
+        fprintf( stderr, "Error: sndio is not available.\n" );
+        err = hostApi;
+        goto error;
+    }
+    outputParameters.device = Pa_GetHostApiInfo( hostApi )->defaultOutputDevice;
+    outputParameters.channelCount = NUM_CHANNELS;
+    outputParameters.sampleFormat = paInt16;
+    outputParameters.suggestedLatency = Pa_GetDeviceInfo( outputParameters.device )->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    /* Blocking */
+    err = Pa_OpenStream( &stream, NULL, &outputParameters, SAMPLE_RATE, FRAMES_PER_BUFFER, paClipOff, NULL, NULL );
+    if( err != paNoError ) goto error;
+    reported = Pa_GetStreamInfo( stream )->outputLatency;
+    err = Pa_StartStream( stream );
+    if( err != paNoError ) goto error;
+    for( i = 0; i < NUM_SECONDS * SAMPLE_RATE / FRAMES_PER_BUFFER; ++i )
+    {
+        err = Pa_WriteStream( stream, buffer_, FRAMES_PER_BUFFER );
+        if( err != paNoError ) goto error;
+        available = Pa_GetStreamWriteAvailable( stream );
+        if( available > maxAvailable )
+            maxAvailable = available;
+    }
+    measured = Pa_GetStreamTime( stream );
+    printf( "blocking: stream time %.3f s after writing %d s, write available up to %ld frames, latency %.4f s\n",
+            measured, NUM_SECONDS, maxAvailable, reported );
+    if( measured < NUM_SECONDS - 2 * reported || maxAvailable < 0 || maxAvailable > reported * SAMPLE_RATE )
+        failed = 1;
+    err = Pa_StopStream( stream );
+    if( err != paNoError ) goto error;
+    Pa_CloseStream( stream );
+    stream = NULL;
+
+    /* Callback */
+    err = Pa_OpenStream( &stream, NULL, &outputParameters, SAMPLE_RATE, FRAMES_PER_BUFFER, paClipOff,
+                         patestCallback, &data );
+    if( err != paNoError ) goto error;
+    reported = Pa_GetStreamInfo( stream )->outputLatency;
+    err = Pa_StartStream( stream );
+    if( err != paNoError ) goto error;
+    Pa_Sleep( NUM_SECONDS * 1000 );
+    err = Pa_StopStream( stream );
+    if( err != paNoError ) goto error;
+    Pa_CloseStream( stream );
+    stream = NULL;
+
+    measured = data.callbackCount ? data.latencySum / data.callbackCount : 0.;
+    printf( "callback: output latency %.4f s reported, %.4f s seen by %lu callbacks\n",
+            reported, measured, data.callbackCount );
+    /* The callback runs at most one block late */
+    if( !data.callbackCount || measured > reported || measured < reported - 2. * FRAMES_PER_BUFFER / SAMPLE_RATE )
+        failed = 1;
+
+    Pa_Terminate();
+    printf( failed ? "FAILED\n" : "PASSED\n" );
+    return failed;
+
+error:
+    if( stream )
+        Pa_CloseStream( stream );
+    Pa_Terminate();
+    fprintf( stderr, "An error occurred while using the portaudio stream\n" );
+    fprintf( stderr, "Error number: %d\n", err );
+    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+    return err;
+}
@@ -114,6 +114,7 @@ int main(void)
     int numStress;
     paTestData data = {0};
     double load;
+    PaStreamStatistics statistics;
 
     printf("PortAudio Test: output sine wave. SR = %d, BufSize = %d. MAX_LOAD = %f\n",
         SAMPLE_RATE, FRAMES_PER_BUFFER, MAX_LOAD );
@@ -181,6 +182,12 @@ int main(void)
     printf("Suffer for 5 seconds.\n");
     Pa_Sleep( 5000 );
 
+    err = Pa_GetStreamStatistics( stream, &statistics );
+    if( err != paNoError ) goto error;
+    printf("%lu callbacks, %lu missed deadlines. Load: max = %f, 99%% = %f, 99.9%% = %f\n",
+        statistics.callbackCount, statistics.deadlineMissCount, statistics.maximumLoad,
+        statistics.load99thPercentile, statistics.load999thPercentile );
+
     printf("Stop stream.\n");
     err = Pa_StopStream( stream );
     if( err != paNoError ) goto error;
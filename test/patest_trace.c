@@ -0,0 +1,210 @@
+/** @file patest_trace.c
+    @ingroup test_src
+    @brief Tests the binary event tracer in pa_trace.c
+
+    Records events from two threads, overflows a ring, dumps the trace to a
+    text file and a Chrome trace event file and checks their contents, then
+    measures the cost of recording an event with the tracer enabled and disabled.
+*/
+/*
+ * $Id: $
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2008 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "portaudio.h"
+#include "pa_trace.h"
+#include "pa_util.h"
+
+#define TRACE_FILE          "patest_trace.log"
+#define CHROME_TRACE_FILE   "patest_trace.json"
+#define WORKER_EVENT_COUNT  (1000)
+#define TIMING_EVENT_COUNT  (1000000)
+
+static int failures_ = 0;
+
+#define CHECK( expr ) \
+    do { if( !(expr) ){ printf( "FAILED line %d: %s\n", __LINE__, #expr ); ++failures_; } } while(0)
+
+
+#if PA_TRACE_EVENTS
+
+static void *WorkerThread( void *userData )
+{
+    long i;
+    (void) userData;
+
+    PaUtil_RegisterTraceThread( "worker" );
+    PA_TRACE_BEGIN( "worker \"span\"", 0, 0, 0, 0 );
+    for( i=0; i < WORKER_EVENT_COUNT; ++i )
+        PA_TRACE_EVENT( "worker event %ld", i, 0, 0, 0 );
+    PA_TRACE_END( "worker span", 0, 0, 0, 0 );
+    PaUtil_UnregisterTraceThread();
+
+    return NULL;
+}
+
+
+/* records nothing, since it never registers */
+static void *UnregisteredThread( void *userData )
+{
+    long i;
+    (void) userData;
+
+    for( i=0; i < WORKER_EVENT_COUNT; ++i )
+        PA_TRACE_EVENT( "unregistered event %ld", i, 0, 0, 0 );
+
+    return NULL;
+}
+
+
+/* registers while tracing is disabled, which claims no ring, so it records nothing
+   once tracing is enabled */
+static void *LateThread( void *userData )
+{
+    (void) userData;
+
+    PA_TRACE_REGISTER_NAMED_THREAD( "late" );
+    PaUtil_EnableTraceEvents( 1 );
+    PA_TRACE_EVENT( "late event", 0, 0, 0, 0 );
+    PaUtil_EnableTraceEvents( 0 );
+
+    return NULL;
+}
+
+
+/* count the lines of a trace file containing pattern */
+static long CountLines( const char *fileName, const char *pattern )
+{
+    char line[256];
+    long count = 0;
+    FILE *f = fopen( fileName, "r" );
+
+    if( !f )
+        return -1;
+    while( fgets( line, sizeof(line), f ) )
+        if( strstr( line, pattern ) )
+            ++count;
+    fclose( f );
+    return count;
+}
+
+#endif /* PA_TRACE_EVENTS */
+
+
+int main( void );
+int main( void )
+{
+#if PA_TRACE_EVENTS
+    pthread_t worker, unregistered;
+    PaTime start;
+    long i;
+    char last[64];
+
+    PaUtil_InitializeClock();
+
+    /* nothing is recorded until tracing is enabled */
+    PA_TRACE_EVENT( "disabled event", 0, 0, 0, 0 );
+    PaUtil_EnableTraceEvents( 1 );
+    PaUtil_RegisterTraceThread( "main" );
+
+    CHECK( pthread_create( &worker, NULL, WorkerThread, NULL ) == 0 );
+    CHECK( pthread_create( &unregistered, NULL, UnregisteredThread, NULL ) == 0 );
+    for( i=0; i < PA_TRACE_RING_RECORDS + 100; ++i )
+        PA_TRACE_EVENT( "main event %ld of %ld %lx %lu", i, PA_TRACE_RING_RECORDS + 100, 0xABCL, 7 );
+    CHECK( pthread_join( worker, NULL ) == 0 );
+    CHECK( pthread_join( unregistered, NULL ) == 0 );
+
+    CHECK( PaUtil_DumpTraceEvents( TRACE_FILE ) == paNoError );
+
+    CHECK( CountLines( TRACE_FILE, "disabled event" ) == 0 );
+    CHECK( CountLines( TRACE_FILE, "unregistered event" ) == 0 );
+    CHECK( CountLines( TRACE_FILE, "worker event" ) == WORKER_EVENT_COUNT );
+    CHECK( CountLines( TRACE_FILE, "worker" ) == WORKER_EVENT_COUNT + 2 );
+    CHECK( CountLines( TRACE_FILE, "> worker \"span\"" ) == 1 );
+    CHECK( CountLines( TRACE_FILE, "< worker span" ) == 1 );
+    /* the oldest main thread events have been overwritten */
+    CHECK( CountLines( TRACE_FILE, "main event" ) == PA_TRACE_RING_RECORDS );
+    CHECK( CountLines( TRACE_FILE, "main event 99 of" ) == 0 );
+    sprintf( last, "main event %ld of %ld abc 7", (long)PA_TRACE_RING_RECORDS + 99, (long)PA_TRACE_RING_RECORDS + 100 );
+    CHECK( CountLines( TRACE_FILE, last ) == 1 );
+
+    /* one event per line after the metadata for the process and two threads */
+    CHECK( PaUtil_WriteChromeTrace( CHROME_TRACE_FILE ) == paNoError );
+    CHECK( CountLines( CHROME_TRACE_FILE, "\"ph\":" ) == 3 + PA_TRACE_RING_RECORDS + WORKER_EVENT_COUNT + 2 );
+    CHECK( CountLines( CHROME_TRACE_FILE, "\"args\":{\"name\":\"worker\"}}" ) == 1 );
+    CHECK( CountLines( CHROME_TRACE_FILE, "{\"name\":\"worker \\\"span\\\"\",\"cat\":\"portaudio\",\"ph\":\"B\"" ) == 1 );
+    CHECK( CountLines( CHROME_TRACE_FILE, "\"ph\":\"E\"" ) == 1 );
+    CHECK( CountLines( CHROME_TRACE_FILE, "\"ph\":\"i\"" ) == PA_TRACE_RING_RECORDS + WORKER_EVENT_COUNT );
+    remove( CHROME_TRACE_FILE );
+
+    /* events are recorded again after the rings are freed, once the thread has registered again */
+    PaUtil_TerminateTraceEvents();
+    PA_TRACE_EVENT( "event before registering", 0, 0, 0, 0 );
+    PA_TRACE_REGISTER_THREAD();
+    PA_TRACE_EVENT( "event after terminate", 0, 0, 0, 0 );
+    CHECK( PaUtil_DumpTraceEvents( TRACE_FILE ) == paNoError );
+    CHECK( CountLines( TRACE_FILE, "event" ) == 1 );
+    remove( TRACE_FILE );
+
+    start = PaUtil_GetTime();
+    for( i=0; i < TIMING_EVENT_COUNT; ++i )
+        PA_TRACE_EVENT( "timing event %ld", i, 0, 0, 0 );
+    printf( "enabled: %.1f nsec per event\n", (PaUtil_GetTime() - start) * 1e9 / TIMING_EVENT_COUNT );
+
+    PaUtil_EnableTraceEvents( 0 );
+    start = PaUtil_GetTime();
+    for( i=0; i < TIMING_EVENT_COUNT; ++i )
+        PA_TRACE_EVENT( "timing event %ld", i, 0, 0, 0 );
+    printf( "disabled: %.1f nsec per event\n", (PaUtil_GetTime() - start) * 1e9 / TIMING_EVENT_COUNT );
+
+    PaUtil_TerminateTraceEvents();
+
+    /* host API threads don't claim a ring while tracing is disabled */
+    CHECK( pthread_create( &worker, NULL, LateThread, NULL ) == 0 );
+    CHECK( pthread_join( worker, NULL ) == 0 );
+    CHECK( PaUtil_DumpTraceEvents( TRACE_FILE ) == paNoError );
+    CHECK( CountLines( TRACE_FILE, "late event" ) <= 0 );
+    remove( TRACE_FILE );
+#else
+    printf( "event tracer compiled out (PA_TRACE_EVENTS is 0)\n" );
+#endif
+
+    printf( failures_ ? "FAILED\n" : "PASSED\n" );
+    return failures_ ? 1 : 0;
+}
@@ -0,0 +1,185 @@
+/** @file patest_watchdog.c
+    @ingroup test_src
+    @brief Tests the thread watchdog in pa_unix_util.c
+
+    Runs a real-time thread that spins without making progress and checks that
+    the watchdog demotes it within a few periods and restores its priority once
+    it calms down, that a busy thread which keeps making progress is left
+    alone, and that a blocked thread is counted as stalled. The throttling
+    checks are skipped without real-time privileges.
+*/
+/*
+ * $Id: $
+ *
+ * This program uses the PortAudio Portable Audio Library.
+ * For more information see: http://www.portaudio.com/
+ * Copyright (c) 1999-2008 Ross Bencina and Phil Burk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The text above constitutes the entire PortAudio license; however,
+ * the PortAudio community also makes the following non-binding requests:
+ *
+ * Any person wishing to distribute modifications to the Software is
+ * requested to send the modifications to the original developer so that
+ * they can be incorporated into the canonical version. It is also
+ * requested that these non-binding requests be included along with the
+ * license above.
+ */
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "portaudio.h"
+#include "pa_util.h"
+#include "pa_unix_util.h"
+
+#define PERIOD_NSEC     (1000000)
+
+static int failures_ = 0;
+
+#define CHECK( expr ) \
+    do { if( !(expr) ){ printf( "FAILED line %d: %s\n", __LINE__, #expr ); ++failures_; } } while(0)
+
+typedef enum
+{
+    modeRunaway,    /* spin without progress, then recover */
+    modeBusy,       /* spin while reporting progress every period */
+    modeBlocked,    /* sleep without progress */
+    modeRearmed     /* as modeBlocked, after shortening a long period */
+} Mode;
+
+typedef struct
+{
+    PaUnixThread thread;
+    Mode mode;
+    int policy;
+    PaTime throttleTime;    /* seconds from start until the watchdog demoted the thread */
+    PaTime stallTime;       /* seconds from start until the watchdog noticed a stall */
+} TestThread;
+
+static void *ThreadFunc( void *userData )
+{
+    TestThread *self = (TestThread *)userData;
+    PaUnixWatchdogStatistics statistics;
+    struct sched_param spm;
+    PaTime start, lastProgress;
+
+    pthread_getschedparam( pthread_self(), &self->policy, &spm );
+    if( self->mode == modeRearmed )
+    {
+        /* a one second period is checked at the longest interval, until it is shortened */
+        CHECK( PaUnixThread_StartWatchdog( &self->thread, 1000 * PERIOD_NSEC ) == paNoError );
+                PaUnixThread_SetWatchdogPeriod( &self->thread, PERIOD_NSEC );
+    }
+    else
+    {
+        CHECK( PaUnixThread_StartWatchdog( &self->thread, PERIOD_NSEC ) == paNoError );
+    }
+
+    start = lastProgress = PaUtil_GetTime();
+    while( PaUtil_GetTime() - start < .2 )
+    {
+        if( self->mode == modeBlocked || self->mode == modeRearmed )
+        {
+            Pa_Sleep( 10 );
+            PaUnixThread_GetWatchdogStatistics( &self->thread, &statistics );
+            if( statistics.stallCount > 0 && self->stallTime == 0. )
+                self->stallTime = PaUtil_GetTime() - start;
+            continue;
+        }
+        if( self->mode == modeBusy && PaUtil_GetTime() - lastProgress > 1e-3 )
+        {
+            PaUnixThread_NotifyWatchdog( &self->thread, 0 );
+            lastProgress = PaUtil_GetTime();
+        }
+        PaUnixThread_GetWatchdogStatistics( &self->thread, &statistics );
+        if( statistics.throttled && self->throttleTime == 0. )
+            self->throttleTime = PaUtil_GetTime() - start;
+    }
+
+    /* recover so that the watchdog can restore the priority */
+    start = PaUtil_GetTime();
+    while( PaUtil_GetTime() - start < .05 )
+    {
+        Pa_Sleep( 1 );
+        PaUnixThread_NotifyWatchdog( &self->thread, 0 );
+    }
+    PaUnixThread_StopWatchdog( &self->thread );
+
+    while( !PaUnixThread_StopRequested( &self->thread ) )
+        Pa_Sleep( 1 );
+    return NULL;
+}
+
+static void RunThread( TestThread *thread, Mode mode, PaUnixWatchdogStatistics *statistics )
+{
+    thread->mode = mode;
+    thread->throttleTime = thread->stallTime = 0.;
+    CHECK( PaUnixThread_New( &thread->thread, ThreadFunc, thread, 0., 1, NULL ) == paNoError );
+    Pa_Sleep( 300 );
+    PaUnixThread_GetWatchdogStatistics( &thread->thread, statistics );
+    CHECK( PaUnixThread_Terminate( &thread->thread, 1, NULL ) == paNoError );
+}
+
+
+int main( void );
+int main( void )
+{
+    TestThread thread;
+    PaUnixWatchdogStatistics statistics;
+
+    PaUtil_InitializeClock();
+    PaUnixThreading_Initialize();
+
+    RunThread( &thread, modeBlocked, &statistics );
+    CHECK( statistics.stallCount == 1 );
+    CHECK( statistics.throttleCount == 0 );
+    CHECK( statistics.maximumCpuFraction < .05 );
+
+    RunThread( &thread, modeRearmed, &statistics );
+    CHECK( statistics.stallCount == 1 );
+    /* well within the longest check interval */
+    CHECK( thread.stallTime > 0. && thread.stallTime < .05 );
+
+    RunThread( &thread, modeRunaway, &statistics );
+    printf( "runaway thread: throttled %lu times after %.1f msec, max CPU %.2f\n",
+            statistics.throttleCount, thread.throttleTime * 1e3, statistics.maximumCpuFraction );
+    if( thread.policy != SCHED_FIFO )
+    {
+        printf( "no real-time privileges, skipping throttling checks\n" );
+    }
+    else
+    {
+        CHECK( statistics.throttleCount == 1 );
+        CHECK( !statistics.throttled );
+        /* two checks, each two periods apart, allowing for timer latency */
+        CHECK( thread.throttleTime > 0. && thread.throttleTime < .02 );
+
+        RunThread( &thread, modeBusy, &statistics );
+        CHECK( statistics.throttleCount == 0 );
+        CHECK( statistics.maximumCpuFraction > .5 );
+    }
+
+    printf( failures_ ? "FAILED\n" : "PASSED\n" );
+    return failures_ ? 1 : 0;
+}